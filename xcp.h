@@ -45,6 +45,8 @@
 #define __XCP_H
 
 #include <stdbool.h>
+#include <stdint.h>
+#include <sys/time.h>
 
 #include <linux/can.h>
 
@@ -63,10 +65,26 @@ typedef struct tagCanIdType {
     canid_t dst;
 } CanIdType;
 
+typedef enum tagXcpTransportType {
+    XCP_TRANSPORT_CAN,
+    XCP_TRANSPORT_UDP,
+    XCP_TRANSPORT_TCP
+} XcpTransportType;
+
+/*
+ * One XCP packet, PID first, independent of the transport layer.
+ * `frame` is only set on CAN, `ctr` only on Ethernet.
+ */
 typedef struct tagXcpMessage {
     canid_t src;
     canid_t dst;
     struct canfd_frame * frame;
+    uint8_t const * data;
+    uint16_t length;
+    bool fromSlave;
+    uint8_t transport;
+    uint16_t ctr;
+    struct timeval timestamp;
 } XcpMessage;
 
 /*
@@ -75,6 +93,7 @@ typedef struct tagXcpMessage {
  */
 void print_xcp_message(XcpMessage const * const msg, bool dtos);
 void setIdentifiers(CanIdType const * const ids);
+void xcp_message_from_frame(XcpMessage * const msg, struct canfd_frame * const frame, struct timeval const * const tv);
 
 /*
  * Standard Events.
@@ -197,6 +216,7 @@ void setIdentifiers(CanIdType const * const ids);
  */
 #define XCP_DAQ_LIST_MODE_ALTERNATING       ((uint8_t)0x01)
 #define XCP_DAQ_LIST_MODE_DIRECTION         ((uint8_t)0x02)
+#define XCP_DAQ_LIST_MODE_DTO_CTR           ((uint8_t)0x08)
 #define XCP_DAQ_LIST_MODE_TIMESTAMP         ((uint8_t)0x10)
 #define XCP_DAQ_LIST_MODE_PID_OFF           ((uint8_t)0x20)
 #define XCP_DAQ_LIST_MODE_SELECTED          ((uint8_t)0x40)
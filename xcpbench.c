@@ -0,0 +1,392 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR BSD-3-Clause) */
+/*
+ * xcpbench.c - throughput benchmarks of the dissector and the analyzers
+ *
+ * Copyright (c) 2021 Christoph Schueler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <cpu12.gems@googlemail.com>
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <time.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+#include "xcp.h"
+#include "xcpsession.h"
+#include "xcpdaq.h"
+#include "xcptiming.h"
+#include "xcptransfer.h"
+#include "xcpshadow.h"
+#include "xcpchecksum.h"
+#include "xcppgm.h"
+#include "xcpfilter.h"
+#include "xcpgen.h"
+#include "xcpformat.h"
+
+typedef enum tagOutputModeType {
+    MODE_ANALYZE,       /* Analyzers only, nothing is printed.          */
+    MODE_TEXT,          /* Like xcpdump without options.                */
+    MODE_DTO,           /* -d                                           */
+    MODE_VALUES,        /* -d -v                                        */
+    MODE_FILTER,        /* -f 'error || event'                          */
+    MODE_JSONL,         /* -d -v --format=jsonl                         */
+    MODE_CSV,           /* -d -v --format=csv                           */
+    MODES
+} OutputModeType;
+
+static char const * const mode_names[MODES] = { "analyze", "text", "dto", "values", "filter", "jsonl", "csv" };
+
+static uint64_t allocations = 0;
+
+/*
+ * Count heap allocations of everything linked in, glibc only.
+ */
+extern void * __libc_malloc(size_t size);
+extern void * __libc_calloc(size_t count, size_t size);
+extern void * __libc_realloc(void * ptr, size_t size);
+
+void * malloc(size_t size)
+{
+    ++allocations;
+    return __libc_malloc(size);
+}
+
+void * calloc(size_t count, size_t size)
+{
+    ++allocations;
+    return __libc_calloc(count, size);
+}
+
+void * realloc(void * ptr, size_t size)
+{
+    ++allocations;
+    return __libc_realloc(ptr, size);
+}
+
+
+void print_usage(char *prg)
+{
+    fprintf(stderr, "\nUsage: %s [options]\n", prg);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "         -s <scenario>  (handshake, services, daq, dto, upload, errors, mixed or all, default all)\n");
+    fprintf(stderr, "         -o <mode>      (analyze, text, dto, values, filter, jsonl, csv or all, default all)\n");
+    fprintf(stderr, "         -n <frames>    (frames per measurement, default 1000000)\n");
+    fprintf(stderr, "         -b <cycles>    (DTO cycles per burst, default %u)\n", XCP_GEN_DEFAULT_BURST);
+    fprintf(stderr, "         -S <seed>      (random seed of the generated values, default 1)\n");
+    fprintf(stderr, "         -i <iface>     (send the streams to a (v)can interface instead, for xcpdump end-to-end)\n");
+    fprintf(stderr, "         -r <frames/s>  (send rate with -i, default as fast as possible)\n");
+    fprintf(stderr, "         -m <can_id>    (XCP master can_id, default 7E0)\n");
+    fprintf(stderr, "         -t <can_id>    (XCP slave can_id, default 7E1)\n");
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Same sequence of calls as the receive loop of xcpdump.
+ */
+static void process(XcpMessage * const message, OutputModeType mode)
+{
+    uint64_t fields[XCP_FIELD_COUNT];
+
+    xcp_session_update(message);
+    xcp_daq_update(message);
+    xcp_timing_update(message);
+    xcp_transfer_update(message);
+    xcp_shadow_update(message);
+    xcp_checksum_update(message);
+    xcp_pgm_update(message);
+    xcp_transfer_completed();
+    xcp_pgm_completed();
+
+    switch (mode) {
+        case MODE_ANALYZE:
+            return;
+        case MODE_FILTER:
+            if (!xcp_filter_match(message)) {
+                return;
+            }
+            break;
+        case MODE_JSONL:
+        case MODE_CSV:
+            xcp_filter_fields(message, fields);
+            xcp_format_write(message, fields, stdout);
+            return;
+        default:
+            break;
+    }
+    printf(" vcan0  %3X  [%d]  ", message->frame->can_id, message->frame->len);
+    print_xcp_message(message, mode >= MODE_DTO);
+    printf("\n");
+}
+
+static double run(struct canfd_frame * const frames, size_t count, size_t total, OutputModeType mode,
+                  canid_t master, canid_t slave)
+{
+    XcpMessage message;
+    struct timeval tv;
+    double start;
+    size_t done;
+    size_t idx;
+
+    xcp_daq_set_decode((mode == MODE_VALUES) || (mode == MODE_JSONL) || (mode == MODE_CSV));
+    xcp_format_select((mode == MODE_CSV) ? "csv" : "jsonl");
+    message.src = master;
+    message.dst = slave;
+    tv.tv_sec = 0;
+    tv.tv_usec = 0;
+
+    start = now();
+    for (done = 0; done < total; ) {
+        for (idx = 0; (idx < count) && (done < total); ++idx, ++done) {
+            tv.tv_usec += 100;
+            if (tv.tv_usec >= 1000000) {
+                tv.tv_usec -= 1000000;
+                ++tv.tv_sec;
+            }
+            xcp_message_from_frame(&message, &frames[idx], &tv);
+            process(&message, mode);
+        }
+    }
+    fflush(stdout);
+    return now() - start;
+}
+
+/*
+ * Write the stream to a CAN interface, e.g. vcan0 with xcpdump running on the same interface.
+ */
+static int send_stream(char const * const ifname, struct canfd_frame const * const frames, size_t count,
+                       size_t total, unsigned rate, double * const elapsed)
+{
+    struct sockaddr_can addr;
+    struct timespec pause;
+    int const canfd_on = 1;
+    double start;
+    double due;
+    size_t done;
+    int s;
+
+    s = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+    if (s < 0) {
+        perror("socket");
+        return -1;
+    }
+    setsockopt(s, SOL_CAN_RAW, CAN_RAW_FD_FRAMES, &canfd_on, sizeof(canfd_on));
+    memset(&addr, 0, sizeof(addr));
+    addr.can_family = AF_CAN;
+    addr.can_ifindex = if_nametoindex(ifname);
+    if (bind(s, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("bind");
+        close(s);
+        return -1;
+    }
+
+    start = now();
+    for (done = 0; done < total; ++done) {
+        if (rate) {
+            due = start + (double)done / rate;
+            while (now() < due) {
+                ;
+            }
+        }
+        /* classic frames as CAN_MTU, the generator doesn't produce FD frames */
+        while (write(s, &frames[done % count], CAN_MTU) != CAN_MTU) {
+            if (errno != ENOBUFS) {
+                perror("write");
+                close(s);
+                return -1;
+            }
+            pause.tv_sec = 0;
+            pause.tv_nsec = 10000;
+            nanosleep(&pause, NULL);
+        }
+    }
+    *elapsed = now() - start;
+    close(s);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    XcpGenConfigType config;
+    XcpGenScenarioType scenario;
+    XcpGenScenarioType first = 0;
+    XcpGenScenarioType last = XCP_GEN_SCENARIOS - 1;
+    OutputModeType mode;
+    OutputModeType firstMode = 0;
+    OutputModeType lastMode = MODES - 1;
+    CanIdType ids;
+    struct canfd_frame * frames;
+    size_t const capacity = 1 << 20;
+    size_t count;
+    size_t total = 1000000;
+    char const * ifname = NULL;
+    unsigned rate = 0;
+    uint64_t before;
+    double elapsed;
+    FILE * results;
+    int opt;
+
+    xcp_gen_config_init(&config);
+    while ((opt = getopt(argc, argv, "s:o:n:b:S:i:r:m:t:?")) != -1) {
+        switch (opt) {
+            case 's':
+                if (strcmp(optarg, "all") != 0) {
+                    if (!xcp_gen_scenario_parse(optarg, &first)) {
+                        fprintf(stderr, "unknown scenario '%s'\n", optarg);
+                        exit(1);
+                    }
+                    last = first;
+                }
+                break;
+            case 'o':
+                if (strcmp(optarg, "all") != 0) {
+                    for (mode = 0; (mode < MODES) && (strcmp(mode_names[mode], optarg) != 0); ++mode) {
+                        ;
+                    }
+                    if (mode == MODES) {
+                        fprintf(stderr, "unknown output mode '%s'\n", optarg);
+                        exit(1);
+                    }
+                    firstMode = lastMode = mode;
+                }
+                break;
+            case 'n':
+                total = strtoul(optarg, NULL, 10);
+                break;
+            case 'b':
+                config.burst = strtoul(optarg, NULL, 10);
+                break;
+            case 'S':
+                config.seed = strtoul(optarg, NULL, 10);
+                break;
+            case 'i':
+                ifname = optarg;
+                break;
+            case 'r':
+                rate = strtoul(optarg, NULL, 10);
+                break;
+            case 'm':
+                config.master = strtoul(optarg, NULL, 16);
+                break;
+            case 't':
+                config.slave = strtoul(optarg, NULL, 16);
+                break;
+            case '?':
+                print_usage(basename(argv[0]));
+                exit(0);
+                break;
+            default:
+                fprintf(stderr, "Unknown option %c\n", opt);
+                print_usage(basename(argv[0]));
+                exit(1);
+                break;
+        }
+    }
+    if (total == 0) {
+        print_usage(basename(argv[0]));
+        exit(1);
+    }
+
+    frames = calloc(capacity, sizeof(struct canfd_frame));
+    if (frames == NULL) {
+        perror("calloc");
+        return 1;
+    }
+
+    if (ifname != NULL) {
+        for (scenario = first; scenario <= last; ++scenario) {
+            count = xcp_gen_build(&config, scenario, frames, capacity);
+            if (send_stream(ifname, frames, count, total, rate, &elapsed) < 0) {
+                return 1;
+            }
+            printf("%-10s %-8s %12.1f frames/s %8.2f ns/frame\n", xcp_gen_scenario_name(scenario), ifname,
+                   total / elapsed, elapsed * 1e9 / total);
+        }
+        free(frames);
+        return 0;
+    }
+
+    /* the dissector output goes to /dev/null, the results to the original stdout */
+    results = fdopen(dup(STDOUT_FILENO), "w");
+    if ((results == NULL) || (freopen("/dev/null", "w", stdout) == NULL)) {
+        perror("stdout");
+        return 1;
+    }
+    ids.src = config.master;
+    ids.dst = config.slave;
+    setIdentifiers(&ids);
+    xcp_shadow_enable();
+    if (!xcp_filter_compile("error || event")) {
+        fprintf(stderr, "filter: %s\n", xcp_filter_error());
+        return 1;
+    }
+
+    for (scenario = first; scenario <= last; ++scenario) {
+        count = xcp_gen_build(&config, scenario, frames, capacity);
+        for (mode = firstMode; mode <= lastMode; ++mode) {
+            /* warm up the analyzers, the first pass allocates the DAQ lists and shadow pages */
+            run(frames, count, count, mode, config.master, config.slave);
+            before = allocations;
+            elapsed = run(frames, count, total, mode, config.master, config.slave);
+            fprintf(results, "%-10s %-8s %12.1f frames/s %8.2f ns/frame %10.3f allocs/frame\n",
+                    xcp_gen_scenario_name(scenario), mode_names[mode], total / elapsed,
+                    elapsed * 1e9 / total, (double)(allocations - before) / total);
+        }
+    }
+    fclose(results);
+    free(frames);
+    return 0;
+}
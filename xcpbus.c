@@ -0,0 +1,603 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR BSD-3-Clause) */
+/*
+ * xcpbus.c - one dissector process per CAN interface, merged output
+ *
+ * Copyright (c) 2021 Christoph Schueler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <cpu12.gems@googlemail.com>
+ *
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "xcp.h"
+#include "xcpbus.h"
+
+/*
+ * The analyzers and the dissector keep their state in module variables, so every bus
+ * gets a process of its own rather than a thread: fork() gives each worker its own
+ * session, DAQ configuration and dissector state without touching them.
+ *
+ * In a worker a receive thread moves frames from the socket into a ring, the main
+ * thread dissects as usual with stdout captured in memory. What a frame printed goes
+ * into a batch as one record [timestamp][length][text], batches are written to a pipe
+ * when the ring runs empty or the batch is full.
+ *
+ * The merging process reads all pipes and repeatedly outputs the oldest head record.
+ * It is safe to do so when every running worker has a record queued, as each pipe is
+ * in timestamp order; otherwise the oldest record is held until it is `window` ms old.
+ * A record arriving later than that, i.e. from a worker lagging by more than the window,
+ * is printed at once and counted.
+ */
+
+/*
+ *
+ * Local Constants.
+ *
+ */
+#define RING_SIZE           (4096)          /* Frames between receive thread and dissector. */
+#define BATCH_SIZE          (64 * 1024)
+#define BATCH_HOLD          (1000)          /* us of frame time a batch is held at most. */
+#define READ_SIZE           (64 * 1024)
+#define POLL_MS             (100)           /* Receive thread checking for termination. */
+#define FINAL               (UINT64_MAX)    /* Timestamp of the output at exit. */
+
+/*
+ *
+ * Local Types.
+ *
+ */
+typedef struct tagRecordHeaderType {
+    uint64_t timestamp;                     /* us */
+    uint32_t length;
+    uint32_t reserved;
+} RecordHeaderType;
+
+typedef struct tagSlotType {
+    struct canfd_frame frame;
+    struct timeval tv;
+    uint32_t dropped;                       /* SO_RXQ_OVFL as of this frame. */
+    int nbytes;                             /* < 0: receive error `error`. */
+    int error;
+} SlotType;
+
+typedef struct tagQueueType {
+    int fd;
+    pid_t pid;
+    bool open;
+    uint8_t * buffer;
+    size_t start;
+    size_t fill;
+    size_t size;
+    uint64_t records;
+} QueueType;
+
+/*
+ *
+ * Local Variables.
+ *
+ */
+static int pipes[XCP_BUS_MAX][2];
+static pid_t pids[XCP_BUS_MAX];
+static unsigned bus_count = 0;
+static volatile sig_atomic_t stopping = 0;
+
+/* Worker. */
+static int output_fd = -1;
+static int receive_socket = -1;
+static pthread_t receiver;
+static bool receiving = FALSE;
+static SlotType * slots = NULL;
+static uint32_t head = 0;                   /* Written by the receive thread. */
+static uint32_t tail = 0;                   /* Written by the dissector. */
+static bool waiting = FALSE;
+static bool stop = FALSE;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ready = PTHREAD_COND_INITIALIZER;
+static FILE * capture = NULL;
+static char * text = NULL;
+static size_t text_length = 0;
+static uint8_t * batch = NULL;
+static size_t batch_fill = 0;
+static uint64_t batch_start;                /* Timestamp of the first record. */
+
+/*
+ *
+ * Local Functions.
+ *
+ */
+static void sigstop(int signo);
+static bool write_all(uint8_t const * data, size_t length);
+static void flush_batch(void);
+static void * receive_thread(void * arg);
+static bool head_record(QueueType const * const queue, RecordHeaderType * const header);
+static bool fill_queue(QueueType * const queue);
+static uint64_t now_us(void);
+
+
+static void sigstop(int signo)
+{
+    (void)signo;
+    stopping = 1;
+}
+
+static bool write_all(uint8_t const * data, size_t length)
+{
+    ssize_t written;
+
+    while (length > 0) {
+        written = write(output_fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return FALSE;
+        }
+        data += written;
+        length -= written;
+    }
+    return TRUE;
+}
+
+static void flush_batch(void)
+{
+    if (batch_fill > 0) {
+        if (!write_all(batch, batch_fill)) {
+            perror("merge");
+            exit(1);
+        }
+        batch_fill = 0;
+    }
+}
+
+static void * receive_thread(void * arg)
+{
+    SlotType * slot;
+    struct iovec iov;
+    struct msghdr msg;
+    struct cmsghdr * cmsg;
+    char ctrlmsg[CMSG_SPACE(sizeof(struct timeval)) + CMSG_SPACE(sizeof(uint32_t))];
+    struct timespec full = { 0, 50000 };
+    uint32_t dropped = 0;
+    uint32_t position;
+    int nbytes;
+
+    (void)arg;
+    msg.msg_name = NULL;
+    msg.msg_namelen = 0;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = &ctrlmsg;
+
+    while (!__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+        position = __atomic_load_n(&head, __ATOMIC_RELAXED);
+        if ((position - __atomic_load_n(&tail, __ATOMIC_ACQUIRE)) == RING_SIZE) {
+            /* The dissector is behind, leave the frames in the socket buffer. */
+            nanosleep(&full, NULL);
+            continue;
+        }
+        slot = &slots[position % RING_SIZE];
+        iov.iov_base = &slot->frame;
+        iov.iov_len = sizeof(slot->frame);
+        msg.msg_controllen = sizeof(ctrlmsg);
+        msg.msg_flags = 0;
+        nbytes = recvmsg(receive_socket, &msg, 0);
+        if (nbytes < 0) {
+            if ((errno == EINTR) || (errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                continue;
+            }
+            slot->error = errno;
+        }
+        slot->nbytes = nbytes;
+        for (cmsg = CMSG_FIRSTHDR(&msg); cmsg && (cmsg->cmsg_level == SOL_SOCKET); cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_type == SO_TIMESTAMP) {
+                memcpy(&slot->tv, CMSG_DATA(cmsg), sizeof(slot->tv));
+            } else if (cmsg->cmsg_type == SO_RXQ_OVFL) {
+                memcpy(&dropped, CMSG_DATA(cmsg), sizeof(dropped));
+            }
+        }
+        slot->dropped = dropped;
+        /* Pairs with the dissector setting `waiting` before it looks at `head`. */
+        __atomic_store_n(&head, position + 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&waiting, __ATOMIC_SEQ_CST)) {
+            pthread_mutex_lock(&lock);
+            pthread_cond_signal(&ready);
+            pthread_mutex_unlock(&lock);
+        }
+        if (nbytes < 0) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+static bool head_record(QueueType const * const queue, RecordHeaderType * const header)
+{
+    if ((queue->fill - queue->start) < sizeof(RecordHeaderType)) {
+        return FALSE;
+    }
+    memcpy(header, &queue->buffer[queue->start], sizeof(RecordHeaderType));
+    return (queue->fill - queue->start - sizeof(RecordHeaderType)) >= header->length;
+}
+
+static bool fill_queue(QueueType * const queue)
+{
+    uint8_t * buffer;
+    ssize_t nbytes;
+
+    if (queue->start > 0) {
+        memmove(queue->buffer, &queue->buffer[queue->start], queue->fill - queue->start);
+        queue->fill -= queue->start;
+        queue->start = 0;
+    }
+    if ((queue->size - queue->fill) < READ_SIZE) {
+        buffer = realloc(queue->buffer, queue->size + READ_SIZE);
+        if (buffer == NULL) {
+            return FALSE;
+        }
+        queue->buffer = buffer;
+        queue->size += READ_SIZE;
+    }
+    nbytes = read(queue->fd, &queue->buffer[queue->fill], queue->size - queue->fill);
+    if (nbytes < 0) {
+        return (errno == EINTR) || (errno == EAGAIN);
+    }
+    if (nbytes == 0) {
+        queue->open = FALSE;
+    }
+    queue->fill += nbytes;
+    return TRUE;
+}
+
+static uint64_t now_us(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (uint64_t)now.tv_sec * 1000000ULL + now.tv_nsec / 1000;
+}
+
+/*
+ *
+ * Global Functions.
+ *
+ */
+bool xcp_bus_spawn(unsigned count, int * const bus)
+{
+    unsigned idx;
+    unsigned other;
+    pid_t pid;
+
+    *bus = -1;
+    if ((count == 0) || (count > XCP_BUS_MAX)) {
+        errno = EINVAL;
+        return FALSE;
+    }
+    for (idx = 0; idx < count; ++idx) {
+        if (pipe(pipes[idx]) < 0) {
+            return FALSE;
+        }
+    }
+    fflush(stdout);
+    for (idx = 0; idx < count; ++idx) {
+        pid = fork();
+        if (pid < 0) {
+            return FALSE;
+        }
+        if (pid == 0) {
+            for (other = 0; other < count; ++other) {
+                close(pipes[other][0]);
+                if (other != idx) {
+                    close(pipes[other][1]);
+                }
+            }
+            output_fd = pipes[idx][1];
+            *bus = idx;
+            return TRUE;
+        }
+        pids[idx] = pid;
+        close(pipes[idx][1]);
+        ++bus_count;
+    }
+    return TRUE;
+}
+
+int xcp_bus_merge(char * const * names, unsigned window)
+{
+    QueueType queues[XCP_BUS_MAX];
+    struct pollfd fds[XCP_BUS_MAX];
+    unsigned map[XCP_BUS_MAX];
+    RecordHeaderType header;
+    RecordHeaderType oldest = { 0, 0, 0 };
+    QueueType * queue;
+    QueueType * next;
+    struct sigaction sa;
+    uint64_t const hold = (uint64_t)window * 1000;
+    uint64_t last = 0;
+    uint64_t records = 0;
+    uint64_t late = 0;
+    uint64_t worst = 0;
+    uint64_t now;
+    unsigned running = bus_count;
+    unsigned idx;
+    unsigned polled;
+    bool waiting_for_bus;
+    bool forwarded = FALSE;
+    int timeout;
+    int status;
+    int result = 0;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sigstop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGHUP, &sa, NULL);
+
+    memset(queues, 0, sizeof(queues));
+    for (idx = 0; idx < bus_count; ++idx) {
+        queues[idx].fd = pipes[idx][0];
+        queues[idx].pid = pids[idx];
+        queues[idx].open = TRUE;
+    }
+
+    for (;;) {
+        /* k-way merge over the queue heads. */
+        for (;;) {
+            next = NULL;
+            waiting_for_bus = FALSE;
+            for (idx = 0; idx < bus_count; ++idx) {
+                queue = &queues[idx];
+                if (!head_record(queue, &header)) {
+                    waiting_for_bus |= queue->open;
+                } else if ((next == NULL) || (header.timestamp < oldest.timestamp)) {
+                    next = queue;
+                    oldest = header;
+                }
+            }
+            if ((next == NULL) || (waiting_for_bus && (oldest.timestamp != FINAL) &&
+                                   ((oldest.timestamp + hold) > now_us()))) {
+                break;
+            }
+            if (oldest.timestamp == FINAL) {
+                if (waiting_for_bus) {
+                    break;
+                }
+            } else if (oldest.timestamp < last) {
+                ++late;
+                if ((last - oldest.timestamp) > worst) {
+                    worst = last - oldest.timestamp;
+                }
+            } else {
+                last = oldest.timestamp;
+            }
+            fwrite(&next->buffer[next->start + sizeof(RecordHeaderType)], 1, oldest.length, stdout);
+            next->start += sizeof(RecordHeaderType) + oldest.length;
+            ++next->records;
+            ++records;
+        }
+        fflush(stdout);
+
+        if (running == 0) {
+            break;
+        }
+        if (stopping && !forwarded) {
+            for (idx = 0; idx < bus_count; ++idx) {
+                kill(queues[idx].pid, SIGTERM);
+            }
+            forwarded = TRUE;
+        }
+
+        timeout = -1;
+        if ((next != NULL) && (oldest.timestamp != FINAL)) {
+            now = now_us();
+            timeout = ((oldest.timestamp + hold) > now) ? ((oldest.timestamp + hold - now) / 1000) + 1 : 0;
+        }
+        polled = 0;
+        for (idx = 0; idx < bus_count; ++idx) {
+            if (queues[idx].open) {
+                fds[polled].fd = queues[idx].fd;
+                fds[polled].events = POLLIN;
+                map[polled++] = idx;
+            }
+        }
+        if (poll(fds, polled, timeout) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("poll");
+            result = 1;
+            break;
+        }
+        for (idx = 0; idx < polled; ++idx) {
+            if (fds[idx].revents == 0) {
+                continue;
+            }
+            queue = &queues[map[idx]];
+            if (!fill_queue(queue)) {
+                perror("merge");
+                queue->open = FALSE;
+            }
+            if (!queue->open) {
+                close(queue->fd);
+                --running;
+            }
+        }
+    }
+
+    for (idx = 0; idx < bus_count; ++idx) {
+        if (queues[idx].open) {
+            kill(queues[idx].pid, SIGTERM);
+            close(queues[idx].fd);
+        }
+        if ((waitpid(queues[idx].pid, &status, 0) < 0) || !WIFEXITED(status) || (WEXITSTATUS(status) != 0)) {
+            result = 1;
+        }
+        free(queues[idx].buffer);
+    }
+    fprintf(stderr, "merge: %llu records from %u buses",
+            (unsigned long long)records, bus_count);
+    for (idx = 0; idx < bus_count; ++idx) {
+        fprintf(stderr, "%s%s %llu", idx ? ", " : " (", names[idx], (unsigned long long)queues[idx].records);
+    }
+    fprintf(stderr, "), %llu out of order by up to %.3f ms, window %u ms\n",
+            (unsigned long long)late, worst / 1000.0, window);
+    return result;
+}
+
+bool xcp_bus_attach(int socket)
+{
+    struct timeval timeout = { 0, POLL_MS * 1000 };
+
+    slots = calloc(RING_SIZE, sizeof(SlotType));
+    batch = malloc(BATCH_SIZE);
+    if ((slots == NULL) || (batch == NULL)) {
+        return FALSE;
+    }
+    /* Everything printed goes to the merge, see xcp_bus_emit(). */
+    capture = open_memstream(&text, &text_length);
+    if (capture == NULL) {
+        return FALSE;
+    }
+    stdout = capture;
+
+    setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    receive_socket = socket;
+    errno = pthread_create(&receiver, NULL, receive_thread, NULL);
+    if (errno != 0) {
+        return FALSE;
+    }
+    receiving = TRUE;
+    return TRUE;
+}
+
+int xcp_bus_receive(struct canfd_frame * const frame, struct timeval * const tv, uint32_t * const dropped)
+{
+    struct timespec deadline;
+    SlotType const * slot;
+    int nbytes;
+
+    if (tail == __atomic_load_n(&head, __ATOMIC_ACQUIRE)) {
+        flush_batch();
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += POLL_MS * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            ++deadline.tv_sec;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_mutex_lock(&lock);
+        __atomic_store_n(&waiting, TRUE, __ATOMIC_SEQ_CST);
+        while (tail == __atomic_load_n(&head, __ATOMIC_SEQ_CST)) {
+            if (pthread_cond_timedwait(&ready, &lock, &deadline) != 0) {
+                break;
+            }
+        }
+        __atomic_store_n(&waiting, FALSE, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&lock);
+        if (tail == __atomic_load_n(&head, __ATOMIC_ACQUIRE)) {
+            /* Let the caller check for termination. */
+            errno = EAGAIN;
+            return -1;
+        }
+    }
+    slot = &slots[tail % RING_SIZE];
+    nbytes = slot->nbytes;
+    if (nbytes < 0) {
+        errno = slot->error;
+    } else {
+        memcpy(frame, &slot->frame, sizeof(*frame));
+        *tv = slot->tv;
+        *dropped = slot->dropped;
+    }
+    __atomic_store_n(&tail, tail + 1, __ATOMIC_RELEASE);
+    return nbytes;
+}
+
+void xcp_bus_emit(struct timeval const * const tv)
+{
+    RecordHeaderType header;
+
+    fflush(capture);
+    if (text_length == 0) {
+        return;
+    }
+    header.timestamp = (tv == NULL) ? FINAL : (uint64_t)tv->tv_sec * 1000000ULL + tv->tv_usec;
+    header.length = text_length;
+    header.reserved = 0;
+    if (((batch_fill + sizeof(header) + text_length) > BATCH_SIZE) ||
+        ((batch_fill > 0) && (header.timestamp - batch_start) > BATCH_HOLD)) {
+        flush_batch();
+    }
+    if (batch_fill == 0) {
+        batch_start = header.timestamp;
+    }
+    if ((sizeof(header) + text_length) > BATCH_SIZE) {
+        if (!write_all((uint8_t const *)&header, sizeof(header)) || !write_all((uint8_t const *)text, text_length)) {
+            perror("merge");
+            exit(1);
+        }
+    } else {
+        memcpy(&batch[batch_fill], &header, sizeof(header));
+        memcpy(&batch[batch_fill + sizeof(header)], text, text_length);
+        batch_fill += sizeof(header) + text_length;
+    }
+    fseeko(capture, 0, SEEK_SET);
+}
+
+void xcp_bus_detach(void)
+{
+    if (receiving) {
+        __atomic_store_n(&stop, TRUE, __ATOMIC_RELAXED);
+        pthread_join(receiver, NULL);
+        receiving = FALSE;
+    }
+    if (capture != NULL) {
+        xcp_bus_emit(NULL);
+        flush_batch();
+    }
+    close(output_fd);
+    output_fd = -1;
+}
@@ -0,0 +1,91 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR BSD-3-Clause) */
+/*
+ * xcpbus.h - one dissector process per CAN interface, merged output
+ *
+ * Copyright (c) 2021 Christoph Schueler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <cpu12.gems@googlemail.com>
+ *
+ */
+#ifndef __XCPBUS_H
+#define __XCPBUS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/time.h>
+
+#include <linux/can.h>
+
+/*
+ * Defines
+ */
+#define XCP_BUS_MAX             (16)
+#define XCP_BUS_DEFAULT_WINDOW  (20)        /* ms */
+
+/*
+ * Global Functions
+ *
+ */
+
+/*
+ * Forks one worker per interface. Returns with `bus` set to the interface index in
+ * each worker and to -1 in the calling process, which then runs xcp_bus_merge().
+ */
+bool xcp_bus_spawn(unsigned count, int * const bus);
+
+/*
+ * Writes the output of all workers to stdout in timestamp order until every worker
+ * has exited. A record waits at most `window` ms for older ones from other buses;
+ * records arriving later than that are counted as out of order. Returns the exit
+ * status for the program.
+ */
+int xcp_bus_merge(char * const * names, unsigned window);
+
+/*
+ * Worker side. xcp_bus_attach() starts the receive thread on `socket` and captures
+ * stdout; xcp_bus_receive() replaces recvmsg(), returning the receive time and the
+ * SO_RXQ_OVFL count (if enabled) along with the frame. xcp_bus_emit() passes everything
+ * printed since the last call on to the merge, as of `tv`. xcp_bus_detach() stops the
+ * receive thread and passes the remaining output, e.g. the summaries, to be printed
+ * after all frames.
+ */
+bool xcp_bus_attach(int socket);
+int xcp_bus_receive(struct canfd_frame * const frame, struct timeval * const tv, uint32_t * const dropped);
+void xcp_bus_emit(struct timeval const * const tv);
+void xcp_bus_detach(void);
+
+#endif /* __XCPBUS_H */
@@ -0,0 +1,309 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR BSD-3-Clause) */
+/*
+ * xcpchange.c - change-only DTO output
+ *
+ * Copyright (c) 2021 Christoph Schueler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <cpu12.gems@googlemail.com>
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "xcp.h"
+#include "xcpdaq.h"
+#include "xcpchange.h"
+
+/*
+ * The last payload of every ODT is kept and compared as 64-bit words under a mask.
+ * While the ODT layout is known from the DAQ configuration, the slot is that of
+ * (DAQ list, ODT), since with identification field types 1..3 the PID is only the
+ * relative ODT number, and the mask covers only the bytes (or bits) of its entries,
+ * so the DTO counter and the slave timestamp, which differ in every cycle, do not
+ * count as a change. Otherwise the slot is that of the PID, per direction, and the
+ * whole payload is compared.
+ */
+
+/*
+ *
+ * Local Constants.
+ *
+ */
+#define WORDS           (CANFD_MAX_DLEN / sizeof(uint64_t))
+#define DIRECTIONS      (2)                 /* STIM, DAQ */
+#define PIDS            (256)
+
+/*
+ *
+ * Local Types.
+ *
+ */
+typedef struct tagSlotType {
+    uint64_t words[WORDS];
+    uint16_t length;
+    bool seen;
+    bool alive;                             /* Since the last keep-alive ... */
+    bool changed;                           /* ... and printed. */
+} SlotType;
+
+typedef struct tagCountersType {
+    uint64_t dtos;
+    uint64_t printed;
+} CountersType;
+
+/*
+ *
+ * Local Variables.
+ *
+ */
+static SlotType slots[DIRECTIONS][PIDS];
+static SlotType ** list_slots = NULL;      /* Per DAQ list, allocated on its first DTO. */
+static uint32_t list_count = 0;
+static CountersType interval_counters;
+static CountersType total_counters;
+static uint64_t interval_us = (uint64_t)XCP_CHANGE_DEFAULT_INTERVAL * 1000;
+static uint64_t due_us = 0;
+
+/*
+ *
+ * Local Functions.
+ *
+ */
+static void plan_mask(XcpDaqPlanType const * const plan, uint16_t length, uint64_t * const mask);
+static void length_mask(uint16_t length, uint64_t * const mask);
+static SlotType * list_slot(uint16_t daqList, uint8_t odt);
+static void reset_slot(SlotType * const slot, unsigned * const alive, unsigned * const changed);
+
+
+/*
+ * Bytes and bits of the ODT entries, within the DTO length.
+ */
+static void plan_mask(XcpDaqPlanType const * const plan, uint16_t length, uint64_t * const mask)
+{
+    uint8_t bytes[CANFD_MAX_DLEN];
+    XcpDaqPlanEntryType const * entry;
+    unsigned position;
+    uint8_t idx;
+
+    memset(bytes, 0, sizeof(bytes));
+    for (idx = 0; idx < plan->entryCount; ++idx) {
+        entry = &plan->entries[idx];
+        if ((entry->offset + entry->width) > length) {
+            continue;
+        }
+        if (entry->bit == XCP_DAQ_NO_BIT) {
+            memset(&bytes[entry->offset], 0xff, entry->width);
+        } else {
+            position = entry->bit / 8;
+            if (entry->motorola) {
+                position = entry->width - 1 - position;
+            }
+            bytes[entry->offset + position] |= (uint8_t)(1U << (entry->bit % 8));
+        }
+    }
+    memcpy(mask, bytes, sizeof(bytes));
+}
+
+static void length_mask(uint16_t length, uint64_t * const mask)
+{
+    uint8_t bytes[CANFD_MAX_DLEN];
+
+    memset(bytes, 0, sizeof(bytes));
+    memset(bytes, 0xff, length);
+    memcpy(mask, bytes, sizeof(bytes));
+}
+
+static SlotType * list_slot(uint16_t daqList, uint8_t odt)
+{
+    SlotType ** lists;
+    uint32_t count;
+
+    if (daqList >= list_count) {
+        count = (uint32_t)daqList + 1;
+        lists = realloc(list_slots, count * sizeof(SlotType *));
+        if (lists == NULL) {
+            return NULL;
+        }
+        memset(&lists[list_count], 0, (count - list_count) * sizeof(SlotType *));
+        list_slots = lists;
+        list_count = count;
+    }
+    if (list_slots[daqList] == NULL) {
+        list_slots[daqList] = calloc(PIDS, sizeof(SlotType));
+        if (list_slots[daqList] == NULL) {
+            return NULL;
+        }
+    }
+    return &list_slots[daqList][odt];
+}
+
+static void reset_slot(SlotType * const slot, unsigned * const alive, unsigned * const changed)
+{
+    if (slot->alive) {
+        ++*alive;
+    }
+    if (slot->changed) {
+        ++*changed;
+    }
+    slot->alive = FALSE;
+    slot->changed = FALSE;
+}
+
+/*
+ *
+ * Global Functions.
+ *
+ */
+void xcp_change_init(uint32_t interval)
+{
+    uint32_t idx;
+
+    memset(slots, 0, sizeof(slots));
+    for (idx = 0; idx < list_count; ++idx) {
+        free(list_slots[idx]);
+    }
+    free(list_slots);
+    list_slots = NULL;
+    list_count = 0;
+    memset(&interval_counters, 0, sizeof(interval_counters));
+    memset(&total_counters, 0, sizeof(total_counters));
+    interval_us = (uint64_t)interval * 1000;
+    due_us = 0;
+}
+
+bool xcp_change_update(XcpMessage const * const msg)
+{
+    XcpDaqPlanType const * plan;
+    SlotType * slot;
+    uint64_t current[WORDS];
+    uint64_t mask[WORDS];
+    uint64_t difference = 0;
+    uint16_t length = msg->length;
+    uint8_t pid;
+    bool overload = FALSE;
+    unsigned idx;
+
+    if ((length == 0) || (length > CANFD_MAX_DLEN) || (msg->data[0] >= (msg->fromSlave ? 0xfc : 0xc0))) {
+        return TRUE;                        /* Not a DTO. */
+    }
+    pid = msg->data[0];
+    ++interval_counters.dtos;
+    ++total_counters.dtos;
+    if (msg->fromSlave && xcp_daq_overload_msb()) {
+        overload = (pid & 0x80) ? TRUE : FALSE;
+        pid &= 0x7f;
+    }
+
+    plan = xcp_daq_lookup_plan(msg->data, length);
+    if ((plan != NULL) && (length >= plan->length)) {
+        slot = list_slot(plan->daqList, plan->odt);
+        if (slot == NULL) {
+            return TRUE;
+        }
+        plan_mask(plan, length, mask);
+    } else {
+        slot = &slots[msg->fromSlave ? 1 : 0][pid];
+        length_mask(length, mask);
+    }
+    slot->alive = TRUE;
+    memset(current, 0, sizeof(current));
+    memcpy(current, msg->data, length);
+    for (idx = 0; idx < WORDS; ++idx) {
+        difference |= (current[idx] ^ slot->words[idx]) & mask[idx];
+    }
+    if (!overload && slot->seen && (difference == 0) && (slot->length == length)) {
+        return FALSE;
+    }
+    memcpy(slot->words, current, sizeof(current));
+    slot->length = length;
+    slot->seen = TRUE;
+    slot->changed = TRUE;
+    ++interval_counters.printed;
+    ++total_counters.printed;
+    return TRUE;
+}
+
+bool xcp_change_keepalive(struct timeval const * const tv)
+{
+    uint64_t now = (uint64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+
+    if (due_us == 0) {
+        due_us = now + interval_us;
+        return FALSE;
+    }
+    if (now < due_us) {
+        return FALSE;
+    }
+    due_us += interval_us * ((now - due_us) / interval_us + 1);
+    return TRUE;
+}
+
+void xcp_change_print_keepalive(void)
+{
+    uint32_t list;
+    unsigned direction;
+    unsigned pid;
+    unsigned odts = 0;
+    unsigned changed = 0;
+
+    for (direction = 0; direction < DIRECTIONS; ++direction) {
+        for (pid = 0; pid < PIDS; ++pid) {
+            reset_slot(&slots[direction][pid], &odts, &changed);
+        }
+    }
+    for (list = 0; list < list_count; ++list) {
+        if (list_slots[list] != NULL) {
+            for (pid = 0; pid < PIDS; ++pid) {
+                reset_slot(&list_slots[list][pid], &odts, &changed);
+            }
+        }
+    }
+    printf("DTO_KEEPALIVE(dtos = %llu, printed = %llu, odts = %u, changed = %u)",
+           (unsigned long long)interval_counters.dtos, (unsigned long long)interval_counters.printed, odts, changed);
+    memset(&interval_counters, 0, sizeof(interval_counters));
+}
+
+void xcp_change_print_summary(void)
+{
+    printf("DTO_CHANGE_SUMMARY(dtos = %llu, printed = %llu, suppressed = %llu)\n",
+           (unsigned long long)total_counters.dtos, (unsigned long long)total_counters.printed,
+           (unsigned long long)(total_counters.dtos - total_counters.printed));
+}
@@ -0,0 +1,80 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR BSD-3-Clause) */
+/*
+ * xcpchange.h - change-only DTO output
+ *
+ * Copyright (c) 2021 Christoph Schueler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <cpu12.gems@googlemail.com>
+ *
+ */
+#ifndef __XCPCHANGE_H
+#define __XCPCHANGE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/time.h>
+
+#include "xcp.h"
+
+/*
+ * Defines
+ */
+#define XCP_CHANGE_DEFAULT_INTERVAL (1000)  /* ms */
+
+/*
+ * Global Functions
+ *
+ */
+void xcp_change_init(uint32_t interval);
+
+/*
+ * Returns FALSE for a DTO whose ODT entries equal those of the previous DTO of the
+ * same DAQ list and ODT, or, while the DAQ configuration is unknown, whose whole
+ * payload equals that of the previous DTO with the same PID.
+ * Everything else, including DTOs with the overload flag, is to be printed.
+ */
+bool xcp_change_update(XcpMessage const * const msg);
+
+/*
+ * TRUE once per interval of frame time, for a keep-alive line about the DTOs
+ * since the last one.
+ */
+bool xcp_change_keepalive(struct timeval const * const tv);
+void xcp_change_print_keepalive(void);
+void xcp_change_print_summary(void);
+
+#endif /* __XCPCHANGE_H */
@@ -0,0 +1,325 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR BSD-3-Clause) */
+/*
+ * xcpchecksum.c - BUILD_CHECKSUM verification
+ *
+ * Copyright (c) 2021 Christoph Schueler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <cpu12.gems@googlemail.com>
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <linux/can.h>
+
+#include "xcp.h"
+#include "xcpsession.h"
+#include "xcpshadow.h"
+#include "xcpchecksum.h"
+
+/*
+ *
+ * Local Constants.
+ *
+ */
+#define CRC_16_POLYNOMIAL       (0xA001)        /* 0x8005 reflected. */
+#define CRC_16_CITT_POLYNOMIAL  (0x1021)
+#define CRC_32_POLYNOMIAL       (0xEDB88320)    /* 0x04C11DB7 reflected. */
+
+#define MAX_CHECKSUM_BLOCK      (0x10000000)    /* Give up on larger blocks. */
+
+/*
+ *
+ * Local Variables.
+ *
+ */
+static bool tables_ready = FALSE;
+static uint32_t crc16_table[8][256];
+static uint32_t crc16_citt_table[8][256];
+static uint32_t crc32_table[8][256];
+
+static XcpChecksumVerdictType verdict = XCP_CHECKSUM_UNVERIFIED;
+static uint32_t computed_checksum;
+static uint8_t * buffer = NULL;
+static uint32_t buffer_size = 0;
+
+/*
+ *
+ * Local Functions.
+ *
+ */
+static void init_tables(void);
+static uint32_t crc_reflected(uint32_t (* table)[256], uint32_t crc, uint8_t const * data, uint32_t length);
+static uint32_t crc_16_citt(uint32_t crc, uint8_t const * data, uint32_t length);
+static void column_sums(uint8_t const * data, uint32_t length, uint64_t sums[16]);
+static uint32_t add_sum(uint8_t const * data, uint32_t length, unsigned width, uint8_t byteOrder);
+
+
+/*
+ * Compute a checksum as specified for BUILD_CHECKSUM, FALSE if the method
+ * isn't supported or the length doesn't fit the element size.
+ */
+bool xcp_checksum_compute(uint8_t method, uint8_t byteOrder, uint8_t const * data, uint32_t length, uint32_t * result)
+{
+    if (!tables_ready) {
+        init_tables();
+    }
+    switch (method) {
+        case XCP_CHECKSUM_METHOD_XCP_ADD_11:
+            *result = add_sum(data, length, 1, byteOrder) & 0xff;
+            break;
+        case XCP_CHECKSUM_METHOD_XCP_ADD_12:
+            *result = add_sum(data, length, 1, byteOrder) & 0xffff;
+            break;
+        case XCP_CHECKSUM_METHOD_XCP_ADD_14:
+            *result = add_sum(data, length, 1, byteOrder);
+            break;
+        case XCP_CHECKSUM_METHOD_XCP_ADD_22:
+            if (length % 2) {
+                return FALSE;
+            }
+            *result = add_sum(data, length, 2, byteOrder) & 0xffff;
+            break;
+        case XCP_CHECKSUM_METHOD_XCP_ADD_24:
+            if (length % 2) {
+                return FALSE;
+            }
+            *result = add_sum(data, length, 2, byteOrder);
+            break;
+        case XCP_CHECKSUM_METHOD_XCP_ADD_44:
+            if (length % 4) {
+                return FALSE;
+            }
+            *result = add_sum(data, length, 4, byteOrder);
+            break;
+        case XCP_CHECKSUM_METHOD_XCP_CRC_16:
+            *result = crc_reflected(crc16_table, 0x0000, data, length);
+            break;
+        case XCP_CHECKSUM_METHOD_XCP_CRC_16_CITT:
+            *result = crc_16_citt(0xffff, data, length);
+            break;
+        case XCP_CHECKSUM_METHOD_XCP_CRC_32:
+            *result = crc_reflected(crc32_table, 0xffffffff, data, length) ^ 0xffffffff;
+            break;
+        default:
+            return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * Recompute the checksum of a positive BUILD_CHECKSUM response from the memory shadow.
+ */
+void xcp_checksum_update(XcpMessage const * const msg)
+{
+    XcpSessionType const * const session = xcp_session_get();
+    uint8_t const * const res = msg->data;
+    uint32_t blockSize;
+    uint64_t length;
+    uint8_t * grown;
+
+    verdict = XCP_CHECKSUM_UNVERIFIED;
+    if ((session->response != 0xff) || (session->request[0] != BUILD_CHECKSUM) ||
+        (session->requestLength < 8) || (msg->length < 8)) {
+        return;
+    }
+    blockSize = xcp_session_dword(session, &session->request[4]);
+    length = (uint64_t)blockSize * session->addressGranularity;
+    if ((length == 0) || (length > MAX_CHECKSUM_BLOCK)) {
+        return;
+    }
+    if (length > buffer_size) {
+        grown = realloc(buffer, length);
+        if (grown == NULL) {
+            return;
+        }
+        buffer = grown;
+        buffer_size = length;
+    }
+    /* The MTA has already been moved past the block. */
+    if (!xcp_shadow_read(session->mtaExtension,
+                         (uint64_t)(session->mtaAddress - blockSize) * session->addressGranularity,
+                         buffer, length)) {
+        return;
+    }
+    if (!xcp_checksum_compute(res[1], session->byteOrder, buffer, length, &computed_checksum)) {
+        return;
+    }
+    verdict = (computed_checksum == xcp_session_dword(session, &res[4])) ? XCP_CHECKSUM_MATCH : XCP_CHECKSUM_MISMATCH;
+}
+
+XcpChecksumVerdictType xcp_checksum_verdict(uint32_t * computed)
+{
+    if (computed != NULL) {
+        *computed = computed_checksum;
+    }
+    return verdict;
+}
+
+/*
+ * Slicing-by-8 tables: table[k][n] is the CRC of byte n followed by k zero bytes.
+ */
+static void init_tables(void)
+{
+    uint32_t r16;
+    uint32_t c16;
+    uint32_t r32;
+    unsigned n;
+    unsigned k;
+
+    for (n = 0; n < 256; ++n) {
+        r16 = n;
+        c16 = n << 8;
+        r32 = n;
+        for (k = 0; k < 8; ++k) {
+            r16 = (r16 & 1) ? ((r16 >> 1) ^ CRC_16_POLYNOMIAL) : (r16 >> 1);
+            c16 = (c16 & 0x8000) ? ((c16 << 1) ^ CRC_16_CITT_POLYNOMIAL) : (c16 << 1);
+            r32 = (r32 & 1) ? ((r32 >> 1) ^ CRC_32_POLYNOMIAL) : (r32 >> 1);
+        }
+        crc16_table[0][n] = r16;
+        crc16_citt_table[0][n] = c16 & 0xffff;
+        crc32_table[0][n] = r32;
+    }
+    for (k = 1; k < 8; ++k) {
+        for (n = 0; n < 256; ++n) {
+            r16 = crc16_table[k - 1][n];
+            crc16_table[k][n] = (r16 >> 8) ^ crc16_table[0][r16 & 0xff];
+            c16 = crc16_citt_table[k - 1][n];
+            crc16_citt_table[k][n] = ((c16 << 8) ^ crc16_citt_table[0][c16 >> 8]) & 0xffff;
+            r32 = crc32_table[k - 1][n];
+            crc32_table[k][n] = (r32 >> 8) ^ crc32_table[0][r32 & 0xff];
+        }
+    }
+    tables_ready = TRUE;
+}
+
+static uint32_t crc_reflected(uint32_t (* table)[256], uint32_t crc, uint8_t const * data, uint32_t length)
+{
+    uint32_t word;
+
+    for (; length >= 8; length -= 8, data += 8) {
+        word = crc ^ ((uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24));
+        crc = table[7][word & 0xff] ^ table[6][(word >> 8) & 0xff] ^
+              table[5][(word >> 16) & 0xff] ^ table[4][word >> 24] ^
+              table[3][data[4]] ^ table[2][data[5]] ^ table[1][data[6]] ^ table[0][data[7]];
+    }
+    for (; length > 0; --length, ++data) {
+        crc = (crc >> 8) ^ table[0][(crc ^ *data) & 0xff];
+    }
+    return crc;
+}
+
+static uint32_t crc_16_citt(uint32_t crc, uint8_t const * data, uint32_t length)
+{
+    uint32_t (* const table)[256] = crc16_citt_table;
+
+    for (; length >= 8; length -= 8, data += 8) {
+        crc = table[7][data[0] ^ (crc >> 8)] ^ table[6][data[1] ^ (crc & 0xff)] ^
+              table[5][data[2]] ^ table[4][data[3]] ^
+              table[3][data[4]] ^ table[2][data[5]] ^ table[1][data[6]] ^ table[0][data[7]];
+    }
+    for (; length > 0; --length, ++data) {
+        crc = ((crc << 8) ^ table[0][(crc >> 8) ^ *data]) & 0xffff;
+    }
+    return crc;
+}
+
+/*
+ * Sum up the bytes per position modulo 16, all ADD_xy methods are weighted sums of these.
+ */
+static void column_sums(uint8_t const * data, uint32_t length, uint64_t sums[16])
+{
+    uint32_t idx = 0;
+#if defined(__SSE2__)
+    __m128i const zero = _mm_setzero_si128();
+    __m128i low;
+    __m128i high;
+    __m128i value;
+    uint16_t lanes[16];
+    uint32_t blocks;
+    unsigned lane;
+
+    while (length - idx >= 16) {
+        /* 16 bit accumulators hold 257 blocks of 0xff, flush earlier. */
+        blocks = (length - idx) / 16;
+        if (blocks > 256) {
+            blocks = 256;
+        }
+        low = zero;
+        high = zero;
+        for (; blocks > 0; --blocks, idx += 16) {
+            value = _mm_loadu_si128((__m128i const *)&data[idx]);
+            low = _mm_add_epi16(low, _mm_unpacklo_epi8(value, zero));
+            high = _mm_add_epi16(high, _mm_unpackhi_epi8(value, zero));
+        }
+        _mm_storeu_si128((__m128i *)&lanes[0], low);
+        _mm_storeu_si128((__m128i *)&lanes[8], high);
+        for (lane = 0; lane < 16; ++lane) {
+            sums[lane] += lanes[lane];
+        }
+    }
+#endif
+    for (; idx < length; ++idx) {
+        sums[idx & 15] += data[idx];
+    }
+}
+
+static uint32_t add_sum(uint8_t const * data, uint32_t length, unsigned width, uint8_t byteOrder)
+{
+    uint64_t sums[16] = {0};
+    uint64_t total = 0;
+    unsigned position;
+    unsigned lane;
+
+    column_sums(data, length, sums);
+    for (lane = 0; lane < 16; ++lane) {
+        position = lane % width;
+        if (byteOrder == XCP_BYTE_ORDER_MOTOROLA) {
+            position = width - 1 - position;
+        }
+        total += sums[lane] << (position * 8);
+    }
+    return (uint32_t)total;
+}
@@ -0,0 +1,469 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR BSD-3-Clause) */
+/*
+ * xcpcorrelate.c - match frames seen on two interfaces, gateway latency and loss
+ *
+ * Copyright (c) 2021 Christoph Schueler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <cpu12.gems@googlemail.com>
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "xcp.h"
+#include "xcpcorrelate.h"
+#include "xcplog.h"
+
+/*
+ * Frames waiting for their counterpart are kept in a hash table keyed by identifier
+ * and payload, and in time buckets: the window is covered by a ring of buckets, each
+ * holding the frames that arrived during its interval. When time moves past the window,
+ * the oldest buckets are expired as a whole and their unmatched frames counted as seen
+ * on one side only, so the cost per frame does not depend on the number pending.
+ * A matched frame is taken out of the hash table right away and freed with its bucket.
+ *
+ * Identical frames (positive responses without data, constant DTOs) can be pending
+ * several times. The candidate whose latency is closest to the running mean of the
+ * direction is taken, the oldest one until the first match. Taking the oldest always
+ * would pair every later frame with its predecessor once one of them is lost.
+ */
+
+/*
+ *
+ * Local Constants.
+ *
+ */
+#define HASH_BITS       (16)
+#define HASH_SIZE       (1U << HASH_BITS)
+#define SLOTS           (64)                /* Time buckets, SLOTS - 2 of them cover the window. */
+#define NONE            (0xffffffffU)
+#define MIN_ENTRIES     (4096)
+
+#define BUCKET_BITS     (3)                 /* Histogram: linear sub-buckets per power of two. */
+#define SUB_BUCKETS     (1U << BUCKET_BITS)
+#define BUCKETS         (64 * SUB_BUCKETS)
+#define BAR_WIDTH       (40)
+#define MEAN_WEIGHT     (16)                /* 1 / weight of a new latency in the running mean. */
+
+/*
+ *
+ * Local Types.
+ *
+ */
+typedef struct tagEntryType {
+    uint64_t key;
+    uint64_t timestamp;
+    uint32_t next;                          /* Hash chain. */
+    uint32_t prev;
+    uint32_t later;                         /* Next of the same time bucket, or free list. */
+    uint8_t side;
+    uint8_t type;
+    bool matched;
+} EntryType;
+
+typedef struct tagSlotType {
+    uint64_t sequence;                      /* timestamp / width of its frames. */
+    uint32_t first;
+} SlotType;
+
+typedef struct tagHistogramType {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+    uint64_t buckets[BUCKETS];
+    uint64_t powers[64];                    /* Power of two of the latency in us, for printing. */
+} HistogramType;
+
+/*
+ *
+ * Local Variables.
+ *
+ */
+static EntryType * entries = NULL;
+static uint32_t entry_capacity = 0;
+static uint32_t entry_count = 0;
+static uint32_t free_list = NONE;
+static uint32_t chains[HASH_SIZE];
+static SlotType slots[SLOTS];
+static uint64_t window_ns;
+static uint64_t width;
+static uint64_t expired = 0;                /* Buckets before this sequence are gone. */
+
+/* Indexed by the side a frame was seen on first. */
+static HistogramType histograms[2][XCP_CORRELATE_TYPES];
+static uint64_t frames[2][XCP_CORRELATE_TYPES];
+static uint64_t unmatched[2][XCP_CORRELATE_TYPES];
+static int64_t expected[2];                 /* Running mean latency, ns. */
+static bool learned[2];
+
+static char const * const type_names[XCP_CORRELATE_TYPES] = { "CTO", "DTO" };
+
+/*
+ *
+ * Local Functions.
+ *
+ */
+static uint32_t allocate(void);
+static void unlink_entry(uint32_t idx);
+static void expire_slot(SlotType * const slot);
+static void advance(uint64_t timestamp);
+static unsigned bucket_of(uint64_t value);
+static uint64_t bucket_value(unsigned bucket);
+static uint64_t percentile(HistogramType const * const histogram, unsigned permille);
+static void record(HistogramType * const histogram, uint64_t value);
+static void print_histogram(HistogramType const * const histogram);
+static uint64_t distance(uint64_t a, uint64_t b);
+
+
+static uint32_t allocate(void)
+{
+    EntryType * grown;
+    uint32_t idx;
+
+    if (free_list != NONE) {
+        idx = free_list;
+        free_list = entries[idx].later;
+        return idx;
+    }
+    if (entry_count == entry_capacity) {
+        grown = realloc(entries, 2 * entry_capacity * sizeof(EntryType));
+        if (grown == NULL) {
+            return NONE;
+        }
+        entries = grown;
+        entry_capacity *= 2;
+    }
+    return entry_count++;
+}
+
+static void unlink_entry(uint32_t idx)
+{
+    EntryType * const entry = &entries[idx];
+
+    if (entry->prev != NONE) {
+        entries[entry->prev].next = entry->next;
+    } else {
+        chains[entry->key & (HASH_SIZE - 1)] = entry->next;
+    }
+    if (entry->next != NONE) {
+        entries[entry->next].prev = entry->prev;
+    }
+}
+
+static void expire_slot(SlotType * const slot)
+{
+    EntryType * entry;
+    uint32_t idx = slot->first;
+    uint32_t later;
+
+    while (idx != NONE) {
+        entry = &entries[idx];
+        later = entry->later;
+        if (!entry->matched) {
+            ++unmatched[entry->side][entry->type];
+            unlink_entry(idx);
+        }
+        entry->later = free_list;
+        free_list = idx;
+        idx = later;
+    }
+    slot->first = NONE;
+}
+
+/*
+ * Expires the buckets that have left the window.
+ */
+static void advance(uint64_t timestamp)
+{
+    uint64_t const limit = (timestamp > window_ns) ? ((timestamp - window_ns) / width) : 0;
+    unsigned idx;
+
+    if ((limit > expired) && ((limit - expired) >= SLOTS)) {
+        for (idx = 0; idx < SLOTS; ++idx) {
+            expire_slot(&slots[idx]);
+        }
+        expired = limit;
+        return;
+    }
+    for (; expired < limit; ++expired) {
+        if (slots[expired % SLOTS].sequence == expired) {
+            expire_slot(&slots[expired % SLOTS]);
+        }
+    }
+}
+
+static unsigned bucket_of(uint64_t value)
+{
+    unsigned exponent;
+
+    if (value < SUB_BUCKETS) {
+        return value;
+    }
+    exponent = 63 - __builtin_clzll(value);
+    return (exponent - BUCKET_BITS + 1) * SUB_BUCKETS + ((value >> (exponent - BUCKET_BITS)) & (SUB_BUCKETS - 1));
+}
+
+/*
+ * Upper bound of a bucket.
+ */
+static uint64_t bucket_value(unsigned bucket)
+{
+    unsigned exponent;
+
+    if (bucket < SUB_BUCKETS) {
+        return bucket;
+    }
+    exponent = bucket / SUB_BUCKETS + BUCKET_BITS - 1;
+    return ((uint64_t)(SUB_BUCKETS + (bucket % SUB_BUCKETS) + 1) << (exponent - BUCKET_BITS)) - 1;
+}
+
+static uint64_t percentile(HistogramType const * const histogram, unsigned permille)
+{
+    uint64_t const rank = (histogram->count * permille + 999) / 1000;
+    uint64_t seen = 0;
+    unsigned bucket;
+
+    for (bucket = 0; bucket < BUCKETS; ++bucket) {
+        seen += histogram->buckets[bucket];
+        if (seen >= rank) {
+            return (bucket_value(bucket) < histogram->max) ? bucket_value(bucket) : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+static void record(HistogramType * const histogram, uint64_t value)
+{
+    if ((histogram->count == 0) || (value < histogram->min)) {
+        histogram->min = value;
+    }
+    if (value > histogram->max) {
+        histogram->max = value;
+    }
+    ++histogram->count;
+    histogram->sum += value;
+    ++histogram->buckets[bucket_of(value)];
+    value /= 1000;
+    ++histogram->powers[(value > 0) ? (63 - __builtin_clzll(value)) : 0];
+}
+
+/*
+ * One line per power of two of the latency in us.
+ */
+static void print_histogram(HistogramType const * const histogram)
+{
+    uint64_t const * const counts = histogram->powers;
+    uint64_t largest = 0;
+    unsigned power;
+    unsigned first = 64;
+    unsigned last = 0;
+
+    for (power = 0; power < 64; ++power) {
+        if (counts[power] > 0) {
+            first = (power < first) ? power : first;
+            last = power;
+            largest = (counts[power] > largest) ? counts[power] : largest;
+        }
+    }
+    for (power = first; power <= last; ++power) {
+        printf("    %8llu .. %8lluus %10llu  %.*s\n", power ? (1ULL << power) : 0ULL,
+               (2ULL << power) - 1, (unsigned long long)counts[power],
+               (int)((counts[power] * BAR_WIDTH + largest - 1) / largest),
+               "########################################");
+    }
+}
+
+static uint64_t distance(uint64_t a, uint64_t b)
+{
+    return (a > b) ? (a - b) : (b - a);
+}
+
+/*
+ *
+ * Global Functions.
+ *
+ */
+bool xcp_correlate_init(uint32_t window)
+{
+    unsigned idx;
+
+    window_ns = (uint64_t)window * 1000000ULL;
+    width = window_ns / (SLOTS - 2);
+    if (width == 0) {
+        width = 1;
+    }
+    entry_capacity = MIN_ENTRIES;
+    entries = malloc(entry_capacity * sizeof(EntryType));
+    if (entries == NULL) {
+        return FALSE;
+    }
+    for (idx = 0; idx < HASH_SIZE; ++idx) {
+        chains[idx] = NONE;
+    }
+    for (idx = 0; idx < SLOTS; ++idx) {
+        slots[idx].sequence = 0;
+        slots[idx].first = NONE;
+    }
+    return TRUE;
+}
+
+void xcp_correlate_frame(unsigned side, uint64_t timestamp, struct canfd_frame const * const frame,
+                         XcpCorrelateType type)
+{
+    uint64_t const key = xcp_log_hash(frame);
+    uint32_t * const chain = &chains[key & (HASH_SIZE - 1)];
+    EntryType * entry;
+    SlotType * slot;
+    uint64_t sequence;
+    uint64_t latency;
+    uint64_t score;
+    uint64_t best = UINT64_MAX;
+    uint32_t match = NONE;
+    uint32_t idx;
+    unsigned first;
+
+    ++frames[side][type];
+    advance(timestamp);
+
+    for (idx = *chain; idx != NONE; idx = entry->next) {
+        entry = &entries[idx];
+        if ((entry->key != key) || (entry->side == side)) {
+            continue;
+        }
+        latency = distance(timestamp, entry->timestamp);
+        if (latency > window_ns) {
+            continue;
+        }
+        first = (timestamp >= entry->timestamp) ? entry->side : side;
+        score = learned[first] ? distance(latency, expected[first]) : entry->timestamp;
+        if (score < best) {
+            best = score;
+            match = idx;
+        }
+    }
+    if (match != NONE) {
+        entry = &entries[match];
+        first = (timestamp >= entry->timestamp) ? entry->side : side;
+        latency = distance(timestamp, entry->timestamp);
+        record(&histograms[first][type], latency);
+        if (learned[first]) {
+            expected[first] += ((int64_t)latency - expected[first]) / MEAN_WEIGHT;
+        } else {
+            expected[first] = latency;
+            learned[first] = TRUE;
+        }
+        unlink_entry(match);
+        entry->matched = TRUE;
+        return;
+    }
+
+    idx = allocate();
+    if (idx == NONE) {
+        ++unmatched[side][type];
+        return;
+    }
+    entry = &entries[idx];
+    entry->key = key;
+    entry->timestamp = timestamp;
+    entry->side = side;
+    entry->type = type;
+    entry->matched = FALSE;
+    entry->prev = NONE;
+    entry->next = *chain;
+    if (*chain != NONE) {
+        entries[*chain].prev = idx;
+    }
+    *chain = idx;
+
+    /* A frame older than the expired buckets, from the other interface, goes into the oldest one. */
+    sequence = timestamp / width;
+    if (sequence < expired) {
+        sequence = expired;
+    }
+    slot = &slots[sequence % SLOTS];
+    if (slot->sequence != sequence) {
+        expire_slot(slot);
+        slot->sequence = sequence;
+    }
+    entry->later = slot->first;
+    slot->first = idx;
+}
+
+void xcp_correlate_flush(void)
+{
+    unsigned idx;
+
+    for (idx = 0; idx < SLOTS; ++idx) {
+        expire_slot(&slots[idx]);
+    }
+}
+
+void xcp_correlate_print(char const * const names[2])
+{
+    HistogramType const * histogram;
+    unsigned side;
+    unsigned type;
+
+    for (side = 0; side < 2; ++side) {
+        for (type = 0; type < XCP_CORRELATE_TYPES; ++type) {
+            histogram = &histograms[side][type];
+            if (histogram->count == 0) {
+                continue;
+            }
+            printf("GATEWAY(%s -> %s, %s, count = %llu", names[side], names[side ^ 1], type_names[type],
+                   (unsigned long long)histogram->count);
+            printf(", min = %.1fus, mean = %.1fus", histogram->min / 1e3, histogram->sum / 1e3 / histogram->count);
+            printf(", p50 = %.1fus, p90 = %.1fus, p99 = %.1fus, max = %.1fus)\n",
+                   percentile(histogram, 500) / 1e3, percentile(histogram, 900) / 1e3,
+                   percentile(histogram, 990) / 1e3, histogram->max / 1e3);
+            print_histogram(histogram);
+        }
+    }
+    for (side = 0; side < 2; ++side) {
+        printf("GATEWAY(only on %s", names[side]);
+        for (type = 0; type < XCP_CORRELATE_TYPES; ++type) {
+            printf(", %s = %llu of %llu", type_names[type], (unsigned long long)unmatched[side][type],
+                   (unsigned long long)frames[side][type]);
+        }
+        printf(")\n");
+    }
+}
@@ -0,0 +1,87 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR BSD-3-Clause) */
+/*
+ * xcpcorrelate.h - match frames seen on two interfaces, gateway latency and loss
+ *
+ * Copyright (c) 2021 Christoph Schueler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <cpu12.gems@googlemail.com>
+ *
+ */
+#ifndef __XCPCORRELATE_H
+#define __XCPCORRELATE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <linux/can.h>
+
+/*
+ * Defines
+ */
+#define XCP_CORRELATE_DEFAULT_WINDOW    (50)    /* ms */
+
+/*
+ * Types
+ */
+typedef enum tagXcpCorrelateType {
+    XCP_CORRELATE_CTO,
+    XCP_CORRELATE_DTO,                  /* DAQ and STIM. */
+    XCP_CORRELATE_TYPES
+} XcpCorrelateType;
+
+/*
+ * Global Functions
+ *
+ */
+bool xcp_correlate_init(uint32_t window);
+
+/*
+ * A frame seen on `side` (0 or 1) at `timestamp` (ns). It is matched with the oldest
+ * unmatched frame of the same identifier and payload on the other side within the
+ * window; a frame not matched within the window was seen on one side only.
+ */
+void xcp_correlate_frame(unsigned side, uint64_t timestamp, struct canfd_frame const * const frame,
+                         XcpCorrelateType type);
+
+/*
+ * Ends the window of all pending frames.
+ */
+void xcp_correlate_flush(void);
+
+void xcp_correlate_print(char const * const names[2]);
+
+#endif /* __XCPCORRELATE_H */
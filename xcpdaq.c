@@ -0,0 +1,866 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR BSD-3-Clause) */
+/*
+ * xcpdaq.c - DAQ configuration tracking and decoding of ODT entries
+ *
+ * Copyright (c) 2021 Christoph Schueler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <cpu12.gems@googlemail.com>
+ *
+ */
+
+#include <endian.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <linux/can.h>
+
+#include "xcp.h"
+#include "xcpsession.h"
+#include "xcpdaq.h"
+
+/*
+ *
+ * Local Types.
+ *
+ */
+typedef struct tagOdtEntryType {
+    uint32_t address;
+    uint8_t addressExtension;
+    uint8_t bitOffset;
+    uint8_t size;               /* In address granules, 0 == unused. */
+} OdtEntryType;
+
+typedef struct tagOdtType {
+    uint8_t entryCount;
+    OdtEntryType entries[XCP_DAQ_MAX_ODT_ENTRIES];
+    uint32_t planGeneration;    /* Configuration generation the plan was compiled for. */
+    bool planValid;
+    XcpDaqPlanType plan;
+} OdtType;
+
+typedef struct tagDaqListType {
+    uint8_t mode;               /* XCP_DAQ_LIST_MODE_* */
+    uint16_t eventChannel;
+    uint8_t prescaler;
+    uint8_t priority;
+    bool selected;
+    bool running;
+    bool pidKnown;
+    uint8_t firstPid;
+    uint16_t odtCount;
+    OdtType * odts;
+    bool sequenceKnown;         /* Expectations for the next DTO of this list. */
+    uint8_t nextOdt;
+    bool counterKnown;
+    uint8_t nextCounter;
+    XcpDaqLossType loss;
+} DaqListType;
+
+typedef struct tagPidMapType {
+    bool valid;
+    uint8_t odt;
+    uint16_t daqList;
+} PidMapType;
+
+
+/*
+ *
+ * Local Variables.
+ *
+ */
+static bool decode_values = FALSE;
+static DaqListType * daq_lists = NULL;
+static uint16_t daq_list_count = 0;
+static uint16_t daq_ptr_list = 0;
+static uint8_t daq_ptr_odt = 0;
+static uint8_t daq_ptr_entry = 0;
+static uint8_t identification_field_type = 0;
+static uint8_t timestamp_size = 0;
+static bool timestamp_fixed = FALSE;
+static uint8_t timestamp_unit = 0;
+static uint16_t timestamp_ticks = 1;
+static bool overload_msb = FALSE;
+static uint64_t overload_events = 0;
+static XcpDaqLossType const * current_loss = NULL;
+
+/*
+ * Bumped on every configuration change, plans and the PID map are rebuilt lazily.
+ */
+static uint32_t generation = 1;
+static uint32_t pid_map_generation = 0;
+static PidMapType pid_map[256];
+
+/*
+ *
+ * Local Functions.
+ *
+ */
+static void daq_response(XcpSessionType const * const session, XcpMessage const * const msg);
+static void free_daq(void);
+static DaqListType * get_daq_list(uint16_t daqList, bool create);
+static OdtType * get_odt(uint16_t daqList, uint8_t odt, bool create);
+static void write_daq(uint8_t bitOffset, uint8_t size, uint8_t ext, uint32_t address);
+static void start_stop_synch(uint8_t mode);
+static void start_list(DaqListType * const list);
+static void check_dto(uint8_t const * const data, uint16_t length);
+static OdtType * identify_dto(uint8_t const * const data, uint16_t length, uint16_t * daqList, uint8_t * odtNumber);
+static inline uint64_t load_entry(uint8_t const * const data, XcpDaqPlanEntryType const * const entry);
+static void rebuild_pid_map(void);
+static bool compile_plan(OdtType * const odt, uint16_t daqList, uint8_t odtNumber);
+
+
+void xcp_daq_set_decode(bool enable)
+{
+    decode_values = enable;
+}
+
+/*
+ * Track the DAQ configuration from confirmed commands.
+ */
+void xcp_daq_update(XcpMessage const * const msg)
+{
+    XcpSessionType const * const session = xcp_session_get();
+    uint8_t const * const data = msg->data;
+
+    current_loss = NULL;
+    if (session->response == 0xff) {
+        daq_response(session, msg);
+    } else if (msg->fromSlave && (msg->length > 0)) {
+        if (data[0] < 0xfc) {
+            check_dto(data, msg->length);
+        } else if ((data[0] == 0xfd) && (msg->length >= 2) && (data[1] == XCP_EV_DAQ_OVERLOAD)) {
+            ++overload_events;
+        }
+    }
+}
+
+static void daq_response(XcpSessionType const * const session, XcpMessage const * const msg)
+{
+    uint8_t const * const req = session->request;
+    uint8_t const * const res = msg->data;
+    uint8_t reqLen = session->requestLength;
+    uint16_t resLen = msg->length;
+    DaqListType * list;
+    OdtType * odt;
+    uint8_t idx;
+
+    switch (req[0]) {
+        case CONNECT:
+        case FREE_DAQ:
+            free_daq();
+            break;
+        case GET_DAQ_PROCESSOR_INFO:
+            if (resLen >= 8) {
+                overload_msb = (res[1] & XCP_DAQ_PROP_OVERLOAD_MSB) ? TRUE : FALSE;
+                identification_field_type = (res[7] & (XCP_DAQ_KEY_IDENTIFICATION_FIELD_TYPE_1 |
+                                                       XCP_DAQ_KEY_IDENTIFICATION_FIELD_TYPE_0)) >> 6;
+                ++generation;
+            }
+            break;
+        case GET_DAQ_RESOLUTION_INFO:
+            if (resLen >= 6) {
+                timestamp_size = res[5] & (DAQ_TIME_STAMP_MODE_SIZE_2 | DAQ_TIME_STAMP_MODE_SIZE_1 |
+                                           DAQ_TIME_STAMP_MODE_SIZE_0);
+                timestamp_fixed = (res[5] & DAQ_TIME_STAMP_MODE_TIMESTAMP_FIXED) ? TRUE : FALSE;
+                timestamp_unit = res[5] >> 4;
+                timestamp_ticks = (resLen >= 8) ? xcp_session_word(session, &res[6]) : 1;
+                ++generation;
+            }
+            break;
+        case ALLOC_DAQ:
+            if (reqLen >= 4) {
+                free_daq();
+                if (xcp_session_word(session, &req[2]) > 0) {
+                    get_daq_list(xcp_session_word(session, &req[2]) - 1, TRUE);
+                }
+            }
+            break;
+        case ALLOC_ODT:
+            if ((reqLen >= 5) && (req[4] > 0)) {
+                get_odt(xcp_session_word(session, &req[2]), req[4] - 1, TRUE);
+            }
+            break;
+        case ALLOC_ODT_ENTRY:
+            if (reqLen >= 6) {
+                odt = get_odt(xcp_session_word(session, &req[2]), req[4], TRUE);
+                if (odt != NULL) {
+                    odt->entryCount = (req[5] < XCP_DAQ_MAX_ODT_ENTRIES) ? req[5] : XCP_DAQ_MAX_ODT_ENTRIES;
+                    ++generation;
+                }
+            }
+            break;
+        case CLEAR_DAQ_LIST:
+            if (reqLen >= 4) {
+                list = get_daq_list(xcp_session_word(session, &req[2]), FALSE);
+                if (list != NULL) {
+                    for (idx = 0; idx < list->odtCount; ++idx) {
+                        memset(list->odts[idx].entries, 0, sizeof(list->odts[idx].entries));
+                    }
+                    list->running = list->selected = list->pidKnown = FALSE;
+                    ++generation;
+                }
+            }
+            break;
+        case SET_DAQ_PTR:
+            if (reqLen >= 6) {
+                daq_ptr_list = xcp_session_word(session, &req[2]);
+                daq_ptr_odt = req[4];
+                daq_ptr_entry = req[5];
+            }
+            break;
+        case WRITE_DAQ:
+            if (reqLen >= 8) {
+                write_daq(req[1], req[2], req[3], xcp_session_dword(session, &req[4]));
+            }
+            break;
+        case WRITE_DAQ_MULTIPLE:
+            for (idx = 0; (idx < req[1]) && ((idx * 8) + 9 < reqLen); ++idx) {
+                write_daq(req[(idx * 8) + 2], req[(idx * 8) + 3], req[(idx * 8) + 8],
+                          xcp_session_dword(session, &req[(idx * 8) + 4]));
+            }
+            break;
+        case SET_DAQ_LIST_MODE:
+            if (reqLen >= 8) {
+                list = get_daq_list(xcp_session_word(session, &req[2]), TRUE);
+                if (list != NULL) {
+                    list->mode = req[1];
+                    list->eventChannel = xcp_session_word(session, &req[4]);
+                    list->prescaler = req[6];
+                    list->priority = req[7];
+                    ++generation;
+                }
+            }
+            break;
+        case GET_DAQ_LIST_MODE:
+            if ((reqLen >= 4) && (resLen >= 8)) {
+                list = get_daq_list(xcp_session_word(session, &req[2]), TRUE);
+                if (list != NULL) {
+                    list->mode = res[1] & (XCP_DAQ_LIST_MODE_TIMESTAMP | XCP_DAQ_LIST_MODE_PID_OFF |
+                                           XCP_DAQ_LIST_MODE_DTO_CTR | XCP_DAQ_LIST_MODE_DIRECTION);
+                    list->running = (res[1] & DAQ_CURRENT_LIST_MODE_RUNNING) ? TRUE : FALSE;
+                    list->eventChannel = xcp_session_word(session, &res[4]);
+                    list->prescaler = res[6];
+                    list->priority = res[7];
+                    ++generation;
+                }
+            }
+            break;
+        case START_STOP_DAQ_LIST:
+            if (reqLen >= 4) {
+                list = get_daq_list(xcp_session_word(session, &req[2]), TRUE);
+                if (list == NULL) {
+                    break;
+                }
+                if (req[1] == 0) {
+                    list->running = FALSE;
+                } else {
+                    if (req[1] == 1) {
+                        start_list(list);
+                    } else {
+                        list->selected = TRUE;
+                    }
+                    if (resLen >= 2) {
+                        list->firstPid = res[1];
+                        list->pidKnown = TRUE;
+                    }
+                }
+                ++generation;
+            }
+            break;
+        case START_STOP_SYNCH:
+            if (reqLen >= 2) {
+                start_stop_synch(req[1]);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static void free_daq(void)
+{
+    uint16_t idx;
+
+    for (idx = 0; idx < daq_list_count; ++idx) {
+        free(daq_lists[idx].odts);
+    }
+    free(daq_lists);
+    daq_lists = NULL;
+    daq_list_count = 0;
+    daq_ptr_list = daq_ptr_odt = daq_ptr_entry = 0;
+    ++generation;
+}
+
+/*
+ * Lists and ODTs are allocated on demand, to cover static DAQ configurations, too.
+ */
+static DaqListType * get_daq_list(uint16_t daqList, bool create)
+{
+    DaqListType * lists;
+
+    if (daqList < daq_list_count) {
+        return &daq_lists[daqList];
+    }
+    if (!create) {
+        return NULL;
+    }
+    lists = realloc(daq_lists, ((size_t)daqList + 1) * sizeof(DaqListType));
+    if (lists == NULL) {
+        return NULL;
+    }
+    memset(&lists[daq_list_count], 0, ((size_t)daqList + 1 - daq_list_count) * sizeof(DaqListType));
+    daq_lists = lists;
+    daq_list_count = daqList + 1;
+    ++generation;
+    return &daq_lists[daqList];
+}
+
+static OdtType * get_odt(uint16_t daqList, uint8_t odt, bool create)
+{
+    DaqListType * list = get_daq_list(daqList, create);
+    OdtType * odts;
+
+    if (list == NULL) {
+        return NULL;
+    }
+    if (odt < list->odtCount) {
+        return &list->odts[odt];
+    }
+    if (!create) {
+        return NULL;
+    }
+    odts = realloc(list->odts, ((size_t)odt + 1) * sizeof(OdtType));
+    if (odts == NULL) {
+        return NULL;
+    }
+    memset(&odts[list->odtCount], 0, ((size_t)odt + 1 - list->odtCount) * sizeof(OdtType));
+    list->odts = odts;
+    list->odtCount = odt + 1;
+    ++generation;
+    return &list->odts[odt];
+}
+
+static void write_daq(uint8_t bitOffset, uint8_t size, uint8_t ext, uint32_t address)
+{
+    OdtType * odt = get_odt(daq_ptr_list, daq_ptr_odt, TRUE);
+    OdtEntryType * entry;
+
+    if ((odt == NULL) || (daq_ptr_entry >= XCP_DAQ_MAX_ODT_ENTRIES)) {
+        return;
+    }
+    entry = &odt->entries[daq_ptr_entry];
+    entry->bitOffset = bitOffset;
+    entry->size = size;
+    entry->addressExtension = ext;
+    entry->address = address;
+    ++daq_ptr_entry;
+    if (odt->entryCount < daq_ptr_entry) {
+        odt->entryCount = daq_ptr_entry;
+    }
+    ++generation;
+}
+
+static void start_stop_synch(uint8_t mode)
+{
+    uint16_t idx;
+
+    for (idx = 0; idx < daq_list_count; ++idx) {
+        switch (mode) {
+            case 0:     /* STOP_ALL         */
+                daq_lists[idx].running = FALSE;
+                break;
+            case 1:     /* START_SELECTED   */
+                if (daq_lists[idx].selected) {
+                    start_list(&daq_lists[idx]);
+                }
+                break;
+            case 2:     /* STOP_SELECTED    */
+                if (daq_lists[idx].selected) {
+                    daq_lists[idx].running = FALSE;
+                }
+                break;
+            default:
+                break;
+        }
+        if (mode != 0) {
+            daq_lists[idx].selected = FALSE;
+        }
+    }
+    ++generation;
+}
+
+static void start_list(DaqListType * const list)
+{
+    list->running = TRUE;
+    list->sequenceKnown = FALSE;
+    list->counterKnown = FALSE;
+}
+
+/*
+ * Loss detection, kept down to a comparison per DTO.
+ *
+ * ODTs of a list have to arrive in sequence, the first ODT of every cycle
+ * carries the DTO counter (behind the identification field) if DTO_CTR
+ * is enabled for the list.
+ */
+static void check_dto(uint8_t const * const data, uint16_t length)
+{
+    static uint8_t const header_sizes[] = {1, 2, 3, 4};
+    DaqListType * list;
+    uint16_t daqList;
+    uint8_t odtNumber;
+    uint8_t lostOdts = 0;
+    uint8_t lostCycles = 0;
+    uint8_t counter;
+    bool overload = FALSE;
+
+    if (identify_dto(data, length, &daqList, &odtNumber) == NULL) {
+        return;
+    }
+    list = &daq_lists[daqList];
+    ++list->loss.dtos;
+    if (overload_msb && (data[0] & 0x80)) {
+        overload = TRUE;
+        ++list->loss.totalOverloads;
+    }
+    if (list->odtCount > 0) {
+        if (list->sequenceKnown && (odtNumber != list->nextOdt)) {
+            lostOdts = (odtNumber + list->odtCount - list->nextOdt) % list->odtCount;
+            list->loss.totalLostOdts += lostOdts;
+            list->loss.expectedOdt = list->nextOdt;
+        }
+        list->sequenceKnown = TRUE;
+        list->nextOdt = (odtNumber + 1) % list->odtCount;
+    }
+    if ((odtNumber == 0) && (list->mode & XCP_DAQ_LIST_MODE_DTO_CTR) &&
+        (length > header_sizes[identification_field_type & 0x03])) {
+        counter = data[header_sizes[identification_field_type & 0x03]];
+        if (list->counterKnown && (counter != list->nextCounter)) {
+            lostCycles = counter - list->nextCounter;
+            list->loss.totalLostCycles += lostCycles;
+        }
+        list->counterKnown = TRUE;
+        list->nextCounter = counter + 1;
+    }
+    if (lostOdts || lostCycles || overload) {
+        list->loss.daqList = daqList;
+        list->loss.eventChannel = list->eventChannel;
+        list->loss.odt = odtNumber;
+        list->loss.lostOdts = lostOdts;
+        list->loss.lostCycles = lostCycles;
+        list->loss.overload = overload;
+        current_loss = &list->loss;
+    }
+}
+
+bool xcp_daq_overload_msb(void)
+{
+    return overload_msb;
+}
+
+/*
+ * Loss revealed by the current frame, if any.
+ */
+XcpDaqLossType const * xcp_daq_loss(void)
+{
+    return current_loss;
+}
+
+void xcp_daq_print_loss(XcpDaqLossType const * const loss)
+{
+    printf("DAQ_LOSS(daqList = %u", loss->daqList);
+    printf(", eventChannel = %u", loss->eventChannel);
+    printf(", odt = %u", loss->odt);
+    if (loss->lostOdts > 0) {
+        printf(", expectedOdt = %u", loss->expectedOdt);
+        printf(", lostOdts = %u", loss->lostOdts);
+    }
+    if (loss->lostCycles > 0) {
+        printf(", lostCycles = %u", loss->lostCycles);
+    }
+    if (loss->overload) {
+        printf(", overload = TRUE");
+    }
+    printf(")");
+}
+
+/*
+ * Totals per DAQ list and per event channel, since the last (re-)configuration.
+ */
+void xcp_daq_print_loss_summary(void)
+{
+    XcpDaqLossType channel;
+    uint16_t idx;
+    uint16_t other;
+    bool first;
+
+    for (idx = 0; idx < daq_list_count; ++idx) {
+        if (daq_lists[idx].loss.dtos == 0) {
+            continue;
+        }
+        printf("DAQ_LOSS_SUMMARY(daqList = %u", idx);
+        printf(", eventChannel = %u", daq_lists[idx].eventChannel);
+        printf(", dtos = %llu", (unsigned long long)daq_lists[idx].loss.dtos);
+        printf(", lostOdts = %llu", (unsigned long long)daq_lists[idx].loss.totalLostOdts);
+        printf(", lostCycles = %llu", (unsigned long long)daq_lists[idx].loss.totalLostCycles);
+        printf(", overloads = %llu", (unsigned long long)daq_lists[idx].loss.totalOverloads);
+        printf(")\n");
+    }
+    for (idx = 0; idx < daq_list_count; ++idx) {
+        if (daq_lists[idx].loss.dtos == 0) {
+            continue;
+        }
+        /* Each event channel is reported at its first list. */
+        first = TRUE;
+        for (other = 0; other < idx; ++other) {
+            if ((daq_lists[other].loss.dtos > 0) && (daq_lists[other].eventChannel == daq_lists[idx].eventChannel)) {
+                first = FALSE;
+                break;
+            }
+        }
+        if (!first) {
+            continue;
+        }
+        memset(&channel, 0, sizeof(channel));
+        for (other = idx; other < daq_list_count; ++other) {
+            if (daq_lists[other].eventChannel == daq_lists[idx].eventChannel) {
+                channel.dtos += daq_lists[other].loss.dtos;
+                channel.totalLostOdts += daq_lists[other].loss.totalLostOdts;
+                channel.totalLostCycles += daq_lists[other].loss.totalLostCycles;
+                channel.totalOverloads += daq_lists[other].loss.totalOverloads;
+            }
+        }
+        printf("DAQ_LOSS_SUMMARY(eventChannel = %u", daq_lists[idx].eventChannel);
+        printf(", dtos = %llu", (unsigned long long)channel.dtos);
+        printf(", lostOdts = %llu", (unsigned long long)channel.totalLostOdts);
+        printf(", lostCycles = %llu", (unsigned long long)channel.totalLostCycles);
+        printf(", overloads = %llu", (unsigned long long)channel.totalOverloads);
+        printf(")\n");
+    }
+    printf("DAQ_LOSS_SUMMARY(overloadEvents = %llu)\n", (unsigned long long)overload_events);
+}
+
+/*
+ * Map the identification field of a DTO to DAQ list and ODT.
+ */
+static OdtType * identify_dto(uint8_t const * const data, uint16_t length, uint16_t * daqList, uint8_t * odtNumber)
+{
+    uint8_t const pid = overload_msb ? (data[0] & 0x7f) : data[0];
+    PidMapType const * entry;
+
+    switch (identification_field_type) {
+        case 0:     /* Absolute ODT number */
+            if (pid_map_generation != generation) {
+                rebuild_pid_map();
+            }
+            entry = &pid_map[pid];
+            if (!entry->valid) {
+                return NULL;
+            }
+            *daqList = entry->daqList;
+            *odtNumber = entry->odt;
+            break;
+        case 1:     /* Relative ODT number, absolute DAQ list number (BYTE) */
+            if (length < 2) {
+                return NULL;
+            }
+            *odtNumber = pid;
+            *daqList = data[1];
+            break;
+        case 2:     /* Relative ODT number, absolute DAQ list number (WORD) */
+            if (length < 3) {
+                return NULL;
+            }
+            *odtNumber = pid;
+            *daqList = xcp_session_word(xcp_session_get(), &data[1]);
+            break;
+        default:    /* Relative ODT number, absolute DAQ list number (WORD, aligned) */
+            if (length < 4) {
+                return NULL;
+            }
+            *odtNumber = pid;
+            *daqList = xcp_session_word(xcp_session_get(), &data[2]);
+            break;
+    }
+    return get_odt(*daqList, *odtNumber, FALSE);
+}
+
+static void rebuild_pid_map(void)
+{
+    uint16_t daqList;
+    uint16_t odt;
+    unsigned pid;
+
+    memset(pid_map, 0, sizeof(pid_map));
+    for (daqList = 0; daqList < daq_list_count; ++daqList) {
+        if (!daq_lists[daqList].pidKnown) {
+            continue;
+        }
+        for (odt = 0; odt < daq_lists[daqList].odtCount; ++odt) {
+            pid = daq_lists[daqList].firstPid + odt;
+            if (pid > 0xfb) {   /* 0xfc..0xff are CTO PIDs. */
+                break;
+            }
+            pid_map[pid].valid = TRUE;
+            pid_map[pid].daqList = daqList;
+            pid_map[pid].odt = odt;
+        }
+    }
+    pid_map_generation = generation;
+}
+
+/*
+ * DAQ list and ODT of a DTO, if the configuration is known.
+ */
+bool xcp_daq_identify(uint8_t const * const data, uint16_t length, uint16_t * daqList, uint8_t * odt)
+{
+    if (length == 0) {
+        return FALSE;
+    }
+    return identify_dto(data, length, daqList, odt) != NULL;
+}
+
+/*
+ * Event channel and prescaler a DAQ list is assigned to.
+ */
+bool xcp_daq_list_event(uint16_t daqList, uint16_t * eventChannel, uint8_t * prescaler)
+{
+    if (daqList >= daq_list_count) {
+        return FALSE;
+    }
+    *eventChannel = daq_lists[daqList].eventChannel;
+    *prescaler = (daq_lists[daqList].prescaler > 0) ? daq_lists[daqList].prescaler : 1;
+    return TRUE;
+}
+
+/*
+ * Seconds per tick of the slave timestamps, from GET_DAQ_RESOLUTION_INFO.
+ */
+double xcp_daq_timestamp_resolution(void)
+{
+    double resolution = 1e-9 * timestamp_ticks;
+    uint8_t unit;
+
+    for (unit = 0; (unit < timestamp_unit) && (unit < 9); ++unit) {
+        resolution *= 10.0;
+    }
+    return resolution;
+}
+
+XcpDaqPlanType const * xcp_daq_lookup_plan(uint8_t const * const data, uint16_t length)
+{
+    OdtType * odt;
+    uint16_t daqList;
+    uint8_t odtNumber;
+
+    if (length == 0) {
+        return NULL;
+    }
+    odt = identify_dto(data, length, &daqList, &odtNumber);
+    if (odt == NULL) {
+        return NULL;
+    }
+    if (odt->planGeneration != generation) {
+        odt->planValid = compile_plan(odt, daqList, odtNumber);
+        odt->planGeneration = generation;
+    }
+    return odt->planValid ? &odt->plan : NULL;
+}
+
+/*
+ * Lay out the ODT entries behind identification field and (optional) timestamp.
+ */
+static bool compile_plan(OdtType * const odt, uint16_t daqList, uint8_t odtNumber)
+{
+    static uint8_t const header_sizes[] = {1, 2, 3, 4};
+    XcpSessionType const * const session = xcp_session_get();
+    DaqListType const * const list = &daq_lists[daqList];
+    OdtEntryType const * entry;
+    unsigned offset = header_sizes[identification_field_type & 0x03];
+    uint8_t idx;
+
+    xcp_daq_plan_init(&odt->plan, daqList, odtNumber);
+    if (list->mode & XCP_DAQ_LIST_MODE_PID_OFF) {
+        return FALSE;
+    }
+    if ((odtNumber == 0) && (list->mode & XCP_DAQ_LIST_MODE_DTO_CTR)) {
+        offset += 1;
+    }
+    if ((odtNumber == 0) && ((list->mode & XCP_DAQ_LIST_MODE_TIMESTAMP) || timestamp_fixed)) {
+        if (timestamp_size == 0) {
+            return FALSE;   /* Timestamp present, but its size was never reported. */
+        }
+        odt->plan.timestampOffset = offset;
+        odt->plan.timestampSize = timestamp_size;
+        offset += timestamp_size;
+    }
+    for (idx = 0; idx < odt->entryCount; ++idx) {
+        entry = &odt->entries[idx];
+        if (entry->size == 0) {
+            continue;
+        }
+        if (!xcp_daq_plan_add(&odt->plan, offset, entry->size * session->addressGranularity,
+                              entry->bitOffset, session->byteOrder == XCP_BYTE_ORDER_MOTOROLA)) {
+            return FALSE;
+        }
+        odt->plan.entries[odt->plan.entryCount - 1].address = entry->address;
+        odt->plan.entries[odt->plan.entryCount - 1].addressExtension = entry->addressExtension;
+        offset += entry->size * session->addressGranularity;
+    }
+    return odt->plan.entryCount > 0;
+}
+
+void xcp_daq_plan_init(XcpDaqPlanType * const plan, uint16_t daqList, uint8_t odt)
+{
+    plan->daqList = daqList;
+    plan->odt = odt;
+    plan->length = 0;
+    plan->timestampOffset = 0;
+    plan->timestampSize = 0;
+    plan->entryCount = 0;
+}
+
+bool xcp_daq_plan_add(XcpDaqPlanType * const plan, uint8_t offset, uint8_t width, uint8_t bit, bool motorola)
+{
+    XcpDaqPlanEntryType * entry;
+    uint8_t idx;
+
+    if ((width != 1) && (width != 2) && (width != 4) && (width != 8)) {
+        return FALSE;
+    }
+    if (((unsigned)offset + width > CANFD_MAX_DLEN) || (plan->entryCount >= XCP_DAQ_MAX_ODT_ENTRIES)) {
+        return FALSE;
+    }
+    if ((bit != XCP_DAQ_NO_BIT) && (bit >= 32)) {
+        return FALSE;
+    }
+    entry = &plan->entries[plan->entryCount++];
+    entry->offset = offset;
+    entry->width = width;
+    entry->bit = (bit != XCP_DAQ_NO_BIT) ? bit % (width * 8) : XCP_DAQ_NO_BIT;
+    entry->bitOffset = bit;
+    entry->motorola = motorola;
+    entry->address = 0;
+    entry->addressExtension = 0;
+    for (idx = 0; idx < sizeof(entry->shuffle); ++idx) {
+        if (idx < width) {
+            entry->shuffle[idx] = motorola ? (width - 1 - idx) : idx;
+        } else {
+            entry->shuffle[idx] = 0x80;
+        }
+    }
+    if (plan->length < offset + width) {
+        plan->length = offset + width;
+    }
+    return TRUE;
+}
+
+/*
+ * Values of the ODT entries of a DTO, if decoding is enabled and the configuration is known.
+ */
+XcpDaqPlanType const * xcp_daq_values(XcpMessage const * const msg, uint64_t * const values)
+{
+    XcpDaqPlanType const * plan;
+    uint8_t idx;
+
+    if (!decode_values) {
+        return NULL;
+    }
+    plan = xcp_daq_lookup_plan(msg->data, msg->length);
+    if ((plan == NULL) || (msg->length < plan->length)) {
+        return NULL;
+    }
+    for (idx = 0; idx < plan->entryCount; ++idx) {
+        values[idx] = load_entry(msg->data, &plan->entries[idx]);
+    }
+    return plan;
+}
+
+bool xcp_daq_print_values(XcpMessage const * const msg)
+{
+    XcpDaqPlanType const * plan;
+    uint64_t values[XCP_DAQ_MAX_ODT_ENTRIES];
+    uint8_t idx;
+
+    plan = xcp_daq_values(msg, values);
+    if (plan == NULL) {
+        return FALSE;
+    }
+    printf("daqList = %u, odt = %u, values = [", plan->daqList, plan->odt);
+    for (idx = 0; idx < plan->entryCount; ++idx) {
+        if (plan->entries[idx].bit != XCP_DAQ_NO_BIT) {
+            printf(" %u", (unsigned)values[idx]);
+        } else {
+            printf(" 0x%0*llx", plan->entries[idx].width * 2, (unsigned long long)values[idx]);
+        }
+    }
+    printf(" ]");
+    return TRUE;
+}
+
+static inline uint64_t load_entry(uint8_t const * const data, XcpDaqPlanEntryType const * const entry)
+{
+    uint8_t const * const ptr = data + entry->offset;
+    uint64_t value;
+    uint32_t dword;
+    uint16_t word;
+
+    switch (entry->width) {
+        case 1:
+            value = *ptr;
+            break;
+        case 2:
+            memcpy(&word, ptr, sizeof(word));
+            value = entry->motorola ? be16toh(word) : le16toh(word);
+            break;
+        case 4:
+            memcpy(&dword, ptr, sizeof(dword));
+            value = entry->motorola ? be32toh(dword) : le32toh(dword);
+            break;
+        default:
+            memcpy(&value, ptr, sizeof(value));
+            value = entry->motorola ? be64toh(value) : le64toh(value);
+            break;
+    }
+    if (entry->bit != XCP_DAQ_NO_BIT) {
+        value = (value >> entry->bit) & 1;
+    }
+    return value;
+}
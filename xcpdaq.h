@@ -0,0 +1,136 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR BSD-3-Clause) */
+/*
+ * xcpdaq.h - DAQ configuration tracking and decoding of ODT entries
+ *
+ * Copyright (c) 2021 Christoph Schueler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <cpu12.gems@googlemail.com>
+ *
+ */
+#ifndef __XCPDAQ_H
+#define __XCPDAQ_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <linux/can.h>
+
+#include "xcp.h"
+#include "xcpsession.h"
+
+/*
+ * Defines
+ */
+#define XCP_DAQ_MAX_ODT_ENTRIES     (CANFD_MAX_DLEN)
+#define XCP_DAQ_NO_BIT              (0xff)
+
+/*
+ * Types
+ */
+
+/*
+ * How to pull a single ODT entry out of a DTO.
+ *
+ * A bit-wise entry stands for bit BIT_OFFSET (0..31) of the 32-bit variable at its
+ * address. The DTO carries the part of that variable holding the bit, `width` bytes,
+ * with the bit in place: `bit` is BIT_OFFSET modulo the width in bits.
+ */
+typedef struct tagXcpDaqPlanEntryType {
+    uint8_t offset;     /* Byte offset within the frame data.                      */
+    uint8_t width;      /* 1, 2, 4 or 8 bytes.                                     */
+    uint8_t bit;        /* Bit position within the entry, else XCP_DAQ_NO_BIT.     */
+    uint8_t bitOffset;  /* BIT_OFFSET as configured, for naming only.              */
+    uint8_t motorola;
+    uint8_t shuffle[8]; /* Byte shuffle for one (up to) 64-bit lane, 0x80 == zero. */
+    uint32_t address;   /* Where the entry came from, for naming only.             */
+    uint8_t addressExtension;
+} XcpDaqPlanEntryType;
+
+/*
+ * Precompiled extraction plan for one ODT.
+ */
+typedef struct tagXcpDaqPlanType {
+    uint16_t daqList;
+    uint8_t odt;
+    uint8_t length;     /* Minimum DTO length covering all entries. */
+    uint8_t timestampOffset;
+    uint8_t timestampSize;  /* Of the slave timestamp in the DTO, 0 == none. */
+    uint8_t entryCount;
+    XcpDaqPlanEntryType entries[XCP_DAQ_MAX_ODT_ENTRIES];
+} XcpDaqPlanType;
+
+/*
+ * Lost DTOs of one DAQ list.
+ */
+typedef struct tagXcpDaqLossType {
+    uint16_t daqList;
+    uint16_t eventChannel;
+    uint8_t odt;                /* The DTO revealing the loss ...                         */
+    uint8_t expectedOdt;        /* ... and the one that should have been there.           */
+    uint8_t lostOdts;           /* Gap in the ODT sequence before this DTO.               */
+    uint8_t lostCycles;         /* Jump of the DTO counter before this DTO.               */
+    bool overload;              /* This DTO carries the overload MSB.                     */
+    uint64_t dtos;
+    uint64_t totalLostOdts;
+    uint64_t totalLostCycles;
+    uint64_t totalOverloads;
+} XcpDaqLossType;
+
+/*
+ * Global Functions
+ *
+ */
+void xcp_daq_update(XcpMessage const * const msg);
+
+bool xcp_daq_overload_msb(void);
+XcpDaqLossType const * xcp_daq_loss(void);
+void xcp_daq_print_loss(XcpDaqLossType const * const loss);
+void xcp_daq_print_loss_summary(void);
+
+void xcp_daq_set_decode(bool enable);
+XcpDaqPlanType const * xcp_daq_lookup_plan(uint8_t const * const data, uint16_t length);
+bool xcp_daq_identify(uint8_t const * const data, uint16_t length, uint16_t * daqList, uint8_t * odt);
+bool xcp_daq_list_event(uint16_t daqList, uint16_t * eventChannel, uint8_t * prescaler);
+double xcp_daq_timestamp_resolution(void);
+XcpDaqPlanType const * xcp_daq_values(XcpMessage const * const msg, uint64_t * const values);
+bool xcp_daq_print_values(XcpMessage const * const msg);
+
+void xcp_daq_plan_init(XcpDaqPlanType * const plan, uint16_t daqList, uint8_t odt);
+bool xcp_daq_plan_add(XcpDaqPlanType * const plan, uint8_t offset, uint8_t width, uint8_t bit, bool motorola);
+
+#endif /* __XCPDAQ_H */
@@ -0,0 +1,165 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR BSD-3-Clause) */
+/*
+ * xcpdedup.c - suppression of duplicated frames
+ *
+ * Copyright (c) 2021 Christoph Schueler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <cpu12.gems@googlemail.com>
+ *
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "xcp.h"
+#include "xcpdedup.h"
+#include "xcplog.h"
+
+/*
+ * The frames of the last window are remembered by a fingerprint of identifier and
+ * payload in a fixed set-associative table, with the paths each has come in on. A copy
+ * is told from a repetition by its path: XCP repeats identical frames (positive
+ * responses, constant DTOs) far more often than any window short enough to be useful,
+ * but never on two paths at once.
+ *
+ * A new fingerprint replaces the oldest one of its set; when a set overflows within
+ * the window, a copy may pass, but no frame is dropped for a fingerprint it does not
+ * have.
+ */
+
+/*
+ *
+ * Local Constants.
+ *
+ */
+#define SET_BITS        (10)
+#define SETS            (1U << SET_BITS)
+#define WAYS            (4)
+
+/*
+ *
+ * Local Types.
+ *
+ */
+typedef struct tagEntryType {
+    uint64_t fingerprint;
+    uint64_t timestamp;                     /* us, 0 for unused. */
+    uint32_t paths;                         /* Bit per path the frame came in on. */
+} EntryType;
+
+/*
+ *
+ * Local Variables.
+ *
+ */
+static EntryType table[SETS][WAYS];
+static uint64_t window_us = XCP_DEDUP_DEFAULT_WINDOW;
+static uint64_t frames = 0;
+static uint64_t duplicates = 0;
+static int path_ifindex[XCP_DEDUP_MAX_PATHS / 2];
+static unsigned path_count = 0;
+
+/*
+ *
+ * Global Functions.
+ *
+ */
+void xcp_dedup_init(uint32_t window)
+{
+    memset(table, 0, sizeof(table));
+    window_us = window;
+    frames = 0;
+    duplicates = 0;
+    path_count = 0;
+}
+
+unsigned xcp_dedup_path(int ifindex, bool loopback)
+{
+    unsigned idx;
+
+    for (idx = 0; idx < path_count; ++idx) {
+        if (path_ifindex[idx] == ifindex) {
+            break;
+        }
+    }
+    if (idx == path_count) {
+        if (path_count == XCP_DEDUP_MAX_PATHS / 2) {
+            return XCP_DEDUP_MAX_PATHS - 1;
+        }
+        path_ifindex[path_count++] = ifindex;
+    }
+    return (idx * 2) + (loopback ? 1 : 0);
+}
+
+bool xcp_dedup_check(struct canfd_frame const * const frame, struct timeval const * const tv,
+                     unsigned path)
+{
+    uint64_t key = xcp_log_hash(frame);
+    uint64_t now = (uint64_t)tv->tv_sec * 1000000 + tv->tv_usec + 1;
+    uint32_t bit = 1U << (path & (XCP_DEDUP_MAX_PATHS - 1));
+    EntryType * set = table[key & (SETS - 1)];
+    EntryType * entry = &set[0];
+    unsigned way;
+
+    ++frames;
+    for (way = 0; way < WAYS; ++way) {
+        if ((set[way].timestamp != 0) && (set[way].fingerprint == key)) {
+            entry = &set[way];
+            if ((now >= entry->timestamp) && ((now - entry->timestamp) < window_us) && !(entry->paths & bit)) {
+                entry->paths |= bit;
+                ++duplicates;
+                return TRUE;
+            }
+            break;                          /* Repeated on its own path, or a new frame after the window. */
+        }
+        if (set[way].timestamp < entry->timestamp) {
+            entry = &set[way];
+        }
+    }
+    entry->fingerprint = key;
+    entry->timestamp = now;
+    entry->paths = bit;
+    return FALSE;
+}
+
+void xcp_dedup_print(char const * ifname)
+{
+    fprintf(stderr, "DEDUP(%s, removed = %llu of %llu frames, window = %lluus)\n", ifname,
+            (unsigned long long)duplicates, (unsigned long long)frames, (unsigned long long)window_us);
+}
@@ -0,0 +1,82 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR BSD-3-Clause) */
+/*
+ * xcpdedup.h - suppression of duplicated frames
+ *
+ * Copyright (c) 2021 Christoph Schueler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <cpu12.gems@googlemail.com>
+ *
+ */
+#ifndef __XCPDEDUP_H
+#define __XCPDEDUP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/time.h>
+
+#include <linux/can.h>
+
+/*
+ * Defines
+ */
+#define XCP_DEDUP_DEFAULT_WINDOW    (1000)  /* us */
+#define XCP_DEDUP_MAX_PATHS         (32)
+
+/*
+ * Global Functions
+ *
+ */
+void xcp_dedup_init(uint32_t window);
+
+/*
+ * Numbers the paths a frame can come in on, i.e. the receiving interface and whether
+ * the frame is the local loopback of a transmission, from 0 on. Paths beyond the
+ * maximum share the last number.
+ */
+unsigned xcp_dedup_path(int ifindex, bool loopback);
+
+/*
+ * Returns TRUE if a frame with the same identifier and payload came in on another
+ * path less than `window` us before `tv`, i.e. `frame` is its copy. Each path passes
+ * one copy of a frame; a frame repeated on the same path is always passed.
+ */
+bool xcp_dedup_check(struct canfd_frame const * const frame, struct timeval const * const tv,
+                     unsigned path);
+
+void xcp_dedup_print(char const * ifname);
+
+#endif /* __XCPDEDUP_H */
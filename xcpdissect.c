@@ -52,6 +52,8 @@
 #include <linux/can.h>
 
 #include "xcp.h"
+#include "xcpdaq.h"
+#include "xcpchecksum.h"
 
 /*
  *
@@ -60,13 +62,13 @@
  */
 
 /*
- * Get n-th byte from CAN frame.
+ * Get n-th byte of the XCP packet.
  *
  * Note: By convention, this function-like macro requires a variable called `msg` of type `XcpMessage`.
  */
-#define MSG_BYTE(n)             (msg->frame->data[(n)])
+#define MSG_BYTE(n)             (msg->data[(n)])
 
-#define MSG_FRAME_LEN()         (msg->frame->len)
+#define MSG_FRAME_LEN()         (msg->length)
 
 #define MSG_BOOL(idx, mask)     ((MSG_BYTE((idx)) & (mask)) ? "TRUE" : "FALSE")
 
@@ -192,15 +194,29 @@ void print_xcp_message(XcpMessage const * const msg, bool dtos)
 {
     include_dtos = dtos;
 
-    if (msg->frame->can_id == CanIds.src) {
-        print_xcp_request(msg);
-    } else if (msg->frame->can_id == CanIds.dst) {
+    if ((msg->frame != NULL) && (msg->frame->can_id != CanIds.src) && (msg->frame->can_id != CanIds.dst)) {
+        hexdump_xcp_message(msg, 0);
+    } else if (msg->fromSlave) {
         print_xcp_response(msg);
     } else {
-        hexdump_xcp_message(msg, 0);
+        print_xcp_request(msg);
     }
 }
 
+/*
+ * View a CAN frame as XCP packet, `src` and `dst` have to be set already.
+ */
+void xcp_message_from_frame(XcpMessage * const msg, struct canfd_frame * const frame, struct timeval const * const tv)
+{
+    msg->frame = frame;
+    msg->data = frame->data;
+    msg->length = frame->len;
+    msg->fromSlave = (frame->can_id == msg->dst);
+    msg->transport = XCP_TRANSPORT_CAN;
+    msg->ctr = 0;
+    msg->timestamp = *tv;
+}
+
 /*
  *  Print message content as HEX bytes.
  *
@@ -209,12 +225,12 @@ static void hexdump_xcp_message(XcpMessage const * const msg, uint16_t offset)
 {
     unsigned idx;
 
-    if ((msg->frame->len - offset) == 0) {
+    if ((msg->length - offset) == 0) {
         return;
     }
 
     printf("[ ");
-    for (idx = offset; idx < msg->frame->len; ++idx) {
+    for (idx = offset; idx < msg->length; ++idx) {
             printf("%02X ", MSG_BYTE(idx));
     }
     printf("]");
@@ -321,8 +337,17 @@ static void print_xcp_response(XcpMessage const * const msg)
             hexdump_xcp_message(msg, 1);
             break;
         default:
-            printf("DTO(pid = %u, ", code); /* we assume absolute ODT number in case of CAN. */
-            hexdump_xcp_message(msg, 1);
+            if (xcp_daq_overload_msb()) {
+                printf("DTO(pid = %u, ", code & 0x7f); /* we assume absolute ODT number in case of CAN. */
+                if (code & 0x80) {
+                    printf("overload = TRUE, ");
+                }
+            } else {
+                printf("DTO(pid = %u, ", code); /* we assume absolute ODT number in case of CAN. */
+            }
+            if (!xcp_daq_print_values(msg)) {
+                hexdump_xcp_message(msg, 1);
+            }
             printf(")");
             break;
     }
@@ -822,6 +847,8 @@ static uint16_t print_requested_service(XcpMessage const * const msg)
 
 static void print_xcp_positive_response(XcpMessage const * const msg)
 {
+    uint32_t checksum;
+
     switch (service_request) {
         case CONNECT:
             printf("(");
@@ -891,6 +918,16 @@ static void print_xcp_positive_response(XcpMessage const * const msg)
             printf("(");
             print_checksum_method(MSG_BYTE(1));
             printf(", checksum = 0x%08x", MSG_DWORD(4));
+            switch (xcp_checksum_verdict(&checksum)) {
+                case XCP_CHECKSUM_MATCH:
+                    printf(", verified = TRUE");
+                    break;
+                case XCP_CHECKSUM_MISMATCH:
+                    printf(", verified = FALSE, computed = 0x%08x", checksum);
+                    break;
+                default:
+                    break;
+            }
             printf(")");
             break;
         case TRANSPORT_LAYER_CMD:
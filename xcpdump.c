@@ -63,6 +63,9 @@
 #include <libgen.h>
 #include <time.h>
 #include <strings.h>
+#include <signal.h>
+#include <errno.h>
+#include <getopt.h>
 
 #include <net/if.h>
 #include <sys/types.h>
@@ -75,23 +78,223 @@
 #include "terminal.h"
 
 #include "xcp.h"
+#include "xcpsession.h"
+#include "xcpdaq.h"
+#include "xcptransfer.h"
+#include "xcpshadow.h"
+#include "xcpchecksum.h"
+#include "xcppgm.h"
+#include "xcpstats.h"
+#include "xcptrigger.h"
+#include "xcpfilter.h"
+#include "xcpshm.h"
+#include "xcpformat.h"
+#include "xcpmdf.h"
+#include "xcpprof.h"
+#include "xcptiming.h"
+#include "xcpbus.h"
+#include "xcpdedup.h"
+#include "xcpchange.h"
+#include "xcpshed.h"
 
 #define NO_CAN_ID 0xFFFFFFFFU
 
+/* long only options */
+#define OPT_STATS    256
+#define OPT_BITRATE  257
+#define OPT_DBITRATE 258
+#define OPT_TRIGGER  259
+#define OPT_PRE      260
+#define OPT_POST     261
+#define OPT_RING     262
+#define OPT_PUBLISH  263
+#define OPT_FORMAT   264
+#define OPT_MDF      265
+#define OPT_MDF_DEFLATE 266
+#define OPT_WINDOW   267
+#define OPT_DEDUP    268
+#define OPT_DEDUP_MARK 269
+#define OPT_ON_CHANGE 270
+#define OPT_SHED     271
+
 const int canfd_on = 1;
+const int timestamp_on = 1;
+const int dropmonitor_on = 1;
+
+static struct option const long_options[] = {
+        { "stats",    optional_argument, NULL, OPT_STATS },
+        { "bitrate",  required_argument, NULL, OPT_BITRATE },
+        { "dbitrate", required_argument, NULL, OPT_DBITRATE },
+        { "trigger",  required_argument, NULL, OPT_TRIGGER },
+        { "pre",      required_argument, NULL, OPT_PRE },
+        { "post",     required_argument, NULL, OPT_POST },
+        { "ring",     required_argument, NULL, OPT_RING },
+        { "publish",  required_argument, NULL, OPT_PUBLISH },
+        { "format",   required_argument, NULL, OPT_FORMAT },
+        { "mdf",      required_argument, NULL, OPT_MDF },
+        { "mdf-deflate", no_argument,    NULL, OPT_MDF_DEFLATE },
+        { "window",   required_argument, NULL, OPT_WINDOW },
+        { "dedup",    optional_argument, NULL, OPT_DEDUP },
+        { "dedup-mark", no_argument,     NULL, OPT_DEDUP_MARK },
+        { "on-change", optional_argument, NULL, OPT_ON_CHANGE },
+        { "shed",     optional_argument, NULL, OPT_SHED },
+        { NULL, 0, NULL, 0 }
+};
+
+static volatile sig_atomic_t running = 1;
+static volatile sig_atomic_t checkpoint = 0;
+
+static void sigterm(int signo)
+{
+        running = 0;
+}
+
+static void sigcheckpoint(int signo)
+{
+        checkpoint = 1;
+}
+
+static void print_shadow_diff(XcpShadowSnapshotType **since)
+{
+        xcp_shadow_diff(*since, NULL);
+        fflush(stdout);
+        xcp_shadow_release(*since);
+        *since = xcp_shadow_snapshot();
+}
 
 
 void print_usage(char *prg)
 {
-        fprintf(stderr, "\nUsage: %s [options] <CAN interface>\n", prg);
+        fprintf(stderr, "\nUsage: %s [options] <CAN interface> [<CAN interface> ...]\n", prg);
         fprintf(stderr, "Options:\n");
         fprintf(stderr, "         -m <can_id>  (XCP master can_id. Use 8 digits for extended IDs)\n");
         fprintf(stderr, "         -s <can_id>  (XCP slave can_id. Use 8 digits for extended IDs)\n");
         fprintf(stderr, "         -d           (include DTOs)\n");
+        fprintf(stderr, "         -v           (decode DTO values from the observed DAQ configuration)\n");
+        fprintf(stderr, "         -T           (summarize UPLOAD/DOWNLOAD/PROGRAM sequences as one transfer each)\n");
+        fprintf(stderr, "         -M <file>    (dump the observed slave memory on exit, Intel HEX or S-Record by suffix)\n");
+        fprintf(stderr, "         -D           (print memory changes on SIGUSR2 and on exit)\n");
+        fprintf(stderr, "         -K           (verify BUILD_CHECKSUM results against the observed memory)\n");
+        fprintf(stderr, "         -P           (summarize flash programming sessions per sector)\n");
+        fprintf(stderr, "         -L           (report lost DTOs, from ODT sequence gaps, DTO counters and overload flags)\n");
+        fprintf(stderr, "         -J           (report period, jitter and missed cycles per event channel on exit)\n");
+        fprintf(stderr, "         -f <expr>    (display filter, e.g. 'service == SHORT_UPLOAD && addr in 0x7000..0x70FF')\n");
         fprintf(stderr, "         -c           (color mode)\n");
 //        fprintf(stderr, "         -a           (print data also in ASCII-chars)\n");
         fprintf(stderr, "         -t <type>    (timestamp: (a)bsolute/(d)elta/(z)ero/(A)bsolute w date)\n");
+        fprintf(stderr, "         --stats[=<ms>]     (no output per frame, redraw statistics every <ms>, default %u)\n",
+                XCP_STATS_DEFAULT_INTERVAL);
+        fprintf(stderr, "         --bitrate=<bps>    (nominal bit rate for the bus load estimate, default %u)\n",
+                XCP_STATS_DEFAULT_BITRATE);
+        fprintf(stderr, "         --dbitrate=<bps>   (CAN FD data bit rate, default nominal bit rate)\n");
+        fprintf(stderr, "         --trigger=<cond>   (buffer silently, print only around error, terminated, overload,\n");
+        fprintf(stderr, "                             pattern=<hex>[/<mask>]; comma separated;\n");
+        fprintf(stderr, "                             not with -T, -M, -D, -K, -P, -L, -J, --stats, --publish, --mdf)\n");
+        fprintf(stderr, "         --pre=<n>[ms|s]    (frames or time before a trigger, default %u frames)\n",
+                XCP_TRIGGER_DEFAULT_PRE);
+        fprintf(stderr, "         --post=<n>[ms|s]   (frames or time after a trigger, default %u frames)\n",
+                XCP_TRIGGER_DEFAULT_POST);
+        fprintf(stderr, "         --ring=<frames>    (pre-trigger ring buffer size, default %u)\n",
+                XCP_TRIGGER_DEFAULT_CAPACITY);
+        fprintf(stderr, "         --publish=<name>   (publish every message to the shared-memory ring /dev/shm/<name>)\n");
+        fprintf(stderr, "         --format=<fmt>     (text, jsonl or csv; -T, -P, -L and -J apply to text only)\n");
+        fprintf(stderr, "         --mdf=<file>       (record the decoded DAQ lists into an MDF4 file)\n");
+        fprintf(stderr, "         --mdf-deflate      (compress the MDF4 data blocks%s)\n",
+                xcp_mdf_deflate_available() ? "" : ", needs make ZLIB=1");
+        fprintf(stderr, "         --window=<ms>      (reorder window merging several interfaces, default %u)\n",
+                XCP_BUS_DEFAULT_WINDOW);
+        fprintf(stderr, "         --dedup[=<us>]     (drop copies coming in on another path within <us>, default %u)\n",
+                XCP_DEDUP_DEFAULT_WINDOW);
+        fprintf(stderr, "         --dedup-mark       (print the copies marked DUPLICATE instead, text output only)\n");
+        fprintf(stderr, "         --on-change[=<ms>] (print DTOs only on a change of their entries, keep-alive every <ms>, default %u)\n",
+                XCP_CHANGE_DEFAULT_INTERVAL);
+        fprintf(stderr, "         --shed[=<ms>]      (print less while the output lags behind by <ms>, report drops, default %u)\n",
+                XCP_SHED_DEFAULT_THRESHOLD);
         fprintf(stderr, "\nCAN IDs and addresses are given and expected as hexadecimal values.\n");
+        fprintf(stderr, "With --dedup, 'any' receives all interfaces, copies on another interface or looped back are dropped.\n");
+        fprintf(stderr, "Several interfaces are dissected in parallel, one process each, output in timestamp order.\n");
+}
+
+void print_timestamp(int timestamp, struct timeval const * tv, struct timeval * last_tv)
+{
+        switch (timestamp) {
+
+        case 'a': /* absolute with timestamp */
+                printf("(%ld.%06ld) ", tv->tv_sec, tv->tv_usec);
+                break;
+
+        case 'A': /* absolute with date */
+        {
+                struct tm tm;
+                char timestring[25];
+
+                tm = *localtime(&tv->tv_sec);
+                strftime(timestring, 24, "%Y-%m-%d %H:%M:%S", &tm);
+                printf("(%s.%06ld) ", timestring, tv->tv_usec);
+        }
+        break;
+
+        case 'd': /* delta */
+        case 'z': /* starting with zero */
+        {
+                struct timeval diff;
+
+                if (last_tv->tv_sec == 0)   /* first init */
+                        *last_tv = *tv;
+                diff.tv_sec  = tv->tv_sec  - last_tv->tv_sec;
+                diff.tv_usec = tv->tv_usec - last_tv->tv_usec;
+                if (diff.tv_usec < 0)
+                        diff.tv_sec--, diff.tv_usec += 1000000;
+                if (diff.tv_sec < 0)
+                        diff.tv_sec = diff.tv_usec = 0;
+                printf("(%ld.%06ld) ", diff.tv_sec, diff.tv_usec);
+
+                if (timestamp == 'd')
+                        *last_tv = *tv; /* update for delta calculation */
+        }
+        break;
+
+        default: /* no timestamp output */
+                break;
+        }
+}
+
+void print_transfer(XcpTransferType const * transfer, char const * ifname, int timestamp,
+                    struct timeval * last_tv)
+{
+        print_timestamp(timestamp, &transfer->start, last_tv);
+        printf(" %s  ", ifname);
+        xcp_transfer_print(transfer);
+        printf("\n");
+        fflush(stdout);
+}
+
+void print_duplicate(struct canfd_frame const * frame, struct timeval const * tv, char const * ifname,
+                     int timestamp, struct timeval * last_tv)
+{
+        int i;
+
+        print_timestamp(timestamp, tv, last_tv);
+        if (frame->can_id & CAN_EFF_FLAG)
+                printf(" %s  %8X", ifname, frame->can_id & CAN_EFF_MASK);
+        else
+                printf(" %s  %3X", ifname, frame->can_id & CAN_SFF_MASK);
+        printf("  [%d]  DUPLICATE ", frame->len);
+        for (i = 0; i < frame->len; i++) {
+                printf(" %02X", frame->data[i]);
+        }
+        printf("\n");
+        fflush(stdout);
+}
+
+void print_pgm(XcpPgmSessionType const * pgm, char const * ifname, int timestamp,
+               struct timeval * last_tv)
+{
+        print_timestamp(timestamp, &pgm->start, last_tv);
+        printf(" %s  ", ifname);
+        xcp_pgm_print(pgm);
+        printf("\n");
+        fflush(stdout);
 }
 
 
@@ -99,8 +302,14 @@ int main(int argc, char **argv)
 {
         int s;
         struct sockaddr_can addr;
+        struct sockaddr_can from;
         struct can_filter rfilter[2];
         struct canfd_frame frame;
+        struct iovec iov;
+        struct msghdr msg;
+        struct cmsghdr *cmsg;
+        struct sigaction sa;
+        char ctrlmsg[CMSG_SPACE(sizeof(struct timeval)) + CMSG_SPACE(sizeof(uint32_t))];
         int nbytes, i;
         canid_t src = NO_CAN_ID;
         canid_t dst = NO_CAN_ID;
@@ -115,15 +324,51 @@ int main(int argc, char **argv)
         int timestamp = 0;
         int datidx = 0;
         int dtos = 0;
+        int transfers = 0;
+        int programming = 0;
+        int losses = 0;
+        int jitter = 0;
+        int checksums = 0;
+        int trigger = 0;
+        int filter = 0;
+        XCP_PROF_DECLARE;
+        int replayed;
+        unsigned ring = XCP_TRIGGER_DEFAULT_CAPACITY;
+        unsigned stats = 0;
+        uint32_t bitrate = XCP_STATS_DEFAULT_BITRATE;
+        uint32_t dbitrate = 0;
+        uint64_t now_ms, redraw_ms = 0;
+        struct timespec now;
+        struct timeval rcvtimeo;
+        bool absorbed;
         struct timeval tv, last_tv;
         int opt;
         XcpMessage message;
         CanIdType CanIds;
+        XcpTransferType const *transfer;
+        XcpPgmSessionType const *pgm;
+        XcpDaqLossType const *loss;
+        XcpShadowSnapshotType *since = NULL;
+        char *shadowfile = NULL;
+        char *publish = NULL;
+        char *mdf = NULL;
+        int mdf_deflate = 0;
+        int format = 0;
+        uint64_t fields[XCP_FIELD_COUNT];
+        int diffs = 0;
+        int bus = -1;
+        unsigned window = XCP_BUS_DEFAULT_WINDOW;
+        unsigned dedup = 0;
+        int dedup_mark = 0;
+        unsigned onchange = 0;
+        unsigned shed = 0;
+        uint32_t dropped = 0;
+        char *ifname;
 
         last_tv.tv_sec  = 0;
         last_tv.tv_usec = 0;
 
-        while ((opt = getopt(argc, argv, "m:s:adct:?")) != -1) {
+        while ((opt = getopt_long(argc, argv, "m:s:adcvTM:DKPLJf:t:?", long_options, NULL)) != -1) {
                 switch (opt) {
                 case 'm':
                         dst = strtoul(optarg, (char **)NULL, 16);
@@ -145,6 +390,49 @@ int main(int argc, char **argv)
                         color = 1;
                         break;
 
+                case 'v':
+                        xcp_daq_set_decode(TRUE);
+                        break;
+
+                case 'T':
+                        transfers = 1;
+                        break;
+
+                case 'M':
+                        shadowfile = optarg;
+                        xcp_shadow_enable();
+                        break;
+
+                case 'D':
+                        diffs = 1;
+                        xcp_shadow_enable();
+                        break;
+
+                case 'K':
+                        checksums = 1;
+                        xcp_shadow_enable();
+                        break;
+
+                case 'P':
+                        programming = 1;
+                        break;
+
+                case 'L':
+                        losses = 1;
+                        break;
+
+                case 'J':
+                        jitter = 1;
+                        break;
+
+                case 'f':
+                        if (!xcp_filter_compile(optarg)) {
+                                fprintf(stderr, "filter: %s\n", xcp_filter_error());
+                                exit(1);
+                        }
+                        filter = 1;
+                        break;
+
                 case 'a':
                         asc = 1;
                         break;
@@ -157,6 +445,94 @@ int main(int argc, char **argv)
                                 timestamp = 0;
                         }
                         break;
+                case OPT_STATS:
+                        stats = optarg ? strtoul(optarg, NULL, 10) : XCP_STATS_DEFAULT_INTERVAL;
+                        if (stats == 0)
+                                stats = XCP_STATS_DEFAULT_INTERVAL;
+                        break;
+
+                case OPT_BITRATE:
+                        bitrate = strtoul(optarg, NULL, 10);
+                        break;
+
+                case OPT_DBITRATE:
+                        dbitrate = strtoul(optarg, NULL, 10);
+                        break;
+
+                case OPT_TRIGGER:
+                        if (!xcp_trigger_add(optarg)) {
+                                fprintf(stderr, "invalid trigger '%s'\n", optarg);
+                                exit(1);
+                        }
+                        trigger = 1;
+                        break;
+
+                case OPT_PRE:
+                        if (!xcp_trigger_set_pre(optarg)) {
+                                fprintf(stderr, "invalid pre-trigger window '%s'\n", optarg);
+                                exit(1);
+                        }
+                        break;
+
+                case OPT_POST:
+                        if (!xcp_trigger_set_post(optarg)) {
+                                fprintf(stderr, "invalid post-trigger window '%s'\n", optarg);
+                                exit(1);
+                        }
+                        break;
+
+                case OPT_RING:
+                        ring = strtoul(optarg, NULL, 10);
+                        break;
+
+                case OPT_PUBLISH:
+                        publish = optarg;
+                        break;
+
+                case OPT_FORMAT:
+                        if (!xcp_format_select(optarg)) {
+                                fprintf(stderr, "unknown output format '%s'\n", optarg);
+                                exit(1);
+                        }
+                        format = (xcp_format_get() != XCP_FORMAT_TEXT);
+                        break;
+
+                case OPT_MDF:
+                        mdf = optarg;
+                        break;
+
+                case OPT_MDF_DEFLATE:
+                        mdf_deflate = 1;
+                        break;
+
+                case OPT_WINDOW:
+                        window = strtoul(optarg, NULL, 10);
+                        break;
+
+                case OPT_DEDUP:
+                        dedup = optarg ? strtoul(optarg, NULL, 10) : XCP_DEDUP_DEFAULT_WINDOW;
+                        if (dedup == 0)
+                                dedup = XCP_DEDUP_DEFAULT_WINDOW;
+                        break;
+
+                case OPT_ON_CHANGE:
+                        onchange = optarg ? strtoul(optarg, NULL, 10) : XCP_CHANGE_DEFAULT_INTERVAL;
+                        if (onchange == 0)
+                                onchange = XCP_CHANGE_DEFAULT_INTERVAL;
+                        break;
+
+                case OPT_SHED:
+                        shed = optarg ? strtoul(optarg, NULL, 10) : XCP_SHED_DEFAULT_THRESHOLD;
+                        if (shed == 0)
+                                shed = XCP_SHED_DEFAULT_THRESHOLD;
+                        break;
+
+                case OPT_DEDUP_MARK:
+                        dedup_mark = 1;
+                        if (dedup == 0)
+                                dedup = XCP_DEDUP_DEFAULT_WINDOW;
+                        break;
+
                 case '?':
                         print_usage(basename(argv[0]));
                         exit(0);
@@ -179,11 +555,44 @@ int main(int argc, char **argv)
                 exit(0);
         }
 
-        if ((argc - optind) != 1 || src == NO_CAN_ID || dst == NO_CAN_ID) {
+        if ((argc - optind) < 1 || (argc - optind) > XCP_BUS_MAX || src == NO_CAN_ID || dst == NO_CAN_ID) {
                 print_usage(basename(argv[0]));
                 exit(0);
         }
 
+        /* frames buffered outside the windows never reach the analyzers */
+        if (trigger && (transfers || shadowfile || diffs || checksums || programming || losses || jitter ||
+                        stats || publish || mdf)) {
+                fprintf(stderr, "--trigger can't be combined with -T, -M, -D, -K, -P, -L, -J, --stats, --publish or --mdf\n");
+                exit(1);
+        }
+
+        if ((argc - optind) > 1) {
+                /* these write one screen or file, not one per bus */
+                if (stats || publish || mdf || shadowfile) {
+                        fprintf(stderr, "--stats, --publish, --mdf and -M take a single interface\n");
+                        exit(1);
+                }
+                /* copies from different buses never meet in one worker */
+                if (dedup) {
+                        fprintf(stderr, "--dedup takes a single interface, 'any' for copies across interfaces\n");
+                        exit(1);
+                }
+                if (format) {
+                        xcp_format_set_bus(argv[optind]);
+                        xcp_format_header(stdout);
+                }
+                if (!xcp_bus_spawn(argc - optind, &bus)) {
+                        perror("fork");
+                        return 1;
+                }
+                if (bus < 0)
+                        return xcp_bus_merge(&argv[optind], window);
+        }
+        ifname = argv[optind + ((bus < 0) ? 0 : bus)];
+        if (bus >= 0)
+                xcp_format_set_bus(ifname);
+
         if ((s = socket(PF_CAN, SOCK_RAW, CAN_RAW)) < 0) {
                 perror("socket");
                 return 1;
@@ -192,6 +601,13 @@ int main(int argc, char **argv)
         /* try to switch the socket into CAN FD mode */
         setsockopt(s, SOL_CAN_RAW, CAN_RAW_FD_FRAMES, &canfd_on, sizeof(canfd_on));
 
+        /* the analyzers need the receive time of every frame, not only with -t */
+        setsockopt(s, SOL_SOCKET, SO_TIMESTAMP, &timestamp_on, sizeof(timestamp_on));
+
+        /* frames dropped for a full receive queue, to be reported instead of lost silently */
+        if (shed)
+                setsockopt(s, SOL_SOCKET, SO_RXQ_OVFL, &dropmonitor_on, sizeof(dropmonitor_on));
+
         if (src & CAN_EFF_FLAG) {
                 rfilter[0].can_id   = src & (CAN_EFF_MASK | CAN_EFF_FLAG);
                 rfilter[0].can_mask = (CAN_EFF_MASK|CAN_EFF_FLAG|CAN_RTR_FLAG);
@@ -211,16 +627,120 @@ int main(int argc, char **argv)
         setsockopt(s, SOL_CAN_RAW, CAN_RAW_FILTER, &rfilter, sizeof(rfilter));
 
         addr.can_family = AF_CAN;
-        addr.can_ifindex = if_nametoindex(argv[optind]);
+        addr.can_ifindex = if_nametoindex(ifname);
 
         if (bind(s, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
                 perror("bind");
                 return 1;
         }
 
-        while (1) {
-                nbytes = read(s, &frame, sizeof(frame));
+        /* no SA_RESTART, a blocking recvmsg() has to return on termination */
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = sigterm;
+        sigaction(SIGINT, &sa, NULL);
+        sigaction(SIGTERM, &sa, NULL);
+        sigaction(SIGHUP, &sa, NULL);
+        if (diffs) {
+                since = xcp_shadow_snapshot();
+                sa.sa_handler = sigcheckpoint;
+                sigaction(SIGUSR2, &sa, NULL);
+        }
+
+        if (stats) {
+                /* wake up for redraws on an idle bus as well */
+                rcvtimeo.tv_sec = stats / 1000;
+                rcvtimeo.tv_usec = (stats % 1000) * 1000;
+                setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &rcvtimeo, sizeof(rcvtimeo));
+                xcp_stats_set_bitrate(bitrate ? bitrate : XCP_STATS_DEFAULT_BITRATE, dbitrate);
+                printf("%s", CSR_HIDE);
+        }
+
+        if (format) {
+                /* the summaries are text, keep the output machine-readable */
+                transfers = programming = losses = jitter = 0;
+                if (bus < 0)
+                        xcp_format_header(stdout);
+        }
+
+        /* only the TRANSFER records show the payload, don't collect it otherwise */
+        if (transfers)
+                xcp_transfer_enable();
+
+        if (publish && !xcp_shm_publish_open(publish, XCP_SHM_DEFAULT_CAPACITY)) {
+                if (errno == EBUSY)
+                        fprintf(stderr, "publish: '%s' is in use by a running xcpdump\n", publish);
+                else
+                        perror("publish");
+                return 1;
+        }
+
+        if (mdf && !xcp_mdf_open(mdf, mdf_deflate)) {
+                perror(mdf);
+                return 1;
+        }
+
+        if (dedup)
+                xcp_dedup_init(dedup);
+
+        if (onchange)
+                xcp_change_init(onchange);
+
+        if (shed)
+                xcp_shed_init(shed);
+
+        if (trigger && !xcp_trigger_init(ring)) {
+                perror("trigger");
+                return 1;
+        }
+
+        if (bus >= 0 && !xcp_bus_attach(s)) {
+                perror("receive");
+                return 1;
+        }
+
+        iov.iov_base = &frame;
+        msg.msg_name = &from;
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = &ctrlmsg;
+
+        XCP_PROF_INIT();
+
+        while (running) {
+                /* what the last frame printed goes to the merge */
+                if (bus >= 0)
+                        xcp_bus_emit(&tv);
+
+                iov.iov_len = sizeof(frame);
+                msg.msg_namelen = sizeof(from);
+                msg.msg_controllen = sizeof(ctrlmsg);
+                msg.msg_flags = 0;
+
+                if (checkpoint) {
+                        checkpoint = 0;
+                        print_shadow_diff(&since);
+                }
+
+                XCP_PROF_POLL();
+
+                if (stats) {
+                        clock_gettime(CLOCK_MONOTONIC, &now);
+                        now_ms = (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+                        if (now_ms >= redraw_ms) {
+                                xcp_stats_print(ifname, stats);
+                                redraw_ms = now_ms + stats;
+                        }
+                }
+
+                /* the window around a trigger is processed before reading on */
+                XCP_PROF_START();
+                replayed = trigger && xcp_trigger_replay(&frame, &tv, &nbytes);
+                if (!replayed)
+                        nbytes = (bus >= 0) ? xcp_bus_receive(&frame, &tv, &dropped) : recvmsg(s, &msg, 0);
+                XCP_PROF_STAGE(XCP_PROF_RECEIVE);
                 if (nbytes < 0) {
+                        if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
+                                continue;
                         perror("read");
                         return 1;
                 } else if (nbytes != CAN_MTU && nbytes != CANFD_MTU) {
@@ -234,59 +754,134 @@ int main(int argc, char **argv)
                         if (frame.can_id == dst && rx_ext && !rx_extany && rx_extaddr != frame.data[0])
                                 continue;
 
-                        if (color)
-                                printf("%s", (frame.can_id == src)? FGRED:FGBLUE);
+                        for (cmsg = (replayed || bus >= 0) ? NULL : CMSG_FIRSTHDR(&msg);
+                             cmsg && (cmsg->cmsg_level == SOL_SOCKET);
+                             cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+                                if (cmsg->cmsg_type == SO_TIMESTAMP)
+                                        memcpy(&tv, CMSG_DATA(cmsg), sizeof(tv));
+                                else if (cmsg->cmsg_type == SO_RXQ_OVFL)
+                                        memcpy(&dropped, CMSG_DATA(cmsg), sizeof(dropped));
+                        }
+                        XCP_PROF_STAGE(XCP_PROF_TIMESTAMP);
+
+                        /* a copy must not reach the analyzers, the trigger ring or the output */
+                        if (dedup && !replayed &&
+                            xcp_dedup_check(&frame, &tv, xcp_dedup_path(from.can_ifindex,
+                                                                        msg.msg_flags & MSG_DONTROUTE))) {
+                                if (dedup_mark && !stats && !format)
+                                        print_duplicate(&frame, &tv, ifname, timestamp, &last_tv);
+                                continue;
+                        }
 
-                        if (timestamp) {
-                                ioctl(s, SIOCGSTAMP, &tv);
+                        if (trigger && !replayed) {
+                                switch (xcp_trigger_update(&frame, &tv, nbytes, dst)) {
+                                case XCP_TRIGGER_BUFFERED:
+                                        continue;
+                                case XCP_TRIGGER_FIRED:
+                                        print_timestamp(timestamp, &tv, &last_tv);
+                                        printf(" %s  ", ifname);
+                                        xcp_trigger_print();
+                                        printf("\n");
+                                        continue;
+                                case XCP_TRIGGER_PASS:
+                                        break;
+                                }
+                        }
 
+                        message.src = src;
+                        message.dst = dst;
+                        xcp_message_from_frame(&message, &frame, &tv);
 
-                                switch (timestamp) {
+                        xcp_session_update(&message);
+                        xcp_daq_update(&message);
+                        xcp_timing_update(&message);
+                        absorbed = xcp_transfer_update(&message);
+                        xcp_shadow_update(&message);
+                        xcp_checksum_update(&message);
+                        xcp_pgm_update(&message);
+                        XCP_PROF_STAGE(XCP_PROF_ANALYZE);
 
-                                case 'a': /* absolute with timestamp */
-                                        printf("(%ld.%06ld) ", tv.tv_sec, tv.tv_usec);
-                                        break;
+                        if (publish || format)
+                                xcp_filter_fields(&message, fields);
 
-                                case 'A': /* absolute with date */
-                                {
-                                        struct tm tm;
-                                        char timestring[25];
+                        if (publish)
+                                xcp_shm_publish(&message, fields);
 
-                                        tm = *localtime(&tv.tv_sec);
-                                        strftime(timestring, 24, "%Y-%m-%d %H:%M:%S", &tm);
-                                        printf("(%s.%06ld) ", timestring, tv.tv_usec);
-                                }
-                                break;
-
-                                case 'd': /* delta */
-                                case 'z': /* starting with zero */
-                                {
-                                        struct timeval diff;
-
-                                        if (last_tv.tv_sec == 0)   /* first init */
-                                                last_tv = tv;
-                                        diff.tv_sec  = tv.tv_sec  - last_tv.tv_sec;
-                                        diff.tv_usec = tv.tv_usec - last_tv.tv_usec;
-                                        if (diff.tv_usec < 0)
-                                                diff.tv_sec--, diff.tv_usec += 1000000;
-                                        if (diff.tv_sec < 0)
-                                                diff.tv_sec = diff.tv_usec = 0;
-                                        printf("(%ld.%06ld) ", diff.tv_sec, diff.tv_usec);
-
-                                        if (timestamp == 'd')
-                                                last_tv = tv; /* update for delta calculation */
-                                }
-                                break;
+                        if (mdf)
+                                xcp_mdf_write(&message);
 
-                                default: /* no timestamp output */
-                                        break;
+                        if (stats) {
+                                xcp_stats_update(&message, nbytes == CANFD_MTU);
+                                continue;
+                        }
+
+                        /* everything above runs on every frame, what follows is display */
+                        if (shed && !replayed && xcp_shed_update(&tv, dropped)) {
+                                if (format) {
+                                        fprintf(stderr, "%s  ", ifname);
+                                        xcp_shed_print(stderr);
+                                        fprintf(stderr, "\n");
+                                } else {
+                                        print_timestamp(timestamp, &tv, &last_tv);
+                                        printf(" %s  ", ifname);
+                                        xcp_shed_print(stdout);
+                                        printf("\n");
                                 }
                         }
 
+                        if (transfers && (transfer = xcp_transfer_completed()) != NULL)
+                                print_transfer(transfer, ifname, timestamp, &last_tv);
+
+                        if (programming && (pgm = xcp_pgm_completed()) != NULL)
+                                print_pgm(pgm, ifname, timestamp, &last_tv);
+
+                        if (losses && (loss = xcp_daq_loss()) != NULL) {
+                                print_timestamp(timestamp, &tv, &last_tv);
+                                printf(" %s  ", ifname);
+                                xcp_daq_print_loss(loss);
+                                printf("\n");
+                        }
+
+                        if (transfers && absorbed)
+                                continue;
+
+                        if (filter && !xcp_filter_match(&message))
+                                continue;
+
+                        if (onchange && !format && xcp_change_keepalive(&tv)) {
+                                print_timestamp(timestamp, &tv, &last_tv);
+                                printf(" %s  ", ifname);
+                                xcp_change_print_keepalive();
+                                printf("\n");
+                        }
+
+                        if (shed && xcp_shed_skip(&message))
+                                continue;
+
+                        if (onchange && !xcp_change_update(&message))
+                                continue;
+
+                        if (format) {
+                                XCP_PROF_START();
+                                xcp_format_write(&message, fields, stdout);
+                                XCP_PROF_STAGE(XCP_PROF_FORMAT);
+                                fflush(stdout);
+                                XCP_PROF_STAGE(XCP_PROF_FLUSH);
+                                XCP_PROF_LATENCY(&tv);
+                                continue;
+                        }
+
+                        XCP_PROF_START();
+                        if (color)
+                                printf("%s", (frame.can_id == src)? FGRED:FGBLUE);
+
+                        if (timestamp)
+                                print_timestamp(timestamp, &tv, &last_tv);
+
                         if (frame.can_id & CAN_EFF_FLAG)
-                                printf(" %s  %8X", argv[optind], frame.can_id & CAN_EFF_MASK);
+                                printf(" %s  %8X", ifname, frame.can_id & CAN_EFF_MASK);
                         else
-                                printf(" %s  %3X", argv[optind], frame.can_id & CAN_SFF_MASK);
+                                printf(" %s  %3X", ifname, frame.can_id & CAN_SFF_MASK);
 
                         if (ext)
                                 printf("{%02X}", frame.data[0]);
@@ -297,11 +892,7 @@ int main(int argc, char **argv)
                                 printf(" [%02d]  ", frame.len);
                         datidx = 0;
 
-                        message.src = src;
-                        message.dst = dst;
-                        message.frame = &frame;
-
-                        print_xcp_message(&message, dtos);
+                        XCP_PROF_CALL(XCP_PROF_DECODE, print_xcp_message(&message, dtos));
 
                         if (datidx && frame.len > datidx) {
                                 printf(" ");
@@ -324,10 +915,48 @@ int main(int argc, char **argv)
                         if (color)
                                 printf("%s", ATTRESET);
                         printf("\n");
+                        XCP_PROF_STAGE(XCP_PROF_FORMAT);
                         fflush(stdout);
+                        XCP_PROF_STAGE(XCP_PROF_FLUSH);
+                        XCP_PROF_LATENCY(&tv);
                 }
         }
 
+        if (stats) {
+                xcp_stats_print(ifname, stats);
+                printf("%s", CSR_SHOW);
+                fflush(stdout);
+        }
+
+        xcp_transfer_flush();
+        if (transfers && (transfer = xcp_transfer_completed()) != NULL)
+                print_transfer(transfer, ifname, timestamp, &last_tv);
+        xcp_pgm_flush();
+        if (programming && (pgm = xcp_pgm_completed()) != NULL)
+                print_pgm(pgm, ifname, timestamp, &last_tv);
+
+        if (losses)
+                xcp_daq_print_loss_summary();
+        if (onchange && !format)
+                xcp_change_print_summary();
+        if (shed)
+                xcp_shed_print_summary(format ? stderr : stdout);
+        if (jitter)
+                xcp_timing_print();
+        if (diffs)
+                print_shadow_diff(&since);
+        if (dedup)
+                xcp_dedup_print(ifname);
+        if (shadowfile && xcp_shadow_dump(shadowfile) < 0)
+                fprintf(stderr, "%s: could not write memory dump\n", shadowfile);
+        XCP_PROF_PRINT();
+        if (publish)
+                xcp_shm_publish_close();
+        if (mdf && !xcp_mdf_close())
+                perror(mdf);
+        if (bus >= 0)
+                xcp_bus_detach();
+
         close(s);
 
         return 0;
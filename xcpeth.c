@@ -0,0 +1,661 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR BSD-3-Clause) */
+/*
+ * xcpeth.c - XCP on Ethernet (UDP/TCP) transport layer
+ *
+ * Copyright (c) 2021 Christoph Schueler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <cpu12.gems@googlemail.com>
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <linux/if_packet.h>
+#include <linux/if_ether.h>
+
+#include "xcp.h"
+#include "xcpeth.h"
+
+/*
+ * Every UDP datagram and TCP segment carries one or more XCP packets:
+ *
+ *   | LEN (WORD) | CTR (WORD) | PID | data ... | LEN | CTR | PID | ...
+ *
+ * Packets are handed on in place, pointing into the captured frame.
+ * Only a TCP packet split across segments is copied, to reassemble it.
+ */
+
+/*
+ *
+ * Local Constants.
+ *
+ */
+#define MASTER                  (0)
+#define SLAVE                   (1)
+
+#define IP_PROTO_TCP            (6)
+#define IP_PROTO_UDP            (17)
+
+#define TCP_FLAG_FIN            (0x01)
+#define TCP_FLAG_SYN            (0x02)
+#define TCP_FLAG_RST            (0x04)
+
+#define PCAP_MAGIC_USEC         (0xa1b2c3d4U)
+#define PCAP_MAGIC_NSEC         (0xa1b23c4dU)
+#define PCAP_HEADER_SIZE        (24)
+#define PCAP_RECORD_SIZE        (16)
+
+#define XCP_CONNECT             (0xff)
+
+/*
+ *
+ * Local Types.
+ *
+ */
+
+/*
+ * Reassembly state of one direction of a TCP connection.
+ */
+typedef struct tagStreamType {
+    bool known;
+    uint32_t nextSeq;
+    uint32_t carryLength;
+    uint8_t carry[XCP_ETH_HEADER_SIZE + XCP_ETH_MAX_PACKET + CANFD_MAX_DLEN];
+} StreamType;
+
+/*
+ *
+ * Local Variables.
+ *
+ */
+static uint16_t slave_port = XCP_ETH_DEFAULT_PORT;
+static XcpEthHandlerType handler = NULL;
+static StreamType streams[2];
+static bool ctr_known[2];
+static uint16_t next_ctr[2];
+static XcpEthLossType loss;
+static XcpEthLossType const * current_loss = NULL;
+static XcpEthStatsType stats;
+static bool live_loopback = FALSE;
+
+/*
+ *
+ * Local Functions.
+ *
+ */
+static void ip_input(uint8_t const * data, size_t length, struct timeval const * const tv);
+static void udp_input(uint8_t const * data, size_t length, struct timeval const * const tv);
+static void tcp_input(uint8_t const * data, size_t length, struct timeval const * const tv);
+static void stream_input(StreamType * const stream, bool fromSlave, uint8_t const * data, size_t length,
+                         struct timeval const * const tv);
+static size_t split(uint8_t const * const data, size_t length, uint8_t transport, bool fromSlave,
+                    struct timeval const * const tv);
+static void deliver(uint8_t const * const packet, uint8_t transport, bool fromSlave,
+                    struct timeval const * const tv);
+
+static inline uint16_t get_le16(uint8_t const * const data)
+{
+    return (uint16_t)(data[0] | (data[1] << 8));
+}
+
+static inline uint16_t get_be16(uint8_t const * const data)
+{
+    return (uint16_t)((data[0] << 8) | data[1]);
+}
+
+static inline uint32_t get_be32(uint8_t const * const data)
+{
+    return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3];
+}
+
+
+void xcp_eth_init(uint16_t port, XcpEthHandlerType callback)
+{
+    slave_port = port;
+    handler = callback;
+    memset(streams, 0, sizeof(streams));
+    memset(ctr_known, 0, sizeof(ctr_known));
+    memset(&stats, 0, sizeof(stats));
+}
+
+/*
+ * Feed one captured frame, starting at the link layer header.
+ */
+void xcp_eth_input(uint32_t linkType, uint8_t const * const data, size_t length, struct timeval const * const tv)
+{
+    uint16_t etherType;
+    size_t offset;
+
+    switch (linkType) {
+        case XCP_ETH_LINK_ETHERNET:
+            offset = 12;
+            if (length < offset + 2) {
+                ++stats.ignored;
+                return;
+            }
+            etherType = get_be16(&data[offset]);
+            while (((etherType == ETH_P_8021Q) || (etherType == ETH_P_8021AD)) && (length >= offset + 6)) {
+                offset += 4;
+                etherType = get_be16(&data[offset]);
+            }
+            offset += 2;
+            break;
+        case XCP_ETH_LINK_LINUX_SLL:
+            offset = 16;
+            if (length < offset) {
+                ++stats.ignored;
+                return;
+            }
+            etherType = get_be16(&data[14]);
+            break;
+        case XCP_ETH_LINK_RAW:
+            ip_input(data, length, tv);
+            return;
+        default:
+            ++stats.ignored;
+            return;
+    }
+    if ((etherType != ETH_P_IP) && (etherType != ETH_P_IPV6)) {
+        return;
+    }
+    ip_input(data + offset, length - offset, tv);
+}
+
+static void ip_input(uint8_t const * data, size_t length, struct timeval const * const tv)
+{
+    size_t headerLength;
+    size_t totalLength;
+    uint8_t protocol;
+
+    if (length < 1) {
+        return;
+    }
+    switch (data[0] >> 4) {
+        case 4:
+            headerLength = (data[0] & 0x0f) * 4;
+            if ((length < 20) || (headerLength < 20) || (length < headerLength)) {
+                ++stats.ignored;
+                return;
+            }
+            if (get_be16(&data[6]) & 0x3fff) {     /* More fragments or fragment offset. */
+                ++stats.ignored;
+                return;
+            }
+            totalLength = get_be16(&data[2]);
+            if ((totalLength >= headerLength) && (totalLength < length)) {
+                length = totalLength;               /* Strip Ethernet padding. */
+            }
+            protocol = data[9];
+            break;
+        case 6:
+            headerLength = 40;                      /* Extension headers are not followed. */
+            if (length < headerLength) {
+                ++stats.ignored;
+                return;
+            }
+            totalLength = headerLength + get_be16(&data[4]);
+            if (totalLength < length) {
+                length = totalLength;
+            }
+            protocol = data[6];
+            break;
+        default:
+            ++stats.ignored;
+            return;
+    }
+    data += headerLength;
+    length -= headerLength;
+    if (protocol == IP_PROTO_UDP) {
+        udp_input(data, length, tv);
+    } else if (protocol == IP_PROTO_TCP) {
+        tcp_input(data, length, tv);
+    }
+}
+
+static void udp_input(uint8_t const * data, size_t length, struct timeval const * const tv)
+{
+    uint16_t udpLength;
+    bool fromSlave;
+
+    if (length < 8) {
+        return;
+    }
+    if (get_be16(&data[2]) == slave_port) {
+        fromSlave = FALSE;
+    } else if (get_be16(&data[0]) == slave_port) {
+        fromSlave = TRUE;
+    } else {
+        return;
+    }
+    udpLength = get_be16(&data[4]);
+    if ((udpLength >= 8) && (udpLength < length)) {
+        length = udpLength;
+    }
+    ++stats.datagrams;
+    split(data + 8, length - 8, XCP_TRANSPORT_UDP, fromSlave, tv);
+}
+
+static void tcp_input(uint8_t const * data, size_t length, struct timeval const * const tv)
+{
+    StreamType * stream;
+    size_t headerLength;
+    uint32_t seq;
+    uint8_t flags;
+    bool fromSlave;
+
+    if (length < 20) {
+        return;
+    }
+    if (get_be16(&data[2]) == slave_port) {
+        fromSlave = FALSE;
+    } else if (get_be16(&data[0]) == slave_port) {
+        fromSlave = TRUE;
+    } else {
+        return;
+    }
+    headerLength = (data[12] >> 4) * 4;
+    if ((headerLength < 20) || (headerLength > length)) {
+        ++stats.ignored;
+        return;
+    }
+    stream = &streams[fromSlave ? SLAVE : MASTER];
+    seq = get_be32(&data[4]);
+    flags = data[13];
+
+    if (flags & TCP_FLAG_SYN) {
+        /* New connection, both sides start counting again. */
+        stream->known = TRUE;
+        stream->nextSeq = seq + 1;
+        stream->carryLength = 0;
+        ctr_known[MASTER] = ctr_known[SLAVE] = FALSE;
+        return;
+    }
+    data += headerLength;
+    length -= headerLength;
+    if (length > 0) {
+        if (!stream->known) {
+            /* Joined a running connection, hope for a segment starting with a packet. */
+            stream->known = TRUE;
+            stream->nextSeq = seq;
+            stream->carryLength = 0;
+        } else if (seq != stream->nextSeq) {
+            if ((int32_t)(seq - stream->nextSeq) < 0) {
+                /* Retransmission, skip what was seen already. */
+                if ((size_t)(stream->nextSeq - seq) >= length) {
+                    return;
+                }
+                data += stream->nextSeq - seq;
+                length -= stream->nextSeq - seq;
+            } else {
+                /* Bytes are missing, resynchronize on this segment. */
+                ++stats.streamGaps;
+                stream->nextSeq = seq;
+                stream->carryLength = 0;
+            }
+        }
+        stream->nextSeq += (uint32_t)length;
+        stream_input(stream, fromSlave, data, length, tv);
+    }
+    if (flags & (TCP_FLAG_FIN | TCP_FLAG_RST)) {
+        stream->known = FALSE;
+    }
+}
+
+/*
+ * Complete a packet carried over from the previous segment first,
+ * the rest of the segment is split in place.
+ */
+static void stream_input(StreamType * const stream, bool fromSlave, uint8_t const * data, size_t length,
+                         struct timeval const * const tv)
+{
+    size_t needed;
+    size_t take;
+    size_t consumed;
+
+    if (stream->carryLength > 0) {
+        if (stream->carryLength < XCP_ETH_HEADER_SIZE) {
+            take = XCP_ETH_HEADER_SIZE - stream->carryLength;
+            take = (take < length) ? take : length;
+            memcpy(&stream->carry[stream->carryLength], data, take);
+            stream->carryLength += take;
+            data += take;
+            length -= take;
+            if (stream->carryLength < XCP_ETH_HEADER_SIZE) {
+                return;
+            }
+        }
+        needed = XCP_ETH_HEADER_SIZE + get_le16(stream->carry) - stream->carryLength;
+        take = (needed < length) ? needed : length;
+        memcpy(&stream->carry[stream->carryLength], data, take);
+        stream->carryLength += take;
+        data += take;
+        length -= take;
+        if (take < needed) {
+            return;
+        }
+        stream->carryLength = 0;
+        if (get_le16(stream->carry) == 0) {
+            ++stats.truncated;
+            return;
+        }
+        deliver(stream->carry, XCP_TRANSPORT_TCP, fromSlave, tv);
+    }
+    consumed = split(data, length, XCP_TRANSPORT_TCP, fromSlave, tv);
+    if (consumed < length) {
+        memcpy(stream->carry, data + consumed, length - consumed);
+        stream->carryLength = length - consumed;
+    }
+}
+
+/*
+ * Hand on the packets of a datagram or segment, returns the bytes used up.
+ * What is left over is the beginning of a packet continued in the next TCP segment.
+ */
+static size_t split(uint8_t const * const data, size_t length, uint8_t transport, bool fromSlave,
+                    struct timeval const * const tv)
+{
+    size_t offset = 0;
+    uint16_t packetLength;
+
+    while ((length - offset) >= XCP_ETH_HEADER_SIZE) {
+        packetLength = get_le16(&data[offset]);
+        if (packetLength == 0) {
+            if (transport == XCP_TRANSPORT_TCP) {
+                /* Not on a packet boundary, drop the segment. */
+                ++stats.truncated;
+                return length;
+            }
+            break;      /* Fill bytes. */
+        }
+        if ((length - offset - XCP_ETH_HEADER_SIZE) < packetLength) {
+            if (transport == XCP_TRANSPORT_UDP) {
+                ++stats.truncated;
+                return length;
+            }
+            break;
+        }
+        deliver(&data[offset], transport, fromSlave, tv);
+        offset += XCP_ETH_HEADER_SIZE + packetLength;
+    }
+    return (transport == XCP_TRANSPORT_UDP) ? length : offset;
+}
+
+/*
+ * Master and slave count their packets independently, CONNECT may restart both counters.
+ */
+static void deliver(uint8_t const * const packet, uint8_t transport, bool fromSlave,
+                    struct timeval const * const tv)
+{
+    unsigned const direction = fromSlave ? SLAVE : MASTER;
+    uint16_t const ctr = get_le16(&packet[2]);
+    uint16_t gap;
+    XcpMessage msg;
+
+    if (!fromSlave && (packet[XCP_ETH_HEADER_SIZE] == XCP_CONNECT)) {
+        ctr_known[MASTER] = ctr_known[SLAVE] = FALSE;
+    }
+    current_loss = NULL;
+    if (ctr_known[direction] && (ctr != next_ctr[direction])) {
+        gap = ctr - next_ctr[direction];
+        if (gap < 0x8000) {     /* Else a duplicate or reordered packet. */
+            loss.fromSlave = fromSlave;
+            loss.expectedCtr = next_ctr[direction];
+            loss.ctr = ctr;
+            loss.lostPackets = gap;
+            stats.lostPackets[direction] += gap;
+            current_loss = &loss;
+        }
+    }
+    ctr_known[direction] = TRUE;
+    next_ctr[direction] = ctr + 1;
+    ++stats.packets[direction];
+
+    msg.src = 0;
+    msg.dst = 0;
+    msg.frame = NULL;
+    msg.data = &packet[XCP_ETH_HEADER_SIZE];
+    msg.length = get_le16(packet);
+    msg.fromSlave = fromSlave;
+    msg.transport = transport;
+    msg.ctr = ctr;
+    msg.timestamp = *tv;
+    if (handler != NULL) {
+        handler(&msg);
+    }
+}
+
+/*
+ * CTR gap revealed by the packet just handed on, if any.
+ */
+XcpEthLossType const * xcp_eth_loss(void)
+{
+    return current_loss;
+}
+
+XcpEthStatsType const * xcp_eth_stats(void)
+{
+    return &stats;
+}
+
+void xcp_eth_print_loss(XcpEthLossType const * const loss)
+{
+    printf("CTR_LOSS(direction = %s", loss->fromSlave ? "slave" : "master");
+    printf(", expectedCtr = %u", loss->expectedCtr);
+    printf(", ctr = %u", loss->ctr);
+    printf(", lostPackets = %u", loss->lostPackets);
+    printf(")");
+}
+
+void xcp_eth_print_stats(void)
+{
+    printf("ETH_SUMMARY(datagrams = %llu", (unsigned long long)stats.datagrams);
+    printf(", masterPackets = %llu", (unsigned long long)stats.packets[MASTER]);
+    printf(", slavePackets = %llu", (unsigned long long)stats.packets[SLAVE]);
+    printf(", lostMasterPackets = %llu", (unsigned long long)stats.lostPackets[MASTER]);
+    printf(", lostSlavePackets = %llu", (unsigned long long)stats.lostPackets[SLAVE]);
+    printf(", truncated = %llu", (unsigned long long)stats.truncated);
+    printf(", streamGaps = %llu", (unsigned long long)stats.streamGaps);
+    printf(", ignored = %llu)\n", (unsigned long long)stats.ignored);
+}
+
+/*
+ * Packet socket below IP, frames arrive without link layer header (XCP_ETH_LINK_RAW).
+ */
+int xcp_eth_open_live(char const * const ifname)
+{
+    int const on = 1;
+    struct sockaddr_ll addr;
+    struct ifreq ifr;
+    int s;
+
+    s = socket(AF_PACKET, SOCK_DGRAM, htons(ETH_P_ALL));
+    if (s < 0) {
+        return -1;
+    }
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+    if (ioctl(s, SIOCGIFFLAGS, &ifr) < 0) {
+        close(s);
+        return -1;
+    }
+    live_loopback = (ifr.ifr_flags & IFF_LOOPBACK) ? TRUE : FALSE;
+    setsockopt(s, SOL_SOCKET, SO_TIMESTAMP, &on, sizeof(on));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sll_family = AF_PACKET;
+    addr.sll_protocol = htons(ETH_P_ALL);
+    addr.sll_ifindex = if_nametoindex(ifname);
+    if (bind(s, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(s);
+        return -1;
+    }
+    return s;
+}
+
+/*
+ * Returns the frame length, 0 for frames to skip, -1 on errors (see errno).
+ */
+ssize_t xcp_eth_read_live(int s, uint8_t * const buffer, size_t size, struct timeval * const tv)
+{
+    char control[CMSG_SPACE(sizeof(struct timeval))];
+    struct sockaddr_ll from;
+    struct cmsghdr * cmsg;
+    struct msghdr msg;
+    struct iovec iov;
+    ssize_t nbytes;
+
+    iov.iov_base = buffer;
+    iov.iov_len = size;
+    msg.msg_name = &from;
+    msg.msg_namelen = sizeof(from);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    msg.msg_flags = 0;
+
+    nbytes = recvmsg(s, &msg, 0);
+    if (nbytes < 0) {
+        return -1;
+    }
+    /* On loopback every packet passes twice, outgoing and incoming. */
+    if (live_loopback && (from.sll_pkttype == PACKET_OUTGOING)) {
+        return 0;
+    }
+    if ((from.sll_protocol != htons(ETH_P_IP)) && (from.sll_protocol != htons(ETH_P_IPV6))) {
+        return 0;
+    }
+    gettimeofday(tv, NULL);
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SO_TIMESTAMP)) {
+            memcpy(tv, CMSG_DATA(cmsg), sizeof(*tv));
+        }
+    }
+    return nbytes;
+}
+
+/*
+ * Classic pcap files (not pcapng), mapped to memory. Frames are returned in place,
+ * with no slack behind them; callers copy them before dissecting.
+ */
+bool xcp_eth_pcap_open(XcpEthPcapType * const pcap, char const * const path)
+{
+    struct stat st;
+    uint32_t magic;
+    void * map;
+    int fd;
+
+    memset(pcap, 0, sizeof(*pcap));
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return FALSE;
+    }
+    if ((fstat(fd, &st) < 0) || (st.st_size < PCAP_HEADER_SIZE)) {
+        close(fd);
+        return FALSE;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return FALSE;
+    }
+    pcap->data = map;
+    pcap->size = st.st_size;
+    memcpy(&magic, pcap->data, sizeof(magic));
+    if ((magic == PCAP_MAGIC_USEC) || (magic == PCAP_MAGIC_NSEC)) {
+        pcap->swapped = FALSE;
+    } else if ((__builtin_bswap32(magic) == PCAP_MAGIC_USEC) || (__builtin_bswap32(magic) == PCAP_MAGIC_NSEC)) {
+        pcap->swapped = TRUE;
+        magic = __builtin_bswap32(magic);
+    } else {
+        xcp_eth_pcap_close(pcap);
+        return FALSE;
+    }
+    pcap->nanoseconds = (magic == PCAP_MAGIC_NSEC);
+    memcpy(&pcap->linkType, &pcap->data[20], sizeof(pcap->linkType));
+    if (pcap->swapped) {
+        pcap->linkType = __builtin_bswap32(pcap->linkType);
+    }
+    pcap->offset = PCAP_HEADER_SIZE;
+    return TRUE;
+}
+
+bool xcp_eth_pcap_next(XcpEthPcapType * const pcap, uint8_t const ** data, size_t * length, struct timeval * const tv)
+{
+    uint32_t record[4];     /* ts_sec, ts_usec/ts_nsec, incl_len, orig_len */
+    unsigned idx;
+
+    if ((pcap->size - pcap->offset) < PCAP_RECORD_SIZE) {
+        return FALSE;
+    }
+    memcpy(record, &pcap->data[pcap->offset], sizeof(record));
+    if (pcap->swapped) {
+        for (idx = 0; idx < 4; ++idx) {
+            record[idx] = __builtin_bswap32(record[idx]);
+        }
+    }
+    pcap->offset += PCAP_RECORD_SIZE;
+    if ((pcap->size - pcap->offset) < record[2]) {
+        return FALSE;       /* Cut off file. */
+    }
+    tv->tv_sec = record[0];
+    tv->tv_usec = pcap->nanoseconds ? record[1] / 1000 : record[1];
+    *data = &pcap->data[pcap->offset];
+    *length = record[2];
+    pcap->offset += record[2];
+    return TRUE;
+}
+
+void xcp_eth_pcap_close(XcpEthPcapType * const pcap)
+{
+    if (pcap->data != NULL) {
+        munmap((void *)pcap->data, pcap->size);
+        pcap->data = NULL;
+    }
+}
@@ -0,0 +1,122 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR BSD-3-Clause) */
+/*
+ * xcpeth.h - XCP on Ethernet (UDP/TCP) transport layer
+ *
+ * Copyright (c) 2021 Christoph Schueler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <cpu12.gems@googlemail.com>
+ *
+ */
+#ifndef __XCPETH_H
+#define __XCPETH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/time.h>
+
+#include "xcp.h"
+
+/*
+ * Defines
+ */
+#define XCP_ETH_DEFAULT_PORT        (5555)
+#define XCP_ETH_HEADER_SIZE         (4)         /* LEN and CTR, both Intel byte order.  */
+#define XCP_ETH_MAX_PACKET          (0xffff)
+#define XCP_ETH_SNAPLEN             (0x10000)
+
+/*
+ * Link layer of the captured frames, numbered as in pcap.
+ */
+#define XCP_ETH_LINK_ETHERNET       (1)
+#define XCP_ETH_LINK_RAW            (101)
+#define XCP_ETH_LINK_LINUX_SLL      (113)
+
+/*
+ * Types
+ */
+
+/*
+ * Called for every XCP packet, `msg->data` points into the captured frame.
+ */
+typedef void (*XcpEthHandlerType)(XcpMessage const * const msg);
+
+typedef struct tagXcpEthLossType {
+    bool fromSlave;
+    uint16_t expectedCtr;
+    uint16_t ctr;
+    uint16_t lostPackets;
+} XcpEthLossType;
+
+typedef struct tagXcpEthStatsType {
+    uint64_t datagrams;
+    uint64_t packets[2];            /* Master, slave.                               */
+    uint64_t lostPackets[2];        /* From CTR gaps.                               */
+    uint64_t truncated;             /* Packet exceeds the datagram or snap length.  */
+    uint64_t streamGaps;            /* TCP bytes missing, stream resynchronized.    */
+    uint64_t ignored;               /* IP fragments, unknown link or network layer. */
+} XcpEthStatsType;
+
+typedef struct tagXcpEthPcapType {
+    uint8_t const * data;
+    size_t size;
+    size_t offset;
+    uint32_t linkType;
+    bool swapped;
+    bool nanoseconds;
+} XcpEthPcapType;
+
+/*
+ * Global Functions
+ *
+ */
+void xcp_eth_init(uint16_t port, XcpEthHandlerType handler);
+void xcp_eth_input(uint32_t linkType, uint8_t const * const data, size_t length, struct timeval const * const tv);
+XcpEthLossType const * xcp_eth_loss(void);
+XcpEthStatsType const * xcp_eth_stats(void);
+void xcp_eth_print_loss(XcpEthLossType const * const loss);
+void xcp_eth_print_stats(void);
+
+int xcp_eth_open_live(char const * const ifname);
+ssize_t xcp_eth_read_live(int s, uint8_t * const buffer, size_t size, struct timeval * const tv);
+
+bool xcp_eth_pcap_open(XcpEthPcapType * const pcap, char const * const path);
+bool xcp_eth_pcap_next(XcpEthPcapType * const pcap, uint8_t const ** data, size_t * length, struct timeval * const tv);
+void xcp_eth_pcap_close(XcpEthPcapType * const pcap);
+
+#endif /* __XCPETH_H */
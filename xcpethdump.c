@@ -0,0 +1,368 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR BSD-3-Clause) */
+/*
+ * xcpethdump.c - dump XCP on Ethernet traffic, live or from pcap
+ *
+ * Copyright (c) 2021 Christoph Schueler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <cpu12.gems@googlemail.com>
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <time.h>
+
+#include "terminal.h"
+
+#include "xcp.h"
+#include "xcpeth.h"
+#include "xcpsession.h"
+#include "xcpdaq.h"
+#include "xcptransfer.h"
+#include "xcpshadow.h"
+#include "xcpchecksum.h"
+#include "xcppgm.h"
+#include "xcptiming.h"
+#include "xcpfilter.h"
+
+/*
+ * The analyzers and the dissector see exactly what they see on CAN,
+ * one XCP packet per XcpMessage, the transport header is printed in
+ * place of the CAN identifier:
+ *
+ *   (0.000100)  lo  UDP S 0007  [6]  ...
+ */
+
+typedef struct tagOptionsType {
+    char const * source;
+    int timestamp;
+    bool dtos;
+    bool color;
+    bool transfers;
+    bool losses;
+    bool filter;
+    struct timeval lastTv;
+} OptionsType;
+
+static OptionsType options;
+static volatile sig_atomic_t running = 1;
+
+static void sigterm(int signo)
+{
+    running = 0;
+}
+
+void print_usage(char *prg)
+{
+    fprintf(stderr, "\nUsage: %s [options] <interface>\n", prg);
+    fprintf(stderr, "       %s [options] -r <pcap file>\n", prg);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "         -p <port>    (UDP/TCP port of the XCP slave, default %u)\n", XCP_ETH_DEFAULT_PORT);
+    fprintf(stderr, "         -r <file>    (read a pcap file instead of capturing)\n");
+    fprintf(stderr, "         -d           (include DTOs)\n");
+    fprintf(stderr, "         -v           (decode DTO values from the observed DAQ configuration)\n");
+    fprintf(stderr, "         -T           (summarize UPLOAD/DOWNLOAD/PROGRAM sequences as one transfer each)\n");
+    fprintf(stderr, "         -L           (report lost packets from CTR gaps and lost DTOs)\n");
+    fprintf(stderr, "         -J           (report period, jitter and missed cycles per event channel on exit)\n");
+    fprintf(stderr, "         -f <expr>    (display filter, see xcpdump)\n");
+    fprintf(stderr, "         -c           (color mode)\n");
+    fprintf(stderr, "         -t <type>    (timestamp: (a)bsolute/(d)elta/(z)ero/(A)bsolute w date)\n");
+    fprintf(stderr, "\nLive capture needs CAP_NET_RAW, loopback (lo) works as well.\n");
+}
+
+static void print_timestamp(struct timeval const * const tv)
+{
+    struct timeval diff;
+    struct tm tm;
+    char timestring[25];
+
+    switch (options.timestamp) {
+        case 'a':
+            printf("(%ld.%06ld) ", tv->tv_sec, tv->tv_usec);
+            break;
+        case 'A':
+            tm = *localtime(&tv->tv_sec);
+            strftime(timestring, 24, "%Y-%m-%d %H:%M:%S", &tm);
+            printf("(%s.%06ld) ", timestring, tv->tv_usec);
+            break;
+        case 'd':
+        case 'z':
+            if (options.lastTv.tv_sec == 0) {
+                options.lastTv = *tv;
+            }
+            diff.tv_sec = tv->tv_sec - options.lastTv.tv_sec;
+            diff.tv_usec = tv->tv_usec - options.lastTv.tv_usec;
+            if (diff.tv_usec < 0) {
+                diff.tv_sec--;
+                diff.tv_usec += 1000000;
+            }
+            if (diff.tv_sec < 0) {
+                diff.tv_sec = diff.tv_usec = 0;
+            }
+            printf("(%ld.%06ld) ", diff.tv_sec, diff.tv_usec);
+            if (options.timestamp == 'd') {
+                options.lastTv = *tv;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static void print_transfer(XcpTransferType const * const transfer)
+{
+    print_timestamp(&transfer->start);
+    printf(" %s  ", options.source);
+    xcp_transfer_print(transfer);
+    printf("\n");
+}
+
+/*
+ * Same sequence of calls as the receive loop of xcpdump.
+ */
+static void handle_message(XcpMessage const * const msg)
+{
+    XcpTransferType const * transfer;
+    XcpDaqLossType const * daqLoss;
+    XcpEthLossType const * ctrLoss;
+    bool absorbed;
+
+    xcp_session_update(msg);
+    xcp_daq_update(msg);
+    xcp_timing_update(msg);
+    absorbed = xcp_transfer_update(msg);
+    xcp_shadow_update(msg);
+    xcp_checksum_update(msg);
+    xcp_pgm_update(msg);
+
+    if (options.losses && (ctrLoss = xcp_eth_loss()) != NULL) {
+        print_timestamp(&msg->timestamp);
+        printf(" %s  ", options.source);
+        xcp_eth_print_loss(ctrLoss);
+        printf("\n");
+    }
+    if (options.transfers && (transfer = xcp_transfer_completed()) != NULL) {
+        print_transfer(transfer);
+    }
+    if (options.losses && (daqLoss = xcp_daq_loss()) != NULL) {
+        print_timestamp(&msg->timestamp);
+        printf(" %s  ", options.source);
+        xcp_daq_print_loss(daqLoss);
+        printf("\n");
+    }
+    if (options.transfers && absorbed) {
+        return;
+    }
+    if (options.filter && !xcp_filter_match(msg)) {
+        return;
+    }
+
+    if (options.color) {
+        printf("%s", msg->fromSlave ? FGBLUE : FGRED);
+    }
+    print_timestamp(&msg->timestamp);
+    printf(" %s  %s %c %04X  [%u]  ", options.source, (msg->transport == XCP_TRANSPORT_TCP) ? "TCP" : "UDP",
+           msg->fromSlave ? 'S' : 'M', msg->ctr, msg->length);
+    print_xcp_message(msg, options.dtos);
+    if (options.color) {
+        printf("%s", ATTRESET);
+    }
+    printf("\n");
+}
+
+static int read_pcap(char const * const path)
+{
+    /* The file is mapped read-only and packets sit back to back, so copy each one
+     * to get the same slack behind it as a live capture. */
+    static uint8_t buffer[XCP_ETH_SNAPLEN + CANFD_MAX_DLEN];
+    XcpEthPcapType pcap;
+    uint8_t const * data;
+    size_t length;
+    struct timeval tv;
+
+    if (!xcp_eth_pcap_open(&pcap, path)) {
+        fprintf(stderr, "%s: not a readable pcap file (pcapng is not supported)\n", path);
+        return 1;
+    }
+    while (running && xcp_eth_pcap_next(&pcap, &data, &length, &tv)) {
+        if (length > XCP_ETH_SNAPLEN) {
+            length = XCP_ETH_SNAPLEN;
+        }
+        memcpy(buffer, data, length);
+        memset(&buffer[length], 0, CANFD_MAX_DLEN);
+        xcp_eth_input(pcap.linkType, buffer, length, &tv);
+    }
+    xcp_eth_pcap_close(&pcap);
+    return 0;
+}
+
+static int capture(char const * const ifname)
+{
+    /* Slack behind the frame, the dissector may look at bytes beyond a short packet. */
+    static uint8_t buffer[XCP_ETH_SNAPLEN + CANFD_MAX_DLEN];
+    struct timeval tv;
+    ssize_t nbytes;
+    int s;
+
+    s = xcp_eth_open_live(ifname);
+    if (s < 0) {
+        perror(ifname);
+        return 1;
+    }
+    while (running) {
+        nbytes = xcp_eth_read_live(s, buffer, XCP_ETH_SNAPLEN, &tv);
+        if (nbytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("recvmsg");
+            close(s);
+            return 1;
+        }
+        if (nbytes > 0) {
+            xcp_eth_input(XCP_ETH_LINK_RAW, buffer, nbytes, &tv);
+            fflush(stdout);
+        }
+    }
+    close(s);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    struct sigaction sa;
+    CanIdType ids;
+    char const * pcapFile = NULL;
+    uint16_t port = XCP_ETH_DEFAULT_PORT;
+    bool jitter = FALSE;
+    int result;
+    int opt;
+
+    memset(&options, 0, sizeof(options));
+    while ((opt = getopt(argc, argv, "p:r:dvTLJf:ct:?")) != -1) {
+        switch (opt) {
+            case 'p':
+                port = strtoul(optarg, NULL, 10);
+                break;
+            case 'r':
+                pcapFile = optarg;
+                break;
+            case 'd':
+                options.dtos = TRUE;
+                break;
+            case 'v':
+                xcp_daq_set_decode(TRUE);
+                break;
+            case 'T':
+                options.transfers = TRUE;
+                xcp_transfer_enable();
+                break;
+            case 'L':
+                options.losses = TRUE;
+                break;
+            case 'J':
+                jitter = TRUE;
+                break;
+            case 'f':
+                if (!xcp_filter_compile(optarg)) {
+                    fprintf(stderr, "filter: %s\n", xcp_filter_error());
+                    exit(1);
+                }
+                options.filter = TRUE;
+                break;
+            case 'c':
+                options.color = TRUE;
+                break;
+            case 't':
+                options.timestamp = optarg[0];
+                if ((options.timestamp != 'a') && (options.timestamp != 'A') &&
+                    (options.timestamp != 'd') && (options.timestamp != 'z')) {
+                    fprintf(stderr, "%s: unknown timestamp mode '%c' - ignored\n", basename(argv[0]), optarg[0]);
+                    options.timestamp = 0;
+                }
+                break;
+            case '?':
+                print_usage(basename(argv[0]));
+                exit(0);
+                break;
+            default:
+                fprintf(stderr, "Unknown option %c\n", opt);
+                print_usage(basename(argv[0]));
+                exit(1);
+                break;
+        }
+    }
+    if ((pcapFile == NULL) ? ((argc - optind) != 1) : ((argc - optind) != 0)) {
+        print_usage(basename(argv[0]));
+        exit(1);
+    }
+    options.source = (pcapFile != NULL) ? "pcap" : argv[optind];
+
+    /* No CAN identifiers, the direction comes with every message. */
+    ids.src = 0;
+    ids.dst = 0;
+    setIdentifiers(&ids);
+    xcp_eth_init(port, handle_message);
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sigterm;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGHUP, &sa, NULL);
+
+    result = (pcapFile != NULL) ? read_pcap(pcapFile) : capture(argv[optind]);
+
+    xcp_transfer_flush();
+    if (options.transfers && (xcp_transfer_completed() != NULL)) {
+        print_transfer(xcp_transfer_completed());
+    }
+    if (options.losses) {
+        xcp_daq_print_loss_summary();
+        xcp_eth_print_stats();
+    }
+    if (jitter) {
+        xcp_timing_print();
+    }
+    return result;
+}
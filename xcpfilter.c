@@ -0,0 +1,577 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR BSD-3-Clause) */
+/*
+ * xcpfilter.c - compiled display filter expressions
+ *
+ * Copyright (c) 2021 Christoph Schueler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <cpu12.gems@googlemail.com>
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <linux/can.h>
+
+#include "xcp.h"
+#include "xcpsession.h"
+#include "xcpdaq.h"
+#include "xcpfilter.h"
+
+/*
+ * Grammar:
+ *
+ *  expr        := and { ("||" | "or") and }
+ *  and         := unary { ("&&" | "and") unary }
+ *  unary       := ("!" | "not") unary | "(" expr ")" | test
+ *  test        := field [ cmp value | "in" value ".." value ]
+ *  cmp         := "==" | "!=" | "<" | "<=" | ">" | ">="
+ *  value       := number | symbol
+ *
+ * A bare field tests if the field is present in the frame, e.g. "error" or "event".
+ * The expression is compiled into an accumulator machine: every test sets the
+ * accumulator, "&&" and "||" become conditional jumps over the right-hand side.
+ */
+
+/*
+ *
+ * Local Constants.
+ *
+ */
+typedef enum tagOpcodeType {
+    OP_PRESENT,         /* acc = field present                          */
+    OP_EQ,              /* acc = field == a                             */
+    OP_NE,
+    OP_LT,
+    OP_LE,
+    OP_GT,
+    OP_GE,
+    OP_RANGE,           /* acc = a <= field <= b                        */
+    OP_NOT,             /* acc = !acc                                   */
+    OP_JF,              /* if (!acc) goto target                        */
+    OP_JT               /* if (acc) goto target                         */
+} OpcodeType;
+
+/*
+ *
+ * Local Types.
+ *
+ */
+typedef struct tagInstructionType {
+    uint8_t opcode;
+    uint8_t field;
+    uint16_t target;
+    uint32_t a;
+    uint32_t b;
+} InstructionType;
+
+typedef struct tagNameType {
+    char const * name;
+    uint32_t value;
+} NameType;
+
+/*
+ * Field values of the frame under test, loaded on first use.
+ */
+typedef struct tagContextType {
+    XcpMessage const * msg;
+    XcpSessionType const * session;
+    uint32_t loaded;
+    uint64_t values[XCP_FIELD_COUNT];
+} ContextType;
+
+/*
+ *
+ * Local Variables.
+ *
+ */
+static InstructionType code[XCP_FILTER_MAX_CODE];
+static uint16_t code_length = 0;
+
+static char const * source;
+static char const * cursor;
+static char error_text[128];
+
+static NameType const fields[] = {
+    { "pid",        XCP_FIELD_PID },
+    { "len",        XCP_FIELD_LEN },
+    { "master",     XCP_FIELD_MASTER },
+    { "slave",      XCP_FIELD_SLAVE },
+    { "service",    XCP_FIELD_SERVICE },
+    { "error",      XCP_FIELD_ERROR },
+    { "event",      XCP_FIELD_EVENT },
+    { "addr",       XCP_FIELD_ADDR },
+    { "ext",        XCP_FIELD_EXT },
+    { "daq",        XCP_FIELD_DAQ },
+    { "odt",        XCP_FIELD_ODT },
+    { NULL,         0 }
+};
+
+#define SYMBOL(name)    { #name, name }
+
+static NameType const symbols[] = {
+    SYMBOL(CONNECT), SYMBOL(DISCONNECT), SYMBOL(GET_STATUS), SYMBOL(SYNCH), SYMBOL(GET_COMM_MODE_INFO),
+    SYMBOL(GET_ID), SYMBOL(SET_REQUEST), SYMBOL(GET_SEED), SYMBOL(UNLOCK), SYMBOL(SET_MTA), SYMBOL(UPLOAD),
+    SYMBOL(SHORT_UPLOAD), SYMBOL(BUILD_CHECKSUM), SYMBOL(TRANSPORT_LAYER_CMD), SYMBOL(USER_CMD),
+    SYMBOL(DOWNLOAD), SYMBOL(DOWNLOAD_NEXT), SYMBOL(DOWNLOAD_MAX), SYMBOL(SHORT_DOWNLOAD), SYMBOL(MODIFY_BITS),
+    SYMBOL(SET_CAL_PAGE), SYMBOL(GET_CAL_PAGE), SYMBOL(GET_PAG_PROCESSOR_INFO), SYMBOL(GET_SEGMENT_INFO),
+    SYMBOL(GET_PAGE_INFO), SYMBOL(SET_SEGMENT_MODE), SYMBOL(GET_SEGMENT_MODE), SYMBOL(COPY_CAL_PAGE),
+    SYMBOL(CLEAR_DAQ_LIST), SYMBOL(SET_DAQ_PTR), SYMBOL(WRITE_DAQ), SYMBOL(SET_DAQ_LIST_MODE),
+    SYMBOL(GET_DAQ_LIST_MODE), SYMBOL(START_STOP_DAQ_LIST), SYMBOL(START_STOP_SYNCH), SYMBOL(GET_DAQ_CLOCK),
+    SYMBOL(READ_DAQ), SYMBOL(GET_DAQ_PROCESSOR_INFO), SYMBOL(GET_DAQ_RESOLUTION_INFO), SYMBOL(GET_DAQ_LIST_INFO),
+    SYMBOL(GET_DAQ_EVENT_INFO), SYMBOL(FREE_DAQ), SYMBOL(ALLOC_DAQ), SYMBOL(ALLOC_ODT), SYMBOL(ALLOC_ODT_ENTRY),
+    SYMBOL(PROGRAM_START), SYMBOL(PROGRAM_CLEAR), SYMBOL(PROGRAM), SYMBOL(PROGRAM_RESET),
+    SYMBOL(GET_PGM_PROCESSOR_INFO), SYMBOL(GET_SECTOR_INFO), SYMBOL(PROGRAM_PREPARE), SYMBOL(PROGRAM_FORMAT),
+    SYMBOL(PROGRAM_NEXT), SYMBOL(PROGRAM_MAX), SYMBOL(PROGRAM_VERIFY), SYMBOL(WRITE_DAQ_MULTIPLE),
+    SYMBOL(TIME_CORRELATION_PROPERTIES), SYMBOL(DTO_CTR_PROPERTIES),
+    { "EV_RESUME_MODE", XCP_EV_RESUME_MODE }, { "EV_CLEAR_DAQ", XCP_EV_CLEAR_DAQ },
+    { "EV_STORE_DAQ", XCP_EV_STORE_DAQ }, { "EV_STORE_CAL", XCP_EV_STORE_CAL },
+    { "EV_CMD_PENDING", XCP_EV_CMD_PENDING }, { "EV_DAQ_OVERLOAD", XCP_EV_DAQ_OVERLOAD },
+    { "EV_SESSION_TERMINATED", XCP_EV_SESSION_TERMINATED }, { "EV_TIME_SYNC", XCP_EV_TIME_SYNC },
+    { "EV_STIM_TIMEOUT", XCP_EV_STIM_TIMEOUT }, { "EV_SLEEP", XCP_EV_SLEEP }, { "EV_WAKE_UP", XCP_EV_WAKE_UP },
+    { "EV_USER", XCP_EV_USER }, { "EV_TRANSPORT", XCP_EV_TRANSPORT },
+    SYMBOL(ERR_CMD_SYNCH), SYMBOL(ERR_CMD_BUSY), SYMBOL(ERR_DAQ_ACTIVE), SYMBOL(ERR_PGM_ACTIVE),
+    SYMBOL(ERR_CMD_UNKNOWN), SYMBOL(ERR_CMD_SYNTAX), SYMBOL(ERR_OUT_OF_RANGE), SYMBOL(ERR_WRITE_PROTECTED),
+    SYMBOL(ERR_ACCESS_DENIED), SYMBOL(ERR_ACCESS_LOCKED), SYMBOL(ERR_PAGE_NOT_VALID), SYMBOL(ERR_MODE_NOT_VALID),
+    SYMBOL(ERR_SEGMENT_NOT_VALID), SYMBOL(ERR_SEQUENCE), SYMBOL(ERR_DAQ_CONFIG), SYMBOL(ERR_MEMORY_OVERFLOW),
+    SYMBOL(ERR_GENERIC), SYMBOL(ERR_VERIFY), SYMBOL(ERR_RESOURCE_TEMPORARY_NOT_ACCESSIBLE),
+    { NULL, 0 }
+};
+
+/*
+ *
+ * Local Functions.
+ *
+ */
+static bool parse_or(void);
+static bool parse_and(void);
+static bool parse_unary(void);
+static bool parse_test(void);
+static bool parse_value(uint32_t * const value);
+static bool parse_name(char * const name, size_t size);
+static bool accept(char const * const token);
+static bool accept_word(char const * const word);
+static void skip_blanks(void);
+static bool emit(uint8_t opcode, uint8_t field, uint32_t a, uint32_t b);
+static bool fail(char const * const message);
+static uint64_t load(ContextType * const ctx, uint8_t field);
+
+
+bool xcp_filter_compile(char const * const expression)
+{
+    source = cursor = expression;
+    code_length = 0;
+    error_text[0] = '\0';
+
+    if (!parse_or()) {
+        return FALSE;
+    }
+    skip_blanks();
+    if (*cursor != '\0') {
+        return fail("unexpected input");
+    }
+    return TRUE;
+}
+
+char const * xcp_filter_error(void)
+{
+    return error_text;
+}
+
+static bool parse_or(void)
+{
+    uint16_t jumps[XCP_FILTER_MAX_CODE];
+    uint16_t count = 0;
+    uint16_t idx;
+
+    if (!parse_and()) {
+        return FALSE;
+    }
+    while (accept("||") || accept_word("or")) {
+        jumps[count++] = code_length;
+        if (!emit(OP_JT, 0, 0, 0) || !parse_and()) {
+            return FALSE;
+        }
+    }
+    for (idx = 0; idx < count; ++idx) {
+        code[jumps[idx]].target = code_length;
+    }
+    return TRUE;
+}
+
+static bool parse_and(void)
+{
+    uint16_t jumps[XCP_FILTER_MAX_CODE];
+    uint16_t count = 0;
+    uint16_t idx;
+
+    if (!parse_unary()) {
+        return FALSE;
+    }
+    while (accept("&&") || accept_word("and")) {
+        jumps[count++] = code_length;
+        if (!emit(OP_JF, 0, 0, 0) || !parse_unary()) {
+            return FALSE;
+        }
+    }
+    for (idx = 0; idx < count; ++idx) {
+        code[jumps[idx]].target = code_length;
+    }
+    return TRUE;
+}
+
+static bool parse_unary(void)
+{
+    if ((accept("!") && !accept("=")) || accept_word("not")) {
+        return parse_unary() && emit(OP_NOT, 0, 0, 0);
+    }
+    if (accept("(")) {
+        if (!parse_or()) {
+            return FALSE;
+        }
+        return accept(")") ? TRUE : fail("')' expected");
+    }
+    return parse_test();
+}
+
+static bool parse_test(void)
+{
+    static struct {
+        char const * token;
+        uint8_t opcode;
+    } const comparisons[] = {
+        { "==", OP_EQ }, { "!=", OP_NE }, { "<=", OP_LE }, { ">=", OP_GE }, { "<", OP_LT }, { ">", OP_GT },
+        { NULL, 0 }
+    };
+    char name[32];
+    NameType const * field;
+    uint32_t a;
+    uint32_t b;
+    uint8_t idx;
+
+    if (!parse_name(name, sizeof(name))) {
+        return fail("field expected");
+    }
+    for (field = fields; field->name != NULL; ++field) {
+        if (strcmp(field->name, name) == 0) {
+            break;
+        }
+    }
+    if (field->name == NULL) {
+        return fail("unknown field");
+    }
+    if (accept_word("in")) {
+        if (!parse_value(&a) || !accept("..") || !parse_value(&b)) {
+            return fail("range expected");
+        }
+        return emit(OP_RANGE, field->value, a, b);
+    }
+    for (idx = 0; comparisons[idx].token != NULL; ++idx) {
+        if (accept(comparisons[idx].token)) {
+            if (!parse_value(&a)) {
+                return fail("value expected");
+            }
+            return emit(comparisons[idx].opcode, field->value, a, 0);
+        }
+    }
+    return emit(OP_PRESENT, field->value, 0, 0);
+}
+
+static bool parse_value(uint32_t * const value)
+{
+    char name[48];
+    char * end;
+
+    skip_blanks();
+    if (isdigit((unsigned char)*cursor)) {
+        *value = strtoul(cursor, &end, 0);
+        cursor = end;
+        return TRUE;
+    }
+    if (!parse_name(name, sizeof(name))) {
+        return FALSE;
+    }
+    if (xcp_filter_symbol(name, value)) {
+        return TRUE;
+    }
+    return fail("unknown symbol");
+}
+
+/*
+ * Value of a service, event or error code name.
+ */
+bool xcp_filter_symbol(char const * const name, uint32_t * const value)
+{
+    NameType const * symbol;
+
+    for (symbol = symbols; symbol->name != NULL; ++symbol) {
+        if (strcmp(symbol->name, name) == 0) {
+            *value = symbol->value;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static bool parse_name(char * const name, size_t size)
+{
+    size_t length = 0;
+
+    skip_blanks();
+    while ((isalnum((unsigned char)cursor[length]) || (cursor[length] == '_')) && (length + 1 < size)) {
+        name[length] = cursor[length];
+        ++length;
+    }
+    if ((length == 0) || isdigit((unsigned char)name[0])) {
+        return FALSE;
+    }
+    name[length] = '\0';
+    cursor += length;
+    return TRUE;
+}
+
+static bool accept(char const * const token)
+{
+    size_t const length = strlen(token);
+
+    skip_blanks();
+    if (strncmp(cursor, token, length) == 0) {
+        cursor += length;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+static bool accept_word(char const * const word)
+{
+    size_t const length = strlen(word);
+
+    skip_blanks();
+    if ((strncmp(cursor, word, length) == 0) && !isalnum((unsigned char)cursor[length]) &&
+        (cursor[length] != '_')) {
+        cursor += length;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+static void skip_blanks(void)
+{
+    while (isspace((unsigned char)*cursor)) {
+        ++cursor;
+    }
+}
+
+static bool emit(uint8_t opcode, uint8_t field, uint32_t a, uint32_t b)
+{
+    if (code_length == XCP_FILTER_MAX_CODE) {
+        return fail("expression too long");
+    }
+    code[code_length].opcode = opcode;
+    code[code_length].field = field;
+    code[code_length].target = 0;
+    code[code_length].a = a;
+    code[code_length].b = b;
+    ++code_length;
+    return TRUE;
+}
+
+static bool fail(char const * const message)
+{
+    if (error_text[0] == '\0') {
+        snprintf(error_text, sizeof(error_text), "%s at column %u", message, (unsigned)(cursor - source) + 1);
+    }
+    return FALSE;
+}
+
+/*
+ * Fields are taken from the raw packet and the session state, nothing is formatted.
+ */
+static uint64_t load(ContextType * const ctx, uint8_t field)
+{
+    XcpMessage const * const msg = ctx->msg;
+    XcpSessionType const * const session = ctx->session;
+    bool const fromSlave = msg->fromSlave;
+    uint8_t const pid = msg->data[0];
+    uint64_t value = XCP_FIELD_UNKNOWN;
+    uint16_t daqList;
+    uint8_t odt;
+
+    if (ctx->loaded & (1U << field)) {
+        return ctx->values[field];
+    }
+    if (msg->length > 0) {
+        switch (field) {
+            case XCP_FIELD_PID:
+                value = pid;
+                break;
+            case XCP_FIELD_LEN:
+                value = msg->length;
+                break;
+            case XCP_FIELD_MASTER:
+                value = fromSlave ? XCP_FIELD_UNKNOWN : 1;
+                break;
+            case XCP_FIELD_SLAVE:
+                value = fromSlave ? 1 : XCP_FIELD_UNKNOWN;
+                break;
+            case XCP_FIELD_SERVICE:
+                if (session->isRequest) {
+                    value = pid;
+                } else if (session->response != 0) {
+                    value = session->request[0];
+                }
+                break;
+            case XCP_FIELD_ERROR:
+                if (fromSlave && (pid == 0xfe) && (msg->length >= 2)) {
+                    value = msg->data[1];
+                }
+                break;
+            case XCP_FIELD_EVENT:
+                if (fromSlave && (pid == 0xfd) && (msg->length >= 2)) {
+                    value = msg->data[1];
+                }
+                break;
+            case XCP_FIELD_ADDR:
+            case XCP_FIELD_EXT:
+                if (session->segment.service != 0) {
+                    value = (field == XCP_FIELD_ADDR) ? session->segment.address : session->segment.addressExtension;
+                } else if (session->isRequest && ((pid == SET_MTA) || (pid == SHORT_UPLOAD))) {
+                    value = (field == XCP_FIELD_ADDR) ? session->mtaAddress : session->mtaExtension;
+                }
+                break;
+            case XCP_FIELD_DAQ:
+            case XCP_FIELD_ODT:
+                if (fromSlave && (pid < 0xfc) && xcp_daq_identify(msg->data, msg->length, &daqList, &odt)) {
+                    ctx->values[XCP_FIELD_DAQ] = daqList;
+                    ctx->values[XCP_FIELD_ODT] = odt;
+                    ctx->loaded |= (1U << XCP_FIELD_DAQ) | (1U << XCP_FIELD_ODT);
+                    return ctx->values[field];
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    ctx->values[field] = value;
+    ctx->loaded |= 1U << field;
+    return value;
+}
+
+bool xcp_filter_match(XcpMessage const * const msg)
+{
+    ContextType ctx;
+    InstructionType const * insn;
+    uint16_t pc = 0;
+    uint64_t value;
+    bool acc = TRUE;
+
+    ctx.msg = msg;
+    ctx.session = xcp_session_get();
+    ctx.loaded = 0;
+
+    while (pc < code_length) {
+        insn = &code[pc++];
+        switch (insn->opcode) {
+            case OP_NOT:
+                acc = !acc;
+                continue;
+            case OP_JF:
+                if (!acc) {
+                    pc = insn->target;
+                }
+                continue;
+            case OP_JT:
+                if (acc) {
+                    pc = insn->target;
+                }
+                continue;
+            default:
+                break;
+        }
+        value = load(&ctx, insn->field);
+        if (value == XCP_FIELD_UNKNOWN) {
+            acc = FALSE;
+            continue;
+        }
+        switch (insn->opcode) {
+            case OP_PRESENT:
+                acc = TRUE;
+                break;
+            case OP_EQ:
+                acc = (value == insn->a);
+                break;
+            case OP_NE:
+                acc = (value != insn->a);
+                break;
+            case OP_LT:
+                acc = (value < insn->a);
+                break;
+            case OP_LE:
+                acc = (value <= insn->a);
+                break;
+            case OP_GT:
+                acc = (value > insn->a);
+                break;
+            case OP_GE:
+                acc = (value >= insn->a);
+                break;
+            case OP_RANGE:
+                acc = (value >= insn->a) && (value <= insn->b);
+                break;
+            default:
+                break;
+        }
+    }
+    return acc;
+}
+
+void xcp_filter_fields(XcpMessage const * const msg, uint64_t * const values)
+{
+    ContextType ctx;
+    uint8_t field;
+
+    ctx.msg = msg;
+    ctx.session = xcp_session_get();
+    ctx.loaded = 0;
+    for (field = 0; field < XCP_FIELD_COUNT; ++field) {
+        values[field] = load(&ctx, field);
+    }
+}
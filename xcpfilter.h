@@ -0,0 +1,98 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR BSD-3-Clause) */
+/*
+ * xcpfilter.h - compiled display filter expressions
+ *
+ * Copyright (c) 2021 Christoph Schueler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <cpu12.gems@googlemail.com>
+ *
+ */
+#ifndef __XCPFILTER_H
+#define __XCPFILTER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "xcp.h"
+
+/*
+ * Defines
+ */
+#define XCP_FILTER_MAX_CODE     (128)   /* Instructions per expression. */
+#define XCP_FIELD_UNKNOWN       (0xffffffffffffffffULL)
+
+/*
+ * Types
+ */
+
+/*
+ * Decoded fields of a message, as named in filter expressions.
+ */
+typedef enum tagXcpFieldType {
+    XCP_FIELD_PID,
+    XCP_FIELD_LEN,
+    XCP_FIELD_MASTER,
+    XCP_FIELD_SLAVE,
+    XCP_FIELD_SERVICE,
+    XCP_FIELD_ERROR,
+    XCP_FIELD_EVENT,
+    XCP_FIELD_ADDR,
+    XCP_FIELD_EXT,
+    XCP_FIELD_DAQ,
+    XCP_FIELD_ODT,
+    XCP_FIELD_COUNT
+} XcpFieldType;
+
+/*
+ * Global Functions
+ *
+ */
+bool xcp_filter_compile(char const * const expression);
+char const * xcp_filter_error(void);
+bool xcp_filter_symbol(char const * const name, uint32_t * const value);
+
+/*
+ * Call after xcp_session_update() and xcp_daq_update(), before any formatting.
+ */
+bool xcp_filter_match(XcpMessage const * const msg);
+
+/*
+ * All fields at once, XCP_FIELD_UNKNOWN for those not present, same call order as above.
+ */
+void xcp_filter_fields(XcpMessage const * const msg, uint64_t * const values);
+
+#endif /* __XCPFILTER_H */
@@ -0,0 +1,447 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR BSD-3-Clause) */
+/*
+ * xcpformat.c - machine-readable output (JSON Lines, CSV)
+ *
+ * Copyright (c) 2021 Christoph Schueler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <cpu12.gems@googlemail.com>
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "xcp.h"
+#include "xcpformat.h"
+#include "xcpfilter.h"
+#include "xcpdaq.h"
+#include "xcpeth.h"
+
+/*
+ * One line per message, built from the decoded fields (see xcp_filter_fields()):
+ *
+ *   {"ts":1436509052.249713,"dir":"slave","id":"7E1","len":8,"pid":255,"kind":"res","service":"SHORT_UPLOAD",
+ *    "addr":4096,"ext":0,"data":"FFDEADBEEF"}
+ *
+ *   ts,dir,id,ctr,len,pid,kind,service,error,event,addr,ext,daq,odt,values,data
+ *
+ * The columns are a table; keys, names and hex digits are precomputed, the line is
+ * put together in a static buffer and written with one fwrite().
+ */
+
+/*
+ *
+ * Local Constants.
+ *
+ */
+typedef enum tagRenderType {
+    RENDER_TIME,
+    RENDER_BUS,         /* Only with xcp_format_set_bus().      */
+    RENDER_DIRECTION,
+    RENDER_ID,
+    RENDER_CTR,
+    RENDER_NUMBER,      /* Field value.                         */
+    RENDER_KIND,
+    RENDER_NAME,        /* Field value looked up in `names`.    */
+    RENDER_VALUES,
+    RENDER_DATA
+} RenderType;
+
+#define NO_FIELD        (0xff)
+#define LINE_SIZE       (2 * (XCP_ETH_MAX_PACKET + 1) + 2048)
+
+#define TOKEN(text)     { text, sizeof(text) - 1 }
+
+/*
+ *
+ * Local Types.
+ *
+ */
+typedef struct tagTokenType {
+    char const * text;
+    uint8_t length;
+} TokenType;
+
+typedef struct tagColumnType {
+    TokenType json;                 /* Key incl. quotes and colon.  */
+    TokenType csv;                  /* Header.                      */
+    uint8_t render;
+    uint8_t field;
+    TokenType const * names;
+} ColumnType;
+
+/*
+ *
+ * Local Variables.
+ *
+ */
+static TokenType const service_names[256] = {
+    [CONNECT] = TOKEN("CONNECT"), [DISCONNECT] = TOKEN("DISCONNECT"), [GET_STATUS] = TOKEN("GET_STATUS"),
+    [SYNCH] = TOKEN("SYNCH"), [GET_COMM_MODE_INFO] = TOKEN("GET_COMM_MODE_INFO"), [GET_ID] = TOKEN("GET_ID"),
+    [SET_REQUEST] = TOKEN("SET_REQUEST"), [GET_SEED] = TOKEN("GET_SEED"), [UNLOCK] = TOKEN("UNLOCK"),
+    [SET_MTA] = TOKEN("SET_MTA"), [UPLOAD] = TOKEN("UPLOAD"), [SHORT_UPLOAD] = TOKEN("SHORT_UPLOAD"),
+    [BUILD_CHECKSUM] = TOKEN("BUILD_CHECKSUM"), [TRANSPORT_LAYER_CMD] = TOKEN("TRANSPORT_LAYER_CMD"),
+    [USER_CMD] = TOKEN("USER_CMD"), [DOWNLOAD] = TOKEN("DOWNLOAD"), [DOWNLOAD_NEXT] = TOKEN("DOWNLOAD_NEXT"),
+    [DOWNLOAD_MAX] = TOKEN("DOWNLOAD_MAX"), [SHORT_DOWNLOAD] = TOKEN("SHORT_DOWNLOAD"),
+    [MODIFY_BITS] = TOKEN("MODIFY_BITS"), [SET_CAL_PAGE] = TOKEN("SET_CAL_PAGE"),
+    [GET_CAL_PAGE] = TOKEN("GET_CAL_PAGE"), [GET_PAG_PROCESSOR_INFO] = TOKEN("GET_PAG_PROCESSOR_INFO"),
+    [GET_SEGMENT_INFO] = TOKEN("GET_SEGMENT_INFO"), [GET_PAGE_INFO] = TOKEN("GET_PAGE_INFO"),
+    [SET_SEGMENT_MODE] = TOKEN("SET_SEGMENT_MODE"), [GET_SEGMENT_MODE] = TOKEN("GET_SEGMENT_MODE"),
+    [COPY_CAL_PAGE] = TOKEN("COPY_CAL_PAGE"), [CLEAR_DAQ_LIST] = TOKEN("CLEAR_DAQ_LIST"),
+    [SET_DAQ_PTR] = TOKEN("SET_DAQ_PTR"), [WRITE_DAQ] = TOKEN("WRITE_DAQ"),
+    [SET_DAQ_LIST_MODE] = TOKEN("SET_DAQ_LIST_MODE"), [GET_DAQ_LIST_MODE] = TOKEN("GET_DAQ_LIST_MODE"),
+    [START_STOP_DAQ_LIST] = TOKEN("START_STOP_DAQ_LIST"), [START_STOP_SYNCH] = TOKEN("START_STOP_SYNCH"),
+    [GET_DAQ_CLOCK] = TOKEN("GET_DAQ_CLOCK"), [READ_DAQ] = TOKEN("READ_DAQ"),
+    [GET_DAQ_PROCESSOR_INFO] = TOKEN("GET_DAQ_PROCESSOR_INFO"),
+    [GET_DAQ_RESOLUTION_INFO] = TOKEN("GET_DAQ_RESOLUTION_INFO"),
+    [GET_DAQ_LIST_INFO] = TOKEN("GET_DAQ_LIST_INFO"), [GET_DAQ_EVENT_INFO] = TOKEN("GET_DAQ_EVENT_INFO"),
+    [FREE_DAQ] = TOKEN("FREE_DAQ"), [ALLOC_DAQ] = TOKEN("ALLOC_DAQ"), [ALLOC_ODT] = TOKEN("ALLOC_ODT"),
+    [ALLOC_ODT_ENTRY] = TOKEN("ALLOC_ODT_ENTRY"), [PROGRAM_START] = TOKEN("PROGRAM_START"),
+    [PROGRAM_CLEAR] = TOKEN("PROGRAM_CLEAR"), [PROGRAM] = TOKEN("PROGRAM"),
+    [PROGRAM_RESET] = TOKEN("PROGRAM_RESET"), [GET_PGM_PROCESSOR_INFO] = TOKEN("GET_PGM_PROCESSOR_INFO"),
+    [GET_SECTOR_INFO] = TOKEN("GET_SECTOR_INFO"), [PROGRAM_PREPARE] = TOKEN("PROGRAM_PREPARE"),
+    [PROGRAM_FORMAT] = TOKEN("PROGRAM_FORMAT"), [PROGRAM_NEXT] = TOKEN("PROGRAM_NEXT"),
+    [PROGRAM_MAX] = TOKEN("PROGRAM_MAX"), [PROGRAM_VERIFY] = TOKEN("PROGRAM_VERIFY"),
+    [WRITE_DAQ_MULTIPLE] = TOKEN("WRITE_DAQ_MULTIPLE"),
+    [TIME_CORRELATION_PROPERTIES] = TOKEN("TIME_CORRELATION_PROPERTIES"),
+    [DTO_CTR_PROPERTIES] = TOKEN("DTO_CTR_PROPERTIES")
+};
+
+static TokenType const error_names[256] = {
+    [ERR_CMD_SYNCH] = TOKEN("ERR_CMD_SYNCH"), [ERR_CMD_BUSY] = TOKEN("ERR_CMD_BUSY"),
+    [ERR_DAQ_ACTIVE] = TOKEN("ERR_DAQ_ACTIVE"), [ERR_PGM_ACTIVE] = TOKEN("ERR_PGM_ACTIVE"),
+    [ERR_CMD_UNKNOWN] = TOKEN("ERR_CMD_UNKNOWN"), [ERR_CMD_SYNTAX] = TOKEN("ERR_CMD_SYNTAX"),
+    [ERR_OUT_OF_RANGE] = TOKEN("ERR_OUT_OF_RANGE"), [ERR_WRITE_PROTECTED] = TOKEN("ERR_WRITE_PROTECTED"),
+    [ERR_ACCESS_DENIED] = TOKEN("ERR_ACCESS_DENIED"), [ERR_ACCESS_LOCKED] = TOKEN("ERR_ACCESS_LOCKED"),
+    [ERR_PAGE_NOT_VALID] = TOKEN("ERR_PAGE_NOT_VALID"), [ERR_MODE_NOT_VALID] = TOKEN("ERR_MODE_NOT_VALID"),
+    [ERR_SEGMENT_NOT_VALID] = TOKEN("ERR_SEGMENT_NOT_VALID"), [ERR_SEQUENCE] = TOKEN("ERR_SEQUENCE"),
+    [ERR_DAQ_CONFIG] = TOKEN("ERR_DAQ_CONFIG"), [ERR_MEMORY_OVERFLOW] = TOKEN("ERR_MEMORY_OVERFLOW"),
+    [ERR_GENERIC] = TOKEN("ERR_GENERIC"), [ERR_VERIFY] = TOKEN("ERR_VERIFY"),
+    [ERR_RESOURCE_TEMPORARY_NOT_ACCESSIBLE] = TOKEN("ERR_RESOURCE_TEMPORARY_NOT_ACCESSIBLE")
+};
+
+static TokenType const event_names[256] = {
+    [XCP_EV_RESUME_MODE] = TOKEN("EV_RESUME_MODE"), [XCP_EV_CLEAR_DAQ] = TOKEN("EV_CLEAR_DAQ"),
+    [XCP_EV_STORE_DAQ] = TOKEN("EV_STORE_DAQ"), [XCP_EV_STORE_CAL] = TOKEN("EV_STORE_CAL"),
+    [XCP_EV_CMD_PENDING] = TOKEN("EV_CMD_PENDING"), [XCP_EV_DAQ_OVERLOAD] = TOKEN("EV_DAQ_OVERLOAD"),
+    [XCP_EV_SESSION_TERMINATED] = TOKEN("EV_SESSION_TERMINATED"), [XCP_EV_TIME_SYNC] = TOKEN("EV_TIME_SYNC"),
+    [XCP_EV_STIM_TIMEOUT] = TOKEN("EV_STIM_TIMEOUT"), [XCP_EV_SLEEP] = TOKEN("EV_SLEEP"),
+    [XCP_EV_WAKE_UP] = TOKEN("EV_WAKE_UP"), [XCP_EV_USER] = TOKEN("EV_USER"),
+    [XCP_EV_TRANSPORT] = TOKEN("EV_TRANSPORT")
+};
+
+static TokenType const direction_names[] = {
+    TOKEN("master"), TOKEN("slave")
+};
+
+static TokenType const kind_names[] = {
+    TOKEN("cmd"), TOKEN("stim"), TOKEN("res"), TOKEN("err"), TOKEN("ev"), TOKEN("serv"), TOKEN("dto")
+};
+
+static ColumnType const columns[] = {
+    { TOKEN("\"ts\":"),        TOKEN("ts"),        RENDER_TIME,       NO_FIELD,           NULL },
+    { TOKEN("\"bus\":"),       TOKEN("bus"),       RENDER_BUS,        NO_FIELD,           NULL },
+    { TOKEN("\"dir\":"),       TOKEN("dir"),       RENDER_DIRECTION,  NO_FIELD,           NULL },
+    { TOKEN("\"id\":"),        TOKEN("id"),        RENDER_ID,         NO_FIELD,           NULL },
+    { TOKEN("\"ctr\":"),       TOKEN("ctr"),       RENDER_CTR,        NO_FIELD,           NULL },
+    { TOKEN("\"len\":"),       TOKEN("len"),       RENDER_NUMBER,     XCP_FIELD_LEN,      NULL },
+    { TOKEN("\"pid\":"),       TOKEN("pid"),       RENDER_NUMBER,     XCP_FIELD_PID,      NULL },
+    { TOKEN("\"kind\":"),      TOKEN("kind"),      RENDER_KIND,       XCP_FIELD_PID,      NULL },
+    { TOKEN("\"service\":"),   TOKEN("service"),   RENDER_NAME,       XCP_FIELD_SERVICE,  service_names },
+    { TOKEN("\"error\":"),     TOKEN("error"),     RENDER_NAME,       XCP_FIELD_ERROR,    error_names },
+    { TOKEN("\"event\":"),     TOKEN("event"),     RENDER_NAME,       XCP_FIELD_EVENT,    event_names },
+    { TOKEN("\"addr\":"),      TOKEN("addr"),      RENDER_NUMBER,     XCP_FIELD_ADDR,     NULL },
+    { TOKEN("\"ext\":"),       TOKEN("ext"),       RENDER_NUMBER,     XCP_FIELD_EXT,      NULL },
+    { TOKEN("\"daq\":"),       TOKEN("daq"),       RENDER_NUMBER,     XCP_FIELD_DAQ,      NULL },
+    { TOKEN("\"odt\":"),       TOKEN("odt"),       RENDER_NUMBER,     XCP_FIELD_ODT,      NULL },
+    { TOKEN("\"values\":"),    TOKEN("values"),    RENDER_VALUES,     NO_FIELD,           NULL },
+    { TOKEN("\"data\":"),      TOKEN("data"),      RENDER_DATA,       NO_FIELD,           NULL },
+};
+
+#define COLUMN_COUNT    (sizeof(columns) / sizeof(columns[0]))
+
+static char const hex_digits[] = "0123456789ABCDEF";
+
+static XcpFormatType format = XCP_FORMAT_TEXT;
+static TokenType bus = { "", 0 };
+static char line[LINE_SIZE];
+
+/*
+ *
+ * Local Functions.
+ *
+ */
+static char * put_token(char * out, TokenType const * const token);
+static char * put_uint(char * out, uint64_t value);
+static char * put_name(char * out, TokenType const * const names, uint64_t value, bool quoted);
+static char * put_column(char * out, ColumnType const * const column, XcpMessage const * const msg,
+                         uint64_t const * const fields, bool json);
+static uint8_t kind_of(XcpMessage const * const msg);
+
+
+bool xcp_format_select(char const * const name)
+{
+    if (strcmp(name, "text") == 0) {
+        format = XCP_FORMAT_TEXT;
+    } else if (strcmp(name, "jsonl") == 0) {
+        format = XCP_FORMAT_JSONL;
+    } else if (strcmp(name, "csv") == 0) {
+        format = XCP_FORMAT_CSV;
+    } else {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+XcpFormatType xcp_format_get(void)
+{
+    return format;
+}
+
+void xcp_format_set_bus(char const * const name)
+{
+    bus.text = name;
+    bus.length = strlen(name);
+}
+
+void xcp_format_header(FILE * const out)
+{
+    char * end = line;
+    unsigned idx;
+
+    if (format != XCP_FORMAT_CSV) {
+        return;
+    }
+    for (idx = 0; idx < COLUMN_COUNT; ++idx) {
+        if ((columns[idx].render == RENDER_BUS) && (bus.length == 0)) {
+            continue;
+        }
+        if (idx > 0) {
+            *end++ = ',';
+        }
+        end = put_token(end, &columns[idx].csv);
+    }
+    *end++ = '\n';
+    fwrite(line, 1, end - line, out);
+}
+
+void xcp_format_write(XcpMessage const * const msg, uint64_t const * const fields, FILE * const out)
+{
+    bool const json = (format == XCP_FORMAT_JSONL);
+    char * end = line;
+    char * start;
+    char * value;
+    unsigned idx;
+
+    if (json) {
+        *end++ = '{';
+    }
+    for (idx = 0; idx < COLUMN_COUNT; ++idx) {
+        if ((columns[idx].render == RENDER_BUS) && (bus.length == 0)) {
+            continue;
+        }
+        start = end;
+        if (idx > 0) {
+            *start++ = ',';
+        }
+        if (json) {
+            start = put_token(start, &columns[idx].json);
+        }
+        /* A JSON key of an absent field is taken back, CSV keeps the empty column. */
+        value = put_column(start, &columns[idx], msg, fields, json);
+        if (value != NULL) {
+            end = value;
+        } else if (!json) {
+            end = start;
+        }
+    }
+    if (json) {
+        *end++ = '}';
+    }
+    *end++ = '\n';
+    fwrite(line, 1, end - line, out);
+}
+
+static char * put_token(char * out, TokenType const * const token)
+{
+    memcpy(out, token->text, token->length);
+    return out + token->length;
+}
+
+static char * put_uint(char * out, uint64_t value)
+{
+    char digits[20];
+    unsigned count = 0;
+
+    do {
+        digits[count++] = '0' + (value % 10);
+        value /= 10;
+    } while (value > 0);
+    while (count > 0) {
+        *out++ = digits[--count];
+    }
+    return out;
+}
+
+/*
+ * Symbolic name if there is one, else the number.
+ */
+static char * put_name(char * out, TokenType const * const names, uint64_t value, bool quoted)
+{
+    if ((value > 0xff) || (names[value].text == NULL)) {
+        return put_uint(out, value);
+    }
+    if (quoted) {
+        *out++ = '"';
+    }
+    out = put_token(out, &names[value]);
+    if (quoted) {
+        *out++ = '"';
+    }
+    return out;
+}
+
+/*
+ * Returns the end of the value, NULL if the column doesn't apply to this message.
+ */
+static char * put_column(char * out, ColumnType const * const column, XcpMessage const * const msg,
+                         uint64_t const * const fields, bool json)
+{
+    uint64_t values[XCP_DAQ_MAX_ODT_ENTRIES];
+    XcpDaqPlanType const * plan;
+    canid_t id;
+    uint32_t usec;
+    uint16_t idx;
+    int digit;
+
+    if ((column->field != NO_FIELD) && (fields[column->field] == XCP_FIELD_UNKNOWN)) {
+        return NULL;
+    }
+    switch (column->render) {
+        case RENDER_TIME:
+            out = put_uint(out, (uint64_t)msg->timestamp.tv_sec);
+            *out++ = '.';
+            usec = msg->timestamp.tv_usec;
+            for (digit = 5; digit >= 0; --digit) {
+                out[digit] = '0' + (usec % 10);
+                usec /= 10;
+            }
+            return out + 6;
+        case RENDER_BUS:
+            if (json) {
+                *out++ = '"';
+            }
+            out = put_token(out, &bus);
+            if (json) {
+                *out++ = '"';
+            }
+            return out;
+        case RENDER_DIRECTION:
+            return put_name(out, direction_names, msg->fromSlave ? 1 : 0, json);
+        case RENDER_ID:
+            if (msg->frame == NULL) {
+                return NULL;
+            }
+            id = msg->frame->can_id;
+            if (json) {
+                *out++ = '"';
+            }
+            for (digit = (id & CAN_EFF_FLAG) ? 28 : 8; digit >= 0; digit -= 4) {
+                *out++ = hex_digits[((id & CAN_EFF_MASK) >> digit) & 0x0f];
+            }
+            if (json) {
+                *out++ = '"';
+            }
+            return out;
+        case RENDER_CTR:
+            return (msg->transport == XCP_TRANSPORT_CAN) ? NULL : put_uint(out, msg->ctr);
+        case RENDER_NUMBER:
+            return put_uint(out, fields[column->field]);
+        case RENDER_KIND:
+            return put_name(out, kind_names, kind_of(msg), json);
+        case RENDER_NAME:
+            return put_name(out, column->names, fields[column->field], json);
+        case RENDER_VALUES:
+            if (!msg->fromSlave || (msg->length == 0) || (msg->data[0] >= 0xfc)) {
+                return NULL;
+            }
+            plan = xcp_daq_values(msg, values);
+            if (plan == NULL) {
+                return NULL;
+            }
+            if (json) {
+                *out++ = '[';
+            }
+            for (idx = 0; idx < plan->entryCount; ++idx) {
+                if (idx > 0) {
+                    *out++ = json ? ',' : ' ';
+                }
+                out = put_uint(out, values[idx]);
+            }
+            if (json) {
+                *out++ = ']';
+            }
+            return out;
+        case RENDER_DATA:
+            if (json) {
+                *out++ = '"';
+            }
+            for (idx = 0; idx < msg->length; ++idx) {
+                *out++ = hex_digits[msg->data[idx] >> 4];
+                *out++ = hex_digits[msg->data[idx] & 0x0f];
+            }
+            if (json) {
+                *out++ = '"';
+            }
+            return out;
+        default:
+            return NULL;
+    }
+}
+
+static uint8_t kind_of(XcpMessage const * const msg)
+{
+    uint8_t const pid = msg->data[0];
+
+    if (!msg->fromSlave) {
+        return (pid >= 0xc0) ? 0 : 1;
+    }
+    return (pid >= 0xfc) ? 2 + (0xff - pid) : 6;
+}
@@ -0,0 +1,307 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR BSD-3-Clause) */
+/*
+ * xcpgateway.c - XCP gateway latency and loss between two interfaces
+ *
+ * Copyright (c) 2021 Christoph Schueler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <cpu12.gems@googlemail.com>
+ *
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <libgen.h>
+
+#include <net/if.h>
+#include <sys/socket.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+#include "xcp.h"
+#include "xcplog.h"
+#include "xcpcorrelate.h"
+
+/*
+ * Both interfaces are read through one socket bound to all CAN interfaces, the
+ * interface of a frame comes with its address. Offline, a candump log of both
+ * interfaces (candump -l can0,can1 or xcpmerge output) is read instead.
+ */
+
+#define NO_CAN_ID   (0xFFFFFFFFU)
+#define LINE_SIZE   (512)
+
+static canid_t src = NO_CAN_ID;
+static canid_t dst = NO_CAN_ID;
+static char const * names[2];
+static volatile sig_atomic_t running = 1;
+static volatile sig_atomic_t report = 0;
+
+static void sigterm(int signo)
+{
+    (void)signo;
+    running = 0;
+}
+
+static void sigreport(int signo)
+{
+    (void)signo;
+    report = 1;
+}
+
+void print_usage(char *prg)
+{
+    fprintf(stderr, "\nUsage: %s [options] <CAN interface> <CAN interface>\n", prg);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "         -m <can_id>  (XCP master can_id, as for xcpdump)\n");
+    fprintf(stderr, "         -s <can_id>  (XCP slave can_id, as for xcpdump)\n");
+    fprintf(stderr, "         -w <ms>      (longest latency expected, frames unmatched after it are lost, default %u)\n",
+            XCP_CORRELATE_DEFAULT_WINDOW);
+    fprintf(stderr, "         -r <log>     (read a candump log of both interfaces instead of capturing)\n");
+    fprintf(stderr, "\nThe report is printed on exit and on SIGUSR1.\n");
+}
+
+/*
+ * DAQ from the slave and STIM from the master are DTOs.
+ */
+static XcpCorrelateType type_of(struct canfd_frame const * const frame)
+{
+    if (frame->len == 0) {
+        return XCP_CORRELATE_CTO;
+    }
+    if (frame->can_id == dst) {
+        return (frame->data[0] < 0xfc) ? XCP_CORRELATE_DTO : XCP_CORRELATE_CTO;
+    }
+    return (frame->data[0] < 0xc0) ? XCP_CORRELATE_DTO : XCP_CORRELATE_CTO;
+}
+
+static void print_report(void)
+{
+    xcp_correlate_print(names);
+    fflush(stdout);
+}
+
+static int read_log(char const * const path)
+{
+    XcpLogRecordType record;
+    char line[LINE_SIZE];
+    FILE * file;
+    unsigned side;
+
+    file = fopen(path, "r");
+    if (file == NULL) {
+        perror(path);
+        return 1;
+    }
+    while (running && (fgets(line, sizeof(line), file) != NULL)) {
+        if (!xcp_log_parse(line, &record) ||
+            ((record.frame.can_id != src) && (record.frame.can_id != dst))) {
+            continue;
+        }
+        for (side = 0; (side < 2) && (strcmp(record.interface, names[side]) != 0); ++side) {
+            ;
+        }
+        if (side < 2) {
+            xcp_correlate_frame(side, record.timestamp, &record.frame, type_of(&record.frame));
+        }
+        if (report) {
+            report = 0;
+            print_report();
+        }
+    }
+    fclose(file);
+    return 0;
+}
+
+static int capture(void)
+{
+    int const canfd_on = 1;
+    int const timestamp_on = 1;
+    struct sockaddr_can addr;
+    struct can_filter rfilter[2];
+    struct canfd_frame frame;
+    struct iovec iov;
+    struct msghdr msg;
+    struct cmsghdr * cmsg;
+    struct timespec ts;
+    char ctrlmsg[CMSG_SPACE(sizeof(struct timespec))];
+    int ifindex[2];
+    unsigned side;
+    int nbytes;
+    int s;
+
+    for (side = 0; side < 2; ++side) {
+        ifindex[side] = if_nametoindex(names[side]);
+        if (ifindex[side] == 0) {
+            perror(names[side]);
+            return 1;
+        }
+    }
+    if ((s = socket(PF_CAN, SOCK_RAW, CAN_RAW)) < 0) {
+        perror("socket");
+        return 1;
+    }
+    setsockopt(s, SOL_CAN_RAW, CAN_RAW_FD_FRAMES, &canfd_on, sizeof(canfd_on));
+    setsockopt(s, SOL_SOCKET, SO_TIMESTAMPNS, &timestamp_on, sizeof(timestamp_on));
+    rfilter[0].can_id = src;
+    rfilter[0].can_mask = CAN_EFF_FLAG | CAN_RTR_FLAG | ((src & CAN_EFF_FLAG) ? CAN_EFF_MASK : CAN_SFF_MASK);
+    rfilter[1].can_id = dst;
+    rfilter[1].can_mask = CAN_EFF_FLAG | CAN_RTR_FLAG | ((dst & CAN_EFF_FLAG) ? CAN_EFF_MASK : CAN_SFF_MASK);
+    setsockopt(s, SOL_CAN_RAW, CAN_RAW_FILTER, &rfilter, sizeof(rfilter));
+
+    /* Interface 0: all CAN interfaces. */
+    memset(&addr, 0, sizeof(addr));
+    addr.can_family = AF_CAN;
+    addr.can_ifindex = 0;
+    if (bind(s, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("bind");
+        close(s);
+        return 1;
+    }
+
+    iov.iov_base = &frame;
+    msg.msg_name = &addr;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = &ctrlmsg;
+
+    while (running) {
+        if (report) {
+            report = 0;
+            print_report();
+        }
+        iov.iov_len = sizeof(frame);
+        msg.msg_namelen = sizeof(addr);
+        msg.msg_controllen = sizeof(ctrlmsg);
+        msg.msg_flags = 0;
+        nbytes = recvmsg(s, &msg, 0);
+        if (nbytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("read");
+            close(s);
+            return 1;
+        }
+        for (side = 0; (side < 2) && (addr.can_ifindex != ifindex[side]); ++side) {
+            ;
+        }
+        if (side == 2) {
+            continue;
+        }
+        memset(&ts, 0, sizeof(ts));
+        for (cmsg = CMSG_FIRSTHDR(&msg); cmsg && (cmsg->cmsg_level == SOL_SOCKET); cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_type == SO_TIMESTAMPNS) {
+                memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+            }
+        }
+        xcp_correlate_frame(side, (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec, &frame, type_of(&frame));
+    }
+    close(s);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    struct sigaction sa;
+    char const * log = NULL;
+    unsigned window = XCP_CORRELATE_DEFAULT_WINDOW;
+    int result;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "m:s:w:r:?")) != -1) {
+        switch (opt) {
+            case 'm':
+                dst = strtoul(optarg, NULL, 16);
+                if (strlen(optarg) > 7) {
+                    dst |= CAN_EFF_FLAG;
+                }
+                break;
+            case 's':
+                src = strtoul(optarg, NULL, 16);
+                if (strlen(optarg) > 7) {
+                    src |= CAN_EFF_FLAG;
+                }
+                break;
+            case 'w':
+                window = strtoul(optarg, NULL, 10);
+                break;
+            case 'r':
+                log = optarg;
+                break;
+            case '?':
+                print_usage(basename(argv[0]));
+                exit(0);
+                break;
+            default:
+                fprintf(stderr, "Unknown option %c\n", opt);
+                print_usage(basename(argv[0]));
+                exit(1);
+                break;
+        }
+    }
+    if (((argc - optind) != 2) || (src == NO_CAN_ID) || (dst == NO_CAN_ID) || (window == 0)) {
+        print_usage(basename(argv[0]));
+        exit(1);
+    }
+    names[0] = argv[optind];
+    names[1] = argv[optind + 1];
+
+    if (!xcp_correlate_init(window)) {
+        perror("init");
+        return 1;
+    }
+
+    /* no SA_RESTART, a blocking recvmsg() has to return on termination */
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sigterm;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGHUP, &sa, NULL);
+    sa.sa_handler = sigreport;
+    sigaction(SIGUSR1, &sa, NULL);
+
+    result = (log != NULL) ? read_log(log) : capture();
+    xcp_correlate_flush();
+    print_report();
+    return result;
+}
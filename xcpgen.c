@@ -0,0 +1,440 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR BSD-3-Clause) */
+/*
+ * xcpgen.c - synthetic XCP on CAN traffic
+ *
+ * Copyright (c) 2021 Christoph Schueler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <cpu12.gems@googlemail.com>
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <linux/can.h>
+
+#include "xcp.h"
+#include "xcpgen.h"
+
+/*
+ * All streams are classic CAN with MAX_CTO = MAX_DTO = 8, Intel byte order,
+ * byte granularity and slave block mode, i.e. what most ECUs in the field do.
+ */
+
+/*
+ *
+ * Local Constants.
+ *
+ */
+#define DTO_CYCLES_PER_COMMAND  (50)    /* Mixed scenario: one command between bursts of DTOs. */
+
+/*
+ *
+ * Local Types.
+ *
+ */
+typedef struct tagBuilderType {
+    XcpGenConfigType const * config;
+    struct canfd_frame * frames;
+    size_t max;
+    size_t count;
+    uint32_t rng;
+} BuilderType;
+
+typedef struct tagExchangeType {
+    uint8_t requestLength;
+    uint8_t request[8];
+    uint8_t responseLength;
+    uint8_t response[8];
+} ExchangeType;
+
+/*
+ *
+ * Local Variables.
+ *
+ */
+static uint8_t const terminated[] = { 0xfd, XCP_EV_SESSION_TERMINATED };
+
+static char const * const scenario_names[XCP_GEN_SCENARIOS] = {
+    "handshake", "services", "daq", "dto", "upload", "errors", "mixed"
+};
+
+static ExchangeType const handshake[] = {
+    { 2, { CONNECT, 0x00 },                                     8, { 0xff, 0x15, 0xc0, 0x08, 0x08, 0x00, 0x01, 0x01 } },
+    { 1, { GET_STATUS },                                        6, { 0xff, 0x00, 0x15, 0x00, 0x00, 0x00 } },
+    { 1, { GET_COMM_MODE_INFO },                                8, { 0xff, 0x00, 0x01, 0x00, 0x10, 0x00, 0x00, 0x10 } },
+    { 2, { GET_ID, 0x01 },                                      8, { 0xff, 0x00, 0x00, 0x00, 0x06, 0x00, 0x00, 0x00 } },
+    { 3, { GET_SEED, 0x00, 0x01 },                              6, { 0xff, 0x04, 0x11, 0x22, 0x33, 0x44 } },
+    { 6, { UNLOCK, 0x04, 0xa1, 0xb2, 0xc3, 0xd4 },              2, { 0xff, 0x00 } },
+};
+
+/*
+ * Every service code of xcp.h, in the order of the header.
+ */
+static ExchangeType const services[] = {
+    { 2, { 0xc0, 0x02, },                                       3, { 0xff, 0x00, 0x00 } },      /* GET_DAQ_PACKED_MODE */
+    { 5, { 0xc0, 0x01, 0x00, 0x00, 0x00 },                      1, { 0xff } },                  /* SET_DAQ_PACKED_MODE */
+    { 2, { 0xc0, 0x00 },                                        6, { 0xff, 0x00, 0x01, 0x04, 0x01, 0x04 } }, /* GET_VERSION */
+    { 2, { CONNECT, 0x00 },                                     8, { 0xff, 0x15, 0xc0, 0x08, 0x08, 0x00, 0x01, 0x01 } },
+    { 1, { GET_STATUS },                                        6, { 0xff, 0x00, 0x15, 0x00, 0x00, 0x00 } },
+    { 1, { SYNCH },                                             2, { 0xfe, ERR_CMD_SYNCH } },
+    { 1, { GET_COMM_MODE_INFO },                                8, { 0xff, 0x00, 0x01, 0x00, 0x10, 0x00, 0x00, 0x10 } },
+    { 2, { GET_ID, 0x01 },                                      8, { 0xff, 0x00, 0x00, 0x00, 0x06, 0x00, 0x00, 0x00 } },
+    { 4, { SET_REQUEST, 0x01, 0x00, 0x00 },                     1, { 0xff } },
+    { 3, { GET_SEED, 0x00, 0x01 },                              6, { 0xff, 0x04, 0x11, 0x22, 0x33, 0x44 } },
+    { 6, { UNLOCK, 0x04, 0xa1, 0xb2, 0xc3, 0xd4 },              2, { 0xff, 0x00 } },
+    { 8, { SET_MTA, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x70 }, 1, { 0xff } },
+    { 2, { UPLOAD, 0x04 },                                      5, { 0xff, 0x01, 0x02, 0x03, 0x04 } },
+    { 8, { SHORT_UPLOAD, 0x04, 0x00, 0x00, 0x10, 0x00, 0x00, 0x70 }, 5, { 0xff, 0x05, 0x06, 0x07, 0x08 } },
+    { 8, { BUILD_CHECKSUM, 0x00, 0x00, 0x00, 0x10, 0x00, 0x00, 0x00 }, 8, { 0xff, 0x02, 0x00, 0x00, 0x34, 0x12, 0x00, 0x00 } },
+    { 6, { TRANSPORT_LAYER_CMD, 0xff, 0x58, 0x43, 0x50, 0x00 },  8, { 0xff, 0x58, 0x43, 0x50, 0xe1, 0x07, 0x00, 0x00 } },
+    { 2, { USER_CMD, 0x01 },                                    2, { 0xfe, ERR_CMD_UNKNOWN } },
+    { 8, { SET_MTA, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x70 }, 1, { 0xff } },
+    { 6, { DOWNLOAD, 0x04, 0x11, 0x22, 0x33, 0x44 },            1, { 0xff } },
+    { 4, { DOWNLOAD_NEXT, 0x02, 0x55, 0x66 },                   1, { 0xff } },
+    { 8, { DOWNLOAD_MAX, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07 }, 1, { 0xff } },
+    { 8, { SHORT_DOWNLOAD, 0x00, 0x00, 0x00, 0x20, 0x00, 0x00, 0x70 }, 1, { 0xff } },
+    { 6, { MODIFY_BITS, 0x02, 0xff, 0x00, 0x00, 0x00 },         1, { 0xff } },
+    { 4, { SET_CAL_PAGE, 0x83, 0x00, 0x01 },                    1, { 0xff } },
+    { 3, { GET_CAL_PAGE, 0x01, 0x00 },                          4, { 0xff, 0x00, 0x00, 0x01 } },
+    { 1, { GET_PAG_PROCESSOR_INFO },                            3, { 0xff, 0x02, 0x01 } },
+    { 5, { GET_SEGMENT_INFO, 0x00, 0x00, 0x00, 0x00 },          8, { 0xff, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x70 } },
+    { 4, { GET_PAGE_INFO, 0x00, 0x00, 0x01 },                   3, { 0xff, 0x3f, 0x00 } },
+    { 3, { SET_SEGMENT_MODE, 0x01, 0x00 },                      1, { 0xff } },
+    { 3, { GET_SEGMENT_MODE, 0x00, 0x00 },                      3, { 0xff, 0x00, 0x01 } },
+    { 5, { COPY_CAL_PAGE, 0x00, 0x00, 0x00, 0x01 },             1, { 0xff } },
+    { 4, { CLEAR_DAQ_LIST, 0x00, 0x00, 0x00 },                  1, { 0xff } },
+    { 6, { SET_DAQ_PTR, 0x00, 0x00, 0x00, 0x00, 0x00 },         1, { 0xff } },
+    { 8, { WRITE_DAQ, 0xff, 0x04, 0x00, 0x00, 0x00, 0x00, 0x70 }, 1, { 0xff } },
+    { 8, { SET_DAQ_LIST_MODE, 0x00, 0x00, 0x00, 0x01, 0x00, 0x01, 0x00 }, 1, { 0xff } },
+    { 4, { GET_DAQ_LIST_MODE, 0x00, 0x00, 0x00 },               8, { 0xff, 0x00, 0x00, 0x00, 0x01, 0x00, 0x01, 0x00 } },
+    { 4, { START_STOP_DAQ_LIST, 0x00, 0x00, 0x00 },             2, { 0xff, 0x00 } },
+    { 2, { START_STOP_SYNCH, 0x00 },                            1, { 0xff } },
+    { 1, { GET_DAQ_CLOCK },                                     8, { 0xff, 0x00, 0x00, 0x00, 0x78, 0x56, 0x34, 0x12 } },
+    { 1, { READ_DAQ },                                          8, { 0xff, 0xff, 0x04, 0x00, 0x00, 0x00, 0x00, 0x70 } },
+    { 1, { GET_DAQ_PROCESSOR_INFO },                            8, { 0xff, 0x11, 0x02, 0x00, 0x02, 0x00, 0x00, 0x00 } },
+    { 1, { GET_DAQ_RESOLUTION_INFO },                           8, { 0xff, 0x01, 0x08, 0x01, 0x08, 0x62, 0x01, 0x00 } },
+    { 4, { GET_DAQ_LIST_INFO, 0x00, 0x00, 0x00 },               6, { 0xff, 0x04, 0x02, 0x00, 0x00, 0x00 } },
+    { 4, { GET_DAQ_EVENT_INFO, 0x00, 0x00, 0x00 },              7, { 0xff, 0x04, 0x01, 0x04, 0x0a, 0x06, 0x00 } },
+    { 1, { FREE_DAQ },                                          1, { 0xff } },
+    { 4, { ALLOC_DAQ, 0x00, 0x01, 0x00 },                       1, { 0xff } },
+    { 5, { ALLOC_ODT, 0x00, 0x00, 0x00, 0x01 },                 1, { 0xff } },
+    { 6, { ALLOC_ODT_ENTRY, 0x00, 0x00, 0x00, 0x00, 0x01 },     1, { 0xff } },
+    { 1, { PROGRAM_START },                                     7, { 0xff, 0x00, 0x00, 0x08, 0x00, 0x00, 0x00 } },
+    { 8, { PROGRAM_CLEAR, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00 }, 1, { 0xff } },
+    { 6, { PROGRAM, 0x04, 0x01, 0x02, 0x03, 0x04 },             1, { 0xff } },
+    { 1, { PROGRAM_RESET },                                     1, { 0xff } },
+    { 1, { GET_PGM_PROCESSOR_INFO },                            3, { 0xff, 0x01, 0x04 } },
+    { 4, { GET_SECTOR_INFO, 0x00, 0x00 },                       8, { 0xff, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x70 } },
+    { 4, { PROGRAM_PREPARE, 0x00, 0x00, 0x10 },                 1, { 0xff } },
+    { 5, { PROGRAM_FORMAT, 0x00, 0x00, 0x00, 0x00 },            1, { 0xff } },
+    { 4, { PROGRAM_NEXT, 0x02, 0x05, 0x06 },                    2, { 0xfe, ERR_SEQUENCE } },
+    { 8, { PROGRAM_MAX, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07 }, 1, { 0xff } },
+    { 8, { PROGRAM_VERIFY, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, 1, { 0xff } },
+    { 2, { WRITE_DAQ_MULTIPLE, 0x00 },                          2, { 0xfe, ERR_OUT_OF_RANGE } },
+    { 6, { TIME_CORRELATION_PROPERTIES, 0x00, 0x00, 0x00, 0x00, 0x00 }, 8, { 0xff, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 } },
+    { 6, { DTO_CTR_PROPERTIES, 0x00, 0x00, 0x00, 0x00, 0x00 },  6, { 0xff, 0x00, 0x00, 0x00, 0x00, 0x00 } },
+    { 1, { DISCONNECT },                                        1, { 0xff } },
+};
+
+/*
+ * Two DAQ lists on event channels 0 and 1; list 0 with two ODTs (7 + 6 bytes),
+ * list 1 with one ODT (6 bytes). PIDs 0, 1 and 2.
+ */
+static ExchangeType const daq_setup[] = {
+    { 1, { FREE_DAQ },                                          1, { 0xff } },
+    { 4, { ALLOC_DAQ, 0x00, 0x02, 0x00 },                       1, { 0xff } },
+    { 5, { ALLOC_ODT, 0x00, 0x00, 0x00, 0x02 },                 1, { 0xff } },
+    { 5, { ALLOC_ODT, 0x00, 0x01, 0x00, 0x01 },                 1, { 0xff } },
+    { 6, { ALLOC_ODT_ENTRY, 0x00, 0x00, 0x00, 0x00, 0x03 },     1, { 0xff } },
+    { 6, { ALLOC_ODT_ENTRY, 0x00, 0x00, 0x00, 0x01, 0x02 },     1, { 0xff } },
+    { 6, { ALLOC_ODT_ENTRY, 0x00, 0x01, 0x00, 0x00, 0x02 },     1, { 0xff } },
+    { 6, { SET_DAQ_PTR, 0x00, 0x00, 0x00, 0x00, 0x00 },         1, { 0xff } },
+    { 8, { WRITE_DAQ, 0xff, 0x04, 0x00, 0x00, 0x10, 0x00, 0x70 }, 1, { 0xff } },
+    { 8, { WRITE_DAQ, 0xff, 0x02, 0x00, 0x04, 0x10, 0x00, 0x70 }, 1, { 0xff } },
+    { 8, { WRITE_DAQ, 0x03, 0x01, 0x00, 0x06, 0x10, 0x00, 0x70 }, 1, { 0xff } },
+    { 6, { SET_DAQ_PTR, 0x00, 0x00, 0x00, 0x01, 0x00 },         1, { 0xff } },
+    { 8, { WRITE_DAQ, 0xff, 0x04, 0x00, 0x08, 0x10, 0x00, 0x70 }, 1, { 0xff } },
+    { 8, { WRITE_DAQ, 0xff, 0x02, 0x00, 0x0c, 0x10, 0x00, 0x70 }, 1, { 0xff } },
+    { 6, { SET_DAQ_PTR, 0x00, 0x01, 0x00, 0x00, 0x00 },         1, { 0xff } },
+    { 8, { WRITE_DAQ, 0xff, 0x04, 0x00, 0x00, 0x20, 0x00, 0x70 }, 1, { 0xff } },
+    { 8, { WRITE_DAQ, 0xff, 0x02, 0x00, 0x04, 0x20, 0x00, 0x70 }, 1, { 0xff } },
+    { 8, { SET_DAQ_LIST_MODE, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00 }, 1, { 0xff } },
+    { 8, { SET_DAQ_LIST_MODE, 0x00, 0x01, 0x00, 0x01, 0x00, 0x01, 0x00 }, 1, { 0xff } },
+    { 4, { START_STOP_DAQ_LIST, 0x02, 0x00, 0x00 },             2, { 0xff, 0x00 } },
+    { 4, { START_STOP_DAQ_LIST, 0x02, 0x01, 0x00 },             2, { 0xff, 0x02 } },
+    { 2, { START_STOP_SYNCH, 0x01 },                            1, { 0xff } },
+};
+
+static ExchangeType const errors[] = {
+    { 8, { SHORT_UPLOAD, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80 }, 2, { 0xfe, ERR_ACCESS_LOCKED } },
+    { 8, { SET_MTA, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x90 }, 1, { 0xff } },
+    { 2, { UPLOAD, 0xff },                                      2, { 0xfe, ERR_OUT_OF_RANGE } },
+    { 6, { DOWNLOAD, 0x04, 0x11, 0x22, 0x33, 0x44 },            2, { 0xfe, ERR_WRITE_PROTECTED } },
+    { 1, { 0x80 },                                              2, { 0xfe, ERR_CMD_UNKNOWN } },
+    { 2, { GET_ID, 0x01 },                                      2, { 0xfe, ERR_CMD_BUSY } },
+    { 1, { FREE_DAQ },                                          2, { 0xfe, ERR_DAQ_ACTIVE } },
+    { 4, { ALLOC_DAQ, 0x00, 0xff, 0x00 },                       2, { 0xfe, ERR_MEMORY_OVERFLOW } },
+    { 3, { SET_SEGMENT_MODE, 0x01, 0x09 },                      2, { 0xfe, ERR_SEGMENT_NOT_VALID } },
+    { 4, { SET_CAL_PAGE, 0x83, 0x00, 0x07 },                    2, { 0xfe, ERR_PAGE_NOT_VALID } },
+    { 1, { PROGRAM_START },                                     2, { 0xfe, ERR_GENERIC } },
+};
+
+/*
+ *
+ * Local Functions.
+ *
+ */
+static void put(BuilderType * const builder, canid_t id, uint8_t const * const data, uint8_t length);
+static void exchange(BuilderType * const builder, ExchangeType const * const table, size_t count);
+static void dto_cycle(BuilderType * const builder);
+static void block_upload(BuilderType * const builder, uint32_t address, uint8_t size);
+static void events(BuilderType * const builder);
+static uint32_t next_random(BuilderType * const builder);
+
+
+void xcp_gen_config_init(XcpGenConfigType * const config)
+{
+    config->master = 0x7e0;
+    config->slave = 0x7e1;
+    config->seed = 1;
+    config->burst = XCP_GEN_DEFAULT_BURST;
+}
+
+char const * xcp_gen_scenario_name(XcpGenScenarioType scenario)
+{
+    return (scenario < XCP_GEN_SCENARIOS) ? scenario_names[scenario] : "?";
+}
+
+bool xcp_gen_scenario_parse(char const * const name, XcpGenScenarioType * const scenario)
+{
+    unsigned idx;
+
+    for (idx = 0; idx < XCP_GEN_SCENARIOS; ++idx) {
+        if (strcmp(scenario_names[idx], name) == 0) {
+            *scenario = (XcpGenScenarioType)idx;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/*
+ * Fill `frames` with the stream of `scenario`, returns the number of frames written.
+ * Streams stop early, without error, if `max` is reached.
+ */
+size_t xcp_gen_build(XcpGenConfigType const * const config, XcpGenScenarioType scenario,
+                     struct canfd_frame * const frames, size_t max)
+{
+    BuilderType builder;
+    uint32_t cycle;
+    size_t command = 0;
+
+    builder.config = config;
+    builder.frames = frames;
+    builder.max = max;
+    builder.count = 0;
+    builder.rng = config->seed ? config->seed : 1;
+
+    exchange(&builder, handshake, sizeof(handshake) / sizeof(handshake[0]));
+    switch (scenario) {
+        case XCP_GEN_HANDSHAKE:
+            break;
+        case XCP_GEN_SERVICES:
+            exchange(&builder, services, sizeof(services) / sizeof(services[0]));
+            break;
+        case XCP_GEN_DAQ_SETUP:
+            exchange(&builder, daq_setup, sizeof(daq_setup) / sizeof(daq_setup[0]));
+            break;
+        case XCP_GEN_DTO_BURST:
+            exchange(&builder, daq_setup, sizeof(daq_setup) / sizeof(daq_setup[0]));
+            for (cycle = 0; cycle < config->burst; ++cycle) {
+                dto_cycle(&builder);
+            }
+            break;
+        case XCP_GEN_BLOCK_UPLOAD:
+            for (cycle = 0; cycle < 16; ++cycle) {
+                block_upload(&builder, 0x70000000 + cycle * 0x100, (uint8_t)(8 + (next_random(&builder) % 248)));
+            }
+            break;
+        case XCP_GEN_ERRORS:
+            exchange(&builder, errors, sizeof(errors) / sizeof(errors[0]));
+            events(&builder);
+            put(&builder, config->slave, terminated, sizeof(terminated));
+            break;
+        case XCP_GEN_MIXED:
+            exchange(&builder, daq_setup, sizeof(daq_setup) / sizeof(daq_setup[0]));
+            for (cycle = 0; cycle < config->burst; ++cycle) {
+                dto_cycle(&builder);
+                if ((cycle % DTO_CYCLES_PER_COMMAND) != 0) {
+                    continue;
+                }
+                /* Everything but DISCONNECT and the DAQ reconfiguration, which would end the bursts. */
+                switch (command++ % 4) {
+                    case 0:
+                        exchange(&builder, &services[(command / 4) % 12], 1);
+                        break;
+                    case 1:
+                        block_upload(&builder, 0x70000000 + (next_random(&builder) & 0xff00), 32);
+                        break;
+                    case 2:
+                        exchange(&builder, &errors[(command / 4) % (sizeof(errors) / sizeof(errors[0]))], 1);
+                        break;
+                    default:
+                        events(&builder);
+                        break;
+                }
+            }
+            break;
+        default:
+            break;
+    }
+    return builder.count;
+}
+
+static void put(BuilderType * const builder, canid_t id, uint8_t const * const data, uint8_t length)
+{
+    struct canfd_frame * frame;
+
+    if (builder->count == builder->max) {
+        return;
+    }
+    frame = &builder->frames[builder->count++];
+    memset(frame, 0, sizeof(struct canfd_frame));
+    frame->can_id = id;
+    frame->len = length;
+    memcpy(frame->data, data, length);
+}
+
+static void exchange(BuilderType * const builder, ExchangeType const * const table, size_t count)
+{
+    size_t idx;
+
+    for (idx = 0; idx < count; ++idx) {
+        put(builder, builder->config->master, table[idx].request, table[idx].requestLength);
+        put(builder, builder->config->slave, table[idx].response, table[idx].responseLength);
+    }
+}
+
+/*
+ * One sample of both DAQ lists, the signals drift slowly as real measurements do.
+ */
+static void dto_cycle(BuilderType * const builder)
+{
+    uint8_t dto[8];
+    uint32_t value = next_random(builder);
+
+    dto[0] = 0x00;
+    memcpy(&dto[1], &value, 4);
+    dto[5] = value >> 8;
+    dto[6] = value >> 16;
+    dto[7] = (value >> 29) & 0x08;
+    put(builder, builder->config->slave, dto, 8);
+
+    value = next_random(builder);
+    dto[0] = 0x01;
+    memcpy(&dto[1], &value, 4);
+    dto[5] = value >> 24;
+    dto[6] = value >> 3;
+    put(builder, builder->config->slave, dto, 7);
+
+    value = next_random(builder);
+    dto[0] = 0x02;
+    memcpy(&dto[1], &value, 4);
+    dto[5] = value >> 7;
+    dto[6] = value >> 13;
+    put(builder, builder->config->slave, dto, 7);
+}
+
+/*
+ * UPLOAD of `size` bytes: the first response carries 7 bytes, the slave keeps sending.
+ */
+static void block_upload(BuilderType * const builder, uint32_t address, uint8_t size)
+{
+    uint8_t request[8] = { SET_MTA, 0x00, 0x00, 0x00 };
+    uint8_t response[8] = { 0xff };
+    uint8_t chunk;
+    uint8_t idx;
+
+    request[4] = address;
+    request[5] = address >> 8;
+    request[6] = address >> 16;
+    request[7] = address >> 24;
+    put(builder, builder->config->master, request, 8);
+    put(builder, builder->config->slave, response, 1);
+
+    request[0] = UPLOAD;
+    request[1] = size;
+    put(builder, builder->config->master, request, 2);
+    while (size > 0) {
+        chunk = (size > 7) ? 7 : size;
+        for (idx = 1; idx <= chunk; ++idx) {
+            response[idx] = next_random(builder);
+        }
+        put(builder, builder->config->slave, response, chunk + 1);
+        size -= chunk;
+    }
+}
+
+static void events(BuilderType * const builder)
+{
+    static uint8_t const overload[] = { 0xfd, XCP_EV_DAQ_OVERLOAD };
+    static uint8_t const pending[] = { 0xfd, XCP_EV_CMD_PENDING };
+    static uint8_t const storeCal[] = { 0xfd, XCP_EV_STORE_CAL };
+    static uint8_t const text[] = { 0xfc, XCP_SERV_TEXT, 'h', 'e', 'l', 'l', 'o', 0x00 };
+    put(builder, builder->config->slave, overload, sizeof(overload));
+    put(builder, builder->config->slave, pending, sizeof(pending));
+    put(builder, builder->config->slave, storeCal, sizeof(storeCal));
+    put(builder, builder->config->slave, text, sizeof(text));
+}
+
+/*
+ * xorshift32, streams are reproducible from the seed.
+ */
+static uint32_t next_random(BuilderType * const builder)
+{
+    uint32_t x = builder->rng;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    builder->rng = x;
+    return x;
+}
@@ -0,0 +1,91 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR BSD-3-Clause) */
+/*
+ * xcpgen.h - synthetic XCP on CAN traffic
+ *
+ * Copyright (c) 2021 Christoph Schueler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <cpu12.gems@googlemail.com>
+ *
+ */
+#ifndef __XCPGEN_H
+#define __XCPGEN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <linux/can.h>
+
+#include "xcp.h"
+
+/*
+ * Defines
+ */
+#define XCP_GEN_DEFAULT_BURST   (1000)      /* DTO cycles per burst. */
+
+/*
+ * Types
+ */
+typedef enum tagXcpGenScenarioType {
+    XCP_GEN_HANDSHAKE,          /* CONNECT, status, ID and seed & key.                      */
+    XCP_GEN_SERVICES,           /* One request and response for every service code.         */
+    XCP_GEN_DAQ_SETUP,          /* Allocate, configure and start two DAQ lists.             */
+    XCP_GEN_DTO_BURST,          /* DAQ setup followed by dense DTOs.                        */
+    XCP_GEN_BLOCK_UPLOAD,       /* SET_MTA and UPLOAD answered in slave block mode.         */
+    XCP_GEN_ERRORS,             /* Negative responses, events and service requests.         */
+    XCP_GEN_MIXED,              /* All of the above, DTOs interleaved with commands.        */
+    XCP_GEN_SCENARIOS
+} XcpGenScenarioType;
+
+typedef struct tagXcpGenConfigType {
+    canid_t master;
+    canid_t slave;
+    uint32_t seed;
+    uint32_t burst;             /* DTO cycles of XCP_GEN_DTO_BURST and XCP_GEN_MIXED.       */
+} XcpGenConfigType;
+
+/*
+ * Global Functions
+ *
+ */
+void xcp_gen_config_init(XcpGenConfigType * const config);
+size_t xcp_gen_build(XcpGenConfigType const * const config, XcpGenScenarioType scenario,
+                     struct canfd_frame * const frames, size_t max);
+char const * xcp_gen_scenario_name(XcpGenScenarioType scenario);
+bool xcp_gen_scenario_parse(char const * const name, XcpGenScenarioType * const scenario);
+
+#endif /* __XCPGEN_H */
@@ -0,0 +1,675 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR BSD-3-Clause) */
+/*
+ * xcpindex.c - sidecar index of candump logs
+ *
+ * Copyright (c) 2021 Christoph Schueler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <cpu12.gems@googlemail.com>
+ *
+ */
+
+#include <byteswap.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "xcp.h"
+#include "xcplog.h"
+#include "xcpindex.h"
+
+/*
+ * The log is cut into one chunk per thread at line boundaries. Each thread classifies
+ * the CTOs of its chunk with what it has seen so far; context from before the chunk
+ * (pending request, last CONNECT, byte order, DAQ pointer) is left unresolved and filled
+ * in by a sequential pass over the postings, which are few compared to the DTOs.
+ */
+
+/*
+ *
+ * Local Constants.
+ *
+ */
+#define LINE_SIZE           (512)
+#define MIN_CHUNK_SIZE      (1024 * 1024)
+#define MAX_THREADS         (64)
+
+#define UNRESOLVED          (XCP_INDEX_NONE - 1)
+
+/*
+ * Posting flags while building. DAQ list numbers are kept as read little-endian
+ * until the byte order is known.
+ */
+#define DAQ_RAW             (0x01)      /* `daq` holds the raw WORD.                                */
+#define DAQ_ORDER_KNOWN     (0x02)
+#define DAQ_MOTOROLA        (0x04)
+#define DAQ_FROM_PTR        (0x08)      /* WRITE_DAQ before the first SET_DAQ_PTR of the chunk.     */
+#define DAQ_FROM_REQUEST    (0x10)      /* Response before the first request of the chunk.          */
+#define CONNECT_MOTOROLA    (0x20)      /* Positive response, bit 0 of COMM_MODE_BASIC set.         */
+
+/*
+ *
+ * Local Types.
+ *
+ */
+typedef struct tagDaqRefType {
+    uint32_t daq;
+    uint8_t flags;
+} DaqRefType;
+
+typedef struct tagStateType {
+    bool requestKnown;
+    uint64_t request;
+    uint8_t service;
+    DaqRefType requestDaq;
+    bool connectKnown;
+    uint64_t connect;
+    bool orderKnown;
+    bool motorola;
+    bool daqPtrKnown;
+    DaqRefType daqPtr;
+} StateType;
+
+typedef struct tagChunkType {
+    char const * map;
+    uint64_t begin;
+    uint64_t end;
+    canid_t src;
+    canid_t dst;
+    bool failed;
+    uint64_t frames;
+    uint64_t firstTimestamp;
+    uint64_t lastTimestamp;
+    XcpIndexTimeType * times;
+    size_t timeCount;
+    size_t timeCapacity;
+    XcpIndexPostingType * postings;
+    size_t postingCount;
+    size_t postingCapacity;
+    StateType state;
+} ChunkType;
+
+/*
+ * Context carried through the chunks by the sequential pass, all resolved.
+ */
+typedef struct tagCarryType {
+    uint64_t request;
+    uint8_t service;
+    uint32_t requestDaq;
+    uint64_t connect;
+    bool motorola;
+    uint32_t daqPtr;
+} CarryType;
+
+/*
+ *
+ * Local Functions.
+ *
+ */
+static void * index_chunk(void * arg);
+static void classify(ChunkType * const chunk, XcpLogRecordType const * const record, uint64_t offset);
+static DaqRefType command_daq(StateType const * const state, uint8_t const * const data, uint8_t length);
+static bool grow(void ** array, size_t * capacity, size_t size);
+static uint32_t resolve_daq(uint32_t daq, uint8_t flags, CarryType const * const carry);
+static void resolve(XcpIndexPostingType * const posting, CarryType * const carry);
+static bool merge(XcpIndexType * const index, ChunkType * const chunks, unsigned count);
+static void free_chunks(ChunkType * const chunks, unsigned count);
+
+
+static bool grow(void ** array, size_t * capacity, size_t size)
+{
+    size_t const wanted = (*capacity > 0) ? *capacity * 2 : 1024;
+    void * grown = realloc(*array, wanted * size);
+
+    if (grown == NULL) {
+        return FALSE;
+    }
+    *array = grown;
+    *capacity = wanted;
+    return TRUE;
+}
+
+static void * index_chunk(void * arg)
+{
+    ChunkType * const chunk = arg;
+    char const * line = chunk->map + chunk->begin;
+    char const * const end = chunk->map + chunk->end;
+    char const * next;
+    char buffer[LINE_SIZE];
+    XcpLogRecordType record;
+    size_t length;
+
+    while ((line < end) && !chunk->failed) {
+        next = memchr(line, '\n', end - line);
+        next = (next != NULL) ? next + 1 : end;
+        length = next - line;
+        if (length >= sizeof(buffer)) {
+            length = sizeof(buffer) - 1;
+        }
+        memcpy(buffer, line, length);
+        buffer[length] = '\0';
+        if (xcp_log_parse(buffer, &record) && !(record.frame.can_id & CAN_RTR_FLAG) &&
+            ((record.frame.can_id == chunk->src) || (record.frame.can_id == chunk->dst))) {
+            classify(chunk, &record, line - chunk->map);
+        }
+        line = next;
+    }
+    return NULL;
+}
+
+/*
+ * DAQ list a command refers to, WRITE_DAQ(_MULTIPLE) the one of the last SET_DAQ_PTR.
+ */
+static DaqRefType command_daq(StateType const * const state, uint8_t const * const data, uint8_t length)
+{
+    DaqRefType ref = { XCP_INDEX_NO_DAQ, 0 };
+
+    switch (data[0]) {
+        case CLEAR_DAQ_LIST:
+        case SET_DAQ_PTR:
+        case SET_DAQ_LIST_MODE:
+        case GET_DAQ_LIST_MODE:
+        case START_STOP_DAQ_LIST:
+        case GET_DAQ_LIST_INFO:
+        case ALLOC_ODT:
+        case ALLOC_ODT_ENTRY:
+            if (length >= 4) {
+                ref.daq = data[2] | (data[3] << 8);
+                ref.flags = DAQ_RAW;
+                if (state->orderKnown) {
+                    ref.flags |= DAQ_ORDER_KNOWN | (state->motorola ? DAQ_MOTOROLA : 0);
+                }
+            }
+            break;
+        case WRITE_DAQ:
+        case WRITE_DAQ_MULTIPLE:
+            if (state->daqPtrKnown) {
+                ref = state->daqPtr;
+            } else {
+                ref.daq = 0;
+                ref.flags = DAQ_FROM_PTR;
+            }
+            break;
+        default:
+            break;
+    }
+    return ref;
+}
+
+static void classify(ChunkType * const chunk, XcpLogRecordType const * const record, uint64_t offset)
+{
+    StateType * const state = &chunk->state;
+    uint8_t const * const data = record->frame.data;
+    uint8_t const length = record->frame.len;
+    bool const fromSlave = (record->frame.can_id == chunk->dst);
+    XcpIndexTimeType * time;
+    XcpIndexPostingType * posting;
+    DaqRefType ref;
+
+    if ((chunk->frames % XCP_INDEX_TIME_STRIDE) == 0) {
+        if ((chunk->timeCount == chunk->timeCapacity) &&
+            !grow((void **)&chunk->times, &chunk->timeCapacity, sizeof(XcpIndexTimeType))) {
+            chunk->failed = TRUE;
+            return;
+        }
+        time = &chunk->times[chunk->timeCount++];
+        time->timestamp = record->timestamp;
+        time->offset = offset;
+        time->connect = state->connectKnown ? state->connect : UNRESOLVED;
+    }
+    if (chunk->frames == 0) {
+        chunk->firstTimestamp = record->timestamp;
+    }
+    chunk->lastTimestamp = record->timestamp;
+    ++chunk->frames;
+
+    if ((length == 0) || (fromSlave && (data[0] < 0xfc)) || (!fromSlave && (data[0] < 0xc0))) {
+        return;     /* DTO or STIM */
+    }
+    if ((chunk->postingCount == chunk->postingCapacity) &&
+        !grow((void **)&chunk->postings, &chunk->postingCapacity, sizeof(XcpIndexPostingType))) {
+        chunk->failed = TRUE;
+        return;
+    }
+    posting = &chunk->postings[chunk->postingCount++];
+    posting->offset = offset;
+    posting->timestamp = record->timestamp;
+    posting->request = XCP_INDEX_NONE;
+    posting->connect = state->connectKnown ? state->connect : UNRESOLVED;
+    posting->daq = XCP_INDEX_NO_DAQ;
+    posting->service = 0;
+    posting->code = 0;
+    posting->flags = 0;
+
+    if (!fromSlave) {
+        ref = command_daq(state, data, length);
+        posting->kind = XCP_INDEX_COMMAND;
+        posting->service = data[0];
+        posting->daq = ref.daq;
+        posting->flags = ref.flags;
+        if ((data[0] == SET_DAQ_PTR) && (ref.flags != 0)) {
+            state->daqPtrKnown = TRUE;
+            state->daqPtr = ref;
+        }
+        state->requestKnown = TRUE;
+        state->request = offset;
+        state->service = data[0];
+        state->requestDaq = ref;
+        return;
+    }
+
+    switch (data[0]) {
+        case 0xff:
+        case 0xfe:
+            posting->kind = (data[0] == 0xff) ? XCP_INDEX_RESPONSE : XCP_INDEX_ERROR;
+            posting->code = ((data[0] == 0xfe) && (length >= 2)) ? data[1] : 0;
+            if (state->requestKnown) {
+                posting->request = state->request;
+                posting->service = state->service;
+                posting->daq = state->requestDaq.daq;
+                posting->flags = state->requestDaq.flags;
+            } else {
+                posting->request = UNRESOLVED;
+                posting->daq = 0;
+                posting->flags = DAQ_FROM_REQUEST;
+            }
+            if ((data[0] == 0xff) && (length >= 3) && (data[2] & 0x01)) {
+                posting->flags |= CONNECT_MOTOROLA;
+            }
+            if ((data[0] == 0xff) && state->requestKnown && (state->service == CONNECT)) {
+                state->connectKnown = TRUE;
+                state->connect = offset;
+                state->orderKnown = TRUE;
+                state->motorola = (length >= 3) && (data[2] & 0x01);
+            }
+            break;
+        case 0xfd:
+            posting->kind = XCP_INDEX_EVENT;
+            posting->code = (length >= 2) ? data[1] : 0;
+            break;
+        default:
+            posting->kind = XCP_INDEX_SERVICE_REQUEST;
+            posting->code = (length >= 2) ? data[1] : 0;
+            break;
+    }
+}
+
+static uint32_t resolve_daq(uint32_t daq, uint8_t flags, CarryType const * const carry)
+{
+    bool motorola;
+
+    if (flags & DAQ_FROM_REQUEST) {
+        return carry->requestDaq;
+    }
+    if (flags & DAQ_FROM_PTR) {
+        return carry->daqPtr;
+    }
+    if (flags & DAQ_RAW) {
+        motorola = (flags & DAQ_ORDER_KNOWN) ? ((flags & DAQ_MOTOROLA) != 0) : carry->motorola;
+        return motorola ? bswap_16((uint16_t)daq) : daq;
+    }
+    return XCP_INDEX_NO_DAQ;
+}
+
+/*
+ * Fill in what the chunk couldn't know, then advance the carried context past the posting.
+ */
+static void resolve(XcpIndexPostingType * const posting, CarryType * const carry)
+{
+    if (posting->connect == UNRESOLVED) {
+        posting->connect = carry->connect;
+    }
+    if (posting->request == UNRESOLVED) {
+        posting->request = carry->request;
+        posting->service = carry->service;
+    }
+    posting->daq = resolve_daq(posting->daq, posting->flags, carry);
+
+    if (posting->kind == XCP_INDEX_COMMAND) {
+        carry->request = posting->offset;
+        carry->service = posting->service;
+        carry->requestDaq = posting->daq;
+        if ((posting->service == SET_DAQ_PTR) && (posting->daq != XCP_INDEX_NO_DAQ)) {
+            carry->daqPtr = posting->daq;
+        }
+    } else if ((posting->kind == XCP_INDEX_RESPONSE) && (posting->service == CONNECT) &&
+               (posting->request != XCP_INDEX_NONE)) {
+        carry->connect = posting->offset;
+        carry->motorola = (posting->flags & CONNECT_MOTOROLA) != 0;
+    }
+    posting->flags = 0;
+}
+
+static bool merge(XcpIndexType * const index, ChunkType * const chunks, unsigned count)
+{
+    XcpIndexHeaderType * const header = &index->header;
+    CarryType carry = { XCP_INDEX_NONE, 0, XCP_INDEX_NO_DAQ, XCP_INDEX_NONE, FALSE, XCP_INDEX_NO_DAQ };
+    XcpIndexPostingType const * posting;
+    uint64_t fill[XCP_INDEX_KEYS];
+    uint64_t total = 0;
+    size_t times = 0;
+    size_t idx;
+    size_t time;
+    unsigned chunk;
+    unsigned key;
+
+    memset(header->first, 0, sizeof(header->first));
+    for (chunk = 0; chunk < count; ++chunk) {
+        if (chunks[chunk].failed) {
+            errno = ENOMEM;
+            return FALSE;
+        }
+        if ((chunks[chunk].frames > 0) && (header->frames == 0)) {
+            header->firstTimestamp = chunks[chunk].firstTimestamp;
+        }
+        if (chunks[chunk].frames > 0) {
+            header->lastTimestamp = chunks[chunk].lastTimestamp;
+        }
+        header->frames += chunks[chunk].frames;
+        times += chunks[chunk].timeCount;
+
+        /* Sequential pass, time entries interleaved by offset. */
+        time = 0;
+        for (idx = 0; idx <= chunks[chunk].postingCount; ++idx) {
+            while ((time < chunks[chunk].timeCount) &&
+                   ((idx == chunks[chunk].postingCount) ||
+                    (chunks[chunk].times[time].offset <= chunks[chunk].postings[idx].offset))) {
+                if (chunks[chunk].times[time].connect == UNRESOLVED) {
+                    chunks[chunk].times[time].connect = carry.connect;
+                }
+                ++time;
+            }
+            if (idx < chunks[chunk].postingCount) {
+                resolve(&chunks[chunk].postings[idx], &carry);
+            }
+        }
+        for (idx = 0; idx < chunks[chunk].postingCount; ++idx) {
+            posting = &chunks[chunk].postings[idx];
+            if ((posting->kind == XCP_INDEX_EVENT) || (posting->kind == XCP_INDEX_SERVICE_REQUEST)) {
+                ++header->first[XCP_INDEX_KEY_EVENTS];
+                continue;
+            }
+            ++header->first[posting->service];
+            if (posting->kind == XCP_INDEX_ERROR) {
+                ++header->first[XCP_INDEX_KEY_ERRORS];
+            }
+        }
+    }
+
+    /* Counts to start positions, then scatter; chunk order keeps each list in file order. */
+    for (key = 0; key < XCP_INDEX_KEYS; ++key) {
+        fill[key] = total;
+        total += header->first[key];
+        header->first[key] = fill[key];
+    }
+    header->first[XCP_INDEX_KEYS] = total;
+    header->postingCount = total;
+    header->timeCount = times;
+    index->postings = malloc((total > 0 ? total : 1) * sizeof(XcpIndexPostingType));
+    index->times = malloc((times > 0 ? times : 1) * sizeof(XcpIndexTimeType));
+    if ((index->postings == NULL) || (index->times == NULL)) {
+        return FALSE;
+    }
+    times = 0;
+    for (chunk = 0; chunk < count; ++chunk) {
+        memcpy(&index->times[times], chunks[chunk].times, chunks[chunk].timeCount * sizeof(XcpIndexTimeType));
+        times += chunks[chunk].timeCount;
+        for (idx = 0; idx < chunks[chunk].postingCount; ++idx) {
+            posting = &chunks[chunk].postings[idx];
+            if ((posting->kind == XCP_INDEX_EVENT) || (posting->kind == XCP_INDEX_SERVICE_REQUEST)) {
+                index->postings[fill[XCP_INDEX_KEY_EVENTS]++] = *posting;
+                continue;
+            }
+            index->postings[fill[posting->service]++] = *posting;
+            if (posting->kind == XCP_INDEX_ERROR) {
+                index->postings[fill[XCP_INDEX_KEY_ERRORS]++] = *posting;
+            }
+        }
+    }
+    return TRUE;
+}
+
+static void free_chunks(ChunkType * const chunks, unsigned count)
+{
+    unsigned idx;
+
+    for (idx = 0; idx < count; ++idx) {
+        free(chunks[idx].times);
+        free(chunks[idx].postings);
+    }
+    free(chunks);
+}
+
+bool xcp_index_build(XcpIndexType * const index, char const * const log, canid_t src, canid_t dst, unsigned threads)
+{
+    pthread_t workers[MAX_THREADS];
+    bool joinable[MAX_THREADS];
+    ChunkType * chunks;
+    struct stat st;
+    char const * map;
+    char const * cut;
+    uint64_t size;
+    unsigned count;
+    unsigned idx;
+    bool result;
+    int fd;
+
+    memset(index, 0, sizeof(*index));
+    fd = open(log, O_RDONLY);
+    if (fd < 0) {
+        return FALSE;
+    }
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return FALSE;
+    }
+    size = st.st_size;
+    map = (size > 0) ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+    close(fd);
+    if (map == MAP_FAILED) {
+        return FALSE;
+    }
+    if (size > 0) {
+        madvise((void *)map, size, MADV_SEQUENTIAL);
+    }
+
+    count = (threads > 0) ? threads : 1;
+    if (count > MAX_THREADS) {
+        count = MAX_THREADS;
+    }
+    if (count > size / MIN_CHUNK_SIZE) {
+        count = (size / MIN_CHUNK_SIZE > 0) ? size / MIN_CHUNK_SIZE : 1;
+    }
+    chunks = calloc(count, sizeof(ChunkType));
+    if (chunks == NULL) {
+        if (size > 0) {
+            munmap((void *)map, size);
+        }
+        return FALSE;
+    }
+    for (idx = 0; idx < count; ++idx) {
+        chunks[idx].map = map;
+        chunks[idx].src = src;
+        chunks[idx].dst = dst;
+        chunks[idx].begin = (idx == 0) ? 0 : chunks[idx - 1].end;
+        chunks[idx].end = (idx == count - 1) ? size : (size / count) * (idx + 1);
+        if (chunks[idx].end < chunks[idx].begin) {
+            chunks[idx].end = chunks[idx].begin;
+        }
+        /* Cut after the end of a line. */
+        if (chunks[idx].end < size) {
+            cut = memchr(map + chunks[idx].end, '\n', size - chunks[idx].end);
+            chunks[idx].end = (cut != NULL) ? (uint64_t)(cut - map) + 1 : size;
+        }
+    }
+    for (idx = 1; idx < count; ++idx) {
+        joinable[idx] = (pthread_create(&workers[idx], NULL, index_chunk, &chunks[idx]) == 0);
+    }
+    index_chunk(&chunks[0]);
+    for (idx = 1; idx < count; ++idx) {
+        if (joinable[idx]) {
+            pthread_join(workers[idx], NULL);
+        } else {
+            index_chunk(&chunks[idx]);
+        }
+    }
+
+    index->header.magic = XCP_INDEX_MAGIC;
+    index->header.version = XCP_INDEX_VERSION;
+    index->header.src = src;
+    index->header.dst = dst;
+    index->header.logSize = size;
+    index->header.logModified = (int64_t)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    result = merge(index, chunks, count);
+    free_chunks(chunks, count);
+    if (size > 0) {
+        munmap((void *)map, size);
+    }
+    if (!result) {
+        xcp_index_free(index);
+    }
+    return result;
+}
+
+/*
+ * FALSE if there is no index, or it doesn't belong to this log and these identifiers.
+ */
+bool xcp_index_load(XcpIndexType * const index, char const * const path, char const * const log,
+                    canid_t src, canid_t dst)
+{
+    XcpIndexHeaderType * const header = &index->header;
+    struct stat st;
+    FILE * file;
+    bool valid;
+
+    memset(index, 0, sizeof(*index));
+    if (stat(log, &st) < 0) {
+        return FALSE;
+    }
+    file = fopen(path, "rb");
+    if (file == NULL) {
+        return FALSE;
+    }
+    valid = (fread(header, sizeof(*header), 1, file) == 1) && (header->magic == XCP_INDEX_MAGIC) &&
+            (header->version == XCP_INDEX_VERSION) && (header->src == src) && (header->dst == dst) &&
+            (header->logSize == (uint64_t)st.st_size) &&
+            (header->logModified == (int64_t)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec) &&
+            (header->first[XCP_INDEX_KEYS] == header->postingCount);
+    if (valid) {
+        index->times = malloc((header->timeCount > 0 ? header->timeCount : 1) * sizeof(XcpIndexTimeType));
+        index->postings = malloc((header->postingCount > 0 ? header->postingCount : 1) * sizeof(XcpIndexPostingType));
+        valid = (index->times != NULL) && (index->postings != NULL) &&
+                (fread(index->times, sizeof(XcpIndexTimeType), header->timeCount, file) == header->timeCount) &&
+                (fread(index->postings, sizeof(XcpIndexPostingType), header->postingCount, file) ==
+                 header->postingCount);
+    }
+    fclose(file);
+    if (!valid) {
+        xcp_index_free(index);
+    }
+    return valid;
+}
+
+bool xcp_index_save(XcpIndexType const * const index, char const * const path)
+{
+    XcpIndexHeaderType const * const header = &index->header;
+    FILE * file;
+    bool result;
+
+    file = fopen(path, "wb");
+    if (file == NULL) {
+        return FALSE;
+    }
+    result = (fwrite(header, sizeof(*header), 1, file) == 1) &&
+             (fwrite(index->times, sizeof(XcpIndexTimeType), header->timeCount, file) == header->timeCount) &&
+             (fwrite(index->postings, sizeof(XcpIndexPostingType), header->postingCount, file) ==
+              header->postingCount);
+    if ((fclose(file) != 0) || !result) {
+        unlink(path);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+void xcp_index_free(XcpIndexType * const index)
+{
+    free(index->times);
+    free(index->postings);
+    index->times = NULL;
+    index->postings = NULL;
+    index->header.timeCount = index->header.postingCount = 0;
+}
+
+XcpIndexPostingType const * xcp_index_postings(XcpIndexType const * const index, unsigned key, size_t * const count)
+{
+    if (key >= XCP_INDEX_KEYS) {
+        *count = 0;
+        return NULL;
+    }
+    *count = index->header.first[key + 1] - index->header.first[key];
+    return &index->postings[index->header.first[key]];
+}
+
+/*
+ * Last time table entry not after `timestamp`, NULL for an empty log.
+ */
+XcpIndexTimeType const * xcp_index_seek(XcpIndexType const * const index, uint64_t timestamp)
+{
+    size_t low = 0;
+    size_t high = index->header.timeCount;
+    size_t mid;
+
+    if (high == 0) {
+        return NULL;
+    }
+    while (high - low > 1) {
+        mid = low + (high - low) / 2;
+        if (index->times[mid].timestamp <= timestamp) {
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
+    return &index->times[low];
+}
@@ -0,0 +1,146 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR BSD-3-Clause) */
+/*
+ * xcpindex.h - sidecar index of candump logs
+ *
+ * Copyright (c) 2021 Christoph Schueler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <cpu12.gems@googlemail.com>
+ *
+ */
+#ifndef __XCPINDEX_H
+#define __XCPINDEX_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <linux/can.h>
+
+/*
+ * Defines
+ */
+#define XCP_INDEX_MAGIC         (0x31495158U)   /* "XQI1" */
+#define XCP_INDEX_VERSION       (1)
+#define XCP_INDEX_SUFFIX        ".xqi"
+#define XCP_INDEX_TIME_STRIDE   (4096)          /* XCP frames between two entries of the time table. */
+#define XCP_INDEX_NONE          (0xffffffffffffffffULL)
+#define XCP_INDEX_NO_DAQ        (0xffffffffU)
+
+/*
+ * Posting lists: one per service code, one for all negative responses and one
+ * for events and service requests.
+ */
+#define XCP_INDEX_KEY_ERRORS    (256)
+#define XCP_INDEX_KEY_EVENTS    (257)
+#define XCP_INDEX_KEYS          (258)
+
+/*
+ * Types
+ */
+typedef enum tagXcpIndexKindType {
+    XCP_INDEX_COMMAND,
+    XCP_INDEX_RESPONSE,
+    XCP_INDEX_ERROR,
+    XCP_INDEX_EVENT,
+    XCP_INDEX_SERVICE_REQUEST
+} XcpIndexKindType;
+
+/*
+ * Where to start reading for a point in time.
+ */
+typedef struct tagXcpIndexTimeType {
+    uint64_t timestamp;         /* ns */
+    uint64_t offset;            /* Of the log line.                              */
+    uint64_t connect;           /* Line of the last CONNECT response before it.  */
+} XcpIndexTimeType;
+
+/*
+ * One CTO. Enough context is kept to dissect it on its own: the request a response
+ * answers and the CONNECT response that set byte order and address granularity.
+ */
+typedef struct tagXcpIndexPostingType {
+    uint64_t offset;
+    uint64_t timestamp;
+    uint64_t request;           /* XCP_INDEX_NONE unless a response.                   */
+    uint64_t connect;           /* XCP_INDEX_NONE before the first CONNECT.            */
+    uint32_t daq;               /* DAQ list the command (or its request) refers to.    */
+    uint8_t kind;               /* XcpIndexKindType                                    */
+    uint8_t service;            /* The command, or the command answered.               */
+    uint8_t code;               /* Error or event code.                                */
+    uint8_t flags;              /* Used while building.                                */
+} XcpIndexPostingType;
+
+/*
+ * File layout: header, time table, postings ordered by key and offset. Host byte order,
+ * the index is a cache next to the log and is rebuilt when the log changes.
+ */
+typedef struct tagXcpIndexHeaderType {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t src;
+    uint32_t dst;
+    uint64_t logSize;
+    int64_t logModified;        /* ns */
+    uint64_t frames;            /* XCP frames in the log. */
+    uint64_t firstTimestamp;
+    uint64_t lastTimestamp;
+    uint64_t timeCount;
+    uint64_t postingCount;
+    uint64_t first[XCP_INDEX_KEYS + 1];
+} XcpIndexHeaderType;
+
+typedef struct tagXcpIndexType {
+    XcpIndexHeaderType header;
+    XcpIndexTimeType * times;
+    XcpIndexPostingType * postings;
+} XcpIndexType;
+
+/*
+ * Global Functions
+ *
+ */
+bool xcp_index_build(XcpIndexType * const index, char const * const log, canid_t src, canid_t dst, unsigned threads);
+bool xcp_index_load(XcpIndexType * const index, char const * const path, char const * const log,
+                    canid_t src, canid_t dst);
+bool xcp_index_save(XcpIndexType const * const index, char const * const path);
+void xcp_index_free(XcpIndexType * const index);
+
+XcpIndexPostingType const * xcp_index_postings(XcpIndexType const * const index, unsigned key, size_t * const count);
+XcpIndexTimeType const * xcp_index_seek(XcpIndexType const * const index, uint64_t timestamp);
+
+#endif /* __XCPINDEX_H */
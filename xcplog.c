@@ -0,0 +1,287 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR BSD-3-Clause) */
+/*
+ * xcplog.c - candump log records
+ *
+ * Copyright (c) 2021 Christoph Schueler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <cpu12.gems@googlemail.com>
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "xcp.h"
+#include "xcplog.h"
+
+/*
+ *
+ * Local Functions.
+ *
+ */
+static int hex_nibble(char c);
+static char const * json_value(char const * line, char const * key);
+static size_t parse_hex(char const * text, uint8_t * const data, size_t max);
+
+
+static int hex_nibble(char c)
+{
+    if ((c >= '0') && (c <= '9')) {
+        return c - '0';
+    }
+    c = tolower((unsigned char)c);
+    if ((c >= 'a') && (c <= 'f')) {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+/*
+ * Start of the value of `key` (incl. quotes and colon), NULL if there is none.
+ */
+static char const * json_value(char const * line, char const * key)
+{
+    char const * value = strstr(line, key);
+
+    return (value == NULL) ? NULL : value + strlen(key);
+}
+
+static size_t parse_hex(char const * text, uint8_t * const data, size_t max)
+{
+    size_t length = 0;
+    int hi;
+    int lo;
+
+    while ((length < max) && ((hi = hex_nibble(text[0])) >= 0) && ((lo = hex_nibble(text[1])) >= 0)) {
+        data[length++] = (hi << 4) | lo;
+        text += 2;
+    }
+    return length;
+}
+
+/*
+ * "(<sec>.<usec>) <iface> <id>#<data>", returns FALSE for anything else.
+ */
+bool xcp_log_parse(char const * line, XcpLogRecordType * const record)
+{
+    unsigned long long sec;
+    uint64_t fraction = 0;
+    uint64_t scale = 1000000000ULL;
+    char const * id;
+    char * end;
+    size_t length;
+    int hi;
+    int lo;
+
+    while (isspace((unsigned char)*line)) {
+        ++line;
+    }
+    if (*line != '(') {
+        return FALSE;
+    }
+    sec = strtoull(line + 1, &end, 10);
+    if (*end != '.') {
+        return FALSE;
+    }
+    for (id = end + 1; isdigit((unsigned char)*id); ++id) {
+        if (scale > 1) {
+            scale /= 10;
+            fraction += (*id - '0') * scale;
+        }
+    }
+    if (*id != ')') {
+        return FALSE;
+    }
+    record->timestamp = sec * 1000000000ULL + fraction;
+    ++id;
+    while (*id == ' ') {
+        ++id;
+    }
+    for (length = 0; (id[length] != '\0') && !isspace((unsigned char)id[length]); ++length) {
+        ;
+    }
+    if ((length == 0) || (id[length] != ' ')) {
+        return FALSE;
+    }
+    if (length >= sizeof(record->interface)) {
+        length = sizeof(record->interface) - 1;
+    }
+    memcpy(record->interface, id, length);
+    record->interface[length] = '\0';
+    id = strchr(id, ' ');
+    while (*id == ' ') {
+        ++id;
+    }
+
+    memset(&record->frame, 0, sizeof(record->frame));
+    record->frame.can_id = strtoul(id, &end, 16);
+    if ((end == id) || (*end != '#')) {
+        return FALSE;
+    }
+    if (end - id > 3) {
+        record->frame.can_id |= CAN_EFF_FLAG;
+    }
+    ++end;
+    record->mtu = CAN_MTU;
+    if (*end == '#') {
+        /* CAN FD, the flags nibble follows the second '#' */
+        record->mtu = CANFD_MTU;
+        if ((hi = hex_nibble(end[1])) < 0) {
+            return FALSE;
+        }
+        record->frame.flags = hi;
+        end += 2;
+    } else if (*end == 'R') {
+        record->frame.can_id |= CAN_RTR_FLAG;
+        return TRUE;
+    }
+    length = 0;
+    while (((hi = hex_nibble(end[0])) >= 0) && ((lo = hex_nibble(end[1])) >= 0)) {
+        if (length == ((record->mtu == CANFD_MTU) ? CANFD_MAX_DLEN : CAN_MAX_DLEN)) {
+            return FALSE;
+        }
+        record->frame.data[length++] = (hi << 4) | lo;
+        end += 2;
+        if (*end == '.') {
+            ++end;
+        }
+    }
+    record->frame.len = length;
+    return TRUE;
+}
+
+bool xcp_log_parse_jsonl(char const * line, XcpLogRecordType * const record)
+{
+    char const * value;
+    unsigned long long sec;
+    uint64_t fraction = 0;
+    uint64_t scale = 1000000000ULL;
+    char * end;
+    size_t length;
+
+    if ((value = json_value(line, "\"ts\":")) == NULL) {
+        return FALSE;
+    }
+    sec = strtoull(value, &end, 10);
+    if (*end == '.') {
+        while (isdigit((unsigned char)*++end)) {
+            if (scale > 1) {
+                scale /= 10;
+                fraction += (*end - '0') * scale;
+            }
+        }
+    }
+    record->timestamp = sec * 1000000000ULL + fraction;
+
+    record->interface[0] = '\0';
+    if ((value = json_value(line, "\"bus\":\"")) != NULL) {
+        for (length = 0; (value[length] != '"') && (value[length] != '\0') &&
+                         (length < (sizeof(record->interface) - 1)); ++length) {
+            record->interface[length] = value[length];
+        }
+        record->interface[length] = '\0';
+    }
+
+    memset(&record->frame, 0, sizeof(record->frame));
+    if ((value = json_value(line, "\"id\":\"")) == NULL) {
+        return FALSE;       /* Not from CAN. */
+    }
+    record->frame.can_id = strtoul(value, &end, 16);
+    if ((end == value) || (*end != '"')) {
+        return FALSE;
+    }
+    if (end - value > 3) {
+        record->frame.can_id |= CAN_EFF_FLAG;
+    }
+    if ((value = json_value(line, "\"data\":\"")) == NULL) {
+        return FALSE;
+    }
+    record->frame.len = parse_hex(value, record->frame.data, CANFD_MAX_DLEN);
+    record->mtu = (record->frame.len > CAN_MAX_DLEN) ? CANFD_MTU : CAN_MTU;
+    return TRUE;
+}
+
+size_t xcp_log_format(XcpLogRecordType const * const record, char * const line)
+{
+    static char const hex_digits[] = "0123456789ABCDEF";
+    canid_t const id = record->frame.can_id;
+    char * end;
+    uint8_t idx;
+
+    end = line + sprintf(line, "(%llu.%06llu) %s ",
+                         (unsigned long long)(record->timestamp / 1000000000ULL),
+                         (unsigned long long)((record->timestamp % 1000000000ULL) / 1000ULL),
+                         (record->interface[0] != '\0') ? record->interface : "-");
+    if (id & CAN_EFF_FLAG) {
+        end += sprintf(end, "%08X#", id & CAN_EFF_MASK);
+    } else {
+        end += sprintf(end, "%03X#", id & CAN_SFF_MASK);
+    }
+    if (record->mtu == CANFD_MTU) {
+        *end++ = '#';
+        *end++ = hex_digits[record->frame.flags & 0x0f];
+    } else if (id & CAN_RTR_FLAG) {
+        *end++ = 'R';
+    }
+    for (idx = 0; (idx < record->frame.len) && !(id & CAN_RTR_FLAG); ++idx) {
+        *end++ = hex_digits[record->frame.data[idx] >> 4];
+        *end++ = hex_digits[record->frame.data[idx] & 0x0f];
+    }
+    *end++ = '\n';
+    *end = '\0';
+    return end - line;
+}
+
+uint64_t xcp_log_hash(struct canfd_frame const * const frame)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    uint8_t const * bytes = (uint8_t const *)&frame->can_id;
+    uint8_t idx;
+
+    for (idx = 0; idx < sizeof(frame->can_id); ++idx) {
+        hash = (hash ^ bytes[idx]) * 0x100000001b3ULL;
+    }
+    hash = (hash ^ frame->len) * 0x100000001b3ULL;
+    for (idx = 0; idx < frame->len; ++idx) {
+        hash = (hash ^ frame->data[idx]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
@@ -0,0 +1,98 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR BSD-3-Clause) */
+/*
+ * xcplog.h - candump log records
+ *
+ * Copyright (c) 2021 Christoph Schueler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <cpu12.gems@googlemail.com>
+ *
+ */
+#ifndef __XCPLOG_H
+#define __XCPLOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <net/if.h>
+#include <linux/can.h>
+
+/*
+ * Types
+ */
+
+/*
+ * One line of a candump log (candump -l / -L):
+ *
+ *   (1436509052.249713) can0 7E1#FF00
+ *   (1436509052.249913) can0 7E1##1FF0011223344556677889900
+ */
+typedef struct tagXcpLogRecordType {
+    uint64_t timestamp;         /* ns */
+    int mtu;
+    char interface[IFNAMSIZ];
+    struct canfd_frame frame;
+} XcpLogRecordType;
+
+/*
+ * Defines
+ */
+#define XCP_LOG_LINE_SIZE   (2 * CANFD_MAX_DLEN + IFNAMSIZ + 48)
+
+/*
+ * Global Functions
+ *
+ */
+bool xcp_log_parse(char const * line, XcpLogRecordType * const record);
+
+/*
+ * A line of xcpdump --format=jsonl written from CAN. Leaves `interface` empty
+ * unless the line has a "bus".
+ */
+bool xcp_log_parse_jsonl(char const * line, XcpLogRecordType * const record);
+
+/*
+ * The candump log line of `record` incl. newline, into `line` of XCP_LOG_LINE_SIZE.
+ */
+size_t xcp_log_format(XcpLogRecordType const * const record, char * const line);
+
+/*
+ * FNV-1a of identifier, length and payload of `frame`.
+ */
+uint64_t xcp_log_hash(struct canfd_frame const * const frame);
+
+#endif /* __XCPLOG_H */
@@ -0,0 +1,754 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR BSD-3-Clause) */
+/*
+ * xcpmdf.c - ASAM MDF4 export of decoded DAQ data
+ *
+ * Copyright (c) 2021 Christoph Schueler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <cpu12.gems@googlemail.com>
+ *
+ */
+
+#include <endian.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(HAVE_ZLIB)
+#include <zlib.h>
+#endif
+
+#include "xcp.h"
+#include "xcpdaq.h"
+#include "xcpmdf.h"
+
+/*
+ * Layout of the file:
+ *
+ *   ID, HD, FH, MD  at the start, ID and HD are rewritten at close
+ *   DT|DZ ...       record data as it arrives, up to XCP_MDF_BLOCK_SIZE each
+ *   TX, CN, CG, ... written at close, when all ODTs and record counts are known
+ *   DL (HL), DG     the data group links the only data block, or a list of all of them
+ *
+ * A record is the record ID of the channel group, the time (double, seconds since the
+ * first message) and the DTO bytes from the first to the last ODT entry, copied as-is.
+ * The channels describe where each entry is and in which byte order, so nothing is
+ * converted while recording.
+ */
+
+/*
+ *
+ * Local Constants.
+ *
+ */
+#define ID_SIZE             (64)
+#define HEADER_SIZE         (24)
+#define HD_OFFSET           (ID_SIZE)
+#define HD_SIZE             (HEADER_SIZE + 6 * 8 + 32)
+#define FH_OFFSET           (HD_OFFSET + HD_SIZE)
+#define FH_SIZE             (HEADER_SIZE + 2 * 8 + 16)
+#define MD_OFFSET           (FH_OFFSET + FH_SIZE)
+
+#define RECORD_ID_SIZE      (2)
+#define TIME_SIZE           (8)
+#define MAX_RECORD_SIZE     (RECORD_ID_SIZE + TIME_SIZE + CANFD_MAX_DLEN)
+
+#define MAX_GROUPS          (2048)
+#define LOOKUP_SIZE         (2 * MAX_GROUPS)    /* Never more than half full. */
+
+#define ID_UNFIN_CYCLE_COUNTERS     (0x0001)
+
+#define CN_TYPE_VALUE       (0)
+#define CN_TYPE_MASTER      (2)
+#define CN_SYNC_NONE        (0)
+#define CN_SYNC_TIME        (1)
+
+#define DATA_UINT_LE        (0)
+#define DATA_UINT_BE        (1)
+#define DATA_FLOAT_LE       (4)
+
+/*
+ *
+ * Local Types.
+ *
+ */
+typedef struct tagGroupType {
+    XcpDaqPlanType plan;        /* Layout of the DTOs the records were taken from. */
+    uint8_t base;               /* First DTO byte copied into the record.          */
+    uint64_t records;
+} GroupType;
+
+/*
+ * Slave timestamps of one DAQ list, unwrapped. Only ODT 0 carries one,
+ * the other ODTs of the sample get the same time.
+ */
+typedef struct tagListClockType {
+    bool known;
+    uint64_t raw;
+    uint64_t ticks;             /* Since the first timestamp.         */
+    double origin;              /* Host time of the first timestamp.  */
+    double time;                /* Of the current sample.             */
+} ListClockType;
+
+typedef struct tagBlockRefType {
+    uint64_t position;          /* Of the DT/DZ block in the file.            */
+    uint64_t dataOffset;        /* Of its first record in the record stream.  */
+} BlockRefType;
+
+/*
+ *
+ * Local Variables.
+ *
+ */
+static FILE * file = NULL;
+static bool use_deflate;
+static bool zipped;
+static bool failed;
+static int error;
+static uint64_t position;
+
+static uint8_t * buffer = NULL;
+static size_t fill;
+static uint8_t * zbuffer = NULL;
+#if defined(HAVE_ZLIB)
+static size_t zbuffer_size;
+#endif
+static uint64_t data_offset;
+
+static BlockRefType * blocks = NULL;
+static size_t block_count;
+static size_t block_capacity;
+
+static GroupType * groups = NULL;
+static uint16_t group_count;
+static uint16_t group_capacity;
+static uint16_t lookup[LOOKUP_SIZE];    /* (DAQ list, ODT) -> current group + 1. */
+
+static ListClockType * clocks = NULL;
+static uint32_t clock_count;
+
+static bool started;
+static struct timeval start;
+
+/*
+ *
+ * Local Functions.
+ *
+ */
+static inline void put16(uint8_t * const ptr, uint16_t value);
+static inline void put32(uint8_t * const ptr, uint32_t value);
+static inline void put64(uint8_t * const ptr, uint64_t value);
+static inline void put_double(uint8_t * const ptr, double value);
+static void write_raw(void const * const data, size_t size);
+static uint64_t write_block(char const * const id, uint64_t const * const links, uint64_t linkCount,
+                            void const * const head, size_t headSize, void const * const data, size_t size);
+static uint64_t write_text(char const * const text);
+static void write_id(bool finalized);
+static void write_hd(uint64_t dataGroup);
+static void write_fh(void);
+static void flush_block(void);
+static uint16_t find_group(XcpDaqPlanType const * const plan);
+static bool same_layout(XcpDaqPlanType const * const a, XcpDaqPlanType const * const b);
+static uint16_t new_group(XcpDaqPlanType const * const plan);
+static double record_time(XcpDaqPlanType const * const plan, XcpMessage const * const msg);
+static uint64_t write_channel(uint64_t next, uint64_t name, uint64_t unit, uint8_t type, uint8_t sync,
+                              uint8_t dataType, uint8_t bitOffset, uint32_t byteOffset, uint32_t bitCount);
+static uint64_t write_group(GroupType const * const group, uint16_t recordId, uint64_t next, uint64_t unit);
+static uint64_t write_data_list(void);
+static void release(void);
+
+
+static inline void put16(uint8_t * const ptr, uint16_t value)
+{
+    value = htole16(value);
+    memcpy(ptr, &value, sizeof(value));
+}
+
+static inline void put32(uint8_t * const ptr, uint32_t value)
+{
+    value = htole32(value);
+    memcpy(ptr, &value, sizeof(value));
+}
+
+static inline void put64(uint8_t * const ptr, uint64_t value)
+{
+    value = htole64(value);
+    memcpy(ptr, &value, sizeof(value));
+}
+
+static inline void put_double(uint8_t * const ptr, double value)
+{
+    uint64_t bits;
+
+    memcpy(&bits, &value, sizeof(bits));
+    put64(ptr, bits);
+}
+
+bool xcp_mdf_deflate_available(void)
+{
+#if defined(HAVE_ZLIB)
+    return TRUE;
+#else
+    return FALSE;
+#endif
+}
+
+bool xcp_mdf_open(char const * const name, bool deflate)
+{
+    if (deflate && !xcp_mdf_deflate_available()) {
+        errno = ENOTSUP;
+        return FALSE;
+    }
+    release();
+    buffer = malloc(XCP_MDF_BLOCK_SIZE);
+    if (buffer == NULL) {
+        return FALSE;
+    }
+    /* Fault the pages in now, not while frames are waiting. */
+    memset(buffer, 0, XCP_MDF_BLOCK_SIZE);
+#if defined(HAVE_ZLIB)
+    if (deflate) {
+        zbuffer_size = compressBound(XCP_MDF_BLOCK_SIZE);
+        zbuffer = malloc(zbuffer_size);
+        if (zbuffer == NULL) {
+            release();
+            return FALSE;
+        }
+        memset(zbuffer, 0, zbuffer_size);
+    }
+#endif
+    file = fopen(name, "wb");
+    if (file == NULL) {
+        release();
+        return FALSE;
+    }
+    use_deflate = deflate;
+    zipped = failed = started = FALSE;
+    position = fill = data_offset = 0;
+    block_count = 0;
+    group_count = 0;
+    memset(lookup, 0, sizeof(lookup));
+    gettimeofday(&start, NULL);
+
+    write_id(FALSE);
+    write_hd(0);
+    write_fh();
+    if (failed) {
+        fclose(file);
+        file = NULL;
+        release();
+        errno = error;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * Call after xcp_daq_update(), only DTOs of a known DAQ configuration are recorded.
+ */
+void xcp_mdf_write(XcpMessage const * const msg)
+{
+    XcpDaqPlanType const * plan;
+    GroupType * group;
+    uint8_t * record;
+    uint16_t id;
+    uint8_t size;
+
+    if (file == NULL) {
+        return;
+    }
+    if (!started) {
+        start = msg->timestamp;
+        started = TRUE;
+    }
+    if (!msg->fromSlave || (msg->length == 0) || (msg->data[0] >= 0xfc)) {
+        return;
+    }
+    plan = xcp_daq_lookup_plan(msg->data, msg->length);
+    if ((plan == NULL) || (msg->length < plan->length)) {
+        return;
+    }
+    id = find_group(plan);
+    if (id == 0) {
+        return;
+    }
+    group = &groups[id - 1];
+    if (fill + MAX_RECORD_SIZE > XCP_MDF_BLOCK_SIZE) {
+        flush_block();
+    }
+    size = plan->length - group->base;
+    record = &buffer[fill];
+    put16(record, id);
+    put_double(&record[RECORD_ID_SIZE], record_time(plan, msg));
+    memcpy(&record[RECORD_ID_SIZE + TIME_SIZE], &msg->data[group->base], size);
+    fill += RECORD_ID_SIZE + TIME_SIZE + size;
+    ++group->records;
+}
+
+bool xcp_mdf_close(void)
+{
+    uint64_t unit;
+    uint64_t group = 0;
+    uint64_t dataList;
+    uint64_t links[4];
+    uint8_t data[8];
+    uint64_t dataGroup;
+    int idx;
+
+    if (file == NULL) {
+        return TRUE;
+    }
+    flush_block();
+
+    unit = write_text("s");
+    for (idx = group_count - 1; idx >= 0; --idx) {
+        group = write_group(&groups[idx], idx + 1, group, unit);
+    }
+    dataList = write_data_list();
+
+    links[0] = 0;
+    links[1] = group;
+    links[2] = dataList;
+    links[3] = 0;
+    memset(data, 0, sizeof(data));
+    data[0] = RECORD_ID_SIZE;
+    dataGroup = write_block("##DG", links, 4, data, sizeof(data), NULL, 0);
+
+    if (!failed && (fseeko(file, 0, SEEK_SET) < 0)) {
+        failed = TRUE;
+        error = errno;
+    }
+    write_id(TRUE);
+    write_hd(dataGroup);
+    if ((fclose(file) != 0) && !failed) {
+        failed = TRUE;
+        error = errno;
+    }
+    file = NULL;
+    release();
+    if (failed) {
+        errno = error;
+    }
+    return !failed;
+}
+
+static void release(void)
+{
+    free(buffer);
+    free(zbuffer);
+    free(blocks);
+    free(groups);
+    free(clocks);
+    buffer = zbuffer = NULL;
+    blocks = NULL;
+    groups = NULL;
+    clocks = NULL;
+    block_capacity = 0;
+    group_capacity = 0;
+    clock_count = 0;
+}
+
+/*
+ *
+ * Records.
+ *
+ */
+static uint16_t find_group(XcpDaqPlanType const * const plan)
+{
+    unsigned slot = ((unsigned)plan->daqList * 257 + plan->odt) & (LOOKUP_SIZE - 1);
+    GroupType const * group;
+    uint16_t id;
+
+    while (lookup[slot] != 0) {
+        group = &groups[lookup[slot] - 1];
+        if ((group->plan.daqList == plan->daqList) && (group->plan.odt == plan->odt)) {
+            if (same_layout(&group->plan, plan)) {
+                return lookup[slot];
+            }
+            break;  /* Reconfigured, the old records keep their group. */
+        }
+        slot = (slot + 1) & (LOOKUP_SIZE - 1);
+    }
+    id = new_group(plan);
+    if (id != 0) {
+        lookup[slot] = id;
+    }
+    return id;
+}
+
+static bool same_layout(XcpDaqPlanType const * const a, XcpDaqPlanType const * const b)
+{
+    XcpDaqPlanEntryType const * x;
+    XcpDaqPlanEntryType const * y;
+    uint8_t idx;
+
+    if ((a->length != b->length) || (a->entryCount != b->entryCount) ||
+        (a->timestampOffset != b->timestampOffset) || (a->timestampSize != b->timestampSize)) {
+        return FALSE;
+    }
+    for (idx = 0; idx < a->entryCount; ++idx) {
+        x = &a->entries[idx];
+        y = &b->entries[idx];
+        if ((x->offset != y->offset) || (x->width != y->width) || (x->bit != y->bit) ||
+            (x->motorola != y->motorola) || (x->address != y->address) ||
+            (x->addressExtension != y->addressExtension)) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static uint16_t new_group(XcpDaqPlanType const * const plan)
+{
+    GroupType * grown;
+    GroupType * group;
+    uint16_t capacity;
+    uint8_t idx;
+
+    if (group_count >= MAX_GROUPS) {
+        return 0;
+    }
+    if (group_count == group_capacity) {
+        capacity = (group_capacity > 0) ? group_capacity * 2 : 16;
+        grown = realloc(groups, capacity * sizeof(GroupType));
+        if (grown == NULL) {
+            return 0;
+        }
+        groups = grown;
+        group_capacity = capacity;
+    }
+    group = &groups[group_count];
+    group->plan = *plan;
+    group->base = plan->length;
+    for (idx = 0; idx < plan->entryCount; ++idx) {
+        if (plan->entries[idx].offset < group->base) {
+            group->base = plan->entries[idx].offset;
+        }
+    }
+    group->records = 0;
+    return ++group_count;
+}
+
+/*
+ * Slave time if the DAQ list is timestamped, relative to the host time of its first
+ * timestamp, else the receive time.
+ */
+static double record_time(XcpDaqPlanType const * const plan, XcpMessage const * const msg)
+{
+    double const host = (double)(msg->timestamp.tv_sec - start.tv_sec) +
+                        (msg->timestamp.tv_usec - start.tv_usec) / 1e6;
+    ListClockType * clock;
+    ListClockType * grown;
+    uint64_t raw = 0;
+    uint8_t idx;
+
+    if (plan->daqList >= clock_count) {
+        grown = realloc(clocks, (plan->daqList + 1) * sizeof(ListClockType));
+        if (grown == NULL) {
+            return host;
+        }
+        memset(&grown[clock_count], 0, (plan->daqList + 1 - clock_count) * sizeof(ListClockType));
+        clocks = grown;
+        clock_count = plan->daqList + 1;
+    }
+    clock = &clocks[plan->daqList];
+
+    if (plan->timestampSize == 0) {
+        if (plan->odt == 0) {
+            clock->known = FALSE;
+        }
+        return clock->known ? clock->time : host;
+    }
+    for (idx = 0; idx < plan->timestampSize; ++idx) {
+        raw = (raw << 8) | msg->data[plan->timestampOffset +
+                                     (plan->entries[0].motorola ? idx : plan->timestampSize - 1 - idx)];
+    }
+    if (clock->known) {
+        clock->ticks += (raw - clock->raw) & ((1ULL << (plan->timestampSize * 8)) - 1);
+    } else {
+        clock->known = TRUE;
+        clock->ticks = 0;
+        clock->origin = host;
+    }
+    clock->raw = raw;
+    clock->time = clock->origin + clock->ticks * xcp_daq_timestamp_resolution();
+    return clock->time;
+}
+
+/*
+ * Write the collected records as one DT block, or DZ if deflate makes it smaller.
+ */
+static void flush_block(void)
+{
+    BlockRefType * grown;
+    size_t capacity;
+#if defined(HAVE_ZLIB)
+    uint8_t head[24];
+    uLongf size = zbuffer_size;
+#endif
+
+    if (fill == 0) {
+        return;
+    }
+    if (block_count == block_capacity) {
+        capacity = (block_capacity > 0) ? block_capacity * 2 : 64;
+        grown = realloc(blocks, capacity * sizeof(BlockRefType));
+        if (grown == NULL) {
+            failed = TRUE;
+            error = ENOMEM;
+            fill = 0;
+            return;
+        }
+        blocks = grown;
+        block_capacity = capacity;
+    }
+    blocks[block_count].dataOffset = data_offset;
+#if defined(HAVE_ZLIB)
+    if (use_deflate && (compress2(zbuffer, &size, buffer, fill, Z_BEST_SPEED) == Z_OK) && (size < fill)) {
+        memset(head, 0, sizeof(head));
+        memcpy(head, "DT", 2);      /* Original block type, zip type 0 (deflate), no parameter. */
+        put64(&head[8], fill);
+        put64(&head[16], size);
+        blocks[block_count].position = write_block("##DZ", NULL, 0, head, sizeof(head), zbuffer, size);
+        zipped = TRUE;
+    } else
+#endif
+    {
+        blocks[block_count].position = write_block("##DT", NULL, 0, buffer, fill, NULL, 0);
+    }
+    ++block_count;
+    data_offset += fill;
+    fill = 0;
+}
+
+/*
+ *
+ * Blocks.
+ *
+ */
+static void write_raw(void const * const data, size_t size)
+{
+    if (failed || (size == 0)) {
+        return;
+    }
+    if (fwrite(data, 1, size, file) != size) {
+        failed = TRUE;
+        error = errno;
+    }
+    position += size;
+}
+
+/*
+ * Header, links, data and the padding to the next 8-byte boundary. Returns the position of the block.
+ */
+static uint64_t write_block(char const * const id, uint64_t const * const links, uint64_t linkCount,
+                            void const * const head, size_t headSize, void const * const data, size_t size)
+{
+    static uint8_t const padding[8];
+    uint64_t const at = position;
+    uint64_t const length = HEADER_SIZE + linkCount * 8 + headSize + size;
+    uint8_t header[HEADER_SIZE];
+    uint8_t link[8];
+    uint64_t idx;
+
+    memcpy(header, id, 4);
+    put32(&header[4], 0);
+    put64(&header[8], length);
+    put64(&header[16], linkCount);
+    write_raw(header, sizeof(header));
+    for (idx = 0; idx < linkCount; ++idx) {
+        put64(link, links[idx]);
+        write_raw(link, sizeof(link));
+    }
+    write_raw(head, headSize);
+    write_raw(data, size);
+    write_raw(padding, (8 - (length & 7)) & 7);
+    return at;
+}
+
+static uint64_t write_text(char const * const text)
+{
+    return write_block("##TX", NULL, 0, text, strlen(text) + 1, NULL, 0);
+}
+
+static void write_id(bool finalized)
+{
+    uint8_t id[ID_SIZE];
+
+    memset(id, 0, sizeof(id));
+    memcpy(&id[0], finalized ? "MDF     " : "UnFinMF ", 8);
+    memcpy(&id[8], "4.10    ", 8);
+    memcpy(&id[16], "xcpdump ", 8);
+    put16(&id[28], 410);
+    put16(&id[60], finalized ? 0 : ID_UNFIN_CYCLE_COUNTERS);
+    write_raw(id, sizeof(id));
+}
+
+static void write_hd(uint64_t dataGroup)
+{
+    uint64_t links[6] = { dataGroup, FH_OFFSET, 0, 0, 0, 0 };
+    uint8_t data[32];
+
+    memset(data, 0, sizeof(data));
+    put64(&data[0], (uint64_t)start.tv_sec * 1000000000ULL + (uint64_t)start.tv_usec * 1000ULL);
+    write_block("##HD", links, 6, data, sizeof(data), NULL, 0);
+}
+
+static void write_fh(void)
+{
+    static char const comment[] =
+        "<FHcomment><TX>XCP DAQ recording</TX><tool_id>xcpdump</tool_id>"
+        "<tool_vendor>xcpdump</tool_vendor><tool_version>1</tool_version></FHcomment>";
+    uint64_t links[2] = { 0, MD_OFFSET };
+    uint8_t data[16];
+
+    memset(data, 0, sizeof(data));
+    put64(&data[0], (uint64_t)start.tv_sec * 1000000000ULL + (uint64_t)start.tv_usec * 1000ULL);
+    write_block("##FH", links, 2, data, sizeof(data), NULL, 0);
+    write_block("##MD", NULL, 0, comment, sizeof(comment), NULL, 0);
+}
+
+static uint64_t write_channel(uint64_t next, uint64_t name, uint64_t unit, uint8_t type, uint8_t sync,
+                              uint8_t dataType, uint8_t bitOffset, uint32_t byteOffset, uint32_t bitCount)
+{
+    uint64_t links[8] = { next, 0, name, 0, 0, 0, unit, 0 };
+    uint8_t data[72];
+
+    memset(data, 0, sizeof(data));
+    data[0] = type;
+    data[1] = sync;
+    data[2] = dataType;
+    data[3] = bitOffset;
+    put32(&data[4], byteOffset);
+    put32(&data[8], bitCount);
+    return write_block("##CN", links, 8, data, sizeof(data), NULL, 0);
+}
+
+/*
+ * Channel group of one ODT: the time, then one channel per ODT entry, named by its address.
+ */
+static uint64_t write_group(GroupType const * const group, uint16_t recordId, uint64_t next, uint64_t unit)
+{
+    XcpDaqPlanEntryType const * entry;
+    uint64_t channel = 0;
+    uint64_t links[6];
+    uint8_t data[32];
+    uint32_t byteOffset;
+    char name[32];
+    int len;
+    int idx;
+
+    for (idx = group->plan.entryCount - 1; idx >= 0; --idx) {
+        entry = &group->plan.entries[idx];
+        if (entry->addressExtension != 0) {
+            len = snprintf(name, sizeof(name), "0x%02X:0x%08X", entry->addressExtension, entry->address);
+        } else {
+            len = snprintf(name, sizeof(name), "0x%08X", entry->address);
+        }
+        byteOffset = TIME_SIZE + entry->offset - group->base;
+        if (entry->bit != XCP_DAQ_NO_BIT) {
+            snprintf(&name[len], sizeof(name) - len, ".%u", entry->bitOffset);
+            byteOffset += entry->motorola ? (entry->width - 1 - entry->bit / 8) : (entry->bit / 8);
+            channel = write_channel(channel, write_text(name), 0, CN_TYPE_VALUE, CN_SYNC_NONE,
+                                    DATA_UINT_LE, entry->bit % 8, byteOffset, 1);
+        } else {
+            channel = write_channel(channel, write_text(name), 0, CN_TYPE_VALUE, CN_SYNC_NONE,
+                                    entry->motorola ? DATA_UINT_BE : DATA_UINT_LE, 0, byteOffset,
+                                    entry->width * 8);
+        }
+    }
+    channel = write_channel(channel, write_text("t"), unit, CN_TYPE_MASTER, CN_SYNC_TIME,
+                            DATA_FLOAT_LE, 0, 0, TIME_SIZE * 8);
+
+    snprintf(name, sizeof(name), "DAQ %u ODT %u", group->plan.daqList, group->plan.odt);
+    links[0] = next;
+    links[1] = channel;
+    links[2] = write_text(name);
+    links[3] = links[4] = links[5] = 0;
+    memset(data, 0, sizeof(data));
+    put64(&data[0], recordId);
+    put64(&data[8], group->records);
+    put32(&data[24], TIME_SIZE + group->plan.length - group->base);
+    return write_block("##CG", links, 6, data, sizeof(data), NULL, 0);
+}
+
+/*
+ * A single data block is linked directly, more are listed in a DL block,
+ * behind an HL block if any of them is compressed.
+ */
+static uint64_t write_data_list(void)
+{
+    uint64_t * links;
+    uint8_t * data;
+    uint8_t head[8];
+    uint64_t list;
+    size_t idx;
+
+    if (block_count == 0) {
+        return 0;
+    }
+    if (block_count == 1) {
+        return blocks[0].position;
+    }
+    links = malloc((block_count + 1) * sizeof(uint64_t));
+    data = malloc(8 + block_count * 8);
+    if ((links == NULL) || (data == NULL)) {
+        free(links);
+        free(data);
+        failed = TRUE;
+        error = ENOMEM;
+        return 0;
+    }
+    links[0] = 0;
+    memset(data, 0, 8);
+    put32(&data[4], block_count);
+    for (idx = 0; idx < block_count; ++idx) {
+        links[idx + 1] = blocks[idx].position;
+        put64(&data[8 + idx * 8], blocks[idx].dataOffset);
+    }
+    list = write_block("##DL", links, block_count + 1, data, 8 + block_count * 8, NULL, 0);
+    free(links);
+    free(data);
+    if (zipped) {
+        memset(head, 0, sizeof(head));      /* No flags, zip type 0 (deflate). */
+        list = write_block("##HL", &list, 1, head, sizeof(head), NULL, 0);
+    }
+    return list;
+}
@@ -0,0 +1,561 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR BSD-3-Clause) */
+/*
+ * xcpmerge.c - merge recordings of several buses or machines
+ *
+ * Copyright (c) 2021 Christoph Schueler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <cpu12.gems@googlemail.com>
+ *
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "xcp.h"
+#include "xcplog.h"
+#include "xcpsession.h"
+#include "xcpdaq.h"
+#include "xcpfilter.h"
+
+/*
+ * Every input is mmap()ed and read line by line; a binary heap keyed by the next
+ * timestamp of each input (plus its clock offset) gives the next line to write. Pages
+ * read are dropped as the inputs are consumed, so the memory used is the same for any
+ * size of input.
+ *
+ * With -a the clock offset of an input is estimated from the frames it has in common
+ * with the first input: a sample of frames from the middle of the input is hashed,
+ * the first input is scanned for the same frames and the median of the time
+ * differences is taken. Frames seen more than once, e.g. repeated GET_STATUS or
+ * constant DTOs, are left out, they can't be paired.
+ */
+
+/*
+ *
+ * Local Constants.
+ *
+ */
+#define NO_CAN_ID       (0xFFFFFFFFU)
+#define MAX_INPUTS      (64)
+#define LINE_SIZE       (8192)
+#define RELEASE_SIZE    (4 * 1024 * 1024)   /* Consumed bytes released from the mapping at once. */
+
+#define SAMPLE_SIZE     (4096)              /* Frames hashed for estimating an offset. */
+#define SAMPLE_SLOTS    (2 * SAMPLE_SIZE)
+#define MIN_PAIRS       (8)
+
+/*
+ *
+ * Local Types.
+ *
+ */
+typedef enum tagInputFormatType {
+    INPUT_CANDUMP,
+    INPUT_JSONL
+} InputFormatType;
+
+typedef struct tagInputType {
+    char const * name;
+    char const * map;
+    size_t size;
+    size_t position;
+    size_t released;
+    InputFormatType format;
+    bool manual;                    /* Offset given. */
+    int64_t offset;                 /* ns, added to the timestamps. */
+    XcpLogRecordType record;        /* Next record, timestamp incl. offset. */
+    uint64_t records;
+    uint64_t backwards;             /* Records older than the one before. */
+    uint64_t last;
+} InputType;
+
+typedef struct tagSignatureType {
+    uint64_t key;
+    uint64_t timestamp;
+    uint32_t samples;
+    uint32_t matches;
+    int64_t difference;
+} SignatureType;
+
+/*
+ *
+ * Local Variables.
+ *
+ */
+static InputType inputs[MAX_INPUTS];
+static unsigned input_count = 0;
+static unsigned heap[MAX_INPUTS];
+static unsigned heap_size = 0;
+static SignatureType signatures[SAMPLE_SLOTS];
+static int64_t differences[SAMPLE_SIZE];
+static canid_t src = NO_CAN_ID;
+static canid_t dst = NO_CAN_ID;
+static bool dissect = FALSE;
+static bool dtos = FALSE;
+static bool filter = FALSE;
+
+/*
+ *
+ * Local Functions.
+ *
+ */
+static bool open_input(InputType * const input, char * const argument);
+static bool read_record(InputType * const input, XcpLogRecordType * const record);
+static bool is_xcp(XcpLogRecordType const * const record);
+static uint64_t signature(XcpLogRecordType const * const record);
+static SignatureType * lookup(uint64_t key);
+static int compare_differences(void const * a, void const * b);
+static void estimate_offset(InputType * const reference, InputType * const input);
+static bool earlier(unsigned a, unsigned b);
+static void sift_down(unsigned position);
+static bool advance(InputType * const input);
+static void print_record(XcpLogRecordType * const record);
+
+
+void print_usage(char *prg)
+{
+    fprintf(stderr, "\nUsage: %s [options] <log>[@<offset>] <log>[@<offset>] ...\n", prg);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "         -m <can_id>  (XCP master can_id, as for xcpdump)\n");
+    fprintf(stderr, "         -s <can_id>  (XCP slave can_id, as for xcpdump)\n");
+    fprintf(stderr, "         -a           (estimate the clock offsets to the first log from the XCP frames they share)\n");
+    fprintf(stderr, "         -D           (dissect the merged XCP frames instead of writing a candump log)\n");
+    fprintf(stderr, "         -d           (include DTOs, with -D)\n");
+    fprintf(stderr, "         -v           (decode DTO values, with -D)\n");
+    fprintf(stderr, "         -f <expr>    (display filter, with -D)\n");
+    fprintf(stderr, "\nLogs are candump -l logs or xcpdump --format=jsonl output, <offset> is added to the\n");
+    fprintf(stderr, "timestamps of the log, in seconds.\n");
+}
+
+static bool open_input(InputType * const input, char * const argument)
+{
+    struct stat st;
+    char * at = strrchr(argument, '@');
+    char * end;
+    double offset;
+    int fd;
+
+    if (at != NULL) {
+        offset = strtod(at + 1, &end);
+        if ((end != (at + 1)) && (*end == '\0')) {
+            *at = '\0';
+            input->manual = TRUE;
+            input->offset = (int64_t)(offset * 1e9);
+        }
+    }
+    input->name = argument;
+    fd = open(argument, O_RDONLY);
+    if (fd < 0) {
+        return FALSE;
+    }
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return FALSE;
+    }
+    input->size = st.st_size;
+    if (input->size > 0) {
+        input->map = mmap(NULL, input->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (input->map == MAP_FAILED) {
+            close(fd);
+            return FALSE;
+        }
+        madvise((void *)input->map, input->size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    input->format = INPUT_CANDUMP;
+    for (input->position = 0; input->position < input->size; ++input->position) {
+        if (input->map[input->position] == '{') {
+            input->format = INPUT_JSONL;
+        }
+        if ((input->map[input->position] != ' ') && (input->map[input->position] != '\n')) {
+            break;
+        }
+    }
+    input->position = 0;
+    return TRUE;
+}
+
+/*
+ * Next record from the current position, timestamps as in the log.
+ */
+static bool read_record(InputType * const input, XcpLogRecordType * const record)
+{
+    char line[LINE_SIZE];
+    char const * start;
+    char const * newline;
+    size_t length;
+    bool valid;
+
+    while (input->position < input->size) {
+        start = &input->map[input->position];
+        newline = memchr(start, '\n', input->size - input->position);
+        length = (newline != NULL) ? (size_t)(newline - start) : (input->size - input->position);
+        input->position += length + 1;
+        if (length >= sizeof(line)) {
+            continue;
+        }
+        memcpy(line, start, length);
+        line[length] = '\0';
+        if (input->format == INPUT_JSONL) {
+            valid = xcp_log_parse_jsonl(line, record);
+        } else {
+            valid = xcp_log_parse(line, record);
+        }
+        if (valid) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static bool is_xcp(XcpLogRecordType const * const record)
+{
+    if (record->frame.can_id & CAN_RTR_FLAG) {
+        return FALSE;
+    }
+    return ((src == NO_CAN_ID) && (dst == NO_CAN_ID)) ||
+           (record->frame.can_id == src) || (record->frame.can_id == dst);
+}
+
+/*
+ * A key of 0 marks a free slot.
+ */
+static uint64_t signature(XcpLogRecordType const * const record)
+{
+    uint64_t const hash = xcp_log_hash(&record->frame);
+
+    return (hash == 0) ? 1 : hash;
+}
+
+static SignatureType * lookup(uint64_t key)
+{
+    unsigned slot = key % SAMPLE_SLOTS;
+
+    while ((signatures[slot].key != 0) && (signatures[slot].key != key)) {
+        slot = (slot + 1) % SAMPLE_SLOTS;
+    }
+    return &signatures[slot];
+}
+
+static int compare_differences(void const * a, void const * b)
+{
+    int64_t const x = *(int64_t const *)a;
+    int64_t const y = *(int64_t const *)b;
+
+    return (x > y) - (x < y);
+}
+
+static void estimate_offset(InputType * const reference, InputType * const input)
+{
+    XcpLogRecordType record;
+    SignatureType * entry;
+    size_t sampled = 0;
+    size_t pairs = 0;
+    size_t idx;
+    uint64_t key;
+    int64_t spread;
+
+    memset(signatures, 0, sizeof(signatures));
+
+    /* The middle of a capture is the most likely to overlap with the other one. */
+    input->position = input->size / 2;
+    while ((input->position < input->size) && (input->map[input->position++] != '\n')) {
+        ;
+    }
+    while ((sampled < SAMPLE_SIZE) && read_record(input, &record)) {
+        if (!is_xcp(&record)) {
+            continue;
+        }
+        key = signature(&record);
+        entry = lookup(key);
+        if (entry->key == 0) {
+            entry->key = key;
+            entry->timestamp = record.timestamp;
+            ++sampled;
+        }
+        ++entry->samples;
+    }
+    input->position = 0;
+
+    reference->position = 0;
+    while (read_record(reference, &record)) {
+        if (!is_xcp(&record)) {
+            continue;
+        }
+        entry = lookup(signature(&record));
+        if ((entry->key != 0) && (entry->matches++ == 0)) {
+            entry->difference = (int64_t)(record.timestamp - entry->timestamp);
+        }
+    }
+    reference->position = 0;
+
+    for (idx = 0; idx < SAMPLE_SLOTS; ++idx) {
+        if ((signatures[idx].samples == 1) && (signatures[idx].matches == 1)) {
+            differences[pairs++] = signatures[idx].difference;
+        }
+    }
+    if (pairs < MIN_PAIRS) {
+        fprintf(stderr, "%s: %zu frames in common with %s, offset not estimated\n",
+                input->name, pairs, reference->name);
+        return;
+    }
+    qsort(differences, pairs, sizeof(differences[0]), compare_differences);
+    input->offset = reference->offset + differences[pairs / 2];
+    spread = differences[(3 * pairs) / 4] - differences[pairs / 4];
+    fprintf(stderr, "%s: offset %+.6f s from %zu frames in common with %s (interquartile range %.6f s)\n",
+            input->name, input->offset / 1e9, pairs, reference->name, spread / 1e9);
+}
+
+static bool earlier(unsigned a, unsigned b)
+{
+    return (inputs[a].record.timestamp < inputs[b].record.timestamp) ||
+           ((inputs[a].record.timestamp == inputs[b].record.timestamp) && (a < b));
+}
+
+static void sift_down(unsigned position)
+{
+    unsigned child;
+    unsigned item = heap[position];
+
+    while ((child = 2 * position + 1) < heap_size) {
+        if (((child + 1) < heap_size) && earlier(heap[child + 1], heap[child])) {
+            ++child;
+        }
+        if (!earlier(heap[child], item)) {
+            break;
+        }
+        heap[position] = heap[child];
+        position = child;
+    }
+    heap[position] = item;
+}
+
+/*
+ * Reads the next record of `input` and applies the offset, FALSE at the end.
+ */
+static bool advance(InputType * const input)
+{
+    size_t release;
+
+    if (!read_record(input, &input->record)) {
+        return FALSE;
+    }
+    if ((input->offset < 0) && ((uint64_t)-input->offset > input->record.timestamp)) {
+        input->record.timestamp = 0;
+    } else {
+        input->record.timestamp += input->offset;
+    }
+    if (input->record.timestamp < input->last) {
+        ++input->backwards;
+    }
+    input->last = input->record.timestamp;
+    ++input->records;
+
+    release = input->position & ~(size_t)(RELEASE_SIZE - 1);
+    if (release > input->released) {
+        madvise((void *)&input->map[input->released], release - input->released, MADV_DONTNEED);
+        input->released = release;
+    }
+    return TRUE;
+}
+
+static void print_record(XcpLogRecordType * const record)
+{
+    static XcpMessage message;
+    struct timeval tv;
+
+    tv.tv_sec = record->timestamp / 1000000000ULL;
+    tv.tv_usec = (record->timestamp % 1000000000ULL) / 1000;
+    message.src = src;
+    message.dst = dst;
+    xcp_message_from_frame(&message, &record->frame, &tv);
+    xcp_session_update(&message);
+    xcp_daq_update(&message);
+    if (filter && !xcp_filter_match(&message)) {
+        return;
+    }
+    if (!dtos && message.fromSlave && (message.length > 0) && (message.data[0] < 0xfc)) {
+        return;
+    }
+    printf("(%ld.%06ld) %s  ", (long)tv.tv_sec, (long)tv.tv_usec, record->interface);
+    if (record->frame.can_id & CAN_EFF_FLAG) {
+        printf("%8X", record->frame.can_id & CAN_EFF_MASK);
+    } else {
+        printf("%3X", record->frame.can_id & CAN_SFF_MASK);
+    }
+    printf("  [%d]  ", record->frame.len);
+    print_xcp_message(&message, dtos);
+    printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+    InputType * input;
+    CanIdType ids;
+    char line[XCP_LOG_LINE_SIZE];
+    size_t length;
+    unsigned idx;
+    bool estimate = FALSE;
+    int result = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "m:s:aDdvf:?")) != -1) {
+        switch (opt) {
+            case 'm':
+                dst = strtoul(optarg, NULL, 16);
+                if (strlen(optarg) > 7) {
+                    dst |= CAN_EFF_FLAG;
+                }
+                break;
+            case 's':
+                src = strtoul(optarg, NULL, 16);
+                if (strlen(optarg) > 7) {
+                    src |= CAN_EFF_FLAG;
+                }
+                break;
+            case 'a':
+                estimate = TRUE;
+                break;
+            case 'D':
+                dissect = TRUE;
+                break;
+            case 'd':
+                dtos = TRUE;
+                break;
+            case 'v':
+                xcp_daq_set_decode(TRUE);
+                break;
+            case 'f':
+                if (!xcp_filter_compile(optarg)) {
+                    fprintf(stderr, "filter: %s\n", xcp_filter_error());
+                    exit(1);
+                }
+                filter = TRUE;
+                break;
+            case '?':
+                print_usage(basename(argv[0]));
+                exit(0);
+                break;
+            default:
+                fprintf(stderr, "Unknown option %c\n", opt);
+                print_usage(basename(argv[0]));
+                exit(1);
+                break;
+        }
+    }
+    if (((argc - optind) < 1) || ((argc - optind) > MAX_INPUTS) ||
+        (dissect && ((src == NO_CAN_ID) || (dst == NO_CAN_ID)))) {
+        print_usage(basename(argv[0]));
+        exit(1);
+    }
+
+    for (idx = optind; idx < (unsigned)argc; ++idx) {
+        input = &inputs[input_count++];
+        if (!open_input(input, argv[idx])) {
+            perror(argv[idx]);
+            return 1;
+        }
+    }
+    if (estimate) {
+        for (idx = 1; idx < input_count; ++idx) {
+            if (!inputs[idx].manual) {
+                estimate_offset(&inputs[0], &inputs[idx]);
+            }
+        }
+    }
+
+    if (dissect) {
+        ids.src = src;
+        ids.dst = dst;
+        setIdentifiers(&ids);
+    }
+
+    for (idx = 0; idx < input_count; ++idx) {
+        if (advance(&inputs[idx])) {
+            heap[heap_size++] = idx;
+        }
+    }
+    for (idx = heap_size / 2; idx-- > 0; ) {
+        sift_down(idx);
+    }
+
+    while (heap_size > 0) {
+        input = &inputs[heap[0]];
+        if (input->record.interface[0] == '\0') {
+            snprintf(input->record.interface, sizeof(input->record.interface), "%u", heap[0]);
+        }
+        if (!dissect) {
+            length = xcp_log_format(&input->record, line);
+            if (fwrite(line, 1, length, stdout) != length) {
+                perror("write");
+                result = 1;
+                break;
+            }
+        } else if (is_xcp(&input->record)) {
+            print_record(&input->record);
+        }
+        if (!advance(input)) {
+            heap[0] = heap[--heap_size];
+        }
+        sift_down(0);
+    }
+    if (fflush(stdout) != 0) {
+        perror("write");
+        result = 1;
+    }
+
+    for (idx = 0; idx < input_count; ++idx) {
+        if (inputs[idx].backwards > 0) {
+            fprintf(stderr, "%s: %llu records older than the one before, the log is not in time order\n",
+                    inputs[idx].name, (unsigned long long)inputs[idx].backwards);
+        }
+        if (inputs[idx].size > 0) {
+            munmap((void *)inputs[idx].map, inputs[idx].size);
+        }
+    }
+    return result;
+}
@@ -0,0 +1,409 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR BSD-3-Clause) */
+/*
+ * xcppgm.c - analyzer for flash programming sessions
+ *
+ * Copyright (c) 2021 Christoph Schueler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <cpu12.gems@googlemail.com>
+ *
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <linux/can.h>
+
+#include "xcp.h"
+#include "xcpsession.h"
+#include "xcppgm.h"
+
+/*
+ *
+ * Local Variables.
+ *
+ */
+static XcpPgmSessionType pgm;
+static XcpPgmSessionType superseded;    /* Kept to be reported when PROGRAM_START comes again. */
+static bool active = FALSE;
+static XcpPgmSessionType const * completed = NULL;
+
+static bool awaiting = FALSE;           /* A command is waiting for its response. */
+static uint8_t command;
+static unsigned command_sector;
+static uint64_t command_cleared;
+static struct timeval command_start;
+static struct timeval last_request;
+static struct timeval last_frame;
+
+/*
+ *
+ * Local Functions.
+ *
+ */
+static void pgm_request(XcpMessage const * const msg);
+static void pgm_response(XcpMessage const * const msg);
+static void get_sector_info(XcpSessionType const * const session, XcpMessage const * const msg);
+static void start(XcpMessage const * const msg);
+static unsigned sector_of(uint64_t address);
+static uint64_t elapsed(struct timeval const * const from, struct timeval const * const to);
+static bool is_program(uint8_t service);
+static void print_seconds(char const * const name, uint64_t microseconds);
+
+
+/*
+ * Feed every frame through here, after xcp_session_update().
+ */
+void xcp_pgm_update(XcpMessage const * const msg)
+{
+    XcpSessionType const * const session = xcp_session_get();
+    uint64_t interval;
+
+    completed = NULL;
+    if (session->response == 0xff) {
+        switch (session->request[0]) {
+            case PROGRAM_START:
+                start(msg);
+                return;
+            case GET_SECTOR_INFO:
+                get_sector_info(session, msg);
+                break;
+            default:
+                break;
+        }
+    }
+    if (!active) {
+        return;
+    }
+    ++pgm.frames;
+    interval = elapsed(&last_frame, &msg->timestamp);
+    if ((interval > 0) && (interval < pgm.shortestFrameInterval)) {
+        pgm.shortestFrameInterval = interval;
+    }
+    last_frame = msg->timestamp;
+    pgm.end = msg->timestamp;
+
+    if (session->isRequest) {
+        pgm_request(msg);
+    } else if (msg->fromSlave && (msg->length > 0) &&
+               ((msg->data[0] == 0xff) || (msg->data[0] == 0xfe))) {
+        pgm_response(msg);
+    }
+}
+
+XcpPgmSessionType const * xcp_pgm_completed(void)
+{
+    return completed;
+}
+
+void xcp_pgm_flush(void)
+{
+    if (active) {
+        active = FALSE;
+        completed = &pgm;
+    }
+}
+
+static void start(XcpMessage const * const msg)
+{
+    uint8_t const * const res = msg->data;
+    unsigned idx;
+
+    if (active) {
+        /* Never reset, report what was done so far before it's overwritten. */
+        superseded = pgm;
+        superseded.superseded = TRUE;
+        completed = &superseded;
+    }
+    for (idx = 0; idx <= XCP_PGM_MAX_SECTORS; ++idx) {
+        pgm.sectors[idx].clears = 0;
+        pgm.sectors[idx].cleared = 0;
+        pgm.sectors[idx].clearTime = 0;
+        pgm.sectors[idx].programmed = 0;
+        pgm.sectors[idx].programTime = 0;
+        pgm.sectors[idx].slaveWait = 0;
+    }
+    if (msg->length >= 7) {
+        pgm.commModePgm = res[2];
+        pgm.maxCtoPgm = res[3];
+        pgm.maxBsPgm = res[4];
+        pgm.minStPgm = res[5];
+        pgm.queueSizePgm = res[6];
+    } else {
+        /* Short response, the programming parameters are unknown. */
+        pgm.commModePgm = 0;
+        pgm.maxCtoPgm = 0;
+        pgm.maxBsPgm = 0;
+        pgm.minStPgm = 0;
+        pgm.queueSizePgm = 0;
+    }
+    pgm.addressGranularity = xcp_session_get()->addressGranularity;
+    pgm.start = msg->timestamp;
+    pgm.end = msg->timestamp;
+    pgm.frames = 0;
+    pgm.errors = 0;
+    pgm.cleared = 0;
+    pgm.clearTime = 0;
+    pgm.programmed = 0;
+    pgm.programTime = 0;
+    pgm.slaveWait = 0;
+    pgm.minStViolations = 0;
+    pgm.shortestGap = UINT32_MAX;
+    pgm.shortestFrameInterval = UINT32_MAX;
+    pgm.superseded = FALSE;
+    last_frame = msg->timestamp;
+    awaiting = FALSE;
+    active = TRUE;
+}
+
+static void pgm_request(XcpMessage const * const msg)
+{
+    XcpSessionType const * const session = xcp_session_get();
+    uint8_t const * const req = session->request;
+    XcpDataSegmentType const * const segment = &session->segment;
+    uint64_t gap;
+
+    if (awaiting && (req[0] == PROGRAM_NEXT)) {
+        /* Within a master block, frames have to be separated by at least minStPgm. */
+        gap = elapsed(&last_request, &msg->timestamp);
+        if (gap < pgm.shortestGap) {
+            pgm.shortestGap = gap;
+        }
+        if (gap < pgm.minStPgm * 100ULL) {
+            ++pgm.minStViolations;
+        }
+    } else {
+        command = req[0];
+        command_start = msg->timestamp;
+        /* The MTA has already been moved past the data of PROGRAM commands. */
+        command_sector = sector_of((uint64_t)(is_program(segment->service) ? segment->address : session->mtaAddress) *
+                                   session->addressGranularity);
+        command_cleared = 0;
+        if ((command == PROGRAM_CLEAR) && (session->requestLength >= 8) && (req[1] == 0)) {
+            command_cleared = (uint64_t)xcp_session_dword(session, &req[4]) * session->addressGranularity;
+        }
+    }
+    if (is_program(segment->service) && (segment->length > 0)) {
+        pgm.programmed += segment->length;
+        pgm.sectors[sector_of((uint64_t)segment->address * session->addressGranularity)].programmed += segment->length;
+    }
+    last_request = msg->timestamp;
+    awaiting = TRUE;
+
+    if (command == PROGRAM_RESET) {
+        /* The slave may reset without answering. */
+        active = FALSE;
+        completed = &pgm;
+    }
+}
+
+static void pgm_response(XcpMessage const * const msg)
+{
+    XcpPgmSectorType * const sector = &pgm.sectors[command_sector];
+    uint64_t wait;
+    uint64_t duration;
+
+    if (!awaiting) {
+        return;
+    }
+    awaiting = FALSE;
+    wait = elapsed(&last_request, &msg->timestamp);
+    duration = elapsed(&command_start, &msg->timestamp);
+    pgm.slaveWait += wait;
+    sector->slaveWait += wait;
+    if (msg->data[0] == 0xfe) {
+        ++pgm.errors;
+    }
+    if (command == PROGRAM_CLEAR) {
+        pgm.clearTime += duration;
+        sector->clearTime += duration;
+        ++sector->clears;
+        if (msg->data[0] == 0xff) {
+            pgm.cleared += command_cleared;
+            sector->cleared += command_cleared;
+        }
+    } else if (is_program(command)) {
+        pgm.programTime += duration;
+        sector->programTime += duration;
+    }
+}
+
+static void get_sector_info(XcpSessionType const * const session, XcpMessage const * const msg)
+{
+    uint8_t const * const req = session->request;
+    uint8_t const * const res = msg->data;
+    XcpPgmSectorType * sector;
+
+    /* A short response leaves the sector unknown. */
+    if ((session->requestLength < 3) || (msg->length < 8)) {
+        return;
+    }
+    sector = &pgm.sectors[req[2]];
+    if (req[1] == 0) {
+        sector->address = xcp_session_dword(session, &res[4]);
+        sector->startKnown = TRUE;
+    } else if (req[1] == 1) {
+        sector->length = xcp_session_dword(session, &res[4]);
+        sector->lengthKnown = TRUE;
+    }
+}
+
+static unsigned sector_of(uint64_t address)
+{
+    XcpPgmSectorType const * sector;
+    uint64_t start;
+    unsigned idx;
+
+    for (idx = 0; idx < XCP_PGM_MAX_SECTORS; ++idx) {
+        sector = &pgm.sectors[idx];
+        if (!sector->startKnown || !sector->lengthKnown) {
+            continue;
+        }
+        start = (uint64_t)sector->address * xcp_session_get()->addressGranularity;
+        if ((address >= start) && (address < start + sector->length)) {
+            return idx;
+        }
+    }
+    return XCP_PGM_UNKNOWN_SECTOR;
+}
+
+static uint64_t elapsed(struct timeval const * const from, struct timeval const * const to)
+{
+    struct timeval diff;
+
+    if (timercmp(to, from, <)) {
+        return 0;
+    }
+    timersub(to, from, &diff);
+    return (uint64_t)diff.tv_sec * 1000000 + diff.tv_usec;
+}
+
+static bool is_program(uint8_t service)
+{
+    return (service == PROGRAM) || (service == PROGRAM_NEXT) || (service == PROGRAM_MAX);
+}
+
+static void print_seconds(char const * const name, uint64_t microseconds)
+{
+    printf(", %s = %llu.%06llus", name, (unsigned long long)(microseconds / 1000000),
+           (unsigned long long)(microseconds % 1000000));
+}
+
+/*
+ * The theoretical throughput assumes an instantly answering slave: per
+ * (master) block maxBsPgm frames spaced by minStPgm, plus the response,
+ * where the shortest observed frame interval stands in for the bus time
+ * of a frame.
+ */
+void xcp_pgm_print(XcpPgmSessionType const * const pgm)
+{
+    XcpPgmSectorType const * sector;
+    struct timeval duration;
+    double blockTime;
+    unsigned header;
+    unsigned frames;
+    unsigned spacing;
+    unsigned idx;
+
+    timersub(&pgm->end, &pgm->start, &duration);
+
+    printf("PGM(maxCtoPgm = %u", pgm->maxCtoPgm);
+    printf(", maxBsPgm = %u", pgm->maxBsPgm);
+    printf(", minStPgm = %u", pgm->minStPgm);
+    printf(", queueSizePgm = %u", pgm->queueSizePgm);
+    printf(", frames = %u", pgm->frames);
+    printf(", duration = %ld.%06lds", (long)duration.tv_sec, (long)duration.tv_usec);
+    printf(", cleared = %llu", (unsigned long long)pgm->cleared);
+    print_seconds("clearTime", pgm->clearTime);
+    printf(", programmed = %llu", (unsigned long long)pgm->programmed);
+    print_seconds("programTime", pgm->programTime);
+    print_seconds("slaveWait", pgm->slaveWait);
+    if (pgm->programTime > 0) {
+        printf(", throughput = %.0f bytes/s", pgm->programmed * 1e6 / pgm->programTime);
+    }
+    if ((pgm->shortestFrameInterval != UINT32_MAX) && (pgm->maxCtoPgm > 2)) {
+        if (pgm->commModePgm & XCP_PGM_COMM_MODE_MASTER_BLOCK_MODE) {
+            header = (pgm->addressGranularity > 2) ? pgm->addressGranularity : 2;
+            frames = (pgm->maxBsPgm > 0) ? pgm->maxBsPgm : 1;
+        } else {
+            header = pgm->addressGranularity;
+            frames = 1;
+        }
+        spacing = pgm->minStPgm * 100;
+        if (spacing < pgm->shortestFrameInterval) {
+            spacing = pgm->shortestFrameInterval;
+        }
+        blockTime = 2.0 * pgm->shortestFrameInterval + (frames - 1) * (double)spacing;
+        printf(", theoreticalThroughput = %.0f bytes/s", (pgm->maxCtoPgm - header) * frames * 1e6 / blockTime);
+    }
+    printf(", minStViolations = %u", pgm->minStViolations);
+    if (pgm->shortestGap != UINT32_MAX) {
+        printf(", shortestGap = %uus", pgm->shortestGap);
+    }
+    if (pgm->errors > 0) {
+        printf(", errors = %u", pgm->errors);
+    }
+    if (pgm->superseded) {
+        printf(", superseded = TRUE");
+    }
+    printf(")");
+
+    for (idx = 0; idx <= XCP_PGM_MAX_SECTORS; ++idx) {
+        sector = &pgm->sectors[idx];
+        if ((sector->clears == 0) && (sector->programmed == 0)) {
+            continue;
+        }
+        printf("\nPGM_SECTOR(");
+        if (idx == XCP_PGM_UNKNOWN_SECTOR) {
+            printf("sector = \"UNKNOWN\"");
+        } else {
+            printf("sector = %u", idx);
+            printf(", address = 0x%08x", sector->address);
+            printf(", length = %u", sector->length);
+        }
+        printf(", cleared = %llu", (unsigned long long)sector->cleared);
+        print_seconds("clearTime", sector->clearTime);
+        printf(", programmed = %llu", (unsigned long long)sector->programmed);
+        print_seconds("programTime", sector->programTime);
+        print_seconds("slaveWait", sector->slaveWait);
+        if (sector->programTime > 0) {
+            printf(", throughput = %.0f bytes/s", sector->programmed * 1e6 / sector->programTime);
+        }
+        printf(")");
+    }
+}
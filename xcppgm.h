@@ -0,0 +1,110 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR BSD-3-Clause) */
+/*
+ * xcppgm.h - analyzer for flash programming sessions
+ *
+ * Copyright (c) 2021 Christoph Schueler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <cpu12.gems@googlemail.com>
+ *
+ */
+#ifndef __XCPPGM_H
+#define __XCPPGM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/time.h>
+
+#include "xcp.h"
+
+/*
+ * Defines
+ */
+#define XCP_PGM_MAX_SECTORS     (256)
+#define XCP_PGM_UNKNOWN_SECTOR  (XCP_PGM_MAX_SECTORS)   /* Collects everything outside of known sectors. */
+
+/*
+ * Types
+ */
+typedef struct tagXcpPgmSectorType {
+    bool startKnown;
+    bool lengthKnown;
+    uint32_t address;           /* Start address as reported by GET_SECTOR_INFO. */
+    uint32_t length;            /* In bytes. */
+    uint32_t clears;
+    uint64_t cleared;           /* In bytes. */
+    uint64_t clearTime;         /* All times in microseconds. */
+    uint64_t programmed;        /* In bytes. */
+    uint64_t programTime;
+    uint64_t slaveWait;
+} XcpPgmSectorType;
+
+/*
+ * One PROGRAM_START ... PROGRAM_RESET sequence.
+ */
+typedef struct tagXcpPgmSessionType {
+    uint8_t commModePgm;
+    uint8_t maxCtoPgm;
+    uint8_t maxBsPgm;
+    uint8_t minStPgm;           /* In units of 100 microseconds. */
+    uint8_t queueSizePgm;
+    uint8_t addressGranularity;
+    struct timeval start;
+    struct timeval end;
+    uint32_t frames;
+    uint32_t errors;            /* Negative responses. */
+    uint64_t cleared;
+    uint64_t clearTime;
+    uint64_t programmed;
+    uint64_t programTime;
+    uint64_t slaveWait;         /* Last request of a command until its response. */
+    uint32_t minStViolations;   /* Gaps within a master block shorter than minStPgm. */
+    uint32_t shortestGap;
+    uint32_t shortestFrameInterval;
+    bool superseded;            /* Ended by another PROGRAM_START, not by PROGRAM_RESET. */
+    XcpPgmSectorType sectors[XCP_PGM_MAX_SECTORS + 1];
+} XcpPgmSessionType;
+
+/*
+ * Global Functions
+ *
+ */
+void xcp_pgm_update(XcpMessage const * const msg);
+XcpPgmSessionType const * xcp_pgm_completed(void);
+void xcp_pgm_flush(void);
+void xcp_pgm_print(XcpPgmSessionType const * const pgm);
+
+#endif /* __XCPPGM_H */
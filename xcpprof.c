@@ -0,0 +1,252 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR BSD-3-Clause) */
+/*
+ * xcpprof.c - per-stage hot path instrumentation
+ *
+ * Copyright (c) 2021 Christoph Schueler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <cpu12.gems@googlemail.com>
+ *
+ */
+
+#if defined(XCP_PROFILE)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "xcp.h"
+#include "xcpprof.h"
+
+/*
+ *
+ * Local Constants.
+ *
+ */
+#define SUB_BUCKETS     (1U << XCP_PROF_BUCKET_BITS)
+#define BUCKETS         (64 * SUB_BUCKETS)
+
+/*
+ *
+ * Local Types.
+ *
+ */
+
+/*
+ * Log-linear histogram: every power of two is split into SUB_BUCKETS linear bins,
+ * which keeps the relative error of the percentiles below 1 / SUB_BUCKETS.
+ */
+typedef struct tagHistogramType {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+    uint64_t buckets[BUCKETS];
+} HistogramType;
+
+/*
+ *
+ * Local Variables.
+ *
+ */
+static HistogramType histograms[XCP_PROF_STAGES];
+static double ns_per_tick = 1.0;
+static volatile sig_atomic_t dump_requested = 0;
+
+static char const * const stage_names[XCP_PROF_STAGES] = {
+    "receive", "timestamp", "analyze", "decode", "format", "flush", "latency"
+};
+
+/*
+ *
+ * Local Functions.
+ *
+ */
+static void sigdump(int signo);
+static unsigned bucket_of(uint64_t value);
+static uint64_t bucket_value(unsigned bucket);
+static uint64_t percentile(HistogramType const * const histogram, unsigned permille);
+
+
+static void sigdump(int signo)
+{
+    (void)signo;
+    dump_requested = 1;
+}
+
+/*
+ * Calibrate the tick rate against CLOCK_MONOTONIC and dump on SIGUSR1.
+ */
+void xcp_prof_init(void)
+{
+    struct timespec start;
+    struct timespec stop;
+    struct timespec pause = { 0, 20000000 };
+    struct sigaction sa;
+    uint64_t ticks;
+    uint64_t ns;
+    unsigned idx;
+
+    for (idx = 0; idx < XCP_PROF_STAGES; ++idx) {
+        memset(&histograms[idx], 0, sizeof(HistogramType));
+        histograms[idx].min = UINT64_MAX;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ticks = xcp_prof_ticks();
+    nanosleep(&pause, NULL);
+    ticks = xcp_prof_ticks() - ticks;
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    ns = (uint64_t)(stop.tv_sec - start.tv_sec) * 1000000000ULL + stop.tv_nsec - start.tv_nsec;
+    if (ticks > 0) {
+        ns_per_tick = (double)ns / ticks;
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sigdump;
+    sigaction(SIGUSR1, &sa, NULL);
+}
+
+static unsigned bucket_of(uint64_t value)
+{
+    unsigned exponent;
+
+    if (value < SUB_BUCKETS) {
+        return value;
+    }
+    exponent = 63 - __builtin_clzll(value);
+    return (exponent - XCP_PROF_BUCKET_BITS + 1) * SUB_BUCKETS +
+           ((value >> (exponent - XCP_PROF_BUCKET_BITS)) & (SUB_BUCKETS - 1));
+}
+
+/*
+ * Upper bound of a bucket.
+ */
+static uint64_t bucket_value(unsigned bucket)
+{
+    unsigned exponent;
+
+    if (bucket < SUB_BUCKETS) {
+        return bucket;
+    }
+    exponent = bucket / SUB_BUCKETS + XCP_PROF_BUCKET_BITS - 1;
+    return ((uint64_t)(SUB_BUCKETS + (bucket % SUB_BUCKETS) + 1) << (exponent - XCP_PROF_BUCKET_BITS)) - 1;
+}
+
+void xcp_prof_record(XcpProfStageType stage, uint64_t ticks)
+{
+    HistogramType * const histogram = &histograms[stage];
+
+    ++histogram->count;
+    histogram->sum += ticks;
+    if (ticks < histogram->min) {
+        histogram->min = ticks;
+    }
+    if (ticks > histogram->max) {
+        histogram->max = ticks;
+    }
+    ++histogram->buckets[bucket_of(ticks)];
+}
+
+/*
+ * SO_TIMESTAMP is CLOCK_REALTIME, the latency is recorded in nanoseconds, not in ticks.
+ */
+void xcp_prof_latency(struct timeval const * const tv)
+{
+    struct timespec now;
+    int64_t ns;
+
+    if ((tv->tv_sec == 0) && (tv->tv_usec == 0)) {
+        return;
+    }
+    clock_gettime(CLOCK_REALTIME, &now);
+    ns = (int64_t)(now.tv_sec - tv->tv_sec) * 1000000000LL + now.tv_nsec - (int64_t)tv->tv_usec * 1000;
+    xcp_prof_record(XCP_PROF_LATENCY, (ns > 0) ? (uint64_t)ns : 0);
+}
+
+void xcp_prof_poll(void)
+{
+    if (dump_requested) {
+        dump_requested = 0;
+        xcp_prof_print();
+    }
+}
+
+static uint64_t percentile(HistogramType const * const histogram, unsigned permille)
+{
+    uint64_t const rank = (histogram->count * permille + 999) / 1000;
+    uint64_t seen = 0;
+    unsigned bucket;
+
+    for (bucket = 0; bucket < BUCKETS; ++bucket) {
+        seen += histogram->buckets[bucket];
+        if ((seen >= rank) && (seen > 0)) {
+            return (bucket_value(bucket) < histogram->max) ? bucket_value(bucket) : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+void xcp_prof_print(void)
+{
+    HistogramType const * histogram;
+    double scale;
+    unsigned idx;
+
+    for (idx = 0; idx < XCP_PROF_STAGES; ++idx) {
+        histogram = &histograms[idx];
+        if (histogram->count == 0) {
+            continue;
+        }
+        scale = (idx == XCP_PROF_LATENCY) ? 1.0 : ns_per_tick;
+        fprintf(stderr, "PROFILE(stage = %s", stage_names[idx]);
+        fprintf(stderr, ", count = %llu", (unsigned long long)histogram->count);
+        fprintf(stderr, ", mean = %.0fns", scale * histogram->sum / histogram->count);
+        fprintf(stderr, ", min = %.0fns", scale * histogram->min);
+        fprintf(stderr, ", p50 = %.0fns", scale * percentile(histogram, 500));
+        fprintf(stderr, ", p99 = %.0fns", scale * percentile(histogram, 990));
+        fprintf(stderr, ", p999 = %.0fns", scale * percentile(histogram, 999));
+        fprintf(stderr, ", max = %.0fns", scale * histogram->max);
+        fprintf(stderr, ")\n");
+    }
+}
+
+#endif /* XCP_PROFILE */
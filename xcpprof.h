@@ -0,0 +1,146 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR BSD-3-Clause) */
+/*
+ * xcpprof.h - per-stage hot path instrumentation
+ *
+ * Copyright (c) 2021 Christoph Schueler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <cpu12.gems@googlemail.com>
+ *
+ */
+#ifndef __XCPPROF_H
+#define __XCPPROF_H
+
+/*
+ * Build with -DXCP_PROFILE (make PROFILE=1) to time the stages of the receive loop.
+ * Otherwise all of the macros below expand to nothing.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/time.h>
+
+/*
+ * Defines
+ */
+#define XCP_PROF_BUCKET_BITS    (3)     /* Linear sub-buckets per power of two. */
+
+/*
+ * Types
+ */
+typedef enum tagXcpProfStageType {
+    XCP_PROF_RECEIVE,           /* recvmsg(), including the wait for the bus.               */
+    XCP_PROF_TIMESTAMP,         /* Fetching the receive time from the control messages.     */
+    XCP_PROF_ANALYZE,           /* Session, DAQ and the other analyzers.                    */
+    XCP_PROF_DECODE,            /* print_xcp_message().                                     */
+    XCP_PROF_FORMAT,            /* Prefix, trailing hex dump and ASCII columns.             */
+    XCP_PROF_FLUSH,             /* fflush(stdout).                                          */
+    XCP_PROF_LATENCY,           /* Kernel receive timestamp to output flushed.              */
+    XCP_PROF_STAGES
+} XcpProfStageType;
+
+#if defined(XCP_PROFILE)
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+/*
+ * Global Functions
+ *
+ */
+void xcp_prof_init(void);
+void xcp_prof_record(XcpProfStageType stage, uint64_t ticks);
+void xcp_prof_latency(struct timeval const * const tv);
+void xcp_prof_poll(void);
+void xcp_prof_print(void);
+
+static inline uint64_t xcp_prof_ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+/*
+ * Close the stage started at `*mark` and start the next one.
+ * Time spent in nested stages since then (`*nested`) is not counted twice.
+ */
+static inline void xcp_prof_stage(XcpProfStageType stage, uint64_t * const mark, uint64_t * const nested)
+{
+    uint64_t const now = xcp_prof_ticks();
+
+    xcp_prof_record(stage, now - *mark - *nested);
+    *mark = now;
+    *nested = 0;
+}
+
+#define XCP_PROF_DECLARE            uint64_t xcp_prof_mark = 0, xcp_prof_nested = 0, xcp_prof_call
+#define XCP_PROF_INIT()             xcp_prof_init()
+#define XCP_PROF_START()            (xcp_prof_mark = xcp_prof_ticks(), xcp_prof_nested = 0)
+#define XCP_PROF_STAGE(stage)       xcp_prof_stage((stage), &xcp_prof_mark, &xcp_prof_nested)
+#define XCP_PROF_CALL(stage, call)  do {                                                    \
+                                        xcp_prof_call = xcp_prof_ticks();                   \
+                                        call;                                               \
+                                        xcp_prof_call = xcp_prof_ticks() - xcp_prof_call;   \
+                                        xcp_prof_record((stage), xcp_prof_call);            \
+                                        xcp_prof_nested += xcp_prof_call;                   \
+                                    } while (0)
+#define XCP_PROF_LATENCY(tv)        xcp_prof_latency(tv)
+#define XCP_PROF_POLL()             xcp_prof_poll()
+#define XCP_PROF_PRINT()            xcp_prof_print()
+
+#else
+
+#define XCP_PROF_DECLARE
+#define XCP_PROF_INIT()             ((void)0)
+#define XCP_PROF_START()            ((void)0)
+#define XCP_PROF_STAGE(stage)       ((void)0)
+#define XCP_PROF_CALL(stage, call)  call
+#define XCP_PROF_LATENCY(tv)        ((void)0)
+#define XCP_PROF_POLL()             ((void)0)
+#define XCP_PROF_PRINT()            ((void)0)
+
+#endif /* XCP_PROFILE */
+
+#endif /* __XCPPROF_H */
@@ -0,0 +1,522 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR BSD-3-Clause) */
+/*
+ * xcpquery.c - time-indexed queries on candump logs
+ *
+ * Copyright (c) 2021 Christoph Schueler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <cpu12.gems@googlemail.com>
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "xcp.h"
+#include "xcplog.h"
+#include "xcpindex.h"
+#include "xcpsession.h"
+#include "xcpdaq.h"
+#include "xcpfilter.h"
+
+/*
+ * The first run over a log writes <log>.xqi (see xcpindex.h). Queries for services,
+ * errors, events or DAQ lists read only the matching lines, each after the CONNECT
+ * response and the request it depends on, which are dissected with the output muted.
+ * Time ranges without a selection seek to the nearest time table entry and read on
+ * from there.
+ */
+
+#define NO_CAN_ID   (0xFFFFFFFFU)
+#define LINE_SIZE   (512)
+#define MAX_SERVICES (16)
+
+typedef struct tagOptionsType {
+    canid_t src;
+    canid_t dst;
+    uint64_t begin;
+    uint64_t end;
+    uint8_t services[MAX_SERVICES];
+    unsigned serviceCount;
+    bool errors;
+    bool events;
+    uint32_t daq;
+    bool dtos;
+    bool filter;
+} OptionsType;
+
+static OptionsType options;
+static FILE * log_file;
+static XcpMessage message;
+static int saved_stdout = -1;
+static int devnull = -1;
+
+void print_usage(char *prg)
+{
+    fprintf(stderr, "\nUsage: %s [options] <logfile>\n", prg);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "         -m <can_id>  (XCP master can_id, as for xcpdump)\n");
+    fprintf(stderr, "         -s <can_id>  (XCP slave can_id, as for xcpdump)\n");
+    fprintf(stderr, "         -b <time>    (from, seconds as in the log or [YYYY-MM-DD ]HH:MM[:SS] local time)\n");
+    fprintf(stderr, "         -e <time>    (to, inclusive)\n");
+    fprintf(stderr, "         -S <service> (requests, responses and errors of a service, name or number; repeatable)\n");
+    fprintf(stderr, "         -E           (negative responses)\n");
+    fprintf(stderr, "         -V           (events and service requests)\n");
+    fprintf(stderr, "         -l <daq>     (only CTOs referring to DAQ list <daq>)\n");
+    fprintf(stderr, "         -f <expr>    (display filter on the selected messages, as for xcpdump)\n");
+    fprintf(stderr, "         -d           (include DTOs, time ranges without -S/-E/-V/-l only)\n");
+    fprintf(stderr, "         -v           (decode DTO values)\n");
+    fprintf(stderr, "         -i           (rebuild the index)\n");
+    fprintf(stderr, "         -j <n>       (threads building the index, default: online CPUs)\n");
+    fprintf(stderr, "\n<logfile> is in candump -l format, the index is kept in <logfile>%s.\n", XCP_INDEX_SUFFIX);
+}
+
+/*
+ * Seconds since the epoch as in the log, or a local date and/or time. A time of day
+ * alone is taken on the day the log starts, or the next one if it is earlier than that.
+ */
+static bool parse_time(char const * const text, uint64_t first, uint64_t * const result)
+{
+    time_t const day = first / 1000000000ULL;
+    struct tm tm;
+    double seconds = 0.0;
+    time_t value;
+    char * end;
+    int n = 0;
+
+    if (strchr(text, ':') == NULL) {
+        seconds = strtod(text, &end);
+        if ((end == text) || (*end != '\0') || (seconds < 0.0)) {
+            return FALSE;
+        }
+        *result = (uint64_t)(seconds * 1e9);
+        return TRUE;
+    }
+    localtime_r(&day, &tm);
+    if ((sscanf(text, "%d-%d-%d %d:%d%n", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &tm.tm_hour, &tm.tm_min, &n) == 5) &&
+        (n > 0)) {
+        tm.tm_year -= 1900;
+        tm.tm_mon -= 1;
+    } else if ((sscanf(text, "%d:%d%n", &tm.tm_hour, &tm.tm_min, &n) != 2) || (n == 0)) {
+        return FALSE;
+    }
+    if (text[n] == ':') {
+        seconds = strtod(&text[n + 1], &end);
+    } else {
+        end = (char *)&text[n];
+    }
+    if (*end != '\0') {
+        return FALSE;
+    }
+    tm.tm_sec = 0;
+    tm.tm_isdst = -1;
+    value = mktime(&tm);
+    if (value == (time_t)-1) {
+        return FALSE;
+    }
+    *result = (uint64_t)value * 1000000000ULL + (uint64_t)(seconds * 1e9);
+    if ((text[2] == ':' || text[1] == ':') && (*result < first)) {
+        *result += 86400ULL * 1000000000ULL;
+    }
+    return TRUE;
+}
+
+/*
+ * Context messages go through the dissector as well, it keeps its own request state.
+ */
+static void quiet(bool on)
+{
+    if (on == (saved_stdout >= 0)) {
+        return;
+    }
+    fflush(stdout);
+    if (on) {
+        saved_stdout = dup(STDOUT_FILENO);
+        dup2(devnull, STDOUT_FILENO);
+    } else {
+        dup2(saved_stdout, STDOUT_FILENO);
+        close(saved_stdout);
+        saved_stdout = -1;
+    }
+}
+
+static bool is_xcp(XcpLogRecordType const * const record)
+{
+    return !(record->frame.can_id & CAN_RTR_FLAG) &&
+           ((record->frame.can_id == options.src) || (record->frame.can_id == options.dst));
+}
+
+static bool read_line(XcpLogRecordType * const record)
+{
+    char line[LINE_SIZE];
+
+    while (fgets(line, sizeof(line), log_file) != NULL) {
+        if (xcp_log_parse(line, record) && is_xcp(record)) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static bool read_at(uint64_t offset, XcpLogRecordType * const record)
+{
+    if (fseeko(log_file, offset, SEEK_SET) < 0) {
+        return FALSE;
+    }
+    return read_line(record);
+}
+
+static void feed(XcpLogRecordType * const record, bool print)
+{
+    struct timeval tv;
+
+    tv.tv_sec = record->timestamp / 1000000000ULL;
+    tv.tv_usec = (record->timestamp % 1000000000ULL) / 1000;
+    message.src = options.src;
+    message.dst = options.dst;
+    xcp_message_from_frame(&message, &record->frame, &tv);
+    xcp_session_update(&message);
+    xcp_daq_update(&message);
+
+    if (print && options.filter && !xcp_filter_match(&message)) {
+        print = FALSE;
+    }
+    if (!print) {
+        /* Keep the dissector in step, only CTOs change its state. */
+        if ((message.length > 0) && (!message.fromSlave || (message.data[0] >= 0xfc))) {
+            quiet(TRUE);
+            print_xcp_message(&message, FALSE);
+        }
+        return;
+    }
+    quiet(FALSE);
+    printf("(%ld.%06ld) %s  ", (long)tv.tv_sec, (long)tv.tv_usec, record->interface);
+    if (record->frame.can_id & CAN_EFF_FLAG) {
+        printf("%8X", record->frame.can_id & CAN_EFF_MASK);
+    } else {
+        printf("%3X", record->frame.can_id & CAN_SFF_MASK);
+    }
+    printf("  [%d]  ", record->frame.len);
+    print_xcp_message(&message, options.dtos);
+    printf("\n");
+}
+
+/*
+ * The CONNECT response behind `connect` sets byte order and address granularity.
+ */
+static void feed_connect(uint64_t connect)
+{
+    static uint64_t fed = XCP_INDEX_NONE;
+    XcpLogRecordType record;
+
+    if ((connect == XCP_INDEX_NONE) || (connect == fed) || !read_at(connect, &record)) {
+        return;
+    }
+    fed = connect;
+    memset(&record.frame, 0, sizeof(record.frame));
+    record.frame.can_id = options.src;
+    record.frame.len = 2;
+    record.frame.data[0] = CONNECT;
+    feed(&record, FALSE);
+    read_at(connect, &record);
+    feed(&record, FALSE);
+}
+
+static int compare_offsets(void const * a, void const * b)
+{
+    uint64_t const x = (*(XcpIndexPostingType const * const *)a)->offset;
+    uint64_t const y = (*(XcpIndexPostingType const * const *)b)->offset;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * Add the postings of one list within the time range.
+ */
+static size_t select_postings(XcpIndexType const * const index, unsigned key,
+                              XcpIndexPostingType const ** selected, size_t count)
+{
+    XcpIndexPostingType const * postings;
+    size_t length;
+    size_t low = 0;
+    size_t high;
+    size_t mid;
+
+    postings = xcp_index_postings(index, key, &length);
+    high = length;
+    while (low < high) {
+        mid = low + (high - low) / 2;
+        if (postings[mid].timestamp < options.begin) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    for (; (low < length) && (postings[low].timestamp <= options.end); ++low) {
+        if ((options.daq == XCP_INDEX_NO_DAQ) || (postings[low].daq == options.daq)) {
+            selected[count++] = &postings[low];
+        }
+    }
+    return count;
+}
+
+static void query_postings(XcpIndexType const * const index)
+{
+    XcpIndexPostingType const ** selected;
+    XcpIndexPostingType const * posting;
+    XcpLogRecordType record;
+    uint64_t last = XCP_INDEX_NONE;
+    size_t count = 0;
+    size_t idx;
+    unsigned key;
+
+    selected = malloc((index->header.postingCount + 1) * sizeof(XcpIndexPostingType const *));
+    if (selected == NULL) {
+        perror("query");
+        return;
+    }
+    for (idx = 0; idx < options.serviceCount; ++idx) {
+        count = select_postings(index, options.services[idx], selected, count);
+    }
+    if (options.errors) {
+        count = select_postings(index, XCP_INDEX_KEY_ERRORS, selected, count);
+    }
+    if (options.events) {
+        count = select_postings(index, XCP_INDEX_KEY_EVENTS, selected, count);
+    }
+    if ((options.serviceCount == 0) && !options.errors && !options.events) {
+        for (key = 0; key < 256; ++key) {
+            count = select_postings(index, key, selected, count);
+        }
+    }
+    qsort(selected, count, sizeof(selected[0]), compare_offsets);
+
+    for (idx = 0; idx < count; ++idx) {
+        posting = selected[idx];
+        if (posting->offset == last) {
+            continue;   /* An error is listed under its service as well. */
+        }
+        feed_connect(posting->connect);
+        if ((posting->request != XCP_INDEX_NONE) && (posting->request != last) && read_at(posting->request, &record)) {
+            feed(&record, FALSE);
+        }
+        if (read_at(posting->offset, &record)) {
+            feed(&record, TRUE);
+        }
+        last = posting->offset;
+    }
+    quiet(FALSE);
+    free(selected);
+}
+
+static void query_range(XcpIndexType const * const index)
+{
+    XcpIndexTimeType const * start = xcp_index_seek(index, options.begin);
+    XcpLogRecordType record;
+
+    if (start == NULL) {
+        return;
+    }
+    feed_connect(start->connect);
+    if (fseeko(log_file, start->offset, SEEK_SET) < 0) {
+        perror("seek");
+        return;
+    }
+    while (read_line(&record) && (record.timestamp <= options.end)) {
+        if (record.timestamp < options.begin) {
+            feed(&record, FALSE);
+        } else if (options.dtos || !record.frame.len || (record.frame.can_id != options.dst) ||
+                   (record.frame.data[0] >= 0xfc)) {
+            feed(&record, TRUE);
+        } else {
+            feed(&record, FALSE);
+        }
+    }
+    quiet(FALSE);
+}
+
+int main(int argc, char **argv)
+{
+    XcpIndexType index;
+    CanIdType ids;
+    char const * begin = NULL;
+    char const * end = NULL;
+    char path[4096];
+    char * tail;
+    uint32_t value;
+    unsigned threads = sysconf(_SC_NPROCESSORS_ONLN);
+    bool rebuild = FALSE;
+    struct timespec t0;
+    struct timespec t1;
+    int opt;
+
+    options.src = options.dst = NO_CAN_ID;
+    options.daq = XCP_INDEX_NO_DAQ;
+    options.end = UINT64_MAX;
+
+    while ((opt = getopt(argc, argv, "m:s:b:e:S:EVl:f:dvij:?")) != -1) {
+        switch (opt) {
+            case 'm':
+                options.dst = strtoul(optarg, NULL, 16);
+                if (strlen(optarg) > 7) {
+                    options.dst |= CAN_EFF_FLAG;
+                }
+                break;
+            case 's':
+                options.src = strtoul(optarg, NULL, 16);
+                if (strlen(optarg) > 7) {
+                    options.src |= CAN_EFF_FLAG;
+                }
+                break;
+            case 'b':
+                begin = optarg;
+                break;
+            case 'e':
+                end = optarg;
+                break;
+            case 'S':
+                if (isdigit((unsigned char)optarg[0])) {
+                    value = strtoul(optarg, &tail, 0);
+                    if ((*tail != '\0') || (value > 0xff)) {
+                        fprintf(stderr, "invalid service '%s'\n", optarg);
+                        exit(1);
+                    }
+                } else if (!xcp_filter_symbol(optarg, &value) || (value < 0xc0)) {
+                    fprintf(stderr, "unknown service '%s'\n", optarg);
+                    exit(1);
+                }
+                if (options.serviceCount == MAX_SERVICES) {
+                    fprintf(stderr, "at most %u services\n", MAX_SERVICES);
+                    exit(1);
+                }
+                options.services[options.serviceCount++] = value;
+                break;
+            case 'E':
+                options.errors = TRUE;
+                break;
+            case 'V':
+                options.events = TRUE;
+                break;
+            case 'l':
+                options.daq = strtoul(optarg, NULL, 0);
+                break;
+            case 'f':
+                if (!xcp_filter_compile(optarg)) {
+                    fprintf(stderr, "filter: %s\n", xcp_filter_error());
+                    exit(1);
+                }
+                options.filter = TRUE;
+                break;
+            case 'd':
+                options.dtos = TRUE;
+                break;
+            case 'v':
+                xcp_daq_set_decode(TRUE);
+                break;
+            case 'i':
+                rebuild = TRUE;
+                break;
+            case 'j':
+                threads = strtoul(optarg, NULL, 10);
+                break;
+            case '?':
+                print_usage(basename(argv[0]));
+                exit(0);
+                break;
+            default:
+                fprintf(stderr, "Unknown option %c\n", opt);
+                print_usage(basename(argv[0]));
+                exit(1);
+                break;
+        }
+    }
+    if (((argc - optind) != 1) || (options.src == NO_CAN_ID) || (options.dst == NO_CAN_ID)) {
+        print_usage(basename(argv[0]));
+        exit(1);
+    }
+
+    snprintf(path, sizeof(path), "%s%s", argv[optind], XCP_INDEX_SUFFIX);
+    if (rebuild || !xcp_index_load(&index, path, argv[optind], options.src, options.dst)) {
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        if (!xcp_index_build(&index, argv[optind], options.src, options.dst, threads)) {
+            perror(argv[optind]);
+            return 1;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        fprintf(stderr, "indexed %llu XCP frames, %llu CTOs in %.3fs\n",
+                (unsigned long long)index.header.frames, (unsigned long long)index.header.postingCount,
+                (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9);
+        if (!xcp_index_save(&index, path)) {
+            perror(path);
+        }
+    }
+
+    if ((begin && !parse_time(begin, index.header.firstTimestamp, &options.begin)) ||
+        (end && !parse_time(end, index.header.firstTimestamp, &options.end))) {
+        fprintf(stderr, "invalid time, use seconds or [YYYY-MM-DD ]HH:MM[:SS]\n");
+        return 1;
+    }
+
+    log_file = fopen(argv[optind], "r");
+    devnull = open("/dev/null", O_WRONLY);
+    if ((log_file == NULL) || (devnull < 0)) {
+        perror(argv[optind]);
+        return 1;
+    }
+    ids.src = options.src;
+    ids.dst = options.dst;
+    setIdentifiers(&ids);
+
+    if ((options.serviceCount > 0) || options.errors || options.events || (options.daq != XCP_INDEX_NO_DAQ)) {
+        query_postings(&index);
+    } else {
+        query_range(&index);
+    }
+    fflush(stdout);
+
+    xcp_index_free(&index);
+    fclose(log_file);
+    close(devnull);
+    return 0;
+}
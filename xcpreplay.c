@@ -0,0 +1,341 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR BSD-3-Clause) */
+/*
+ * xcpreplay.c - timed replay of candump logs onto a CAN interface
+ *
+ * Copyright (c) 2021 Christoph Schueler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <cpu12.gems@googlemail.com>
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <time.h>
+#include <poll.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+#include "xcp.h"
+#include "xcplog.h"
+
+/*
+ * Input is the candump log format, see xcplog.h.
+ *
+ * The timer wakes up SPIN_NS ahead of a frame and busy-waits the rest,
+ * frames due within the same window go out with one sendmmsg().
+ */
+
+#define MAX_BATCH               (64)
+#define DEFAULT_BATCH           (16)
+#define SPIN_NS                 (50000ULL)
+#define BATCH_WINDOW_NS         (20000ULL)
+
+static volatile sig_atomic_t running = 1;
+
+static void sigterm(int signo)
+{
+    (void)signo;
+    running = 0;
+}
+
+void print_usage(char *prg)
+{
+    fprintf(stderr, "\nUsage: %s [options] <logfile> <CAN interface>\n", prg);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "         -s <factor>  (speed, 2 = twice as fast, 0.5 = half as fast, default 1)\n");
+    fprintf(stderr, "         -x           (ignore the timestamps, send as fast as possible)\n");
+    fprintf(stderr, "         -l <loops>   (replay the log <loops> times, 0 = forever, default 1)\n");
+    fprintf(stderr, "         -b <frames>  (frames per sendmmsg(), up to %u, default %u)\n", MAX_BATCH, DEFAULT_BATCH);
+    fprintf(stderr, "\n<logfile> is in candump -l format, - reads from stdin.\n");
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Sleep on the timerfd until shortly before `due`, then spin.
+ * Returns FALSE once SIGINT or SIGTERM arrived, the frame isn't due yet then.
+ */
+static bool wait_until(int tfd, uint64_t due)
+{
+    struct itimerspec its;
+    uint64_t expirations;
+
+    if (!running) {
+        return FALSE;
+    }
+    if (due > now_ns() + SPIN_NS) {
+        memset(&its, 0, sizeof(its));
+        its.it_value.tv_sec = (due - SPIN_NS) / 1000000000ULL;
+        its.it_value.tv_nsec = (due - SPIN_NS) % 1000000000ULL;
+        timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, NULL);
+        while (read(tfd, &expirations, sizeof(expirations)) < 0) {
+            if (!running || (errno != EINTR)) {
+                return FALSE;
+            }
+        }
+    }
+    while (now_ns() < due) {
+        if (!running) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static int send_batch(int s, XcpLogRecordType * const records, unsigned count)
+{
+    struct mmsghdr msgs[MAX_BATCH];
+    struct iovec iovs[MAX_BATCH];
+    struct pollfd pfd;
+    unsigned sent = 0;
+    unsigned idx;
+    int result;
+
+    memset(msgs, 0, sizeof(msgs));
+    for (idx = 0; idx < count; ++idx) {
+        iovs[idx].iov_base = &records[idx].frame;
+        iovs[idx].iov_len = records[idx].mtu;
+        msgs[idx].msg_hdr.msg_iov = &iovs[idx];
+        msgs[idx].msg_hdr.msg_iovlen = 1;
+    }
+    while (sent < count) {
+        result = sendmmsg(s, &msgs[sent], count - sent, 0);
+        if (result < 0) {
+            if ((errno == ENOBUFS) || (errno == EAGAIN) || (errno == EINTR)) {
+                if (!running) {
+                    return -1;
+                }
+                if (errno != EINTR) {
+                    /* The TX queue is full, wait for room instead of spinning. */
+                    pfd.fd = s;
+                    pfd.events = POLLOUT;
+                    poll(&pfd, 1, 1);
+                }
+                continue;
+            }
+            perror("sendmmsg");
+            return -1;
+        }
+        sent += result;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    static XcpLogRecordType batch[MAX_BATCH + 1];
+    struct sockaddr_can addr;
+    struct sigaction sa;
+    int const canfd_on = 1;
+    double speed = 1.0;
+    bool maxRate = FALSE;
+    unsigned loops = 1;
+    unsigned loop;
+    unsigned batchSize = DEFAULT_BATCH;
+    unsigned count;
+    bool pending;
+    bool restart;
+    char line[512];
+    FILE * log;
+    uint64_t start;
+    uint64_t first = 0;
+    uint64_t offset = 0;
+    uint64_t last = 0;
+    uint64_t due;
+    uint64_t late;
+    uint64_t maxLate = 0;
+    uint64_t sumLate = 0;
+    uint64_t frames = 0;
+    uint64_t batches = 0;
+    double elapsed;
+    int tfd;
+    int s;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:xl:b:?")) != -1) {
+        switch (opt) {
+            case 's':
+                speed = strtod(optarg, NULL);
+                break;
+            case 'x':
+                maxRate = TRUE;
+                break;
+            case 'l':
+                loops = strtoul(optarg, NULL, 10);
+                break;
+            case 'b':
+                batchSize = strtoul(optarg, NULL, 10);
+                break;
+            case '?':
+                print_usage(basename(argv[0]));
+                exit(0);
+                break;
+            default:
+                fprintf(stderr, "Unknown option %c\n", opt);
+                print_usage(basename(argv[0]));
+                exit(1);
+                break;
+        }
+    }
+    if (((argc - optind) != 2) || (speed <= 0.0) || (batchSize == 0) || (batchSize > MAX_BATCH)) {
+        print_usage(basename(argv[0]));
+        exit(1);
+    }
+
+    s = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+    if (s < 0) {
+        perror("socket");
+        return 1;
+    }
+    setsockopt(s, SOL_CAN_RAW, CAN_RAW_FD_FRAMES, &canfd_on, sizeof(canfd_on));
+    memset(&addr, 0, sizeof(addr));
+    addr.can_family = AF_CAN;
+    addr.can_ifindex = if_nametoindex(argv[optind + 1]);
+    if (bind(s, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("bind");
+        return 1;
+    }
+    tfd = timerfd_create(CLOCK_MONOTONIC, 0);
+    if (tfd < 0) {
+        perror("timerfd_create");
+        return 1;
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sigterm;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    start = now_ns();
+    for (loop = 0; running && ((loops == 0) || (loop < loops)); ++loop) {
+        if (strcmp(argv[optind], "-") == 0) {
+            if (loop > 0) {
+                break;
+            }
+            log = stdin;
+        } else if ((log = fopen(argv[optind], "r")) == NULL) {
+            perror(argv[optind]);
+            return 1;
+        }
+
+        count = 0;
+        pending = FALSE;
+        restart = TRUE;
+        while (running) {
+            /* the record that didn't fit into the last batch opens the next one */
+            if (pending) {
+                batch[0] = batch[batchSize];
+                count = 1;
+                pending = FALSE;
+            }
+            while ((count < batchSize) && (fgets(line, sizeof(line), log) != NULL)) {
+                if (!xcp_log_parse(line, &batch[count])) {
+                    continue;
+                }
+                /* later loops continue where the previous one ended */
+                if (restart) {
+                    first = batch[count].timestamp;
+                    restart = FALSE;
+                }
+                batch[count].timestamp = batch[count].timestamp - first + offset;
+                if ((count > 0) && !maxRate &&
+                    (batch[count].timestamp > batch[0].timestamp + BATCH_WINDOW_NS * speed)) {
+                    batch[batchSize] = batch[count];
+                    pending = TRUE;
+                    break;
+                }
+                ++count;
+            }
+            if (count == 0) {
+                break;
+            }
+            if (!maxRate) {
+                due = start + (uint64_t)(batch[0].timestamp / speed);
+                if (!wait_until(tfd, due)) {
+                    break;
+                }
+                late = now_ns() - due;
+                sumLate += late;
+                if (late > maxLate) {
+                    maxLate = late;
+                }
+            }
+            if (send_batch(s, batch, count) < 0) {
+                break;
+            }
+            last = batch[count - 1].timestamp;
+            frames += count;
+            ++batches;
+            count = 0;
+        }
+        if (log != stdin) {
+            fclose(log);
+        }
+        if (frames == 0) {
+            break;
+        }
+        offset = last + 1000;
+    }
+
+    elapsed = (now_ns() - start) / 1e9;
+    fprintf(stderr, "%llu frames in %.3fs (%.1f frames/s, %llu sendmmsg calls)",
+            (unsigned long long)frames, elapsed, frames / elapsed, (unsigned long long)batches);
+    if (!maxRate && batches) {
+        fprintf(stderr, ", lateness mean %.1fus, max %.1fus", sumLate / 1e3 / batches, maxLate / 1e3);
+    }
+    fprintf(stderr, "\n");
+    close(tfd);
+    close(s);
+    return 0;
+}
@@ -0,0 +1,249 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR BSD-3-Clause) */
+/*
+ * xcpsession.c - XCP session state shared by the analyzers
+ *
+ * Copyright (c) 2021 Christoph Schueler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <cpu12.gems@googlemail.com>
+ *
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <linux/can.h>
+
+#include "xcp.h"
+#include "xcpsession.h"
+
+/*
+ *
+ * Local Variables.
+ *
+ */
+static XcpSessionType session = {
+    .byteOrder = XCP_BYTE_ORDER_INTEL,
+    .addressGranularity = 1,
+    .maxCto = CAN_MAX_DLEN,
+    .maxDto = CAN_MAX_DLEN,
+    .maxCtoPgm = CAN_MAX_DLEN,
+};
+
+/*
+ *
+ * Local Functions.
+ *
+ */
+static void session_request(XcpMessage const * const msg);
+static void session_positive_response(XcpMessage const * const msg);
+static void set_segment(uint8_t service, bool write, uint8_t const * data, uint16_t offset,
+                        uint16_t frameLength, uint32_t length);
+
+
+XcpSessionType const * xcp_session_get(void)
+{
+    return &session;
+}
+
+/*
+ * Feed every frame through here before it is printed.
+ *
+ * Keeps track of the outstanding command, so the analyzers can relate
+ * responses to their requests, independently of the text output.
+ */
+void xcp_session_update(XcpMessage const * const msg)
+{
+    session.segment.service = 0;
+    session.segment.length = 0;
+    session.isRequest = FALSE;
+    session.response = 0;
+    if (msg->length == 0) {
+        return;
+    }
+    if (!msg->fromSlave) {
+        session_request(msg);
+    } else {
+        switch (msg->data[0]) {
+            case 0xff:  /* Positive Response    */
+                if (session.requestPending) {
+                    session.response = 0xff;
+                    session_positive_response(msg);
+                }
+                /* In slave block mode UPLOAD is answered by several responses. */
+                if ((session.request[0] != UPLOAD) || (session.uploadRemaining == 0)) {
+                    session.requestPending = FALSE;
+                }
+                break;
+            case 0xfe:  /* Error                */
+                if (session.requestPending) {
+                    session.response = 0xfe;
+                }
+                session.requestPending = FALSE;
+                session.uploadRemaining = 0;
+                break;
+            case 0xfd:  /* Event                */
+            case 0xfc:  /* Service Request      */
+                break;
+            default:    /* DTO                  */
+                break;
+        }
+    }
+}
+
+/*
+ * Describe the memory contents of the current frame and advance the MTA behind them.
+ */
+static void set_segment(uint8_t service, bool write, uint8_t const * data, uint16_t offset,
+                        uint16_t frameLength, uint32_t length)
+{
+    uint8_t const ag = session.addressGranularity;
+
+    if (frameLength <= offset) {
+        length = 0;
+    } else if (length > (uint32_t)(frameLength - offset)) {
+        length = frameLength - offset;
+    }
+    length -= length % ag;
+
+    session.segment.service = service;
+    session.segment.write = write;
+    session.segment.addressExtension = session.mtaExtension;
+    session.segment.address = session.mtaAddress;
+    session.segment.data = data + offset;
+    session.segment.length = length;
+    session.mtaAddress += length / ag;
+}
+
+static void session_request(XcpMessage const * const msg)
+{
+    uint8_t const * const data = msg->data;
+    uint8_t const ag = session.addressGranularity;
+    uint8_t const offset = (ag > 2) ? ag : 2;
+
+    session.isRequest = TRUE;
+    session.requestLength = (msg->length < XCP_SESSION_MAX_CTO) ? msg->length : XCP_SESSION_MAX_CTO;
+    memcpy(session.request, data, session.requestLength);
+    session.requestPending = TRUE;
+    session.uploadRemaining = 0;
+
+    switch (data[0]) {
+        case DISCONNECT:
+            session.connected = FALSE;
+            break;
+        case SET_MTA:
+            if (msg->length >= 8) {
+                session.mtaExtension = data[3];
+                session.mtaAddress = xcp_session_dword(&session, &data[4]);
+            }
+            break;
+        case UPLOAD:
+            if (msg->length >= 2) {
+                session.uploadRemaining = (uint32_t)data[1] * ag;
+            }
+            break;
+        case SHORT_UPLOAD:
+            if (msg->length >= 8) {
+                session.mtaExtension = data[3];
+                session.mtaAddress = xcp_session_dword(&session, &data[4]);
+                session.uploadRemaining = (uint32_t)data[1] * ag;
+            }
+            break;
+        case SHORT_DOWNLOAD:
+            if (msg->length >= 8) {
+                session.mtaExtension = data[3];
+                session.mtaAddress = xcp_session_dword(&session, &data[4]);
+                set_segment(SHORT_DOWNLOAD, TRUE, data, 8, msg->length, (uint32_t)data[1] * ag);
+            }
+            break;
+        case DOWNLOAD:
+        case DOWNLOAD_NEXT:
+        case PROGRAM:
+        case PROGRAM_NEXT:
+            if (msg->length >= 2) {
+                set_segment(data[0], TRUE, data, offset, msg->length, (uint32_t)data[1] * ag);
+            }
+            break;
+        case DOWNLOAD_MAX:
+            set_segment(DOWNLOAD_MAX, TRUE, data, ag, (msg->length < session.maxCto) ? msg->length : session.maxCto,
+                        XCP_SESSION_MAX_CTO);
+            break;
+        case PROGRAM_MAX:
+            set_segment(PROGRAM_MAX, TRUE, data, ag,
+                        (msg->length < session.maxCtoPgm) ? msg->length : session.maxCtoPgm, XCP_SESSION_MAX_CTO);
+            break;
+        case BUILD_CHECKSUM:
+            if (msg->length >= 8) {
+                session.mtaAddress += xcp_session_dword(&session, &data[4]);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static void session_positive_response(XcpMessage const * const msg)
+{
+    switch (session.request[0]) {
+        case CONNECT:
+            if (msg->length >= 6) {
+                session.connected = TRUE;
+                session.byteOrder = msg->data[2] & XCP_BYTE_ORDER_MOTOROLA;
+                session.addressGranularity = 1 << ((msg->data[2] >> 1) & 0x03);
+                session.maxCto = msg->data[3];
+                session.maxDto = xcp_session_word(&session, &msg->data[4]);
+            }
+            break;
+        case PROGRAM_START:
+            if (msg->length >= 4) {
+                session.maxCtoPgm = msg->data[3];
+            }
+            break;
+        case UPLOAD:
+        case SHORT_UPLOAD:
+            set_segment(session.request[0], FALSE, msg->data, session.addressGranularity, msg->length,
+                        session.uploadRemaining);
+            session.uploadRemaining -= session.segment.length;
+            if (session.segment.length == 0) {
+                session.uploadRemaining = 0;
+            }
+            break;
+        default:
+            break;
+    }
+}
@@ -0,0 +1,123 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR BSD-3-Clause) */
+/*
+ * xcpsession.h - XCP session state shared by the analyzers
+ *
+ * Copyright (c) 2021 Christoph Schueler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <cpu12.gems@googlemail.com>
+ *
+ */
+#ifndef __XCPSESSION_H
+#define __XCPSESSION_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <linux/can.h>
+
+#include "xcp.h"
+
+/*
+ * Defines
+ */
+#define XCP_SESSION_MAX_CTO     (0xff)  /* MAX_CTO is a BYTE, on Ethernet requests exceed CAN FD frames. */
+
+/*
+ * Types
+ */
+
+/*
+ * Memory contents carried by the current frame, i.e. written by
+ * DOWNLOAD*, SHORT_DOWNLOAD, PROGRAM* or read by UPLOAD, SHORT_UPLOAD.
+ */
+typedef struct tagXcpDataSegmentType {
+    uint8_t service;                /* Command the data belongs to, 0 == no data.       */
+    bool write;
+    uint8_t addressExtension;
+    uint32_t address;               /* In address units (AG).                           */
+    uint8_t const * data;
+    uint16_t length;                /* In bytes.                                        */
+} XcpDataSegmentType;
+
+/*
+ * Everything negotiated or requested so far, as seen from the bus.
+ */
+typedef struct tagXcpSessionType {
+    bool connected;
+    uint8_t byteOrder;              /* XCP_BYTE_ORDER_INTEL or XCP_BYTE_ORDER_MOTOROLA   */
+    uint8_t addressGranularity;     /* Size of one address unit in bytes (1, 2 or 4).   */
+    uint8_t maxCto;
+    uint16_t maxDto;
+    uint8_t maxCtoPgm;
+    uint8_t mtaExtension;           /* Memory Transfer Address.                         */
+    uint32_t mtaAddress;
+    uint32_t uploadRemaining;       /* Bytes still to come in slave block mode.         */
+    XcpDataSegmentType segment;     /* Valid for the frame just passed in.              */
+    bool isRequest;                 /* The frame just passed in is a command.           */
+    uint8_t response;               /* 0xff or 0xfe if it answers `request`, else 0.    */
+    bool requestPending;            /* A command is waiting for its response.           */
+    uint8_t requestLength;
+    uint8_t request[XCP_SESSION_MAX_CTO]; /* Last command sent by the master.           */
+} XcpSessionType;
+
+/*
+ * Global Functions
+ *
+ */
+void xcp_session_update(XcpMessage const * const msg);
+XcpSessionType const * xcp_session_get(void);
+
+/*
+ * Fetch multi-byte parameters in the byte order negotiated by CONNECT.
+ */
+static inline uint16_t xcp_session_word(XcpSessionType const * const session, uint8_t const * const data)
+{
+    if (session->byteOrder == XCP_BYTE_ORDER_MOTOROLA) {
+        return (uint16_t)((data[0] << 8) | data[1]);
+    }
+    return (uint16_t)((data[1] << 8) | data[0]);
+}
+
+static inline uint32_t xcp_session_dword(XcpSessionType const * const session, uint8_t const * const data)
+{
+    if (session->byteOrder == XCP_BYTE_ORDER_MOTOROLA) {
+        return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3];
+    }
+    return ((uint32_t)data[3] << 24) | ((uint32_t)data[2] << 16) | ((uint32_t)data[1] << 8) | data[0];
+}
+
+#endif /* __XCPSESSION_H */
@@ -0,0 +1,953 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR BSD-3-Clause) */
+/*
+ * xcpshadow.c - sparse shadow of slave memory built from observed transfers
+ *
+ * Copyright (c) 2021 Christoph Schueler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <cpu12.gems@googlemail.com>
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include <limits.h>
+
+#include <linux/can.h>
+
+#include "xcp.h"
+#include "xcpsession.h"
+#include "xcpshadow.h"
+
+/*
+ *
+ * Local Constants.
+ *
+ */
+#define PAGE_SHIFT      (12)
+#define PAGE_SIZE       (1u << PAGE_SHIFT)
+#define PAGE_MASK       (PAGE_SIZE - 1)
+
+/*
+ * Index keys: address extension, calibration page and page number of the byte address.
+ */
+#define KEY_USED                (1ULL << 47)
+#define KEY(ext, page, number)  (((uint64_t)(ext) << 56) | ((uint64_t)(page) << 48) | KEY_USED | (number))
+#define KEY_EXT(key)            ((uint8_t)((key) >> 56))
+#define KEY_PAGE(key)           ((uint8_t)((key) >> 48))
+#define KEY_NUMBER(key)         ((key) & (KEY_USED - 1))
+#define KEY_SPACE(key)          ((key) >> 48)
+
+#define MAX_SEGMENTS    (256)
+#define MAX_PENDING     (0xff * 4 + XCP_SESSION_MAX_CTO)    /* One block of 255 elements at AG 4, plus a frame. */
+#define LINE_LENGTH     (16)
+
+#define BIT_TEST(map, n)        ((map)[(n) >> 3] & (1 << ((n) & 7)))
+#define BIT_SET(map, n)         ((map)[(n) >> 3] |= (1 << ((n) & 7)))
+#define BIT_CLEAR(map, n)       ((map)[(n) >> 3] &= ~(1 << ((n) & 7)))
+
+/*
+ *
+ * Local Types.
+ *
+ */
+typedef struct tagShadowPageType {
+    uint32_t refs;
+    uint8_t valid[PAGE_SIZE / 8];
+    uint8_t written[PAGE_SIZE / 8];     /* Set by the master, as opposed to just read back. */
+    uint8_t data[PAGE_SIZE];
+} ShadowPageType;
+
+struct tagXcpShadowSnapshotType {
+    size_t capacity;                    /* Power of two, open addressing. */
+    size_t count;
+    uint64_t * keys;
+    ShadowPageType ** pages;
+};
+
+typedef struct tagShadowSegmentType {
+    bool addressKnown;
+    bool lengthKnown;
+    bool extKnown;
+    uint8_t addressExtension;
+    uint32_t address;
+    uint32_t length;
+    uint8_t xcpPage;                    /* Page currently accessed by XCP. */
+} ShadowSegmentType;
+
+/*
+ * Data written by the master, held back until the slave acknowledges it.
+ */
+typedef struct tagShadowPendingType {
+    uint8_t addressExtension;
+    uint32_t address;                   /* In address units (AG). */
+    uint32_t length;                    /* In bytes. */
+    uint8_t data[MAX_PENDING];
+} ShadowPendingType;
+
+/*
+ *
+ * Local Variables.
+ *
+ */
+static bool enabled = FALSE;
+static XcpShadowSnapshotType live;
+static ShadowSegmentType segments[MAX_SEGMENTS];
+static unsigned segment_count = 0;
+static uint8_t default_page = 0;
+static ShadowPendingType pending;
+
+/*
+ *
+ * Local Functions.
+ *
+ */
+static ShadowPageType ** index_find(XcpShadowSnapshotType const * const index, uint64_t key);
+static bool index_insert(XcpShadowSnapshotType * const index, uint64_t key, ShadowPageType * page);
+static size_t index_keys(XcpShadowSnapshotType const * const index, uint64_t * keys);
+static void index_free(XcpShadowSnapshotType * const index);
+static ShadowPageType * writable_page(uint8_t ext, uint8_t calPage, uint64_t number);
+static uint8_t calibration_page(uint8_t ext, uint64_t address);
+static void store(uint8_t ext, uint64_t address, uint8_t const * data, uint32_t length, bool written);
+static void invalidate(uint8_t ext, uint64_t address, uint64_t length);
+static void hold_back(XcpSessionType const * const session);
+static void modify_bits(XcpSessionType const * const session);
+static void set_cal_page(uint8_t mode, uint8_t segment, uint8_t page);
+static void copy_cal_page(uint8_t srcSegment, uint8_t srcPage, uint8_t dstSegment, uint8_t dstPage);
+static void copy_range(uint8_t ext, uint8_t srcPage, uint64_t from, uint8_t dstPage, uint64_t to, uint64_t length);
+static void get_segment_info(XcpSessionType const * const session, XcpMessage const * const msg);
+static int compare_keys(void const * lhs, void const * rhs);
+static void print_diff_line(uint64_t key, unsigned offset, unsigned length,
+                            ShadowPageType const * const from, ShadowPageType const * const to);
+static void write_hex_record(FILE * out, uint8_t type, uint16_t address, uint8_t const * data, uint8_t length);
+static void write_srecord(FILE * out, char type, uint32_t address, uint8_t const * data, uint8_t length);
+static int dump_space(char const * const filename, XcpShadowFormatType format, uint64_t const * keys, size_t count);
+
+
+void xcp_shadow_enable(void)
+{
+    enabled = TRUE;
+}
+
+/*
+ * Apply the memory contents of the current frame, and follow the page switching.
+ *
+ * Writes only take effect once the slave has acknowledged them, a rejected
+ * or unanswered command leaves the shadow as it was.
+ */
+void xcp_shadow_update(XcpMessage const * const msg)
+{
+    XcpSessionType const * const session = xcp_session_get();
+    XcpDataSegmentType const * const segment = &session->segment;
+    uint8_t const * const req = session->request;
+
+    if (!enabled) {
+        return;
+    }
+    if (session->isRequest) {
+        hold_back(session);
+        return;
+    }
+    if ((segment->service != 0) && (segment->length > 0)) {
+        store(segment->addressExtension, (uint64_t)segment->address * session->addressGranularity,
+              segment->data, segment->length, segment->write);
+    }
+    if (session->response == 0xfe) {
+        pending.length = 0;
+    } else if (session->response == 0xff) {
+        if (pending.length > 0) {
+            store(pending.addressExtension, (uint64_t)pending.address * session->addressGranularity,
+                  pending.data, pending.length, TRUE);
+            pending.length = 0;
+        }
+        switch (req[0]) {
+            case MODIFY_BITS:
+                if (session->requestLength >= 6) {
+                    modify_bits(session);
+                }
+                break;
+            case PROGRAM_CLEAR:
+                /* Erased contents are device specific, forget them (absolute access mode only). */
+                if ((session->requestLength >= 8) && (req[1] == 0)) {
+                    invalidate(session->mtaExtension, (uint64_t)session->mtaAddress * session->addressGranularity,
+                               (uint64_t)xcp_session_dword(session, &req[4]) * session->addressGranularity);
+                }
+                break;
+            case GET_SEGMENT_INFO:
+                get_segment_info(session, msg);
+                break;
+            case SET_CAL_PAGE:
+                if (session->requestLength >= 4) {
+                    set_cal_page(req[1], req[2], req[3]);
+                }
+                break;
+            case COPY_CAL_PAGE:
+                if (session->requestLength >= 5) {
+                    copy_cal_page(req[1], req[2], req[3], req[4]);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+/*
+ * Fetch known memory contents, FALSE if any byte hasn't been observed yet.
+ */
+bool xcp_shadow_read(uint8_t ext, uint64_t address, uint8_t * buffer, uint32_t length)
+{
+    ShadowPageType ** slot;
+    ShadowPageType const * page;
+    unsigned offset;
+    unsigned size;
+    unsigned idx;
+
+    while (length > 0) {
+        slot = index_find(&live, KEY(ext, calibration_page(ext, address), address >> PAGE_SHIFT));
+        if (slot == NULL) {
+            return FALSE;
+        }
+        page = *slot;
+        offset = address & PAGE_MASK;
+        size = PAGE_SIZE - offset;
+        if (size > length) {
+            size = length;
+        }
+        for (idx = offset; idx < offset + size; ++idx) {
+            if (!BIT_TEST(page->valid, idx)) {
+                return FALSE;
+            }
+        }
+        memcpy(buffer, &page->data[offset], size);
+        buffer += size;
+        address += size;
+        length -= size;
+    }
+    return TRUE;
+}
+
+uint8_t xcp_shadow_page(uint8_t ext, uint64_t address)
+{
+    return calibration_page(ext, address);
+}
+
+static ShadowPageType ** index_find(XcpShadowSnapshotType const * const index, uint64_t key)
+{
+    size_t mask = index->capacity - 1;
+    size_t slot;
+
+    if (index->capacity == 0) {
+        return NULL;
+    }
+    for (slot = (size_t)((key * 0x9e3779b97f4a7c15ULL) >> 32) & mask; ; slot = (slot + 1) & mask) {
+        if (index->keys[slot] == key) {
+            return &index->pages[slot];
+        } else if (index->keys[slot] == 0) {
+            return NULL;
+        }
+    }
+}
+
+static bool index_insert(XcpShadowSnapshotType * const index, uint64_t key, ShadowPageType * page)
+{
+    XcpShadowSnapshotType grown;
+    size_t mask;
+    size_t slot;
+    size_t idx;
+
+    if ((index->count + 1) * 4 > index->capacity * 3) {
+        grown.capacity = (index->capacity != 0) ? (index->capacity * 2) : 256;
+        grown.count = 0;
+        grown.keys = calloc(grown.capacity, sizeof(uint64_t));
+        grown.pages = calloc(grown.capacity, sizeof(ShadowPageType *));
+        if ((grown.keys == NULL) || (grown.pages == NULL)) {
+            free(grown.keys);
+            free(grown.pages);
+            return FALSE;
+        }
+        for (idx = 0; idx < index->capacity; ++idx) {
+            if (index->keys[idx] != 0) {
+                index_insert(&grown, index->keys[idx], index->pages[idx]);
+            }
+        }
+        free(index->keys);
+        free(index->pages);
+        *index = grown;
+    }
+    mask = index->capacity - 1;
+    for (slot = (size_t)((key * 0x9e3779b97f4a7c15ULL) >> 32) & mask; index->keys[slot] != 0; slot = (slot + 1) & mask) {
+    }
+    index->keys[slot] = key;
+    index->pages[slot] = page;
+    ++index->count;
+    return TRUE;
+}
+
+static size_t index_keys(XcpShadowSnapshotType const * const index, uint64_t * keys)
+{
+    size_t count = 0;
+    size_t idx;
+
+    for (idx = 0; idx < index->capacity; ++idx) {
+        if (index->keys[idx] != 0) {
+            keys[count++] = index->keys[idx];
+        }
+    }
+    return count;
+}
+
+static void index_free(XcpShadowSnapshotType * const index)
+{
+    size_t idx;
+
+    for (idx = 0; idx < index->capacity; ++idx) {
+        if ((index->keys[idx] != 0) && (--index->pages[idx]->refs == 0)) {
+            free(index->pages[idx]);
+        }
+    }
+    free(index->keys);
+    free(index->pages);
+    memset(index, 0, sizeof(XcpShadowSnapshotType));
+}
+
+/*
+ * Pages shared with a snapshot are copied before they are modified.
+ */
+static ShadowPageType * writable_page(uint8_t ext, uint8_t calPage, uint64_t number)
+{
+    uint64_t const key = KEY(ext, calPage, number);
+    ShadowPageType ** slot = index_find(&live, key);
+    ShadowPageType * page;
+
+    if (slot == NULL) {
+        page = calloc(1, sizeof(ShadowPageType));
+        if (page == NULL) {
+            return NULL;
+        }
+        page->refs = 1;
+        if (!index_insert(&live, key, page)) {
+            free(page);
+            return NULL;
+        }
+        return page;
+    }
+    if ((*slot)->refs > 1) {
+        page = malloc(sizeof(ShadowPageType));
+        if (page == NULL) {
+            return NULL;
+        }
+        memcpy(page, *slot, sizeof(ShadowPageType));
+        page->refs = 1;
+        --(*slot)->refs;
+        *slot = page;
+    }
+    return *slot;
+}
+
+/*
+ * The page XCP currently accesses for the segment containing the address.
+ */
+static uint8_t calibration_page(uint8_t ext, uint64_t address)
+{
+    uint8_t const ag = xcp_session_get()->addressGranularity;
+    ShadowSegmentType const * segment;
+    unsigned idx;
+
+    for (idx = 0; idx < segment_count; ++idx) {
+        segment = &segments[idx];
+        if (!segment->addressKnown || !segment->lengthKnown) {
+            continue;
+        }
+        if (segment->extKnown && (segment->addressExtension != ext)) {
+            continue;
+        }
+        if ((address >= (uint64_t)segment->address * ag) &&
+            (address < ((uint64_t)segment->address + segment->length) * ag)) {
+            return segment->xcpPage;
+        }
+    }
+    return default_page;
+}
+
+static void store(uint8_t ext, uint64_t address, uint8_t const * data, uint32_t length, bool written)
+{
+    ShadowPageType * page;
+    unsigned offset;
+    unsigned size;
+    unsigned idx;
+
+    while (length > 0) {
+        offset = address & PAGE_MASK;
+        size = PAGE_SIZE - offset;
+        if (size > length) {
+            size = length;
+        }
+        page = writable_page(ext, calibration_page(ext, address), address >> PAGE_SHIFT);
+        if (page != NULL) {
+            memcpy(&page->data[offset], data, size);
+            for (idx = offset; idx < offset + size; ++idx) {
+                BIT_SET(page->valid, idx);
+                if (written) {
+                    BIT_SET(page->written, idx);
+                }
+            }
+        }
+        data += size;
+        address += size;
+        length -= size;
+    }
+}
+
+static void invalidate(uint8_t ext, uint64_t address, uint64_t length)
+{
+    ShadowPageType * page;
+    unsigned offset;
+    unsigned size;
+    unsigned idx;
+    uint8_t calPage;
+
+    while (length > 0) {
+        offset = address & PAGE_MASK;
+        size = PAGE_SIZE - offset;
+        if (size > length) {
+            size = length;
+        }
+        calPage = calibration_page(ext, address);
+        if (index_find(&live, KEY(ext, calPage, address >> PAGE_SHIFT)) != NULL) {
+            page = writable_page(ext, calPage, address >> PAGE_SHIFT);
+            if (page != NULL) {
+                for (idx = offset; idx < offset + size; ++idx) {
+                    BIT_CLEAR(page->valid, idx);
+                    BIT_CLEAR(page->written, idx);
+                }
+            }
+        }
+        address += size;
+        length -= size;
+    }
+}
+
+/*
+ * Collect the data of a write command. In master block mode only the last
+ * DOWNLOAD_NEXT / PROGRAM_NEXT is answered, so a block is gathered as a whole.
+ */
+static void hold_back(XcpSessionType const * const session)
+{
+    XcpDataSegmentType const * const segment = &session->segment;
+    bool const next = (segment->service == DOWNLOAD_NEXT) || (segment->service == PROGRAM_NEXT);
+
+    if (!next || (pending.addressExtension != segment->addressExtension) ||
+        (pending.address + pending.length / session->addressGranularity != segment->address)) {
+        pending.length = 0;
+    }
+    if ((segment->service == 0) || !segment->write || (segment->length == 0)) {
+        return;
+    }
+    if (pending.length == 0) {
+        pending.addressExtension = segment->addressExtension;
+        pending.address = segment->address;
+    }
+    if (pending.length + segment->length > sizeof(pending.data)) {
+        pending.length = 0;     /* Not a valid block, don't guess. */
+        return;
+    }
+    memcpy(&pending.data[pending.length], segment->data, segment->length);
+    pending.length += segment->length;
+}
+
+/*
+ * MODIFY_BITS works on the DWORD at MTA, which has to be known to follow it.
+ */
+static void modify_bits(XcpSessionType const * const session)
+{
+    uint8_t const * const req = session->request;
+    uint64_t const address = (uint64_t)session->mtaAddress * session->addressGranularity;
+    uint8_t const shift = req[1];
+    uint16_t const andMask = xcp_session_word(session, &req[2]);
+    uint16_t const xorMask = xcp_session_word(session, &req[4]);
+    uint8_t data[4];
+    uint32_t value;
+
+    if ((shift > 31) || !xcp_shadow_read(session->mtaExtension, address, data, sizeof(data))) {
+        invalidate(session->mtaExtension, address, sizeof(data));
+        return;
+    }
+    value = xcp_session_dword(session, data);
+    value = (value & ~((uint32_t)(uint16_t)~andMask << shift)) ^ ((uint32_t)xorMask << shift);
+    if (session->byteOrder == XCP_BYTE_ORDER_MOTOROLA) {
+        data[0] = value >> 24;
+        data[1] = value >> 16;
+        data[2] = value >> 8;
+        data[3] = value;
+    } else {
+        data[0] = value;
+        data[1] = value >> 8;
+        data[2] = value >> 16;
+        data[3] = value >> 24;
+    }
+    store(session->mtaExtension, address, data, sizeof(data), TRUE);
+}
+
+static void get_segment_info(XcpSessionType const * const session, XcpMessage const * const msg)
+{
+    uint8_t const * const req = session->request;
+    uint8_t const * const res = msg->data;
+    ShadowSegmentType * segment;
+
+    if ((session->requestLength < 4) || (msg->length < ((req[1] == 0) ? 8 : 3))) {
+        return;
+    }
+    segment = &segments[req[2]];
+    if (req[1] == 0) {
+        if (req[3] == 0) {
+            segment->address = xcp_session_dword(session, &res[4]);
+            segment->addressKnown = TRUE;
+        } else if (req[3] == 1) {
+            segment->length = xcp_session_dword(session, &res[4]);
+            segment->lengthKnown = TRUE;
+        }
+    } else if (req[1] == 1) {
+        segment->addressExtension = res[2];
+        segment->extKnown = TRUE;
+    }
+    if (segment_count <= req[2]) {
+        segment_count = req[2] + 1;
+    }
+}
+
+static void set_cal_page(uint8_t mode, uint8_t segment, uint8_t page)
+{
+    unsigned idx;
+
+    if (!(mode & XCP_SET_CAL_PAGE_XCP)) {
+        return;
+    }
+    if (mode & XCP_SET_CAL_PAGE_ALL) {
+        for (idx = 0; idx < MAX_SEGMENTS; ++idx) {
+            segments[idx].xcpPage = page;
+        }
+        default_page = page;
+    } else {
+        segments[segment].xcpPage = page;
+        if (!segments[segment].addressKnown || !segments[segment].lengthKnown) {
+            default_page = page;
+        }
+    }
+}
+
+static void copy_cal_page(uint8_t srcSegment, uint8_t srcPage, uint8_t dstSegment, uint8_t dstPage)
+{
+    ShadowSegmentType const * const src = &segments[srcSegment];
+    ShadowSegmentType const * const dst = &segments[dstSegment];
+    uint8_t const ag = xcp_session_get()->addressGranularity;
+    uint64_t length;
+    uint64_t * keys;
+    size_t count;
+    size_t idx;
+
+    if (src->addressKnown && src->lengthKnown) {
+        length = (uint64_t)src->length * ag;
+        if (dst->lengthKnown && (dst->length < src->length)) {
+            length = (uint64_t)dst->length * ag;
+        }
+        copy_range(src->extKnown ? src->addressExtension : 0, srcPage, (uint64_t)src->address * ag, dstPage,
+                   (uint64_t)(dst->addressKnown ? dst->address : src->address) * ag, length);
+        return;
+    }
+
+    /* Segment layout unknown, copy everything observed on the source page. */
+    keys = malloc((live.count + 1) * sizeof(uint64_t));
+    if (keys == NULL) {
+        return;
+    }
+    count = index_keys(&live, keys);
+    for (idx = 0; idx < count; ++idx) {
+        if (KEY_PAGE(keys[idx]) == srcPage) {
+            copy_range(KEY_EXT(keys[idx]), srcPage, KEY_NUMBER(keys[idx]) << PAGE_SHIFT, dstPage,
+                       KEY_NUMBER(keys[idx]) << PAGE_SHIFT, PAGE_SIZE);
+        }
+    }
+    free(keys);
+}
+
+static void copy_range(uint8_t ext, uint8_t srcPage, uint64_t from, uint8_t dstPage, uint64_t to, uint64_t length)
+{
+    ShadowPageType ** slot;
+    ShadowPageType const * src;
+    ShadowPageType * dst;
+    unsigned srcOffset;
+    unsigned dstOffset;
+    unsigned size;
+    unsigned idx;
+
+    if ((srcPage == dstPage) && (from == to)) {
+        return;
+    }
+    while (length > 0) {
+        srcOffset = from & PAGE_MASK;
+        dstOffset = to & PAGE_MASK;
+        size = PAGE_SIZE - ((srcOffset > dstOffset) ? srcOffset : dstOffset);
+        if (size > length) {
+            size = length;
+        }
+        slot = index_find(&live, KEY(ext, srcPage, from >> PAGE_SHIFT));
+        if (slot != NULL) {
+            src = *slot;
+            dst = writable_page(ext, dstPage, to >> PAGE_SHIFT);
+            if (dst != NULL) {
+                for (idx = 0; idx < size; ++idx) {
+                    if (BIT_TEST(src->valid, srcOffset + idx)) {
+                        dst->data[dstOffset + idx] = src->data[srcOffset + idx];
+                        BIT_SET(dst->valid, dstOffset + idx);
+                        BIT_SET(dst->written, dstOffset + idx);
+                    }
+                }
+            }
+        }
+        from += size;
+        to += size;
+        length -= size;
+    }
+}
+
+/*
+ *
+ * Snapshots and Differences.
+ *
+ */
+XcpShadowSnapshotType * xcp_shadow_snapshot(void)
+{
+    XcpShadowSnapshotType * snapshot = calloc(1, sizeof(XcpShadowSnapshotType));
+    size_t idx;
+
+    if ((snapshot == NULL) || (live.capacity == 0)) {
+        return snapshot;
+    }
+    snapshot->keys = malloc(live.capacity * sizeof(uint64_t));
+    snapshot->pages = malloc(live.capacity * sizeof(ShadowPageType *));
+    if ((snapshot->keys == NULL) || (snapshot->pages == NULL)) {
+        free(snapshot->keys);
+        free(snapshot->pages);
+        free(snapshot);
+        return NULL;
+    }
+    memcpy(snapshot->keys, live.keys, live.capacity * sizeof(uint64_t));
+    memcpy(snapshot->pages, live.pages, live.capacity * sizeof(ShadowPageType *));
+    snapshot->capacity = live.capacity;
+    snapshot->count = live.count;
+    for (idx = 0; idx < live.capacity; ++idx) {
+        if (live.keys[idx] != 0) {
+            ++live.pages[idx]->refs;
+        }
+    }
+    return snapshot;
+}
+
+void xcp_shadow_release(XcpShadowSnapshotType * snapshot)
+{
+    if (snapshot == NULL) {
+        return;
+    }
+    index_free(snapshot);
+    free(snapshot);
+}
+
+static int compare_keys(void const * lhs, void const * rhs)
+{
+    uint64_t const l = *(uint64_t const *)lhs;
+    uint64_t const r = *(uint64_t const *)rhs;
+
+    return (l > r) - (l < r);
+}
+
+/*
+ * Print the bytes changed between two points in time (`to` == NULL: now).
+ *
+ * A byte counts as changed if its value differs, or if it has been written
+ * while its previous value was unknown. Pages still shared are skipped.
+ */
+unsigned xcp_shadow_diff(XcpShadowSnapshotType const * const from, XcpShadowSnapshotType const * const to)
+{
+    XcpShadowSnapshotType const * const after = (to != NULL) ? to : &live;
+    ShadowPageType ** slot;
+    ShadowPageType const * old;
+    ShadowPageType const * new;
+    uint64_t * keys;
+    size_t count;
+    size_t idx;
+    unsigned changed = 0;
+    unsigned offset;
+    unsigned start;
+    bool differs;
+
+    keys = malloc((from->count + after->count + 1) * sizeof(uint64_t));
+    if (keys == NULL) {
+        return 0;
+    }
+    count = index_keys(from, keys);
+    count += index_keys(after, &keys[count]);
+    qsort(keys, count, sizeof(uint64_t), compare_keys);
+
+    for (idx = 0; idx < count; ++idx) {
+        if ((idx > 0) && (keys[idx] == keys[idx - 1])) {
+            continue;
+        }
+        slot = index_find(from, keys[idx]);
+        old = (slot != NULL) ? *slot : NULL;
+        slot = index_find(after, keys[idx]);
+        new = (slot != NULL) ? *slot : NULL;
+        if ((old == new) || (new == NULL)) {
+            continue;
+        }
+        start = PAGE_SIZE;
+        for (offset = 0; offset <= PAGE_SIZE; ++offset) {
+            differs = FALSE;
+            if ((offset < PAGE_SIZE) && BIT_TEST(new->valid, offset)) {
+                if ((old != NULL) && BIT_TEST(old->valid, offset)) {
+                    differs = old->data[offset] != new->data[offset];
+                } else {
+                    differs = BIT_TEST(new->written, offset) ? TRUE : FALSE;
+                }
+            }
+            if (differs) {
+                ++changed;
+                if (start == PAGE_SIZE) {
+                    start = offset;
+                } else if (offset - start == LINE_LENGTH) {
+                    print_diff_line(keys[idx], start, LINE_LENGTH, old, new);
+                    start = offset;
+                }
+            } else if (start != PAGE_SIZE) {
+                print_diff_line(keys[idx], start, offset - start, old, new);
+                start = PAGE_SIZE;
+            }
+        }
+    }
+    free(keys);
+    printf("SHADOW(changedBytes = %u)\n", changed);
+    return changed;
+}
+
+static void print_diff_line(uint64_t key, unsigned offset, unsigned length,
+                            ShadowPageType const * const from, ShadowPageType const * const to)
+{
+    unsigned idx;
+
+    printf("SHADOW(addressExtension = 0x%02x", KEY_EXT(key));
+    printf(", page = %u", KEY_PAGE(key));
+    printf(", address = 0x%08llx", (unsigned long long)((KEY_NUMBER(key) << PAGE_SHIFT) + offset));
+    printf(", old: [ ");
+    for (idx = offset; idx < offset + length; ++idx) {
+        if ((from != NULL) && BIT_TEST(from->valid, idx)) {
+            printf("%02X ", from->data[idx]);
+        } else {
+            printf("?? ");
+        }
+    }
+    printf("], new: [ ");
+    for (idx = offset; idx < offset + length; ++idx) {
+        printf("%02X ", to->data[idx]);
+    }
+    printf("])\n");
+}
+
+/*
+ *
+ * Intel HEX and Motorola S-Record Output.
+ *
+ */
+XcpShadowFormatType xcp_shadow_format(char const * const filename)
+{
+    static char const * const srecord_suffixes[] = {".s19", ".s28", ".s37", ".srec", ".mot", ".s", NULL};
+    char const * suffix = strrchr(filename, '.');
+    unsigned idx;
+
+    if (suffix != NULL) {
+        for (idx = 0; srecord_suffixes[idx] != NULL; ++idx) {
+            if (strcasecmp(suffix, srecord_suffixes[idx]) == 0) {
+                return XCP_SHADOW_FORMAT_SRECORD;
+            }
+        }
+    }
+    return XCP_SHADOW_FORMAT_INTEL_HEX;
+}
+
+/*
+ * Write one image per address extension and calibration page.
+ *
+ * If there is more than one, the file names get a "_ext<XX>_page<N>" infix.
+ */
+int xcp_shadow_dump(char const * const filename)
+{
+    XcpShadowFormatType const format = xcp_shadow_format(filename);
+    char name[PATH_MAX];
+    char const * suffix;
+    uint64_t * keys;
+    size_t count;
+    size_t first;
+    size_t idx;
+    bool multiple;
+    int result = 0;
+
+    keys = malloc((live.count + 1) * sizeof(uint64_t));
+    if (keys == NULL) {
+        return -1;
+    }
+    count = index_keys(&live, keys);
+    qsort(keys, count, sizeof(uint64_t), compare_keys);
+    multiple = (count > 0) && (KEY_SPACE(keys[0]) != KEY_SPACE(keys[count - 1]));
+
+    suffix = strrchr(filename, '.');
+    if ((suffix == NULL) || (strchr(suffix, '/') != NULL)) {
+        suffix = filename + strlen(filename);
+    }
+    for (first = 0; (first < count) || ((count == 0) && (first == 0)); first = idx) {
+        for (idx = first; (idx < count) && (KEY_SPACE(keys[idx]) == KEY_SPACE(keys[first])); ++idx) {
+        }
+        if (multiple) {
+            snprintf(name, sizeof(name), "%.*s_ext%02X_page%u%s", (int)(suffix - filename), filename,
+                     KEY_EXT(keys[first]), KEY_PAGE(keys[first]), suffix);
+        } else {
+            snprintf(name, sizeof(name), "%s", filename);
+        }
+        if (dump_space(name, format, &keys[first], idx - first) < 0) {
+            result = -1;
+        }
+        if (count == 0) {
+            break;
+        }
+    }
+    free(keys);
+    return result;
+}
+
+static int dump_space(char const * const filename, XcpShadowFormatType format, uint64_t const * keys, size_t count)
+{
+    static uint8_t const header[] = "xcpdump";
+    ShadowPageType const * page;
+    FILE * out;
+    uint8_t record[LINE_LENGTH];
+    uint32_t address;
+    uint32_t recordAddress = 0;
+    uint32_t upper = 0;
+    uint8_t length = 0;
+    unsigned offset;
+    size_t idx;
+
+    out = fopen(filename, "w");
+    if (out == NULL) {
+        perror(filename);
+        return -1;
+    }
+    if (format == XCP_SHADOW_FORMAT_SRECORD) {
+        write_srecord(out, '0', 0, header, sizeof(header) - 1);
+    }
+    for (idx = 0; idx < count; ++idx) {
+        page = *index_find(&live, keys[idx]);
+        for (offset = 0; offset <= PAGE_SIZE; ++offset) {
+            address = (uint32_t)((KEY_NUMBER(keys[idx]) << PAGE_SHIFT) + offset);
+            /* Flush on gaps, full records and (Intel HEX) 64K boundaries. */
+            if ((length > 0) && ((offset == PAGE_SIZE) || !BIT_TEST(page->valid, offset) ||
+                                 (length == LINE_LENGTH) || ((address & 0xffff) == 0))) {
+                if (format == XCP_SHADOW_FORMAT_SRECORD) {
+                    write_srecord(out, '3', recordAddress, record, length);
+                } else {
+                    if ((recordAddress >> 16) != upper) {
+                        uint8_t const segment[2] = {recordAddress >> 24, recordAddress >> 16};
+
+                        upper = recordAddress >> 16;
+                        write_hex_record(out, 0x04, 0, segment, sizeof(segment));
+                    }
+                    write_hex_record(out, 0x00, recordAddress & 0xffff, record, length);
+                }
+                length = 0;
+            }
+            if ((offset < PAGE_SIZE) && BIT_TEST(page->valid, offset)) {
+                if (length == 0) {
+                    recordAddress = address;
+                }
+                record[length++] = page->data[offset];
+            }
+        }
+    }
+    if (format == XCP_SHADOW_FORMAT_SRECORD) {
+        write_srecord(out, '7', 0, NULL, 0);
+    } else {
+        write_hex_record(out, 0x01, 0, NULL, 0);
+    }
+    if (fclose(out) != 0) {
+        perror(filename);
+        return -1;
+    }
+    return 0;
+}
+
+static void write_hex_record(FILE * out, uint8_t type, uint16_t address, uint8_t const * data, uint8_t length)
+{
+    uint8_t sum = length + (address >> 8) + (address & 0xff) + type;
+    uint8_t idx;
+
+    fprintf(out, ":%02X%04X%02X", length, address, type);
+    for (idx = 0; idx < length; ++idx) {
+        fprintf(out, "%02X", data[idx]);
+        sum += data[idx];
+    }
+    fprintf(out, "%02X\n", (uint8_t)(0x100 - sum));
+}
+
+static void write_srecord(FILE * out, char type, uint32_t address, uint8_t const * data, uint8_t length)
+{
+    uint8_t const addressLength = (type == '0') ? 2 : 4;
+    uint8_t const count = addressLength + length + 1;
+    uint8_t sum = count;
+    uint8_t idx;
+
+    fprintf(out, "S%c%02X", type, count);
+    for (idx = addressLength; idx > 0; --idx) {
+        fprintf(out, "%02X", (uint8_t)(address >> ((idx - 1) * 8)));
+        sum += (uint8_t)(address >> ((idx - 1) * 8));
+    }
+    for (idx = 0; idx < length; ++idx) {
+        fprintf(out, "%02X", data[idx]);
+        sum += data[idx];
+    }
+    fprintf(out, "%02X\n", (uint8_t)~sum);
+}
@@ -0,0 +1,83 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR BSD-3-Clause) */
+/*
+ * xcpshadow.h - sparse shadow of slave memory built from observed transfers
+ *
+ * Copyright (c) 2021 Christoph Schueler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <cpu12.gems@googlemail.com>
+ *
+ */
+#ifndef __XCPSHADOW_H
+#define __XCPSHADOW_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "xcp.h"
+
+/*
+ * Types
+ */
+typedef enum tagXcpShadowFormatType {
+    XCP_SHADOW_FORMAT_INTEL_HEX,
+    XCP_SHADOW_FORMAT_SRECORD
+} XcpShadowFormatType;
+
+/*
+ * A frozen view of the shadow, pages are shared copy-on-write with the live one.
+ */
+typedef struct tagXcpShadowSnapshotType XcpShadowSnapshotType;
+
+/*
+ * Global Functions
+ *
+ */
+void xcp_shadow_enable(void);
+void xcp_shadow_update(XcpMessage const * const msg);
+
+bool xcp_shadow_read(uint8_t ext, uint64_t address, uint8_t * buffer, uint32_t length);
+uint8_t xcp_shadow_page(uint8_t ext, uint64_t address);
+
+XcpShadowSnapshotType * xcp_shadow_snapshot(void);
+void xcp_shadow_release(XcpShadowSnapshotType * snapshot);
+unsigned xcp_shadow_diff(XcpShadowSnapshotType const * const from, XcpShadowSnapshotType const * const to);
+
+int xcp_shadow_dump(char const * const filename);
+XcpShadowFormatType xcp_shadow_format(char const * const filename);
+
+#endif /* __XCPSHADOW_H */
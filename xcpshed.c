@@ -0,0 +1,194 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR BSD-3-Clause) */
+/*
+ * xcpshed.c - load shedding of the output
+ *
+ * Copyright (c) 2021 Christoph Schueler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <cpu12.gems@googlemail.com>
+ *
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "xcp.h"
+#include "xcpshed.h"
+
+/*
+ * A slow terminal or SSH session blocks the dissector in fflush(), while the socket
+ * queue fills up and the kernel drops frames. How far the output is behind shows as
+ * the age of the frame being printed: its receive timestamp against the clock. The
+ * analyzers and recorders run on every frame in any case; only what is printed is
+ * reduced, first the DTOs, then everything but the summaries, until the backlog
+ * has drained.
+ *
+ * Shedding drains the backlog at once, so the lag alone would switch back and forth.
+ * A level is only left after the lag has stayed low for a hold time, which doubles
+ * each time the output falls behind again soon after a recovery.
+ */
+
+/*
+ *
+ * Local Constants.
+ *
+ */
+#define REPORT_INTERVAL     (1000000)       /* us, while degraded. */
+#define RECOVERY_DIVISOR    (10)            /* Lag to step back: threshold / divisor. */
+#define HOLD_FACTOR         (10)            /* Initial hold time: threshold * factor. */
+#define MAX_HOLD            (60000000)      /* us */
+
+/*
+ *
+ * Local Variables.
+ *
+ */
+static XcpShedLevelType level = XCP_SHED_FULL;
+static uint64_t threshold_us = (uint64_t)XCP_SHED_DEFAULT_THRESHOLD * 1000;
+static uint64_t changed_us = 0;             /* Last change of the level. */
+static uint64_t recovered_us = 0;           /* Last step back. */
+static uint64_t calm_us = 0;                /* Since when the lag is low. */
+static uint64_t hold_us;
+static uint64_t report_us = 0;
+static uint64_t lag_us = 0;
+static uint64_t frames = 0;
+static uint64_t skipped = 0;
+static uint64_t skipped_total = 0;
+static uint32_t dropped_frames = 0;      /* By the kernel, since the socket was opened. */
+
+static char const * const level_names[XCP_SHED_LEVELS] = { "FULL", "NO_DTOS", "SUMMARY" };
+
+/*
+ *
+ * Global Functions.
+ *
+ */
+void xcp_shed_init(uint32_t threshold)
+{
+    level = XCP_SHED_FULL;
+    threshold_us = (uint64_t)threshold * 1000;
+    changed_us = 0;
+    recovered_us = 0;
+    calm_us = 0;
+    hold_us = threshold_us * HOLD_FACTOR;
+    report_us = 0;
+    lag_us = 0;
+    frames = 0;
+    skipped = 0;
+    skipped_total = 0;
+    dropped_frames = 0;
+}
+
+bool xcp_shed_update(struct timeval const * const tv, uint32_t dropped)
+{
+    struct timeval now;
+    uint64_t now_us;
+    uint64_t received_us = (uint64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+    XcpShedLevelType previous = level;
+
+    gettimeofday(&now, NULL);
+    now_us = (uint64_t)now.tv_sec * 1000000 + now.tv_usec;
+    lag_us = (now_us > received_us) ? now_us - received_us : 0;
+    ++frames;
+    dropped_frames = dropped;
+
+    if (lag_us >= threshold_us / RECOVERY_DIVISOR) {
+        calm_us = now_us;
+    }
+    if ((lag_us > threshold_us) && (level < XCP_SHED_SUMMARY) && ((now_us - changed_us) >= threshold_us)) {
+        /* Each level gets the threshold to take effect. */
+        if ((recovered_us != 0) && ((now_us - recovered_us) < 2 * hold_us)) {
+            hold_us = (2 * hold_us < MAX_HOLD) ? 2 * hold_us : MAX_HOLD;
+        } else if (level == XCP_SHED_FULL) {
+            hold_us = threshold_us * HOLD_FACTOR;
+        }
+        ++level;
+    } else if ((level > XCP_SHED_FULL) && ((now_us - calm_us) >= hold_us)) {
+        --level;
+        recovered_us = now_us;
+        calm_us = now_us;
+    }
+    if (level != previous) {
+        changed_us = now_us;
+        report_us = now_us + REPORT_INTERVAL;
+        return TRUE;
+    }
+    if ((level != XCP_SHED_FULL) && (now_us >= report_us)) {
+        report_us = now_us + REPORT_INTERVAL;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+bool xcp_shed_skip(XcpMessage const * const msg)
+{
+    bool dto;
+
+    switch (level) {
+        case XCP_SHED_NO_DTOS:
+            dto = (msg->length > 0) && (msg->data[0] < (msg->fromSlave ? 0xfc : 0xc0));
+            if (!dto) {
+                return FALSE;
+            }
+            break;
+        case XCP_SHED_SUMMARY:
+            break;
+        default:
+            return FALSE;
+    }
+    ++skipped;
+    ++skipped_total;
+    return TRUE;
+}
+
+/*
+ * Skipped since the last report.
+ */
+void xcp_shed_print(FILE * out)
+{
+    fprintf(out, "OUTPUT(level = %s, lag = %llums, skipped = %llu, dropped = %u)", level_names[level],
+            (unsigned long long)(lag_us / 1000), (unsigned long long)skipped, dropped_frames);
+    skipped = 0;
+}
+
+void xcp_shed_print_summary(FILE * out)
+{
+    fprintf(out, "OUTPUT_SUMMARY(frames = %llu, skipped = %llu, dropped = %u)\n", (unsigned long long)frames,
+            (unsigned long long)skipped_total, dropped_frames);
+}
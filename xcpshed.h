@@ -0,0 +1,99 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR BSD-3-Clause) */
+/*
+ * xcpshed.h - load shedding of the output
+ *
+ * Copyright (c) 2021 Christoph Schueler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <cpu12.gems@googlemail.com>
+ *
+ */
+#ifndef __XCPSHED_H
+#define __XCPSHED_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/time.h>
+
+#include "xcp.h"
+
+/*
+ * Defines
+ */
+#define XCP_SHED_DEFAULT_THRESHOLD  (100)   /* ms */
+
+/*
+ * Types
+ */
+typedef enum tagXcpShedLevelType {
+    XCP_SHED_FULL,
+    XCP_SHED_NO_DTOS,                   /* DTOs are counted, but not printed. */
+    XCP_SHED_SUMMARY,                   /* Only summaries and these reports are printed. */
+    XCP_SHED_LEVELS
+} XcpShedLevelType;
+
+/*
+ * Global Functions
+ *
+ */
+void xcp_shed_init(uint32_t threshold);
+
+/*
+ * Called with the receive time of every frame from the socket and the socket's
+ * count of frames dropped for a full receive queue. The output lags behind by the
+ * time since `tv`; past the threshold, one level more is shed, at most once per
+ * threshold. One level less is shed once the lag has stayed below a tenth of the
+ * threshold for the hold time. The hold time starts at ten times the threshold,
+ * doubles whenever the output falls behind again within twice the hold time of the
+ * last step back, and is capped at 60 s. Returns TRUE when a report is to be printed:
+ * on a change of the level and every second while degraded.
+ */
+bool xcp_shed_update(struct timeval const * const tv, uint32_t dropped);
+
+/*
+ * TRUE if the message is not to be printed on the current level.
+ */
+bool xcp_shed_skip(XcpMessage const * const msg);
+
+/*
+ * The reports go to `out`; xcpdump passes stderr with --format, so that they
+ * stay out of the JSON lines or CSV rows.
+ */
+void xcp_shed_print(FILE * out);
+void xcp_shed_print_summary(FILE * out);
+
+#endif /* __XCPSHED_H */
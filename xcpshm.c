@@ -0,0 +1,295 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR BSD-3-Clause) */
+/*
+ * xcpshm.c - shared-memory ring of decoded XCP messages
+ *
+ * Copyright (c) 2021 Christoph Schueler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <cpu12.gems@googlemail.com>
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "xcp.h"
+#include "xcpshm.h"
+
+/*
+ * Single producer, any number of readers, nobody takes a lock:
+ *
+ * The producer invalidates a record (sequence = 0), writes it, stores its sequence
+ * and advances `head`. A reader copies the record between two loads of `sequence`;
+ * if either isn't the expected one, the producer has lapped the reader.
+ */
+
+/*
+ *
+ * Local Constants.
+ *
+ */
+#define RECORD_OFFSET       ((uint32_t)((sizeof(XcpShmHeaderType) + 63) & ~63UL))
+
+/*
+ *
+ * Local Variables.
+ *
+ */
+static XcpShmHeaderType * header = NULL;
+static XcpShmRecordType * records;
+static size_t map_size;
+static uint64_t mask;
+static char shm_name[NAME_MAX];
+
+/*
+ *
+ * Local Functions.
+ *
+ */
+static void make_name(char * const buffer, size_t size, char const * const name);
+static bool producer_alive(char const * const name);
+
+
+/*
+ * shm_open() wants names with a leading slash, accept them without as well.
+ */
+static void make_name(char * const buffer, size_t size, char const * const name)
+{
+    snprintf(buffer, size, "%s%s", (name[0] == '/') ? "" : "/", name);
+}
+
+/*
+ * The ring `name` exists and the process that created it is still running.
+ */
+static bool producer_alive(char const * const name)
+{
+    XcpShmHeaderType head;
+    ssize_t nbytes;
+    int fd;
+
+    fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        return FALSE;
+    }
+    nbytes = read(fd, &head, sizeof(head));
+    close(fd);
+    if ((nbytes != sizeof(head)) || (head.magic != XCP_SHM_MAGIC) || (head.producerPid == 0)) {
+        return FALSE;
+    }
+    return (kill((pid_t)head.producerPid, 0) == 0) || (errno == EPERM);
+}
+
+bool xcp_shm_publish_open(char const * const name, uint32_t capacity)
+{
+    uint32_t rounded = 2;
+    void * map;
+    int fd;
+
+    while ((rounded < capacity) && (rounded < 0x80000000U)) {
+        rounded <<= 1;
+    }
+    make_name(shm_name, sizeof(shm_name), name);
+
+    /* Readers of a previous run keep their (dead) ring, they have to attach again. */
+    if (producer_alive(shm_name)) {
+        errno = EBUSY;
+        return FALSE;
+    }
+    shm_unlink(shm_name);
+    fd = shm_open(shm_name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        return FALSE;
+    }
+    map_size = RECORD_OFFSET + (size_t)rounded * sizeof(XcpShmRecordType);
+    if (ftruncate(fd, map_size) < 0) {
+        close(fd);
+        shm_unlink(shm_name);
+        return FALSE;
+    }
+    map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        shm_unlink(shm_name);
+        return FALSE;
+    }
+    header = map;
+    records = (XcpShmRecordType *)((uint8_t *)map + RECORD_OFFSET);
+    mask = rounded - 1;
+
+    header->version = XCP_SHM_VERSION;
+    header->recordSize = sizeof(XcpShmRecordType);
+    header->capacity = rounded;
+    header->recordOffset = RECORD_OFFSET;
+    header->producerPid = getpid();
+    header->head = 0;
+    __atomic_store_n(&header->magic, XCP_SHM_MAGIC, __ATOMIC_RELEASE);
+    return TRUE;
+}
+
+/*
+ * Call after the analyzers, `fields` as from xcp_filter_fields().
+ */
+void xcp_shm_publish(XcpMessage const * const msg, uint64_t const * const fields)
+{
+    uint64_t const n = header->head;
+    XcpShmRecordType * const record = &records[n & mask];
+    uint8_t field;
+
+    __atomic_store_n(&record->sequence, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    record->tvSec = msg->timestamp.tv_sec;
+    record->tvUsec = msg->timestamp.tv_usec;
+    record->canId = (msg->frame != NULL) ? msg->frame->can_id : 0;
+    record->transport = msg->transport;
+    record->fromSlave = msg->fromSlave;
+    record->ctr = msg->ctr;
+    record->length = msg->length;
+    record->present = 0;
+    for (field = 0; field < XCP_FIELD_COUNT; ++field) {
+        if (fields[field] != XCP_FIELD_UNKNOWN) {
+            record->fields[field] = (uint32_t)fields[field];
+            record->present |= 1U << field;
+        } else {
+            record->fields[field] = 0;
+        }
+    }
+    memcpy(record->data, msg->data, (msg->length < CANFD_MAX_DLEN) ? msg->length : CANFD_MAX_DLEN);
+
+    __atomic_store_n(&record->sequence, n + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&header->head, n + 1, __ATOMIC_RELEASE);
+}
+
+void xcp_shm_publish_close(void)
+{
+    if (header != NULL) {
+        munmap(header, map_size);
+        shm_unlink(shm_name);
+        header = NULL;
+    }
+}
+
+bool xcp_shm_reader_open(XcpShmReaderType * const reader, char const * const name, bool latest)
+{
+    char path[NAME_MAX];
+    struct stat st;
+    XcpShmHeaderType const * head;
+    void * map;
+    int fd;
+
+    memset(reader, 0, sizeof(*reader));
+    make_name(path, sizeof(path), name);
+    fd = shm_open(path, O_RDONLY, 0);
+    if (fd < 0) {
+        return FALSE;
+    }
+    if ((fstat(fd, &st) < 0) || ((size_t)st.st_size < sizeof(XcpShmHeaderType))) {
+        close(fd);
+        return FALSE;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return FALSE;
+    }
+    head = map;
+    if ((__atomic_load_n(&head->magic, __ATOMIC_ACQUIRE) != XCP_SHM_MAGIC) || (head->version != XCP_SHM_VERSION) ||
+        (head->recordSize != sizeof(XcpShmRecordType)) || ((head->capacity & (head->capacity - 1)) != 0) ||
+        ((size_t)st.st_size < head->recordOffset + (size_t)head->capacity * sizeof(XcpShmRecordType))) {
+        munmap(map, st.st_size);
+        return FALSE;
+    }
+    reader->header = head;
+    reader->records = (XcpShmRecordType const *)((uint8_t const *)map + head->recordOffset);
+    reader->size = st.st_size;
+    reader->cursor = __atomic_load_n(&head->head, __ATOMIC_ACQUIRE);
+    if (!latest) {
+        reader->cursor = (reader->cursor > head->capacity) ? reader->cursor - head->capacity : 0;
+    }
+    return TRUE;
+}
+
+XcpShmResultType xcp_shm_read(XcpShmReaderType * const reader, XcpShmRecordType * const record)
+{
+    uint64_t const capacity = reader->header->capacity;
+    uint64_t head = __atomic_load_n(&reader->header->head, __ATOMIC_ACQUIRE);
+    XcpShmRecordType const * slot;
+    uint64_t sequence;
+    uint64_t resume;
+
+    if (reader->cursor >= head) {
+        return XCP_SHM_EMPTY;
+    }
+    if ((head - reader->cursor) <= capacity) {
+        slot = &reader->records[reader->cursor & (capacity - 1)];
+        sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        if (sequence == reader->cursor + 1) {
+            memcpy(record, slot, sizeof(*record));
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) == sequence) {
+                ++reader->cursor;
+                return XCP_SHM_RECORD;
+            }
+        }
+        head = __atomic_load_n(&reader->header->head, __ATOMIC_ACQUIRE);
+    }
+    /* Lapped, continue with the oldest record the producer is not about to overwrite. */
+    resume = (head > capacity) ? head - capacity + 1 : reader->cursor + 1;
+    if (resume <= reader->cursor) {
+        resume = reader->cursor + 1;
+    }
+    reader->lost += resume - reader->cursor;
+    reader->cursor = resume;
+    return XCP_SHM_OVERRUN;
+}
+
+void xcp_shm_reader_close(XcpShmReaderType * const reader)
+{
+    if (reader->header != NULL) {
+        munmap((void *)reader->header, reader->size);
+        reader->header = NULL;
+    }
+}
@@ -0,0 +1,138 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR BSD-3-Clause) */
+/*
+ * xcpshm.h - shared-memory ring of decoded XCP messages
+ *
+ * Copyright (c) 2021 Christoph Schueler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <cpu12.gems@googlemail.com>
+ *
+ */
+#ifndef __XCPSHM_H
+#define __XCPSHM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <linux/can.h>
+
+#include "xcp.h"
+#include "xcpfilter.h"
+
+/*
+ * Defines
+ */
+#define XCP_SHM_MAGIC               (0x52504358U)   /* "XCPR" */
+#define XCP_SHM_VERSION             (1)
+#define XCP_SHM_DEFAULT_CAPACITY    (65536)         /* Records, rounded up to a power of two. */
+
+/*
+ * Types
+ */
+
+/*
+ * One message, fixed size. `sequence` is the record number + 1 and is stored last,
+ * a reader compares it before and after copying the record to detect overruns.
+ */
+typedef struct tagXcpShmRecordType {
+    uint64_t sequence;
+    int64_t tvSec;
+    uint32_t tvUsec;
+    uint32_t canId;                     /* 0 on Ethernet.                           */
+    uint8_t transport;                  /* XcpTransportType                         */
+    uint8_t fromSlave;
+    uint16_t ctr;
+    uint16_t length;                    /* Of the packet, data is cut at 64 bytes.  */
+    uint16_t reserved;
+    uint32_t fields[XCP_FIELD_COUNT];   /* Decoded fields, see `present`.           */
+    uint32_t present;                   /* Bit n set: fields[n] is valid.           */
+    uint8_t data[CANFD_MAX_DLEN];
+} XcpShmRecordType;
+
+/*
+ * Head of the shared memory, the records follow at `recordOffset`.
+ */
+typedef struct tagXcpShmHeaderType {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t recordSize;
+    uint32_t capacity;
+    uint32_t recordOffset;
+    uint32_t producerPid;
+    uint32_t reserved;
+    uint64_t head __attribute__((aligned(64)));     /* Records published so far. */
+} XcpShmHeaderType;
+
+/*
+ * Each reader has its own cursor, the producer never waits for readers.
+ */
+typedef struct tagXcpShmReaderType {
+    XcpShmHeaderType const * header;
+    XcpShmRecordType const * records;
+    size_t size;
+    uint64_t cursor;
+    uint64_t lost;                      /* Records overwritten before they were read. */
+} XcpShmReaderType;
+
+typedef enum tagXcpShmResultType {
+    XCP_SHM_RECORD,                     /* `record` is filled in.                             */
+    XCP_SHM_EMPTY,                      /* Nothing new, try again later.                      */
+    XCP_SHM_OVERRUN                     /* The reader fell behind, records were skipped.      */
+} XcpShmResultType;
+
+/*
+ * Global Functions
+ *
+ */
+
+/*
+ * Producer side (xcpdump --publish). Replaces a ring left behind by a previous run,
+ * but fails with EBUSY while its producer is still running.
+ */
+bool xcp_shm_publish_open(char const * const name, uint32_t capacity);
+void xcp_shm_publish(XcpMessage const * const msg, uint64_t const * const fields);
+void xcp_shm_publish_close(void);
+
+/*
+ * Reader side, see xcpshmcat.c. Readers start at the oldest record still in the ring,
+ * or at the head with `latest`.
+ */
+bool xcp_shm_reader_open(XcpShmReaderType * const reader, char const * const name, bool latest);
+XcpShmResultType xcp_shm_read(XcpShmReaderType * const reader, XcpShmRecordType * const record);
+void xcp_shm_reader_close(XcpShmReaderType * const reader);
+
+#endif /* __XCPSHM_H */
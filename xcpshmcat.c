@@ -0,0 +1,206 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR BSD-3-Clause) */
+/*
+ * xcpshmcat.c - print the messages published by xcpdump --publish
+ *
+ * Copyright (c) 2021 Christoph Schueler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <cpu12.gems@googlemail.com>
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <time.h>
+
+#include "xcp.h"
+#include "xcpshm.h"
+
+/*
+ * Example consumer of the ring xcpdump --publish=<name> writes:
+ * polls, never blocks the producer, and attaches again after xcpdump restarted.
+ */
+
+#define POLL_NS             (1000000L)
+#define LIVENESS_POLLS      (1000)
+
+static char const * const field_names[XCP_FIELD_COUNT] = {
+    "pid", "len", "master", "slave", "service", "error", "event", "addr", "ext", "daq", "odt"
+};
+
+static volatile sig_atomic_t running = 1;
+
+static void sigterm(int signo)
+{
+    running = 0;
+}
+
+void print_usage(char *prg)
+{
+    fprintf(stderr, "\nUsage: %s [options] <name>\n", prg);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "         -l           (start with the next message, not the oldest one in the ring)\n");
+    fprintf(stderr, "         -x           (print the data bytes)\n");
+    fprintf(stderr, "\n<name> as given to xcpdump --publish.\n");
+}
+
+static void print_record(XcpShmRecordType const * const record, bool hex)
+{
+    uint8_t field;
+    uint16_t idx;
+    uint16_t length;
+
+    printf("(%lld.%06u) ", (long long)record->tvSec, record->tvUsec);
+    if (record->transport == XCP_TRANSPORT_CAN) {
+        printf("%3X", record->canId & CAN_EFF_MASK);
+    } else {
+        printf("%s %04X", (record->transport == XCP_TRANSPORT_TCP) ? "TCP" : "UDP", record->ctr);
+    }
+    printf(" %s [%u]", record->fromSlave ? "<-" : "->", record->length);
+    for (field = XCP_FIELD_SERVICE; field < XCP_FIELD_COUNT; ++field) {
+        if (record->present & (1U << field)) {
+            printf(" %s = 0x%X", field_names[field], record->fields[field]);
+        }
+    }
+    if (hex) {
+        length = (record->length < CANFD_MAX_DLEN) ? record->length : CANFD_MAX_DLEN;
+        printf(" [");
+        for (idx = 0; idx < length; ++idx) {
+            printf(" %02X", record->data[idx]);
+        }
+        printf(" ]");
+    }
+    printf("\n");
+}
+
+static bool producer_alive(XcpShmReaderType const * const reader)
+{
+    return (kill(reader->header->producerPid, 0) == 0) || (errno != ESRCH);
+}
+
+int main(int argc, char **argv)
+{
+    struct timespec const pause = { 0, POLL_NS };
+    XcpShmReaderType reader;
+    XcpShmRecordType record;
+    struct sigaction sa;
+    bool latest = FALSE;
+    bool hex = FALSE;
+    bool attached = FALSE;
+    unsigned idle = 0;
+    uint64_t lost = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "lx?")) != -1) {
+        switch (opt) {
+            case 'l':
+                latest = TRUE;
+                break;
+            case 'x':
+                hex = TRUE;
+                break;
+            case '?':
+                print_usage(basename(argv[0]));
+                exit(0);
+                break;
+            default:
+                fprintf(stderr, "Unknown option %c\n", opt);
+                print_usage(basename(argv[0]));
+                exit(1);
+                break;
+        }
+    }
+    if ((argc - optind) != 1) {
+        print_usage(basename(argv[0]));
+        exit(1);
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sigterm;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGHUP, &sa, NULL);
+
+    while (running) {
+        if (!attached) {
+            attached = xcp_shm_reader_open(&reader, argv[optind], latest);
+            if (!attached) {
+                nanosleep(&pause, NULL);
+                continue;
+            }
+            idle = 0;
+        }
+        switch (xcp_shm_read(&reader, &record)) {
+            case XCP_SHM_RECORD:
+                print_record(&record, hex);
+                idle = 0;
+                break;
+            case XCP_SHM_OVERRUN:
+                fprintf(stderr, "%s: overrun, %llu messages lost\n", basename(argv[0]),
+                        (unsigned long long)(reader.lost - lost));
+                lost = reader.lost;
+                break;
+            case XCP_SHM_EMPTY:
+                fflush(stdout);
+                if (++idle >= LIVENESS_POLLS) {
+                    idle = 0;
+                    if (!producer_alive(&reader)) {
+                        /* xcpdump is gone, wait for the next one. */
+                        xcp_shm_reader_close(&reader);
+                        attached = FALSE;
+                        latest = FALSE;
+                        continue;
+                    }
+                }
+                nanosleep(&pause, NULL);
+                break;
+        }
+    }
+    if (attached) {
+        xcp_shm_reader_close(&reader);
+    }
+    if (lost > 0) {
+        fprintf(stderr, "%s: %llu messages lost in total\n", basename(argv[0]), (unsigned long long)lost);
+    }
+    return 0;
+}
@@ -0,0 +1,918 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR BSD-3-Clause) */
+/*
+ * xcpsim.c - XCP on CAN slave simulator
+ *
+ * Copyright (c) 2021 Christoph Schueler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <cpu12.gems@googlemail.com>
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <time.h>
+#include <net/if.h>
+#include <sys/socket.h>
+
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+#include "xcp.h"
+#include "xcpchecksum.h"
+
+/*
+ * A dynamic DAQ slave with byte granularity and Intel byte order. Memory is a
+ * 64 KiB image mirrored over the whole address space; the first 1 KiB changes
+ * on every event cycle, so DAQ and uploads see live values.
+ */
+
+#define MEMORY_SIZE             (0x10000)
+#define LIVE_SIZE               (0x400)
+#define MAX_DAQ_LISTS           (64)
+#define MAX_ODTS                (252)       /* Absolute ODT numbers, 0xFC and above are reserved. */
+#define MAX_ODT_ENTRIES         (64)
+#define MAX_EVENT_CHANNELS      (16)
+#define MAX_CTO                 (8)
+
+typedef struct tagOdtEntryType {
+    uint32_t address;
+    uint8_t size;
+    uint8_t bitOffset;
+} OdtEntryType;
+
+typedef struct tagOdtType {
+    uint8_t entryCount;
+    OdtEntryType entries[MAX_ODT_ENTRIES];
+} OdtType;
+
+typedef struct tagDaqListType {
+    uint16_t firstOdt;          /* Index into `odts`, i.e. the absolute ODT number. */
+    uint8_t odtCount;
+    uint8_t mode;
+    uint16_t eventChannel;
+    uint8_t prescaler;
+    uint8_t priority;
+    uint8_t cycle;
+    bool selected;
+    bool running;
+} DaqListType;
+
+typedef struct tagEventChannelType {
+    uint64_t period;            /* ns, 0 == as fast as possible. */
+    uint64_t due;
+} EventChannelType;
+
+static uint8_t memory[MEMORY_SIZE];
+static DaqListType daq_lists[MAX_DAQ_LISTS];
+static uint16_t daq_list_count = 0;
+static OdtType odts[MAX_ODTS];
+static uint16_t odt_count = 0;
+static EventChannelType channels[MAX_EVENT_CHANNELS];
+static uint16_t channel_count = 0;
+
+static canid_t master = 0x7e0;
+static canid_t slave = 0x7e1;
+static bool fd = FALSE;
+static uint8_t max_dto = 8;
+static int s;
+
+static bool connected = FALSE;
+static uint32_t mta = 0;
+static uint16_t daq_ptr_list;
+static uint8_t daq_ptr_odt;
+static uint8_t daq_ptr_entry;
+static uint32_t download_remaining = 0;
+static uint64_t dtos_sent = 0;
+static uint64_t dtos_dropped = 0;
+
+static volatile sig_atomic_t running = 1;
+
+static void sigterm(int signo)
+{
+    (void)signo;
+    running = 0;
+}
+
+void print_usage(char *prg)
+{
+    fprintf(stderr, "\nUsage: %s [options] <CAN interface>\n", prg);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "         -m <can_id>        (XCP master can_id, default 7E0)\n");
+    fprintf(stderr, "         -s <can_id>        (XCP slave can_id, default 7E1)\n");
+    fprintf(stderr, "         -e <us>[,<us>...]  (event channel periods, 0 = as fast as possible, default 10000,100000)\n");
+    fprintf(stderr, "         -F                 (CAN FD, DTOs up to 64 bytes)\n");
+    fprintf(stderr, "         -a <lists>x<odts>  (configure and start DAQ without a master, for load tests)\n");
+    fprintf(stderr, "\nCAN IDs are given as hexadecimal values.\n");
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint16_t get_word(uint8_t const * data)
+{
+    return data[0] | (data[1] << 8);
+}
+
+static uint32_t get_dword(uint8_t const * data)
+{
+    return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+static void put_dword(uint8_t * data, uint32_t value)
+{
+    data[0] = value;
+    data[1] = value >> 8;
+    data[2] = value >> 16;
+    data[3] = value >> 24;
+}
+
+static uint8_t * mem(uint32_t address)
+{
+    return &memory[address % MEMORY_SIZE];
+}
+
+static void read_memory(uint32_t address, uint8_t * data, uint32_t length)
+{
+    while (length--) {
+        *data++ = *mem(address++);
+    }
+}
+
+static void write_memory(uint32_t address, uint8_t const * data, uint32_t length)
+{
+    while (length--) {
+        *mem(address++) = *data++;
+    }
+}
+
+/*
+ * CAN FD knows only a few lengths above 8, round up and pad.
+ */
+static uint8_t fd_length(uint8_t length)
+{
+    static uint8_t const lengths[] = { 8, 12, 16, 20, 24, 32, 48, 64 };
+    unsigned idx;
+
+    if (length <= 8) {
+        return length;
+    }
+    for (idx = 0; lengths[idx] < length; ++idx) {
+        ;
+    }
+    return lengths[idx];
+}
+
+/*
+ * Returns FALSE if the socket buffer is full, the frame is dropped then.
+ */
+static bool send_frame(uint8_t const * data, uint8_t length, bool block)
+{
+    struct canfd_frame frame;
+    struct pollfd pfd;
+    int const mtu = (fd && (length > 8)) ? CANFD_MTU : CAN_MTU;
+
+    memset(&frame, 0, sizeof(frame));
+    frame.can_id = slave;
+    frame.len = fd ? fd_length(length) : length;
+    memcpy(frame.data, data, length);
+    while (write(s, &frame, mtu) != mtu) {
+        if ((errno != ENOBUFS) && (errno != EAGAIN)) {
+            perror("write");
+            running = 0;
+            return FALSE;
+        }
+        if (!block) {
+            return FALSE;
+        }
+        pfd.fd = s;
+        pfd.events = POLLOUT;
+        poll(&pfd, 1, 10);
+    }
+    return TRUE;
+}
+
+static void respond(uint8_t const * data, uint8_t length)
+{
+    send_frame(data, length, TRUE);
+}
+
+static void positive(void)
+{
+    uint8_t const res[] = { 0xff };
+
+    respond(res, sizeof(res));
+}
+
+static void error(uint8_t code)
+{
+    uint8_t const res[] = { 0xfe, code };
+
+    respond(res, sizeof(res));
+}
+
+static void free_daq(void)
+{
+    uint16_t idx;
+
+    for (idx = 0; idx < MAX_DAQ_LISTS; ++idx) {
+        memset(&daq_lists[idx], 0, sizeof(DaqListType));
+    }
+    daq_list_count = 0;
+    odt_count = 0;
+}
+
+static bool daq_running(void)
+{
+    uint16_t idx;
+
+    for (idx = 0; idx < daq_list_count; ++idx) {
+        if (daq_lists[idx].running) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/*
+ * DTO length of an ODT, PID included, leaving out the entry about to be rewritten.
+ */
+static unsigned odt_length(OdtType const * const odt, uint8_t skip)
+{
+    unsigned length = 1;
+    uint8_t idx;
+
+    for (idx = 0; idx < odt->entryCount; ++idx) {
+        if (idx != skip) {
+            length += odt->entries[idx].size;
+        }
+    }
+    return length;
+}
+
+/*
+ * Sample the entries of one ODT behind its PID.
+ */
+static uint8_t build_dto(uint16_t odtNumber, uint8_t * dto)
+{
+    OdtType const * const odt = &odts[odtNumber];
+    uint8_t length = 1;
+    uint8_t idx;
+    uint8_t byte;
+    uint8_t word[4];
+    unsigned bits;
+    uint64_t value;
+
+    dto[0] = odtNumber;
+    for (idx = 0; idx < odt->entryCount; ++idx) {
+        OdtEntryType const * const entry = &odt->entries[idx];
+
+        if (entry->bitOffset != 0xff) {
+            /* The part of the 32-bit variable holding the bit, with the bit in place. */
+            read_memory(entry->address, word, sizeof(word));
+            value = get_dword(word) & (1UL << (entry->bitOffset & 0x1f));
+            bits = entry->size * 8;
+            if (bits < 32) {
+                value >>= ((entry->bitOffset & 0x1f) / bits) * bits;
+            }
+            for (byte = 0; byte < entry->size; ++byte) {
+                dto[length++] = value >> (byte * 8);
+            }
+        } else {
+            read_memory(entry->address, &dto[length], entry->size);
+            length += entry->size;
+        }
+    }
+    return length;
+}
+
+static void event_cycle(uint16_t channel)
+{
+    uint8_t dto[CANFD_MAX_DLEN];
+    uint16_t idx;
+    uint16_t odt;
+    uint32_t word;
+
+    /* the ECU computes */
+    for (idx = 0; idx < LIVE_SIZE; idx += 4) {
+        word = get_dword(&memory[idx]) + (idx / 4) + 1;
+        put_dword(&memory[idx], word);
+    }
+
+    for (idx = 0; idx < daq_list_count; ++idx) {
+        DaqListType * const list = &daq_lists[idx];
+
+        if (!list->running || (list->eventChannel != channel)) {
+            continue;
+        }
+        if (++list->cycle < list->prescaler) {
+            continue;
+        }
+        list->cycle = 0;
+        for (odt = list->firstOdt; odt < list->firstOdt + list->odtCount; ++odt) {
+            if (send_frame(dto, build_dto(odt, dto), FALSE)) {
+                ++dtos_sent;
+            } else {
+                ++dtos_dropped;
+            }
+        }
+    }
+}
+
+static void start_list(DaqListType * const list)
+{
+    list->running = TRUE;
+    list->cycle = 0;
+}
+
+/*
+ * Without a master: `lists` DAQ lists with `count` ODTs each, filled up to MAX_DTO
+ * with 4-byte entries, spread over the event channels.
+ */
+static void autostart(unsigned lists, unsigned count)
+{
+    uint32_t address = 0;
+    unsigned list;
+    unsigned odt;
+    unsigned entry;
+
+    free_daq();
+    for (list = 0; (list < lists) && (list < MAX_DAQ_LISTS) && (odt_count + count <= MAX_ODTS); ++list) {
+        daq_lists[list].firstOdt = odt_count;
+        daq_lists[list].odtCount = count;
+        daq_lists[list].eventChannel = list % channel_count;
+        daq_lists[list].prescaler = 1;
+        for (odt = 0; odt < count; ++odt) {
+            OdtType * const o = &odts[odt_count++];
+
+            o->entryCount = (max_dto - 1) / 4;
+            for (entry = 0; entry < o->entryCount; ++entry) {
+                o->entries[entry].address = address % LIVE_SIZE;
+                o->entries[entry].size = 4;
+                o->entries[entry].bitOffset = 0xff;
+                address += 4;
+            }
+        }
+        start_list(&daq_lists[list]);
+        ++daq_list_count;
+    }
+}
+
+/*
+ * Time cycle and unit of GET_DAQ_EVENT_INFO, as coarse as needed to fit into a byte.
+ */
+static void event_cycle_time(uint64_t period, uint8_t * cycle, uint8_t * unit)
+{
+    *unit = XCP_DAQ_EVENT_CHANNEL_TIME_UNIT_1NS;
+    while ((period > 0xff) && (*unit < XCP_DAQ_EVENT_CHANNEL_TIME_UNIT_1S)) {
+        period /= 10;
+        ++*unit;
+    }
+    *cycle = (period > 0xff) ? 0xff : period;
+}
+
+static void upload(uint32_t length)
+{
+    uint8_t res[MAX_CTO] = { 0xff };
+    uint32_t chunk;
+
+    /* slave block mode */
+    do {
+        chunk = (length > MAX_CTO - 1) ? MAX_CTO - 1 : length;
+        read_memory(mta, &res[1], chunk);
+        mta += chunk;
+        length -= chunk;
+        respond(res, chunk + 1);
+    } while (length > 0);
+}
+
+static void command(struct canfd_frame const * const frame)
+{
+    uint8_t const * const req = frame->data;
+    uint8_t res[MAX_CTO];
+    DaqListType * list;
+    OdtType * odt;
+    OdtEntryType * entry;
+    uint32_t length;
+    uint32_t checksum;
+    uint16_t idx;
+
+    if (frame->len == 0) {
+        return;
+    }
+    if (!connected && (req[0] != CONNECT)) {
+        return;
+    }
+    memset(res, 0, sizeof(res));
+    res[0] = 0xff;
+
+    switch (req[0]) {
+        case CONNECT:
+            connected = TRUE;
+            res[1] = XCP_RESOURCE_DAQ | XCP_RESOURCE_CAL_PAG;
+            res[2] = XCP_OPTIONAL_COMM_MODE | XCP_SLAVE_BLOCK_MODE | XCP_ADDRESS_GRANULARITY_BYTE | XCP_BYTE_ORDER_INTEL;
+            res[3] = MAX_CTO;
+            res[4] = max_dto;
+            res[5] = 0;
+            res[6] = 1;
+            res[7] = 1;
+            respond(res, 8);
+            break;
+        case DISCONNECT:
+            connected = FALSE;
+            for (idx = 0; idx < daq_list_count; ++idx) {
+                daq_lists[idx].running = FALSE;
+            }
+            positive();
+            break;
+        case GET_STATUS:
+            res[1] = daq_running() ? DAQ_RUNNING : 0;
+            respond(res, 6);
+            break;
+        case SYNCH:
+            error(ERR_CMD_SYNCH);
+            break;
+        case GET_COMM_MODE_INFO:
+            res[6] = 0;
+            res[7] = 0x10;
+            respond(res, 8);
+            break;
+        case GET_ID:
+            respond(res, 8);
+            break;
+        case SET_MTA:
+            if (frame->len < 8) {
+                error(ERR_CMD_SYNTAX);
+                break;
+            }
+            mta = get_dword(&req[4]);
+            positive();
+            break;
+        case UPLOAD:
+            if (frame->len < 2) {
+                error(ERR_CMD_SYNTAX);
+                break;
+            }
+            upload(req[1]);
+            break;
+        case SHORT_UPLOAD:
+            if ((frame->len < 8) || (req[1] > MAX_CTO - 1)) {
+                error(ERR_OUT_OF_RANGE);
+                break;
+            }
+            mta = get_dword(&req[4]);
+            upload(req[1]);
+            break;
+        case BUILD_CHECKSUM:
+            if (frame->len < 8) {
+                error(ERR_CMD_SYNTAX);
+                break;
+            }
+            length = get_dword(&req[4]);
+            if ((length == 0) || (length > MEMORY_SIZE)) {
+                error(ERR_OUT_OF_RANGE);
+                break;
+            }
+            {
+                uint8_t * const block = malloc(length);
+
+                if (block == NULL) {
+                    error(ERR_MEMORY_OVERFLOW);
+                    break;
+                }
+                read_memory(mta, block, length);
+                xcp_checksum_compute(XCP_CHECKSUM_METHOD_XCP_CRC_32, XCP_BYTE_ORDER_INTEL, block, length, &checksum);
+                free(block);
+            }
+            mta += length;
+            res[1] = XCP_CHECKSUM_METHOD_XCP_CRC_32;
+            put_dword(&res[4], checksum);
+            respond(res, 8);
+            break;
+        case DOWNLOAD:
+        case DOWNLOAD_NEXT:
+            if ((frame->len < 2) || (req[1] == 0)) {
+                error(ERR_CMD_SYNTAX);
+                break;
+            }
+            if (req[0] == DOWNLOAD) {
+                download_remaining = req[1];
+            } else if (req[1] != download_remaining) {
+                error(ERR_SEQUENCE);
+                break;
+            }
+            length = (req[1] < frame->len - 2) ? req[1] : frame->len - 2;
+            write_memory(mta, &req[2], length);
+            mta += length;
+            download_remaining -= length;
+            /* in master block mode only the last frame is answered */
+            if (download_remaining == 0) {
+                positive();
+            }
+            break;
+        case DOWNLOAD_MAX:
+            write_memory(mta, &req[1], frame->len - 1);
+            mta += frame->len - 1;
+            positive();
+            break;
+        case SHORT_DOWNLOAD:
+            if ((frame->len < 8) || (req[1] > frame->len - 8)) {
+                error(ERR_OUT_OF_RANGE);
+                break;
+            }
+            mta = get_dword(&req[4]);
+            write_memory(mta, &req[8], req[1]);
+            mta += req[1];
+            positive();
+            break;
+        case MODIFY_BITS:
+            if (frame->len < 6) {
+                error(ERR_CMD_SYNTAX);
+                break;
+            }
+            if (req[1] > 31) {
+                error(ERR_OUT_OF_RANGE);
+                break;
+            }
+            {
+                uint8_t value[4];
+
+                read_memory(mta, value, 4);
+                length = (get_dword(value) & ~((uint32_t)(uint16_t)~get_word(&req[2]) << req[1])) ^
+                         ((uint32_t)get_word(&req[4]) << req[1]);
+                put_dword(value, length);
+                write_memory(mta, value, 4);
+            }
+            positive();
+            break;
+        case GET_DAQ_PROCESSOR_INFO:
+            res[1] = XCP_DAQ_PROP_DAQ_CONFIG_TYPE | XCP_DAQ_PROP_PRESCALER_SUPPORTED | XCP_DAQ_PROP_OVERLOAD_EVENT;
+            res[2] = MAX_DAQ_LISTS;
+            res[4] = channel_count;
+            res[6] = 0;
+            res[7] = 0;     /* absolute ODT numbers */
+            respond(res, 8);
+            break;
+        case GET_DAQ_RESOLUTION_INFO:
+            res[1] = 1;
+            res[2] = 4;
+            res[3] = 1;
+            res[4] = 4;
+            respond(res, 8);
+            break;
+        case GET_DAQ_EVENT_INFO:
+            if ((frame->len < 4) || (get_word(&req[2]) >= channel_count)) {
+                error(ERR_OUT_OF_RANGE);
+                break;
+            }
+            res[1] = XCP_DAQ_EVENT_CHANNEL_TYPE_DAQ;
+            res[2] = 0xff;
+            res[3] = 0;
+            event_cycle_time(channels[get_word(&req[2])].period, &res[4], &res[5]);
+            respond(res, 7);
+            break;
+        case GET_DAQ_LIST_INFO:
+            if ((frame->len < 4) || (get_word(&req[2]) >= daq_list_count)) {
+                error(ERR_OUT_OF_RANGE);
+                break;
+            }
+            res[1] = XCP_DAQ_EVENT_CHANNEL_TYPE_DAQ;
+            res[2] = daq_lists[get_word(&req[2])].odtCount;
+            res[3] = MAX_ODT_ENTRIES;
+            respond(res, 6);
+            break;
+        case FREE_DAQ:
+            free_daq();
+            positive();
+            break;
+        case ALLOC_DAQ:
+            if ((frame->len < 4) || (daq_list_count != 0)) {
+                error(ERR_SEQUENCE);
+                break;
+            }
+            if (get_word(&req[2]) > MAX_DAQ_LISTS) {
+                error(ERR_MEMORY_OVERFLOW);
+                break;
+            }
+            daq_list_count = get_word(&req[2]);
+            positive();
+            break;
+        case ALLOC_ODT:
+            if ((frame->len < 5) || (get_word(&req[2]) >= daq_list_count) ||
+                (odt_count + req[4] > MAX_ODTS)) {
+                error(ERR_MEMORY_OVERFLOW);
+                break;
+            }
+            list = &daq_lists[get_word(&req[2])];
+            list->firstOdt = odt_count;
+            list->odtCount = req[4];
+            odt_count += req[4];
+            positive();
+            break;
+        case ALLOC_ODT_ENTRY:
+            if ((frame->len < 6) || (get_word(&req[2]) >= daq_list_count) ||
+                (req[4] >= daq_lists[get_word(&req[2])].odtCount) || (req[5] > MAX_ODT_ENTRIES)) {
+                error(ERR_MEMORY_OVERFLOW);
+                break;
+            }
+            odt = &odts[daq_lists[get_word(&req[2])].firstOdt + req[4]];
+            memset(odt->entries, 0, sizeof(odt->entries));
+            odt->entryCount = req[5];
+            positive();
+            break;
+        case SET_DAQ_PTR:
+            if ((frame->len < 6) || (get_word(&req[2]) >= daq_list_count) ||
+                (req[4] >= daq_lists[get_word(&req[2])].odtCount)) {
+                error(ERR_OUT_OF_RANGE);
+                break;
+            }
+            daq_ptr_list = get_word(&req[2]);
+            daq_ptr_odt = req[4];
+            daq_ptr_entry = req[5];
+            positive();
+            break;
+        case WRITE_DAQ:
+            if ((frame->len < 8) || (daq_ptr_list >= daq_list_count) || ((req[1] != 0xff) && (req[1] > 31)) ||
+                (req[2] == 0) || (req[2] > 8) ||
+                (daq_ptr_entry >= odts[daq_lists[daq_ptr_list].firstOdt + daq_ptr_odt].entryCount)) {
+                error(ERR_OUT_OF_RANGE);
+                break;
+            }
+            odt = &odts[daq_lists[daq_ptr_list].firstOdt + daq_ptr_odt];
+            /* The ODT has to fit into one DTO. */
+            if (odt_length(odt, daq_ptr_entry) + req[2] > max_dto) {
+                error(ERR_DAQ_CONFIG);
+                break;
+            }
+            entry = &odt->entries[daq_ptr_entry++];
+            entry->bitOffset = req[1];
+            entry->size = req[2];
+            entry->address = get_dword(&req[4]);
+            positive();
+            break;
+        case SET_DAQ_LIST_MODE:
+            if ((frame->len < 8) || (get_word(&req[2]) >= daq_list_count) ||
+                (get_word(&req[4]) >= channel_count)) {
+                error(ERR_OUT_OF_RANGE);
+                break;
+            }
+            if (req[1] & (XCP_DAQ_LIST_MODE_DIRECTION | XCP_DAQ_LIST_MODE_TIMESTAMP | XCP_DAQ_LIST_MODE_PID_OFF)) {
+                error(ERR_MODE_NOT_VALID);
+                break;
+            }
+            list = &daq_lists[get_word(&req[2])];
+            list->mode = req[1];
+            list->eventChannel = get_word(&req[4]);
+            list->prescaler = req[6] ? req[6] : 1;
+            list->priority = req[7];
+            positive();
+            break;
+        case GET_DAQ_LIST_MODE:
+            if ((frame->len < 4) || (get_word(&req[2]) >= daq_list_count)) {
+                error(ERR_OUT_OF_RANGE);
+                break;
+            }
+            list = &daq_lists[get_word(&req[2])];
+            res[1] = list->mode | (list->selected ? XCP_DAQ_LIST_MODE_SELECTED : 0) |
+                     (list->running ? XCP_DAQ_LIST_MODE_STARTED : 0);
+            res[4] = list->eventChannel;
+            res[5] = list->eventChannel >> 8;
+            res[6] = list->prescaler;
+            res[7] = list->priority;
+            respond(res, 8);
+            break;
+        case START_STOP_DAQ_LIST:
+            if ((frame->len < 4) || (get_word(&req[2]) >= daq_list_count) || (req[1] > 2)) {
+                error(ERR_OUT_OF_RANGE);
+                break;
+            }
+            list = &daq_lists[get_word(&req[2])];
+            if (req[1] == 0) {
+                list->running = FALSE;
+            } else if (req[1] == 1) {
+                start_list(list);
+            } else {
+                list->selected = TRUE;
+            }
+            res[1] = list->firstOdt;
+            respond(res, 2);
+            break;
+        case START_STOP_SYNCH:
+            if ((frame->len < 2) || (req[1] > 2)) {
+                error(ERR_OUT_OF_RANGE);
+                break;
+            }
+            for (idx = 0; idx < daq_list_count; ++idx) {
+                list = &daq_lists[idx];
+                if (req[1] == 0) {
+                    list->running = FALSE;
+                } else if (list->selected) {
+                    if (req[1] == 1) {
+                        start_list(list);
+                    } else {
+                        list->running = FALSE;
+                    }
+                    list->selected = FALSE;
+                }
+            }
+            positive();
+            break;
+        case GET_DAQ_CLOCK:
+            put_dword(&res[4], (uint32_t)(now_ns() / 1000));
+            respond(res, 8);
+            break;
+        default:
+            error(ERR_CMD_UNKNOWN);
+            break;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    struct sockaddr_can addr;
+    struct can_filter rfilter;
+    struct canfd_frame frame;
+    struct pollfd pfd;
+    struct timespec timeout;
+    struct sigaction sa;
+    int const canfd_on = 1;
+    unsigned lists = 0;
+    unsigned odtsPerList = 0;
+    uint64_t now;
+    uint64_t next;
+    uint32_t idx;
+    char * token;
+    int opt;
+
+    channels[0].period = 10000000;
+    channels[1].period = 100000000;
+    channel_count = 2;
+
+    while ((opt = getopt(argc, argv, "m:s:e:Fa:?")) != -1) {
+        switch (opt) {
+            case 'm':
+                master = strtoul(optarg, NULL, 16);
+                if (strlen(optarg) > 7) {
+                    master |= CAN_EFF_FLAG;
+                }
+                break;
+            case 's':
+                slave = strtoul(optarg, NULL, 16);
+                if (strlen(optarg) > 7) {
+                    slave |= CAN_EFF_FLAG;
+                }
+                break;
+            case 'e':
+                channel_count = 0;
+                for (token = strtok(optarg, ","); (token != NULL) && (channel_count < MAX_EVENT_CHANNELS);
+                     token = strtok(NULL, ",")) {
+                    channels[channel_count++].period = strtoull(token, NULL, 10) * 1000;
+                }
+                break;
+            case 'F':
+                fd = TRUE;
+                max_dto = CANFD_MAX_DLEN;
+                break;
+            case 'a':
+                if (sscanf(optarg, "%ux%u", &lists, &odtsPerList) != 2) {
+                    print_usage(basename(argv[0]));
+                    exit(1);
+                }
+                break;
+            case '?':
+                print_usage(basename(argv[0]));
+                exit(0);
+                break;
+            default:
+                fprintf(stderr, "Unknown option %c\n", opt);
+                print_usage(basename(argv[0]));
+                exit(1);
+                break;
+        }
+    }
+    if (((argc - optind) != 1) || (channel_count == 0)) {
+        print_usage(basename(argv[0]));
+        exit(1);
+    }
+
+    s = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+    if (s < 0) {
+        perror("socket");
+        return 1;
+    }
+    if (fd && (setsockopt(s, SOL_CAN_RAW, CAN_RAW_FD_FRAMES, &canfd_on, sizeof(canfd_on)) < 0)) {
+        perror("CAN_RAW_FD_FRAMES");
+        return 1;
+    }
+    rfilter.can_id = master;
+    rfilter.can_mask = CAN_EFF_FLAG | CAN_RTR_FLAG | ((master & CAN_EFF_FLAG) ? CAN_EFF_MASK : CAN_SFF_MASK);
+    setsockopt(s, SOL_CAN_RAW, CAN_RAW_FILTER, &rfilter, sizeof(rfilter));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.can_family = AF_CAN;
+    addr.can_ifindex = if_nametoindex(argv[optind]);
+    if (bind(s, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("bind");
+        return 1;
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sigterm;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    for (idx = 0; idx < MEMORY_SIZE; ++idx) {
+        memory[idx] = idx * 0x9d;
+    }
+    if (lists > 0) {
+        autostart(lists, odtsPerList);
+    }
+    now = now_ns();
+    for (idx = 0; idx < channel_count; ++idx) {
+        channels[idx].due = now + channels[idx].period;
+    }
+
+    pfd.fd = s;
+    pfd.events = POLLIN;
+    while (running) {
+        now = now_ns();
+        next = UINT64_MAX;
+        for (idx = 0; idx < channel_count; ++idx) {
+            if (channels[idx].due <= now) {
+                if (daq_running()) {
+                    event_cycle(idx);
+                }
+                /* don't try to catch up on cycles lost to an overloaded bus */
+                channels[idx].due += channels[idx].period;
+                if (channels[idx].due < now) {
+                    channels[idx].due = now + channels[idx].period;
+                }
+            }
+            if (channels[idx].due < next) {
+                next = channels[idx].due;
+            }
+        }
+        now = now_ns();
+        next = (next > now) ? next - now : 0;
+        timeout.tv_sec = next / 1000000000ULL;
+        timeout.tv_nsec = next % 1000000000ULL;
+        /* idle until the master starts DAQ */
+        if (ppoll(&pfd, 1, daq_running() ? &timeout : NULL, NULL) <= 0) {
+            continue;
+        }
+        if (read(s, &frame, sizeof(frame)) > 0) {
+            command(&frame);
+        }
+    }
+
+    fprintf(stderr, "%s: %llu DTOs sent, %llu dropped on a full transmit queue\n", basename(argv[0]),
+            (unsigned long long)dtos_sent, (unsigned long long)dtos_dropped);
+    close(s);
+    return 0;
+}
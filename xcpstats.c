@@ -0,0 +1,292 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR BSD-3-Clause) */
+/*
+ * xcpstats.c - live statistics dashboard
+ *
+ * Copyright (c) 2021 Christoph Schueler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <cpu12.gems@googlemail.com>
+ *
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include <linux/can.h>
+
+#include "terminal.h"
+#include "xcp.h"
+#include "xcpdaq.h"
+#include "xcpstats.h"
+
+/*
+ *
+ * Local Constants.
+ *
+ */
+#define MASTER      (0)
+#define SLAVE       (1)
+
+#define PER_LINE    (6)
+
+/*
+ *
+ * Local Variables.
+ *
+ */
+static uint64_t frames[2];
+static uint64_t bytes[2];
+static uint64_t positive_responses;
+static uint64_t service_requests;
+static uint64_t commands[256];
+static uint64_t errors[256];
+static uint64_t events[256];
+static uint64_t dto_pids[256];
+static uint64_t dto_lists[XCP_STATS_MAX_DAQ_LISTS + 1];
+static uint64_t bus_time;                       /* Nanoseconds, since the last redraw. */
+
+static uint64_t last_frames[2];
+static uint64_t last_dto_pids[256];
+static uint64_t last_dto_lists[XCP_STATS_MAX_DAQ_LISTS + 1];
+static struct timespec started;
+static struct timespec last_print;
+
+static uint32_t nominal_bitrate = XCP_STATS_DEFAULT_BITRATE;
+static uint32_t data_bitrate = XCP_STATS_DEFAULT_BITRATE;
+
+/*
+ * Frame duration in ns, by [FD][extended ID][bit rate switch][length].
+ */
+static uint32_t frame_time[2][2][2][CANFD_MAX_DLEN + 1];
+static bool frame_time_ready = FALSE;
+
+/*
+ *
+ * Local Functions.
+ *
+ */
+static void init_frame_time(void);
+static double seconds_between(struct timespec const * const from, struct timespec const * const to);
+static void print_counters(char const * const title, uint64_t const * counters, unsigned count);
+static void print_rates(char const * const title, uint64_t const * counters, uint64_t * last,
+                        unsigned count, double seconds);
+
+
+void xcp_stats_set_bitrate(uint32_t nominal, uint32_t data)
+{
+    nominal_bitrate = nominal;
+    data_bitrate = (data != 0) ? data : nominal;
+    frame_time_ready = FALSE;
+}
+
+/*
+ * Bit counts without stuff bits.
+ *
+ * Classic: SOF, arbitration, control, CRC, delimiters, ACK, EOF and intermission.
+ * FD: the same split into nominal (arbitration, ACK, EOF) and data phase (ESI, DLC,
+ * payload, stuff count, CRC), the latter at the data bit rate if BRS is set.
+ */
+static void init_frame_time(void)
+{
+    unsigned eff;
+    unsigned brs;
+    unsigned len;
+    double nominal;
+    double data;
+
+    for (eff = 0; eff < 2; ++eff) {
+        for (brs = 0; brs < 2; ++brs) {
+            for (len = 0; len <= CANFD_MAX_DLEN; ++len) {
+                nominal = (eff ? 67 : 47) + 8.0 * ((len <= CAN_MAX_DLEN) ? len : CAN_MAX_DLEN);
+                frame_time[0][eff][brs][len] = nominal * 1e9 / nominal_bitrate;
+                nominal = eff ? 50 : 30;
+                data = 26 + 8.0 * len + ((len > 16) ? 4 : 0);
+                frame_time[1][eff][brs][len] = nominal * 1e9 / nominal_bitrate +
+                                               data * 1e9 / (brs ? data_bitrate : nominal_bitrate);
+            }
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    last_print = started;
+    frame_time_ready = TRUE;
+}
+
+/*
+ * Per frame work is kept to a few increments.
+ */
+void xcp_stats_update(XcpMessage const * const msg, bool fd)
+{
+    struct canfd_frame const * const frame = msg->frame;
+    uint8_t const * const data = msg->data;
+    unsigned const direction = msg->fromSlave ? SLAVE : MASTER;
+    uint16_t daqList;
+    uint8_t odt;
+
+    if (!frame_time_ready) {
+        init_frame_time();
+    }
+    ++frames[direction];
+    bytes[direction] += msg->length;
+    if (frame != NULL) {
+        bus_time += frame_time[fd][(frame->can_id & CAN_EFF_FLAG) ? 1 : 0][(frame->flags & CANFD_BRS) ? 1 : 0]
+                              [(frame->len <= CANFD_MAX_DLEN) ? frame->len : CANFD_MAX_DLEN];
+    }
+    if (msg->length == 0) {
+        return;
+    }
+    if (direction == MASTER) {
+        if (data[0] >= 0xc0) {
+            ++commands[data[0]];
+        } else {
+            ++dto_pids[data[0]];     /* STIM */
+        }
+        return;
+    }
+    switch (data[0]) {
+        case 0xff:
+            ++positive_responses;
+            break;
+        case 0xfe:
+            if (msg->length >= 2) {
+                ++errors[data[1]];
+            }
+            break;
+        case 0xfd:
+            if (msg->length >= 2) {
+                ++events[data[1]];
+            }
+            break;
+        case 0xfc:
+            ++service_requests;
+            break;
+        default:
+            ++dto_pids[data[0]];
+            if (xcp_daq_identify(data, msg->length, &daqList, &odt)) {
+                ++dto_lists[(daqList < XCP_STATS_MAX_DAQ_LISTS) ? daqList : XCP_STATS_MAX_DAQ_LISTS];
+            }
+            break;
+    }
+}
+
+static double seconds_between(struct timespec const * const from, struct timespec const * const to)
+{
+    return (to->tv_sec - from->tv_sec) + (to->tv_nsec - from->tv_nsec) / 1e9;
+}
+
+static void print_counters(char const * const title, uint64_t const * counters, unsigned count)
+{
+    unsigned shown = 0;
+    unsigned idx;
+
+    printf("%s:", title);
+    for (idx = 0; idx < count; ++idx) {
+        if (counters[idx] == 0) {
+            continue;
+        }
+        if ((shown > 0) && ((shown % PER_LINE) == 0)) {
+            printf("\n%*s", (int)strlen(title) + 1, "");
+        }
+        printf("  %02X: %-8llu", idx, (unsigned long long)counters[idx]);
+        ++shown;
+    }
+    printf("\n");
+}
+
+static void print_rates(char const * const title, uint64_t const * counters, uint64_t * last,
+                        unsigned count, double seconds)
+{
+    unsigned shown = 0;
+    unsigned idx;
+
+    printf("%s:", title);
+    for (idx = 0; idx < count; ++idx) {
+        if (counters[idx] == 0) {
+            continue;
+        }
+        if ((shown > 0) && ((shown % (PER_LINE / 2)) == 0)) {
+            printf("\n%*s", (int)strlen(title) + 1, "");
+        }
+        printf("  %4u: %10llu %8.1f/s", idx, (unsigned long long)counters[idx],
+               (seconds > 0.0) ? (counters[idx] - last[idx]) / seconds : 0.0);
+        last[idx] = counters[idx];
+        ++shown;
+    }
+    printf("\n");
+}
+
+/*
+ * Redraw the whole screen.
+ */
+void xcp_stats_print(char const * const ifname, unsigned interval)
+{
+    struct timespec now;
+    double seconds;
+    unsigned direction;
+    static char const * const names[] = {"master -> slave", "slave -> master"};
+
+    if (!frame_time_ready) {
+        init_frame_time();
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    seconds = seconds_between(&last_print, &now);
+
+    printf("%s%s", CLR_SCREEN, CSR_HOME);
+    printf("xcpdump statistics on %s, running %.0fs, updated every %ums\n\n", ifname,
+           seconds_between(&started, &now), interval);
+    printf("%-16s %12s %14s %10s\n", "", "frames", "bytes", "frames/s");
+    for (direction = MASTER; direction <= SLAVE; ++direction) {
+        printf("%-16s %12llu %14llu %10.1f\n", names[direction], (unsigned long long)frames[direction],
+               (unsigned long long)bytes[direction],
+               (seconds > 0.0) ? (frames[direction] - last_frames[direction]) / seconds : 0.0);
+        last_frames[direction] = frames[direction];
+    }
+    printf("\nbus load (estimated, w/o stuff bits): %.1f%% at %u/%u bit/s\n",
+           (seconds > 0.0) ? (bus_time / 1e7 / seconds) : 0.0, nominal_bitrate, data_bitrate);
+    bus_time = 0;
+    printf("positive responses: %llu, service requests: %llu\n\n",
+           (unsigned long long)positive_responses, (unsigned long long)service_requests);
+    print_counters("commands", commands, 256);
+    print_counters("errors  ", errors, 256);
+    print_counters("events  ", events, 256);
+    printf("\n");
+    print_rates("DTOs per PID     ", dto_pids, last_dto_pids, 256, seconds);
+    print_rates("DTOs per DAQ list", dto_lists, last_dto_lists, XCP_STATS_MAX_DAQ_LISTS + 1, seconds);
+    fflush(stdout);
+    last_print = now;
+}
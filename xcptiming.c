@@ -0,0 +1,284 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR BSD-3-Clause) */
+/*
+ * xcptiming.c - event channel timing and jitter monitor
+ *
+ * Copyright (c) 2021 Christoph Schueler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <cpu12.gems@googlemail.com>
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <linux/can.h>
+
+#include "xcp.h"
+#include "xcpsession.h"
+#include "xcpdaq.h"
+#include "xcptiming.h"
+
+/*
+ *
+ * Local Types.
+ *
+ */
+typedef struct tagChannelType {
+    double declaredCycle;       /* Nanoseconds, 0 == not cyclic or unknown. */
+    bool referenceKnown;
+    uint16_t referenceList;     /* The first ODT of this list marks a cycle. */
+    uint8_t prescaler;
+    bool lastKnown;
+    uint64_t last;              /* Microseconds. */
+    uint64_t periods;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+    uint64_t missed;
+    uint64_t maxDeviation;
+    uint32_t histogram[XCP_TIMING_BINS + 1];
+} ChannelType;
+
+/*
+ *
+ * Local Variables.
+ *
+ */
+static ChannelType * channels = NULL;
+static uint32_t channel_count = 0;
+
+/*
+ * Event channel time units in nanoseconds.
+ */
+static double const unit_ns[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,  /* 1ns .. 1s      */
+    1e-3, 1e-2, 1e-1                                    /* 1ps .. 100ps   */
+};
+
+/*
+ *
+ * Local Functions.
+ *
+ */
+static ChannelType * get_channel(uint16_t number);
+static void restart(void);
+static void account(ChannelType * const channel, uint64_t period);
+static double expected_period(ChannelType const * const channel);
+static double percentile(ChannelType const * const channel, double fraction);
+
+
+/*
+ * Feed every frame through here, after xcp_daq_update().
+ */
+void xcp_timing_update(XcpMessage const * const msg)
+{
+    XcpSessionType const * const session = xcp_session_get();
+    uint8_t const * const req = session->request;
+    ChannelType * channel;
+    uint16_t daqList;
+    uint16_t number;
+    uint8_t odt;
+    uint8_t prescaler;
+    uint64_t now;
+
+    if (session->response == 0xff) {
+        switch (req[0]) {
+            case GET_DAQ_EVENT_INFO:
+                if ((session->requestLength >= 4) && (msg->length >= 6)) {
+                    channel = get_channel(xcp_session_word(session, &req[2]));
+                    if (channel != NULL) {
+                        channel->declaredCycle = (msg->data[5] < sizeof(unit_ns) / sizeof(unit_ns[0])) ?
+                                                 msg->data[4] * unit_ns[msg->data[5]] : 0.0;
+                    }
+                }
+                break;
+            case CONNECT:
+            case FREE_DAQ:
+            case START_STOP_DAQ_LIST:
+            case START_STOP_SYNCH:
+                restart();
+                break;
+            default:
+                break;
+        }
+        return;
+    }
+    if (!msg->fromSlave || (msg->length == 0) || (msg->data[0] >= 0xfc)) {
+        return;
+    }
+    if (!xcp_daq_identify(msg->data, msg->length, &daqList, &odt) || (odt != 0)) {
+        return;
+    }
+    if (!xcp_daq_list_event(daqList, &number, &prescaler) || ((channel = get_channel(number)) == NULL)) {
+        return;
+    }
+    if (!channel->referenceKnown) {
+        channel->referenceKnown = TRUE;
+        channel->referenceList = daqList;
+        channel->prescaler = prescaler;
+    } else if (channel->referenceList != daqList) {
+        return;
+    }
+    now = (uint64_t)msg->timestamp.tv_sec * 1000000 + msg->timestamp.tv_usec;
+    if (channel->lastKnown && (now > channel->last)) {
+        account(channel, now - channel->last);
+    }
+    channel->last = now;
+    channel->lastKnown = TRUE;
+}
+
+static ChannelType * get_channel(uint16_t number)
+{
+    ChannelType * grown;
+
+    if (number < channel_count) {
+        return &channels[number];
+    }
+    grown = realloc(channels, ((size_t)number + 1) * sizeof(ChannelType));
+    if (grown == NULL) {
+        return NULL;
+    }
+    memset(&grown[channel_count], 0, ((size_t)number + 1 - channel_count) * sizeof(ChannelType));
+    channels = grown;
+    channel_count = (uint32_t)number + 1;
+    return &channels[number];
+}
+
+/*
+ * The gap around a (re-)start of the measurement is no period.
+ */
+static void restart(void)
+{
+    uint32_t idx;
+
+    for (idx = 0; idx < channel_count; ++idx) {
+        channels[idx].lastKnown = FALSE;
+        channels[idx].referenceKnown = FALSE;
+    }
+}
+
+static double expected_period(ChannelType const * const channel)
+{
+    return channel->declaredCycle * channel->prescaler / 1e3;
+}
+
+/*
+ * Periods over 1.5 times the expected one count as missed cycles, not as jitter.
+ */
+static void account(ChannelType * const channel, uint64_t period)
+{
+    double const expected = expected_period(channel);
+    double deviation;
+    unsigned bin;
+
+    if ((expected > 0.0) && (period > 1.5 * expected)) {
+        channel->missed += (uint64_t)(period / expected + 0.5) - 1;
+        return;
+    }
+    if ((channel->periods == 0) || (period < channel->min)) {
+        channel->min = period;
+    }
+    if (period > channel->max) {
+        channel->max = period;
+    }
+    ++channel->periods;
+    channel->sum += period;
+    if (expected > 0.0) {
+        deviation = (period > expected) ? (period - expected) : (expected - period);
+        if (deviation > channel->maxDeviation) {
+            channel->maxDeviation = deviation;
+        }
+        bin = deviation * XCP_TIMING_BINS / expected;
+        ++channel->histogram[(bin < XCP_TIMING_BINS) ? bin : XCP_TIMING_BINS];
+    }
+}
+
+/*
+ * Upper bound of the absolute jitter in microseconds, at the resolution of the histogram.
+ */
+static double percentile(ChannelType const * const channel, double fraction)
+{
+    uint64_t const target = (uint64_t)(channel->periods * fraction + 0.5);
+    uint64_t seen = 0;
+    unsigned bin;
+    double bound;
+
+    for (bin = 0; bin < XCP_TIMING_BINS; ++bin) {
+        seen += channel->histogram[bin];
+        if ((seen >= target) && (seen > 0)) {
+            bound = (bin + 1) * expected_period(channel) / XCP_TIMING_BINS;
+            return (bound < channel->maxDeviation) ? bound : channel->maxDeviation;
+        }
+    }
+    return channel->maxDeviation;
+}
+
+void xcp_timing_print(void)
+{
+    ChannelType const * channel;
+    uint32_t idx;
+
+    for (idx = 0; idx < channel_count; ++idx) {
+        channel = &channels[idx];
+        if ((channel->periods == 0) && (channel->missed == 0)) {
+            continue;
+        }
+        printf("EVENT_TIMING(eventChannel = %u", idx);
+        if (channel->declaredCycle > 0.0) {
+            printf(", declaredCycle = %.3fms", channel->declaredCycle / 1e6);
+        } else {
+            printf(", declaredCycle = \"not cyclic\"");
+        }
+        printf(", prescaler = %u", channel->prescaler);
+        printf(", periods = %llu", (unsigned long long)channel->periods);
+        if (channel->periods > 0) {
+            printf(", period = { min = %lluus, mean = %.1fus, max = %lluus }",
+                   (unsigned long long)channel->min, (double)channel->sum / channel->periods,
+                   (unsigned long long)channel->max);
+        }
+        if ((channel->declaredCycle > 0.0) && (channel->periods > 0)) {
+            printf(", jitter = { p50 = %.0fus, p90 = %.0fus, p99 = %.0fus, max = %lluus }",
+                   percentile(channel, 0.50), percentile(channel, 0.90), percentile(channel, 0.99),
+                   (unsigned long long)channel->maxDeviation);
+        }
+        printf(", missed = %llu", (unsigned long long)channel->missed);
+        printf(")\n");
+    }
+}
@@ -0,0 +1,335 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR BSD-3-Clause) */
+/*
+ * xcptransfer.c - reassemble segmented UPLOAD, DOWNLOAD and PROGRAM transfers
+ *
+ * Copyright (c) 2021 Christoph Schueler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <cpu12.gems@googlemail.com>
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <linux/can.h>
+
+#include "xcp.h"
+#include "xcpsession.h"
+#include "xcptransfer.h"
+
+/*
+ *
+ * Local Constants.
+ *
+ */
+#define PREVIEW_LENGTH  (16)
+
+/*
+ *
+ * Local Variables.
+ *
+ */
+static bool enabled = FALSE;
+static bool current_open = FALSE;
+static XcpTransferType current;
+static bool completed_valid = FALSE;
+static XcpTransferType completed;
+
+/*
+ * Payload chunks are recycled, so long flash sessions don't hit malloc() per transfer.
+ */
+static XcpTransferChunkType * chunk_pool = NULL;
+
+/*
+ *
+ * Local Functions.
+ *
+ */
+static uint8_t transfer_family(uint8_t service);
+static void open_transfer(uint8_t service, uint8_t ext, uint32_t address, struct timeval const * const ts);
+static void close_transfer(void);
+static void release_completed(void);
+static void account(XcpMessage const * const msg);
+static void append(uint8_t const * data, uint16_t length);
+
+
+static uint8_t transfer_family(uint8_t service)
+{
+    switch (service) {
+        case UPLOAD:
+        case SHORT_UPLOAD:
+            return UPLOAD;
+        case DOWNLOAD:
+        case DOWNLOAD_NEXT:
+        case DOWNLOAD_MAX:
+        case SHORT_DOWNLOAD:
+            return DOWNLOAD;
+        case PROGRAM:
+        case PROGRAM_NEXT:
+        case PROGRAM_MAX:
+            return PROGRAM;
+        default:
+            return 0;
+    }
+}
+
+void xcp_transfer_enable(void)
+{
+    enabled = TRUE;
+}
+
+/*
+ * Follow the data commands through the MTA.
+ *
+ * Returns TRUE if the frame has been merged into a transfer record, i.e. there's
+ * no need to print it individually.
+ */
+bool xcp_transfer_update(XcpMessage const * const msg)
+{
+    XcpSessionType const * const session = xcp_session_get();
+    XcpDataSegmentType const * const segment = &session->segment;
+    uint8_t family;
+    uint8_t ext;
+    uint32_t address;
+
+    release_completed();
+    if (msg->length == 0) {
+        return FALSE;
+    }
+
+    if (!msg->fromSlave) {
+        if (msg->data[0] == SET_MTA) {
+            if (current_open && (session->mtaExtension == current.addressExtension) &&
+                (session->mtaAddress == current.nextAddress)) {
+                account(msg);
+                return TRUE;
+            }
+            close_transfer();
+            return FALSE;
+        }
+        family = transfer_family(msg->data[0]);
+        if (family == 0) {
+            close_transfer();
+            return FALSE;
+        }
+        if (segment->service != 0) {
+            ext = segment->addressExtension;
+            address = segment->address;
+        } else {
+            ext = session->mtaExtension;
+            address = session->mtaAddress;
+        }
+        if (!current_open || (current.service != family) || (current.addressExtension != ext) ||
+            (current.nextAddress != address)) {
+            close_transfer();
+            open_transfer(family, ext, address, &msg->timestamp);
+        }
+        account(msg);
+        if (segment->service != 0) {
+            append(segment->data, segment->length);
+            current.nextAddress = session->mtaAddress;
+        }
+        return TRUE;
+    } else if (msg->fromSlave && current_open) {
+        switch (msg->data[0]) {
+            case 0xff:  /* Positive Response    */
+                account(msg);
+                if ((segment->service != 0) && !segment->write) {
+                    append(segment->data, segment->length);
+                    current.nextAddress = session->mtaAddress;
+                }
+                return TRUE;
+            case 0xfe:  /* Error                */
+                account(msg);
+                current.error = msg->data[1];
+                close_transfer();
+                return FALSE;
+            default:
+                return FALSE;
+        }
+    }
+    return FALSE;
+}
+
+/*
+ * The record of a transfer that has just been finished, valid until the next update.
+ */
+XcpTransferType const * xcp_transfer_completed(void)
+{
+    return completed_valid ? &completed : NULL;
+}
+
+void xcp_transfer_flush(void)
+{
+    release_completed();
+    close_transfer();
+}
+
+static void open_transfer(uint8_t service, uint8_t ext, uint32_t address, struct timeval const * const ts)
+{
+    memset(&current, 0, sizeof(current));
+    current.service = service;
+    current.addressExtension = ext;
+    current.address = address;
+    current.nextAddress = address;
+    current.error = ERR_SUCCESS;
+    current.start = *ts;
+    current.end = *ts;
+    current_open = TRUE;
+}
+
+static void close_transfer(void)
+{
+    if (!current_open) {
+        return;
+    }
+    completed = current;
+    completed_valid = TRUE;
+    current_open = FALSE;
+    current.head = current.tail = NULL;
+}
+
+static void release_completed(void)
+{
+    if (!completed_valid) {
+        return;
+    }
+    if (completed.tail != NULL) {
+        completed.tail->next = chunk_pool;
+        chunk_pool = completed.head;
+    }
+    completed.head = completed.tail = NULL;
+    completed_valid = FALSE;
+}
+
+static void account(XcpMessage const * const msg)
+{
+    ++current.frames;
+    current.end = msg->timestamp;
+}
+
+static void append(uint8_t const * data, uint16_t length)
+{
+    XcpTransferChunkType * chunk;
+    uint16_t size;
+
+    current.length += length;
+    if (!enabled) {
+        return;
+    }
+    while (length > 0) {
+        if ((current.tail == NULL) || (current.tail->length == XCP_TRANSFER_CHUNK_SIZE)) {
+            if (chunk_pool != NULL) {
+                chunk = chunk_pool;
+                chunk_pool = chunk->next;
+            } else {
+                chunk = malloc(sizeof(XcpTransferChunkType));
+                if (chunk == NULL) {
+                    return;     /* Length is still accounted, the payload is incomplete. */
+                }
+            }
+            chunk->next = NULL;
+            chunk->length = 0;
+            if (current.tail != NULL) {
+                current.tail->next = chunk;
+            } else {
+                current.head = chunk;
+            }
+            current.tail = chunk;
+        }
+        chunk = current.tail;
+        size = XCP_TRANSFER_CHUNK_SIZE - chunk->length;
+        if (size > length) {
+            size = length;
+        }
+        memcpy(&chunk->data[chunk->length], data, size);
+        chunk->length += size;
+        data += size;
+        length -= size;
+    }
+}
+
+void xcp_transfer_print(XcpTransferType const * const transfer)
+{
+    struct timeval duration;
+    double seconds;
+    unsigned idx;
+
+    timersub(&transfer->end, &transfer->start, &duration);
+    seconds = duration.tv_sec + duration.tv_usec / 1e6;
+
+    printf("TRANSFER(service = ");
+    switch (transfer->service) {
+        case UPLOAD:
+            printf("UPLOAD");
+            break;
+        case DOWNLOAD:
+            printf("DOWNLOAD");
+            break;
+        case PROGRAM:
+            printf("PROGRAM");
+            break;
+        default:
+            break;
+    }
+    printf(", address = 0x%08x", transfer->address);
+    printf(", addressExtension = 0x%02x", transfer->addressExtension);
+    printf(", length = %u", transfer->length);
+    printf(", frames = %u", transfer->frames);
+    printf(", duration = %ld.%06lds", (long)duration.tv_sec, (long)duration.tv_usec);
+    if (seconds > 0.0) {
+        printf(", throughput = %.0f bytes/s", transfer->length / seconds);
+    }
+    if (transfer->error != ERR_SUCCESS) {
+        printf(", error = 0x%02x", transfer->error);
+    }
+    if (transfer->head != NULL) {
+        printf(", data: [ ");
+        for (idx = 0; (idx < transfer->head->length) && (idx < PREVIEW_LENGTH); ++idx) {
+            printf("%02X ", transfer->head->data[idx]);
+        }
+        if (transfer->length > idx) {
+            printf("... ");
+        }
+        printf("]");
+    }
+    printf(")");
+}
@@ -0,0 +1,99 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR BSD-3-Clause) */
+/*
+ * xcptransfer.h - reassemble segmented UPLOAD, DOWNLOAD and PROGRAM transfers
+ *
+ * Copyright (c) 2021 Christoph Schueler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <cpu12.gems@googlemail.com>
+ *
+ */
+#ifndef __XCPTRANSFER_H
+#define __XCPTRANSFER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/time.h>
+
+#include "xcp.h"
+
+/*
+ * Defines
+ */
+#define XCP_TRANSFER_CHUNK_SIZE     (4096)
+
+/*
+ * Types
+ */
+typedef struct tagXcpTransferChunkType {
+    struct tagXcpTransferChunkType * next;
+    uint16_t length;
+    uint8_t data[XCP_TRANSFER_CHUNK_SIZE];
+} XcpTransferChunkType;
+
+/*
+ * One logical transfer, i.e. a run of data commands over contiguous memory.
+ */
+typedef struct tagXcpTransferType {
+    uint8_t service;            /* UPLOAD, DOWNLOAD or PROGRAM. */
+    uint8_t addressExtension;
+    uint32_t address;
+    uint32_t nextAddress;       /* Where the next segment has to start to continue this transfer. */
+    uint32_t length;            /* In bytes. */
+    uint32_t frames;
+    uint8_t error;              /* ERR_SUCCESS or error code of the negative response. */
+    struct timeval start;
+    struct timeval end;
+    XcpTransferChunkType * head;
+    XcpTransferChunkType * tail;
+} XcpTransferType;
+
+/*
+ * Global Functions
+ *
+ */
+
+/*
+ * Keep the payload of the transfers, for xcp_transfer_print(). Without it only
+ * address, length and timing are followed.
+ */
+void xcp_transfer_enable(void);
+bool xcp_transfer_update(XcpMessage const * const msg);
+XcpTransferType const * xcp_transfer_completed(void);
+void xcp_transfer_flush(void);
+void xcp_transfer_print(XcpTransferType const * const transfer);
+
+#endif /* __XCPTRANSFER_H */
@@ -0,0 +1,384 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR BSD-3-Clause) */
+/*
+ * xcptrigger.c - pre-trigger ring buffer
+ *
+ * Copyright (c) 2021 Christoph Schueler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <cpu12.gems@googlemail.com>
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <linux/can.h>
+
+#include "xcp.h"
+#include "xcptrigger.h"
+
+/*
+ *
+ * Local Constants.
+ *
+ */
+#define CONDITION_ERROR         (0x01)
+#define CONDITION_TERMINATED    (0x02)
+#define CONDITION_OVERLOAD      (0x04)
+#define CONDITION_PATTERN       (0x08)
+
+/*
+ *
+ * Local Types.
+ *
+ */
+typedef struct tagRecordType {
+    struct timeval timestamp;
+    int nbytes;
+    struct canfd_frame frame;
+} RecordType;
+
+/*
+ * Either a number of frames or a duration.
+ */
+typedef struct tagWindowType {
+    bool duration;
+    uint64_t value;             /* Frames or microseconds. */
+} WindowType;
+
+/*
+ *
+ * Local Variables.
+ *
+ */
+static RecordType * ring = NULL;
+static uint32_t capacity = 0;
+static uint32_t head = 0;               /* Next slot to write. */
+static uint32_t count = 0;
+static uint32_t replay_index;
+static uint32_t replay_remaining = 0;
+
+static unsigned conditions = 0;
+static uint8_t pattern[XCP_TRIGGER_MAX_PATTERN];
+static uint8_t pattern_mask[XCP_TRIGGER_MAX_PATTERN];
+static uint8_t pattern_length = 0;
+
+static WindowType pre = { FALSE, XCP_TRIGGER_DEFAULT_PRE };
+static WindowType post = { FALSE, XCP_TRIGGER_DEFAULT_POST };
+
+static bool post_active = FALSE;
+static uint64_t post_frames;
+static struct timeval post_end;
+
+static char const * fired_reason;
+static struct timeval fired_at;
+static uint32_t fired_frames;
+static uint64_t triggers = 0;
+
+/*
+ *
+ * Local Functions.
+ *
+ */
+static bool parse_window(char const * const text, WindowType * const window);
+static bool parse_hex(char const * text, uint8_t * const bytes, uint8_t * const length);
+static char const * check(struct canfd_frame const * const frame, canid_t dst);
+static uint32_t pre_window_start(struct timeval const * const tv);
+static void arm_post(struct timeval const * const tv);
+
+
+/*
+ * Conditions: "error", "terminated", "overload", "pattern=<hex>[/<hex mask>]", comma separated.
+ */
+bool xcp_trigger_add(char const * const spec)
+{
+    char buffer[128];
+    char * token;
+    char * save;
+    char * mask;
+    uint8_t maskLength;
+
+    if (strlen(spec) >= sizeof(buffer)) {
+        return FALSE;
+    }
+    strcpy(buffer, spec);
+    for (token = strtok_r(buffer, ",", &save); token != NULL; token = strtok_r(NULL, ",", &save)) {
+        if (strcmp(token, "error") == 0) {
+            conditions |= CONDITION_ERROR;
+        } else if (strcmp(token, "terminated") == 0) {
+            conditions |= CONDITION_TERMINATED;
+        } else if (strcmp(token, "overload") == 0) {
+            conditions |= CONDITION_OVERLOAD;
+        } else if (strncmp(token, "pattern=", 8) == 0) {
+            mask = strchr(token, '/');
+            if (mask != NULL) {
+                *mask++ = '\0';
+            }
+            if (!parse_hex(token + 8, pattern, &pattern_length) || (pattern_length == 0)) {
+                return FALSE;
+            }
+            memset(pattern_mask, 0xff, sizeof(pattern_mask));
+            if ((mask != NULL) && (!parse_hex(mask, pattern_mask, &maskLength) || (maskLength != pattern_length))) {
+                return FALSE;
+            }
+            conditions |= CONDITION_PATTERN;
+        } else {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+bool xcp_trigger_set_pre(char const * const window)
+{
+    return parse_window(window, &pre);
+}
+
+bool xcp_trigger_set_post(char const * const window)
+{
+    return parse_window(window, &post);
+}
+
+/*
+ * "<n>" frames or "<n>ms" / "<n>s".
+ */
+static bool parse_window(char const * const text, WindowType * const window)
+{
+    char * end;
+    unsigned long long value = strtoull(text, &end, 10);
+
+    if (end == text) {
+        return FALSE;
+    }
+    if (*end == '\0') {
+        window->duration = FALSE;
+        window->value = value;
+    } else if (strcmp(end, "ms") == 0) {
+        window->duration = TRUE;
+        window->value = value * 1000;
+    } else if (strcmp(end, "s") == 0) {
+        window->duration = TRUE;
+        window->value = value * 1000000;
+    } else {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+static bool parse_hex(char const * text, uint8_t * const bytes, uint8_t * const length)
+{
+    unsigned value;
+
+    *length = 0;
+    while (*text != '\0') {
+        if (!isxdigit((unsigned char)text[0]) || !isxdigit((unsigned char)text[1]) ||
+            (*length == XCP_TRIGGER_MAX_PATTERN) || (sscanf(text, "%2x", &value) != 1)) {
+            return FALSE;
+        }
+        bytes[(*length)++] = value;
+        text += 2;
+    }
+    return TRUE;
+}
+
+/*
+ * The ring is allocated once, nothing is allocated per frame.
+ */
+bool xcp_trigger_init(uint32_t frames)
+{
+    if (conditions == 0) {
+        conditions = CONDITION_ERROR | CONDITION_TERMINATED | CONDITION_OVERLOAD;
+    }
+    if (!pre.duration && (pre.value + 1 > frames)) {
+        frames = pre.value + 1;
+    }
+    ring = calloc(frames, sizeof(RecordType));
+    if (ring == NULL) {
+        return FALSE;
+    }
+    capacity = frames;
+    head = count = 0;
+    return TRUE;
+}
+
+/*
+ * Only raw bytes are looked at, the dissector doesn't run outside of the windows.
+ */
+static char const * check(struct canfd_frame const * const frame, canid_t dst)
+{
+    uint8_t idx;
+
+    if ((conditions & CONDITION_PATTERN) && (frame->len >= pattern_length)) {
+        for (idx = 0; idx < pattern_length; ++idx) {
+            if ((frame->data[idx] & pattern_mask[idx]) != (pattern[idx] & pattern_mask[idx])) {
+                break;
+            }
+        }
+        if (idx == pattern_length) {
+            return "PATTERN";
+        }
+    }
+    if ((frame->can_id != dst) || (frame->len < 2)) {
+        return NULL;
+    }
+    if ((conditions & CONDITION_ERROR) && (frame->data[0] == 0xfe)) {
+        return "ERROR";
+    }
+    if (frame->data[0] == 0xfd) {
+        if ((conditions & CONDITION_TERMINATED) && (frame->data[1] == XCP_EV_SESSION_TERMINATED)) {
+            return "EV_SESSION_TERMINATED";
+        }
+        if ((conditions & CONDITION_OVERLOAD) && (frame->data[1] == XCP_EV_DAQ_OVERLOAD)) {
+            return "EV_DAQ_OVERLOAD";
+        }
+    }
+    return NULL;
+}
+
+XcpTriggerResultType xcp_trigger_update(struct canfd_frame const * const frame, struct timeval const * const tv,
+                                        int nbytes, canid_t dst)
+{
+    char const * reason = check(frame, dst);
+    RecordType * record;
+
+    if (post_active) {
+        if (reason != NULL) {
+            /* Triggers within the post-trigger window extend it. */
+            ++triggers;
+            arm_post(tv);
+            return XCP_TRIGGER_PASS;
+        }
+        if (post.duration ? !timercmp(tv, &post_end, >) : (post_frames-- > 0)) {
+            return XCP_TRIGGER_PASS;
+        }
+        post_active = FALSE;
+    }
+
+    record = &ring[head];
+    record->timestamp = *tv;
+    record->nbytes = nbytes;
+    memcpy(&record->frame, frame, (nbytes == CAN_MTU) ? CAN_MTU : CANFD_MTU);
+    head = (head + 1) % capacity;
+    if (count < capacity) {
+        ++count;
+    }
+    if (reason == NULL) {
+        return XCP_TRIGGER_BUFFERED;
+    }
+
+    ++triggers;
+    fired_reason = reason;
+    fired_at = *tv;
+    replay_index = pre_window_start(tv);
+    replay_remaining = (head + capacity - replay_index) % capacity;
+    if (replay_remaining == 0) {
+        replay_remaining = count;
+    }
+    fired_frames = replay_remaining;
+    /* Replayed frames are not recorded a second time. */
+    count = 0;
+    arm_post(tv);
+    return XCP_TRIGGER_FIRED;
+}
+
+static uint32_t pre_window_start(struct timeval const * const tv)
+{
+    struct timeval limit;
+    struct timeval span;
+    uint32_t frames;
+    uint32_t idx;
+
+    if (!pre.duration) {
+        frames = ((pre.value + 1) < count) ? (pre.value + 1) : count;
+        return (head + capacity - frames) % capacity;
+    }
+    span.tv_sec = pre.value / 1000000;
+    span.tv_usec = pre.value % 1000000;
+    timersub(tv, &span, &limit);
+    for (frames = 1; frames < count; ++frames) {
+        idx = (head + capacity - frames - 1) % capacity;
+        if (timercmp(&ring[idx].timestamp, &limit, <)) {
+            break;
+        }
+    }
+    return (head + capacity - frames) % capacity;
+}
+
+static void arm_post(struct timeval const * const tv)
+{
+    struct timeval span;
+
+    post_active = TRUE;
+    if (post.duration) {
+        span.tv_sec = post.value / 1000000;
+        span.tv_usec = post.value % 1000000;
+        timeradd(tv, &span, &post_end);
+    } else {
+        post_frames = post.value;
+    }
+}
+
+/*
+ * Hand out the frames before (and including) the trigger, oldest first.
+ */
+bool xcp_trigger_replay(struct canfd_frame * const frame, struct timeval * const tv, int * const nbytes)
+{
+    RecordType const * record;
+
+    if (replay_remaining == 0) {
+        return FALSE;
+    }
+    record = &ring[replay_index];
+    memcpy(frame, &record->frame, (record->nbytes == CAN_MTU) ? CAN_MTU : CANFD_MTU);
+    *tv = record->timestamp;
+    *nbytes = record->nbytes;
+    replay_index = (replay_index + 1) % capacity;
+    --replay_remaining;
+    return TRUE;
+}
+
+void xcp_trigger_print(void)
+{
+    printf("TRIGGER(reason = %s", fired_reason);
+    printf(", time = %ld.%06ld", (long)fired_at.tv_sec, (long)fired_at.tv_usec);
+    printf(", preTriggerFrames = %u", fired_frames);
+    printf(", count = %llu", (unsigned long long)triggers);
+    printf(")");
+}
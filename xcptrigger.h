@@ -0,0 +1,86 @@
+/* SPDX-License-Identifier: (GPL-2.0-only OR BSD-3-Clause) */
+/*
+ * xcptrigger.h - pre-trigger ring buffer
+ *
+ * Copyright (c) 2021 Christoph Schueler
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of Volkswagen nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * Alternatively, provided that this notice is retained in full, this
+ * software may be distributed under the terms of the GNU General
+ * Public License ("GPL") version 2, in which case the provisions of the
+ * GPL apply INSTEAD OF those given above.
+ *
+ * The provided data structures and external interfaces from this code
+ * are not restricted to be used by modules with a GPL compatible license.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ *
+ * Send feedback to <cpu12.gems@googlemail.com>
+ *
+ */
+#ifndef __XCPTRIGGER_H
+#define __XCPTRIGGER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/time.h>
+
+#include <linux/can.h>
+
+#include "xcp.h"
+
+/*
+ * Defines
+ */
+#define XCP_TRIGGER_DEFAULT_CAPACITY    (100000)    /* Frames. */
+#define XCP_TRIGGER_DEFAULT_PRE         (1000)      /* Frames. */
+#define XCP_TRIGGER_DEFAULT_POST        (100)       /* Frames. */
+#define XCP_TRIGGER_MAX_PATTERN         (8)
+
+/*
+ * Types
+ */
+typedef enum tagXcpTriggerResultType {
+    XCP_TRIGGER_BUFFERED,       /* Frame went into the ring buffer only.                    */
+    XCP_TRIGGER_FIRED,          /* Frame fired the trigger, replay the window.              */
+    XCP_TRIGGER_PASS            /* Frame is within the post-trigger window, output it.      */
+} XcpTriggerResultType;
+
+/*
+ * Global Functions
+ *
+ */
+bool xcp_trigger_add(char const * const spec);
+bool xcp_trigger_set_pre(char const * const window);
+bool xcp_trigger_set_post(char const * const window);
+bool xcp_trigger_init(uint32_t capacity);
+
+XcpTriggerResultType xcp_trigger_update(struct canfd_frame const * const frame, struct timeval const * const tv,
+                                        int nbytes, canid_t dst);
+bool xcp_trigger_replay(struct canfd_frame * const frame, struct timeval * const tv, int * const nbytes);
+void xcp_trigger_print(void);
+
+#endif /* __XCPTRIGGER_H */